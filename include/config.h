@@ -6,6 +6,8 @@
 
 // Forward declarations
 class AsyncWebServerRequest;
+struct RadioFrame;
+class GatewayRadio;
 
 // Compile-time constants (if not already from build flags)
 
@@ -42,8 +44,46 @@ class AsyncWebServerRequest;
 #define RFM69_RST_PIN 5  // GPIO5 (D1 on WeMos Mini)
 #endif
 
+// Optional second RFM69 module on its own CS/IRQ pins, sharing SPI
+#ifndef RFM69_SECOND_RADIO
+#define RFM69_SECOND_RADIO  0
+#endif
+
+#ifndef RFM69_2_CS_PIN
+#define RFM69_2_CS_PIN      16  // GPIO16 (D0 on WeMos Mini)
+#endif
+
+#ifndef RFM69_2_IRQ_PIN
+#define RFM69_2_IRQ_PIN     5   // GPIO5 (D1 on WeMos Mini), RFM69_RST_PIN is not driven
+#endif
+
+#ifndef IS_RFM69_2_HW_HCW
+#define IS_RFM69_2_HW_HCW   IS_RFM69HW_HCW
+#endif
+
+#ifndef RFM69_2_FREQUENCY
+#define RFM69_2_FREQUENCY   RFM69_FREQUENCY
+#endif
+
+#ifndef RFM69_2_FREQUENCY_HZ
+#define RFM69_2_FREQUENCY_HZ 0  // Channel of the second radio, 0 = band default
+#endif
+
+#ifndef RFM69_2_NETWORK_ID
+#define RFM69_2_NETWORK_ID  0   // 0 = same network ID as the first radio
+#endif
+
+#ifndef RADIO_RX_QUEUE_LEN
+#define RADIO_RX_QUEUE_LEN  4   // Received frames per radio waiting for processing
+#endif
+
+#ifndef RFM69_SPI_CLOCK
+#define RFM69_SPI_CLOCK     10000000    // SPI clock of FIFO bursts in Hz, the RFM69 allows up to 10 MHz
+#endif
+
 // Derived definitions
 #define RFM69_IRQN digitalPinToInterrupt(RFM69_IRQ_PIN)
+#define RADIO_COUNT (RFM69_SECOND_RADIO ? 2 : 1)
 
 // Boot time Configuration GPIO Settings
 #ifndef CONF_GPIO_NUM
@@ -102,6 +142,357 @@ class AsyncWebServerRequest;
 #define DEF_CFG_
 #define DEF_CFG_
 
+// Radio airtime accounting and TX scheduling
+#ifndef AIRTIME_WINDOW_BUCKETS
+#define AIRTIME_WINDOW_BUCKETS      12          // Buckets of the rolling one hour duty-cycle window
+#endif
+
+#ifndef AIRTIME_LBT_RSSI_DBM
+#define AIRTIME_LBT_RSSI_DBM        -90         // Channel counts as busy at or above this RSSI
+#endif
+
+#ifndef AIRTIME_LBT_BACKOFF_MS
+#define AIRTIME_LBT_BACKOFF_MS      10          // Base of the randomized listen-before-talk backoff
+#endif
+
+#ifndef AIRTIME_LBT_MAX_ATTEMPTS
+#define AIRTIME_LBT_MAX_ATTEMPTS    8           // Busy channel checks before a queued frame is given up
+#endif
+
+#ifndef RADIO_TX_QUEUE_LEN
+#define RADIO_TX_QUEUE_LEN          8           // Deferred downlink frames
+#endif
+
+#ifndef RADIO_TX_RETRIES
+#define RADIO_TX_RETRIES            3
+#endif
+
+#ifndef RADIO_TX_RETRY_WAIT_MS
+#define RADIO_TX_RETRY_WAIT_MS      100         // ACK wait per attempt
+#endif
+
+// Binary payload decoders
+#ifndef DECODER_MAX_LAYOUTS
+#define DECODER_MAX_LAYOUTS         8           // Decoder layouts, each shared by any number of nodes
+#endif
+
+#ifndef DECODER_PROGRAM_SIZE
+#define DECODER_PROGRAM_SIZE        96          // Bytecode per layout (3-8 bytes per field)
+#endif
+
+#ifndef DECODER_POOL_SIZE
+#define DECODER_POOL_SIZE           96          // Field name and unit characters per layout
+#endif
+
+#ifndef DECODER_NAME_MAX
+#define DECODER_NAME_MAX            15
+#endif
+
+// Uplink filter rules
+#ifndef FILTER_MAX_NODES
+#define FILTER_MAX_NODES            16          // Nodes with a filter rule
+#endif
+
+#ifndef FILTER_MAX_FIELDS
+#define FILTER_MAX_FIELDS           4           // Deadband fields per rule
+#endif
+
+#ifndef FILTER_FIELD_NAME_MAX
+#define FILTER_FIELD_NAME_MAX       15
+#endif
+
+// Radio packet capture
+#ifndef CAPTURE_TCP_PORT
+#define CAPTURE_TCP_PORT            5555        // Raw TCP port the pcap stream is served on
+#endif
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE           4096        // Bytes buffered for the capture client
+#endif
+
+#ifndef CAPTURE_FORWARD_SNIFFED
+#define CAPTURE_FORWARD_SNIFFED     0           // Also forward frames between other nodes (spy mode) to MQTT
+#endif
+
+// UDP binary bridge
+#ifndef UDP_BRIDGE_HOST
+#define UDP_BRIDGE_HOST             ""          // Receiver host name or IP, empty disables the bridge
+#endif
+
+#ifndef UDP_BRIDGE_PORT
+#define UDP_BRIDGE_PORT             5556        // Receiver port for uplinks
+#endif
+
+#ifndef UDP_BRIDGE_LOCAL_PORT
+#define UDP_BRIDGE_LOCAL_PORT       5556        // Gateway port for downlinks and pings
+#endif
+
+#ifndef UDP_BRIDGE_MAX_PER_LOOP
+#define UDP_BRIDGE_MAX_PER_LOOP     4           // Datagrams handled per loop pass
+#endif
+
+// Duplicate suppression between gateways with overlapping coverage
+#ifndef GATEWAY_DEDUP_TOPIC
+#define GATEWAY_DEDUP_TOPIC         ""          // Topic shared by all cooperating gateways, empty disables
+#endif
+
+#ifndef GATEWAY_DEDUP_WINDOW_MS
+#define GATEWAY_DEDUP_WINDOW_MS     150         // How long a frame waits for better claims before it is forwarded
+#endif
+
+#ifndef DEDUP_MAX_PENDING
+#define DEDUP_MAX_PENDING           8           // Frames held for arbitration at once
+#endif
+
+#ifndef DEDUP_MAX_CLAIMS
+#define DEDUP_MAX_CLAIMS            16          // Claims of other gateways remembered
+#endif
+
+// Normal mode WebSocket live feed
+#ifndef LIVE_FEED_MAX_CLIENTS
+#define LIVE_FEED_MAX_CLIENTS       4
+#endif
+
+#ifndef LIVE_FEED_CLIENT_QUEUE
+#define LIVE_FEED_CLIENT_QUEUE      8           // Queued messages per client before frames are dropped
+#endif
+
+#ifndef LIVE_FEED_STATS_MS
+#define LIVE_FEED_STATS_MS          2000        // Link stats message interval
+#endif
+
+// Live configuration changes in normal mode
+#ifndef LIVE_CONFIG_BODY_MAX
+#define LIVE_CONFIG_BODY_MAX        1024        // Largest accepted POST /api/config body
+#endif
+
+#ifndef LIVE_CONFIG_ROLLBACK_MS
+#define LIVE_CONFIG_ROLLBACK_MS     60000       // WiFi or broker change without a connection in this time is undone
+#endif
+
+// SNTP time sync
+#ifndef NTP_SERVER_1
+#define NTP_SERVER_1                "pool.ntp.org"
+#endif
+
+#ifndef NTP_SERVER_2
+#define NTP_SERVER_2                "time.google.com"
+#endif
+
+#ifndef NTP_SYNC_INTERVAL_S
+#define NTP_SYNC_INTERVAL_S         3600        // SNTP poll interval (min 15 s)
+#endif
+
+// ACK fast path
+#ifndef ACK_NODE_TIMEOUT_MS
+#define ACK_NODE_TIMEOUT_MS         40          // How long nodes wait for an ACK (RFM69 sendWithRetry default)
+#endif
+
+#define ACK_LATENCY_BUCKETS         8           // Interrupt to ACK latency histogram buckets
+
+// Loop stall watchdog, on top of the hardware and SDK watchdogs
+#ifndef LOOP_STALL_MS
+#define LOOP_STALL_MS               1000        // A loop stage running longer counts as a stall
+#endif
+
+#ifndef LOOP_WATCHDOG_RESET_MS
+#define LOOP_WATCHDOG_RESET_MS      60000       // Restart when one stage runs this long (0 = never)
+#endif
+
+#ifndef LOOP_WATCHDOG_TICK_MS
+#define LOOP_WATCHDOG_TICK_MS       250         // Post-mortem refresh interval
+#endif
+
+#ifndef LOOP_WATCHDOG_RTC_BLOCK
+#define LOOP_WATCHDOG_RTC_BLOCK     96          // RTC user memory block of the post-mortem (0-31 are used by OTA)
+#endif
+
+// Node registry
+#define NODE_NAME_MAX               23
+#define NODE_LOCATION_MAX           31
+
+#define NODE_FLAG_REGISTERED        0x01
+#define NODE_FLAG_BLOCKED           0x02        // Frames are dropped and not ACKed
+#define NODE_FLAG_NO_ACK            0x04        // Frames are forwarded but not ACKed
+#define NODE_FLAG_ALARM             0x08        // Frames and downlinks use the alarm lane
+
+// Noise-floor survey of nearby channels
+#ifndef NOISE_SURVEY
+#define NOISE_SURVEY                0           // 1 = survey from boot, otherwise enabled by command/survey
+#endif
+
+#ifndef NOISE_SURVEY_CHANNELS
+#define NOISE_SURVEY_CHANNELS       5           // Default channels, the operating one in the middle
+#endif
+
+#ifndef NOISE_SURVEY_STEP_HZ
+#define NOISE_SURVEY_STEP_HZ        200000      // Default channel spacing
+#endif
+
+#ifndef NOISE_SURVEY_INTERVAL_MS
+#define NOISE_SURVEY_INTERVAL_MS    250         // One channel sample per interval
+#endif
+
+#ifndef NOISE_SURVEY_MOVE_DELAY_MS
+#define NOISE_SURVEY_MOVE_DELAY_MS  10000       // Announcing a channel move to the nodes before retuning
+#endif
+
+#define NOISE_SURVEY_MAX_CHANNELS   16
+#define NOISE_SURVEY_SETTLE_US      500         // PLL lock and RSSI measurement after retuning
+#define NOISE_SURVEY_BUCKETS        8           // RSSI histogram buckets per channel
+#define NOISE_SURVEY_ANNOUNCES      3           // MOVE broadcasts before a channel move
+
+// Time-slotted beacon mode
+#ifndef TDMA_BEACON
+#define TDMA_BEACON                 0           // 1 = beacon mode from boot, otherwise enabled by command/tdma
+#endif
+
+#ifndef TDMA_SLOT_MS
+#define TDMA_SLOT_MS                100         // Transmit slot of one node, frame, ACK and clock drift
+#endif
+
+#ifndef TDMA_GUARD_MS
+#define TDMA_GUARD_MS               200         // Between the beacon and slot 0
+#endif
+
+#ifndef TDMA_MIN_CYCLE_MS
+#define TDMA_MIN_CYCLE_MS           10000       // Beacon interval with few nodes
+#endif
+
+#define TDMA_BEACON_LATE_MS         20          // A beacon sent later than this is counted late
+#define TDMA_BEACON_PAIRS           22          // Slot assignments per beacon
+
+// Node groups and group downlink
+#ifndef NODE_GROUP_MAX
+#define NODE_GROUP_MAX              8           // Stored groups 1-8, group 0 is every registered node
+#endif
+
+#ifndef GROUP_SEND_GAP_MS
+#define GROUP_SEND_GAP_MS           20          // Listening for a member's ACK before the next member is sent to
+#endif
+
+#ifndef GROUP_SEND_TIMEOUT_MS
+#define GROUP_SEND_TIMEOUT_MS       60000       // Members not reached by then are reported as failed
+#endif
+
+// Last-value cache
+#ifndef LAST_VALUE_CACHE_NODES
+#define LAST_VALUE_CACHE_NODES      24          // Nodes whose latest frame is kept in RAM (max 254)
+#endif
+
+#ifndef LAST_VALUE_STATE_RETAIN
+#define LAST_VALUE_STATE_RETAIN     0           // 1 = retained radio/state/{node} topics, republished after reconnect
+#endif
+
+#define LAST_VALUE_STATE_BURST      4           // State topics published per loop pass
+
+// Priority lanes
+#define RFM69_CTL_PRIORITY          0x10        // Header control bit of alarm frames (unused by RFM69 1.5)
+#define PRIORITY_LATENCY_BUCKETS    9           // Per-class latency histogram buckets
+
+#ifndef PRIORITY_ALARM_HOLD
+#define PRIORITY_ALARM_HOLD         8           // Alarm uplinks kept for MQTT while the broker is down
+#endif
+
+// Downlink mailbox for sleeping nodes
+#ifndef MAILBOX_POOL_SIZE
+#define MAILBOX_POOL_SIZE           16          // Queued downlinks shared by all nodes (max 254)
+#endif
+
+#ifndef MAILBOX_MAX_PER_NODE
+#define MAILBOX_MAX_PER_NODE        4           // Queued downlinks per node
+#endif
+
+#ifndef MAILBOX_DEFAULT_TTL_S
+#define MAILBOX_DEFAULT_TTL_S       3600        // Queued downlinks expire after this many seconds
+#endif
+
+#ifndef MAILBOX_STATS_NODES
+#define MAILBOX_STATS_NODES         16          // Nodes with delivery statistics
+#endif
+
+// MQTT uplink delivery
+#ifndef MQTT_UPLINK_QOS
+#define MQTT_UPLINK_QOS             1           // QoS for forwarded radio frames (0 or 1)
+#endif
+
+#ifndef MQTT_QOS1_WINDOW
+#define MQTT_QOS1_WINDOW            8           // QoS 1 messages in flight before the publisher waits
+#endif
+
+#ifndef MQTT_QOS1_SLOT_SIZE
+#define MQTT_QOS1_SLOT_SIZE         384         // Largest encoded QoS 1 PUBLISH packet kept for retransmission, larger go at QoS 0
+#endif
+
+#ifndef MQTT_QOS1_RETRY_MS
+#define MQTT_QOS1_RETRY_MS          1000        // PUBACK timeout before retransmission with DUP
+#endif
+
+#ifndef MQTT_QOS1_MAX_RETRIES
+#define MQTT_QOS1_MAX_RETRIES       5
+#endif
+
+// MQTT over TLS (set the broker port to the TLS listener, usually 8883)
+#ifndef MQTT_TLS
+#define MQTT_TLS                    0           // 1 = connect to the broker with TLS
+#endif
+
+#ifndef MQTT_TLS_MFLN
+#define MQTT_TLS_MFLN               512         // Requested max fragment length, also the TLS RX buffer (512-4096)
+#endif
+
+#ifndef MQTT_TLS_TX_BUFFER
+#define MQTT_TLS_TX_BUFFER          512         // TLS TX buffer, outgoing records are split to fit
+#endif
+
+#ifndef MQTT_TLS_FINGERPRINT
+#define MQTT_TLS_FINGERPRINT        ""          // Broker certificate SHA-1 fingerprint, "AB:CD:..." or hex
+#endif
+
+#ifndef MQTT_TLS_CA_CERT
+#define MQTT_TLS_CA_CERT            ""          // PEM CA certificate to validate the broker against
+#endif
+
+// MQTT command routing
+#ifndef MQTT_ROUTE_MAX_NODES
+#define MQTT_ROUTE_MAX_NODES        48          // Trie nodes for all command route segments
+#endif
+
+#define MQTT_ROUTE_MAX_PARAMS       2           // Numeric '+' segments passed to a handler
+
+// Node firmware push (over-the-air update of radio nodes)
+#ifndef NODE_FW_BLOCK_SIZE
+#define NODE_FW_BLOCK_SIZE          48          // Image bytes per radio block (max 55 with 6 byte block header)
+#endif
+
+#ifndef NODE_FW_WINDOW_BLOCKS
+#define NODE_FW_WINDOW_BLOCKS       16          // Blocks in flight before a selective ACK is required (max 32)
+#endif
+
+#ifndef NODE_FW_MAX_IMAGE_SIZE
+#define NODE_FW_MAX_IMAGE_SIZE      65536       // Largest node image accepted for staging
+#endif
+
+#ifndef NODE_FW_SACK_TIMEOUT_MS
+#define NODE_FW_SACK_TIMEOUT_MS     300         // Wait for node SACK before re-requesting it
+#endif
+
+#ifndef NODE_FW_SACK_RETRIES
+#define NODE_FW_SACK_RETRIES        8           // SACK re-requests before the node is given up (resumable)
+#endif
+
+#ifndef NODE_FW_OFFER_TIMEOUT_MS
+#define NODE_FW_OFFER_TIMEOUT_MS    1000        // Wait for node READY after an image offer
+#endif
+
+#ifndef NODE_FW_OFFER_RETRIES
+#define NODE_FW_OFFER_RETRIES       5
+#endif
+
+#ifndef NODE_FW_PROGRESS_INTERVAL_MS
+#define NODE_FW_PROGRESS_INTERVAL_MS 2000       // Progress publish interval during a transfer
+#endif
+
 // Structure to hold all configuration variables
 struct GatewayConfig {
     // Magic number and version for validation
@@ -147,6 +538,79 @@ struct GatewayConfig {
 // Default configuration values
 extern const GatewayConfig defaultConfig;
 
+// Outcome of a downlink transmission request
+enum RadioTxResult {
+    RADIO_TX_SENT,
+    RADIO_TX_FAILED,
+    RADIO_TX_DEFERRED
+};
+
+// Where the result of a (possibly deferred) downlink is reported
+enum RadioResponseKind {
+    RADIO_RESPONSE_NONE,
+    RADIO_RESPONSE_SEND,
+    RADIO_RESPONSE_RAW
+};
+
+// Outcome of queueing a downlink in a node mailbox
+enum MailboxResult {
+    MAILBOX_QUEUED,
+    MAILBOX_COALESCED,
+    MAILBOX_REJECTED
+};
+
+// Priority class of a frame, lower values are served first
+enum FramePriority {
+    PRIORITY_ALARM,
+    PRIORITY_ROUTINE,
+    PRIORITY_CLASSES
+};
+
+enum PriorityDirection {
+    PRIORITY_UPLINK,
+    PRIORITY_DOWNLINK
+};
+
+// Main loop stages watched for stalls, see loop_watchdog.cpp for the names
+enum LoopStage {
+    STAGE_BOOT,
+    STAGE_WIFI,
+    STAGE_MQTT_CONNECT,
+    STAGE_MQTT_LOOP,
+    STAGE_RADIO_RX,
+    STAGE_RADIO_TX,
+    STAGE_MAILBOX,
+    STAGE_NODE_OTA,
+    STAGE_CAPTURE,
+    STAGE_UDP_BRIDGE,
+    STAGE_LIVE_FEED,
+    STAGE_LIVE_CONFIG,
+    STAGE_STATUS,
+    STAGE_IDLE,
+    STAGE_LOG,
+    LOOP_STAGE_COUNT
+};
+
+// Node registry record, stored as is in the node's slot of the registry file
+struct NodeRecord {
+    uint8_t nodeId;
+    uint8_t flags;                  // NODE_FLAG_*
+    uint8_t type;                   // Application defined, 0 = unspecified
+    uint8_t reserved;
+    char name[NODE_NAME_MAX + 1];
+    char location[NODE_LOCATION_MAX + 1];
+    uint32_t updated;               // Epoch seconds of the last change, 0 = clock was not synced
+};
+
+// Numeric topic segments matched by '+' in a command route, in topic order
+struct MqttRouteParams {
+    uint32_t values[MQTT_ROUTE_MAX_PARAMS];
+    uint8_t count;
+};
+
+// Command handlers get the payload in place from the MQTT client buffer (not terminated)
+typedef void (*MqttRouteHandler)(const MqttRouteParams& params, const byte* payload, unsigned int length);
+
 // EEPROM management functions
 bool saveConfig(const GatewayConfig& config);
 bool loadConfig(GatewayConfig& config);
@@ -170,6 +634,10 @@ void handleApPage(AsyncWebServerRequest *request);
 void handleApSave(AsyncWebServerRequest *request);
 void handleSystemPage(AsyncWebServerRequest *request);
 void handleSystemAction(AsyncWebServerRequest *request);
+void handleDecoderPage(AsyncWebServerRequest *request);
+void handleNodesPage(AsyncWebServerRequest *request);
+void handleNodesSave(AsyncWebServerRequest *request);
+void handleDecoderSave(AsyncWebServerRequest *request);
 void handleApiStatus(AsyncWebServerRequest *request);
 void handleApiReboot(AsyncWebServerRequest *request);
 void handleApiFactoryReset(AsyncWebServerRequest *request);
@@ -179,15 +647,202 @@ void enterNormalMode();
 bool initializeWiFi();
 bool initializeMQTT();
 bool initializeRadio();
+void initializeSecondRadio();
 void setupMqttTopics();
 void handleNormalModeLoop();
 bool connectMqtt();
 void publishStatus();
 void handleRadioMessages();
-void processRadioToMqtt(uint8_t senderId, uint8_t targetId, const String& message, int16_t rssi);
+void processRadioFrame(const RadioFrame& frame);
+void processRadioToMqtt(const RadioFrame& frame);
 void onMqttMessage(char* topic, byte* payload, unsigned int length);
-void handleMqttCommand(const String& topic, const String& message);
-void handleRadioSendCommand(const String& message);
+void handleRadioSendCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleRadioRawCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleRadioRawAckCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleRadio2RawCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleRadio2RawAckCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishRadioSendResult(uint8_t responseKind, uint8_t targetNode, RadioTxResult result, unsigned long deferredMs);
+
+// Radio airtime and TX scheduling functions
+void initializeAirtime();
+uint32_t radioFrameAirtimeUs(uint8_t payloadLength);
+bool airtimeAvailable(uint8_t payloadLength);
+void accountAirtime(uint8_t payloadLength);
+bool radioTxPossible(uint8_t length);
+bool radioAckAllowed(uint8_t length);
+bool radioTransmitImmediate(uint8_t targetId, const void* data, uint8_t length, bool requestAck = false);
+RadioTxResult radioTransmit(uint8_t targetId, const void* data, uint8_t length, bool requestAck, uint8_t responseKind, uint8_t priority);
+RadioTxResult radioTransmitVia(GatewayRadio& via, uint8_t targetId, const void* data, uint8_t length, bool requestAck);
+void handleRadioTxQueue();
+void publishAirtimeStats();
+
+// Payload decoder functions
+bool initializeDecoders();
+bool setDecoderLayout(uint32_t decoderId, const char* json, size_t length, String& error);
+String decoderLayoutJson(uint8_t decoderId);
+uint8_t nodeDecoder(uint8_t nodeId);
+void handleDecoderCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishDecoderStats();
+
+// Node registry functions
+bool initializeNodeRegistry();
+bool nodeRegistered(uint8_t nodeId);
+bool nodeBlocked(uint8_t nodeId);
+bool nodeAckAllowed(uint8_t nodeId);
+bool nodeAlarm(uint8_t nodeId);
+uint8_t nodeType(uint8_t nodeId);
+bool getNodeRecord(uint8_t nodeId, NodeRecord& record);
+bool setNodeRecord(uint8_t nodeId, const char* name, const char* location, uint8_t type, uint8_t flags, String& error);
+bool removeNodeRecord(uint8_t nodeId);
+String nodeRecordJson(uint8_t nodeId);
+void handleNodeCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishNodeRegistryStats();
+
+// Noise survey functions
+void initializeNoiseSurvey();
+void handleNoiseSurveyLoop();
+void handleSurveyCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleSurveyMoveCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishSurveyStats();
+
+// TDMA beacon functions
+void initializeTdmaBeacon();
+void handleTdmaLoop();
+void tdmaFrame(const RadioFrame& frame);
+void handleTdmaCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishTdmaStats();
+
+// Node group functions
+bool initializeNodeGroups();
+bool groupSendAck(uint8_t nodeId);
+void handleGroupSendLoop();
+void handleGroupCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleGroupSendCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishGroupStats();
+
+// Last-value cache functions
+void initializeLastValueCache();
+void cacheLastValue(const RadioFrame& frame);
+void republishLastValues();
+void handleLastValueLoop();
+void handleGetCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleRadio2GetCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishLastValueStats();
+
+// Priority lane functions
+uint8_t framePriority(uint8_t senderId, uint8_t ctl);
+uint8_t downlinkPriority(uint8_t targetId);
+void recordPriorityLatency(uint8_t direction, uint8_t priority, uint32_t latencyUs);
+void holdAlarmFrame(const RadioFrame& frame);
+bool nextHeldAlarm(RadioFrame& frame);
+void publishPriorityStats();
+
+// Uplink filter functions
+bool initializeUplinkFilter();
+bool setUplinkFilterRule(uint8_t nodeId, const char* json, size_t length, String& error);
+void handleFilterCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishFilterStats();
+
+// Packet capture functions
+void initializeCapture();
+void captureRadioFrame(const RadioFrame& frame);
+void handleCaptureLoop();
+void publishCaptureStats();
+
+// UDP bridge functions
+bool initializeUdpBridge();
+void udpBridgeForward(const RadioFrame& frame);
+void handleUdpBridgeLoop();
+void publishUdpBridgeStats();
+
+// Gateway duplicate suppression functions
+bool initializeGatewayDedup();
+void subscribeGatewayDedup();
+bool gatewayDedupHold(const RadioFrame& frame);
+bool handleGatewayDedupClaim(const char* topic, const byte* payload, unsigned int length);
+void handleGatewayDedupLoop();
+void publishGatewayDedupStats();
+
+// Live feed functions
+void initializeLiveFeed();
+void liveFeedFrame(const RadioFrame& frame);
+void handleLiveFeedLoop();
+void publishLiveFeedStats();
+
+// Live configuration functions
+void initializeLiveConfig();
+void handleLiveConfigLoop();
+void publishPendingConfigResponse();
+void handleConfigCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishLiveConfigStats();
+
+// Loop watchdog functions
+void initializeLoopWatchdog();
+void startLoopWatchdog();
+void stopLoopWatchdog();
+void loopStage(LoopStage stage);
+void enterLoopStage(LoopStage stage);
+void leaveLoopStage();
+void loopWatchdogFrame(const RadioFrame& frame);
+void publishLoopWatchdogPostMortem();
+void publishLoopWatchdogStats();
+
+// Time sync functions
+void initializeTimeSync();
+bool timeSynced();
+uint64_t epochMillis();
+uint64_t epochMicrosAt(uint32_t microsValue);
+uint64_t epochMillisAt(uint32_t microsValue);
+uint32_t timeSyncCount();
+uint32_t timeSyncAgeS();
+int32_t clockOffsetMs();
+float clockDriftPpm();
+
+// Radio functions
+void publishRadioStats();
+
+// ACK latency functions
+void recordAckLatency(uint32_t latencyUs);
+void publishAckStats();
+
+// Node mailbox functions
+void initializeMailbox();
+MailboxResult mailboxEnqueue(uint8_t nodeId, const uint8_t* data, uint8_t length, uint8_t key, uint32_t ttlSeconds);
+uint8_t mailboxDepth(uint8_t nodeId);
+void queueMailboxCommand(uint8_t nodeId, const uint8_t* data, uint8_t length, uint8_t key, uint32_t ttlSeconds);
+bool sendNodeAck(uint8_t nodeId);
+void deliverMailbox(uint8_t nodeId);
+void handleMailboxLoop();
+void handleMailboxCommand(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void publishMailboxStats();
+
+// MQTT QoS 1 publish functions
+bool mqttPublishQos1(const char* topic, const uint8_t* payload, size_t length);
+bool mqttQos1WindowFull();
+void handleMqttQos1Loop();
+void resendMqttQos1InFlight();
+void publishMqttQos1Stats();
+
+// MQTT TLS functions
+void initializeMqttTls();
+bool prepareMqttTlsConnect();
+void publishMqttTlsStats();
+
+// MQTT command router functions
+void buildMqttRoutes();
+bool dispatchMqttCommand(const char* topic, const byte* payload, unsigned int length);
+
+// Node firmware push functions
+bool initializeNodeOta();
+void handleNodeOtaBegin(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleNodeOtaData(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleNodeOtaPush(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleNodeOtaAbort(const MqttRouteParams& params, const byte* payload, unsigned int length);
+void handleNodeOtaStatus(const MqttRouteParams& params, const byte* payload, unsigned int length);
+bool handleNodeOtaFrame(uint8_t senderId, const uint8_t* data, uint8_t length);
+void handleNodeOtaLoop();
+bool nodeOtaActive();
+bool nodeOtaTarget(uint8_t nodeId);
 
 // Main application functions
 bool checkConfigurationMode();
@@ -195,5 +850,7 @@ bool checkConfigurationMode();
 // Utility functions
 void printConfig(const GatewayConfig& config);
 void debugLog(const String& message);
+uint16_t crc16Ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length);
 
 #endif // CONFIG_H
\ No newline at end of file
@@ -0,0 +1,120 @@
+#ifndef GATEWAY_RADIO_H
+#define GATEWAY_RADIO_H
+
+#include <Arduino.h>
+#include <RFM69.h>
+#include <RFM69_ATC.h>
+#include "config.h"
+
+#ifdef RFM69_ENABLE_ATC
+typedef RFM69_ATC GatewayRadioBase;
+#else
+typedef RFM69 GatewayRadioBase;
+#endif
+
+// A received frame, copied out of the driver before anything else touches the radio
+struct RadioFrame {
+    uint8_t radioIndex;             // 0 = primary radio, 1 = second radio
+    uint8_t networkId;
+    uint8_t senderId;
+    uint8_t targetId;
+    int16_t rssi;
+    bool ackRequested;              // ACK requested from this gateway
+    uint8_t ctl;                    // Control bits as received (RFM69_CTL_SENDACK, RFM69_CTL_REQACK, RFM69_CTL_PRIORITY)
+    uint8_t priority;               // FramePriority
+    uint8_t length;
+    uint32_t rxMicros;              // Radio interrupt time of the frame
+    uint8_t data[RF69_MAX_DATA_LEN];
+};
+
+// RFM69 driver with the gateway's own interrupt handler. The handler does what
+// the library's does (flag the frame for receiveFrame()) and also records when
+// the interrupt fired, so receive time does not depend on how often the main
+// loop polls the radio.
+//
+// The library keeps the receive buffer and driver mode in static members, so
+// two modules share them. use() hands that shared state to one radio and
+// parks the other's; receiveDone() does so itself. All SPI work happens in the
+// main loop, the interrupt only sets a per-radio flag.
+//
+// Frames are read from the FIFO by the gateway itself, as SPI bursts at
+// RFM69_SPI_CLOCK straight into a receive queue slot. Transmit frames are
+// written the same way, except with ATC, whose frames the library builds.
+class GatewayRadio : public GatewayRadioBase {
+public:
+    GatewayRadio(uint8_t slaveSelectPin, uint8_t interruptPin, bool isRFM69HW_HCW, uint8_t index = 0);
+
+    bool initialize(uint8_t freqBand, uint16_t ID, uint8_t networkID);
+    bool receiveDone() override;
+
+    // Read a waiting frame into a free slot of its priority queue and leave
+    // the radio in standby, nullptr if there is none. The frame is queued by
+    // queueFrame(), until then the slot is reused by the next frame.
+    RadioFrame* receiveFrame();
+
+    // Make this radio the owner of the library's shared state
+    void use();
+
+    // setNetwork() that keeps networkId() current
+    void changeNetwork(uint8_t networkID);
+
+    uint8_t index() const { return _index; }
+    uint8_t networkId() const { return _networkId; }
+    bool ready() const { return _ready; }
+
+    // micros() at the radio's last interrupt
+    uint32_t irqMicros() const { return _irqMicros[_index]; }
+
+    // Received frames waiting to be processed, one queue per priority class;
+    // ACKs are sent before queueing
+    bool queueFrame();
+    bool nextFrame(RadioFrame& frame, uint8_t priority);
+    uint8_t queuedFrames() const;
+
+    // Per-radio counters, see publishRadioStats()
+    uint32_t framesReceived;
+    uint32_t framesDropped;
+    uint32_t acksSent;
+    uint8_t queuePeak;
+    int16_t rssiAvg;
+    uint32_t readAvgUs;             // FIFO read time of a frame
+    uint32_t readMaxUs;
+
+    // A frame is waiting for receiveFrame() on any radio
+    static bool frameReady();
+
+    static GatewayRadio* instance(uint8_t index) { return index < RADIO_COUNT ? _instances[index] : nullptr; }
+
+protected:
+#ifndef RFM69_ENABLE_ATC
+    void sendFrame(uint16_t toAddress, const void* buffer, uint8_t size, bool requestACK = false, bool sendACK = false) override;
+#endif
+
+private:
+    static void isrRadio0();
+    static void isrRadio1();
+
+    void selectBurst();
+    void unselectBurst();
+
+    static GatewayRadio* _instances[RADIO_COUNT];
+    static GatewayRadio* _active;
+    static volatile bool _irqPending[RADIO_COUNT];
+    static volatile uint32_t _irqMicros[RADIO_COUNT];
+
+    uint8_t _index;
+    uint8_t _networkId;
+    bool _ready;
+
+    // Shared library state of this radio while another one is in use
+    uint8_t _parkedMode;
+    uint8_t _parkedPayloadLength;
+
+    RadioFrame _rxQueue[PRIORITY_CLASSES][RADIO_RX_QUEUE_LEN];
+    uint8_t _rxHead[PRIORITY_CLASSES];
+    uint8_t _rxCount[PRIORITY_CLASSES];
+    RadioFrame _rxSpare;            // Read target while the frame's queue is full
+    RadioFrame* _rxLast;            // Frame of the last receiveFrame()
+};
+
+#endif // GATEWAY_RADIO_H
@@ -0,0 +1,9 @@
+#ifndef LOOP_WATCHDOG_H
+#define LOOP_WATCHDOG_H
+
+#include <ArduinoJson.h>
+
+// Add the stall count of every stage that stalled since boot to 'stalls'
+void addLoopStallCounts(JsonObject stalls);
+
+#endif // LOOP_WATCHDOG_H
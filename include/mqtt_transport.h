@@ -0,0 +1,59 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Pass-through network client placed between PubSubClient and the socket.
+// PubSubClient drops packets it does not handle, so the transport follows the
+// inbound MQTT framing and reports PUBACKs for the QoS 1 in-flight window.
+// QoS 1 PUBLISH packets are written through writeRaw() on the same connection.
+// Connect time and heap cost are recorded, which for TLS is the handshake.
+class MqttTransport : public Client {
+public:
+    explicit MqttTransport(Client& inner);
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+
+    size_t writeRaw(const uint8_t* buf, size_t size);
+
+    uint32_t connects() const { return _connects; }
+    uint32_t connectFailures() const { return _connectFailures; }
+    uint32_t lastConnectMs() const { return _lastConnectMs; }
+    uint32_t avgConnectMs() const { return _avgConnectMs; }
+    int32_t connectHeapCost() const { return _connectHeapCost; }
+
+private:
+    void sniff(uint8_t b);
+    int recordConnect(int result, unsigned long start, uint32_t heapBefore);
+
+    Client* _inner;
+
+    // Connection setup statistics
+    uint32_t _connects;
+    uint32_t _connectFailures;
+    uint32_t _lastConnectMs;
+    uint32_t _avgConnectMs;
+    int32_t _connectHeapCost;       // Free heap before connect minus after, held while connected
+
+    // Inbound packet framing
+    uint8_t _state;
+    uint8_t _type;
+    uint32_t _remaining;
+    uint32_t _multiplier;
+    uint16_t _packetId;
+    uint8_t _idBytes;
+};
+
+#endif // MQTT_TRANSPORT_H
@@ -0,0 +1,17 @@
+#ifndef PAYLOAD_DECODER_H
+#define PAYLOAD_DECODER_H
+
+#include <ArduinoJson.h>
+
+struct RadioFrame;
+
+// Decode a binary frame with the layout assigned to its sender. Fields go to
+// doc["data"], units to doc["units"]. Returns false when the sender has no
+// layout or the frame is shorter than the layout.
+bool decodeRadioPayload(const RadioFrame& frame, JsonDocument& doc);
+
+// Sender, signal and payload of a frame as published on radio/received:
+// decoded, parsed JSON text, or the text as is. See gateway.cpp.
+void radioFrameJson(const RadioFrame& frame, JsonDocument& doc);
+
+#endif // PAYLOAD_DECODER_H
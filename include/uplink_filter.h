@@ -0,0 +1,10 @@
+#ifndef UPLINK_FILTER_H
+#define UPLINK_FILTER_H
+
+#include <ArduinoJson.h>
+
+// Apply the node's filter rule to an uplink whose fields are in 'data'.
+// Returns false when the uplink should not be published.
+bool uplinkFilterPass(uint8_t nodeId, JsonVariantConst data);
+
+#endif // UPLINK_FILTER_H
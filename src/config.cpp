@@ -188,6 +188,9 @@ void printConfig(const GatewayConfig& config) {
 }
 
 void debugLog(const String& message) {
+    // Serial blocks once its FIFO is full
+    enterLoopStage(STAGE_LOG);
     Serial.print("[DEBUG] ");
     Serial.println(message);
+    leaveLoopStage();
 }
\ No newline at end of file
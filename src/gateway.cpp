@@ -1,18 +1,28 @@
 #include "config.h"
+#include "mqtt_transport.h"
+#include "gateway_radio.h"
+#include "payload_decoder.h"
+#include "uplink_filter.h"
+#include "loop_watchdog.h"
 #include <ESP8266WiFi.h>
+#if MQTT_TLS
+#include <WiFiClientSecureBearSSL.h>
+#endif
 #include <PubSubClient.h>
-#include <RFM69.h>
-#include <RFM69_ATC.h>
 #include <ArduinoJson.h>
 
 // Global objects for normal mode operation
+#if MQTT_TLS
+BearSSL::WiFiClientSecure wifiClient;
+#else
 WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+#endif
+MqttTransport mqttTransport(wifiClient);
+PubSubClient mqttClient(mqttTransport);
 
-#ifdef RFM69_ENABLE_ATC
-    RFM69_ATC radio;
-#else 
-    RFM69 radio;
+GatewayRadio radio(RFM69_CS_PIN, RFM69_IRQ_PIN, IS_RFM69HW_HCW, 0);
+#if RFM69_SECOND_RADIO
+GatewayRadio radio2(RFM69_2_CS_PIN, RFM69_2_IRQ_PIN, IS_RFM69_2_HW_HCW, 1);
 #endif
 
 GatewayConfig activeConfig;
@@ -24,11 +34,9 @@ bool radioInitialized = false;
 
 // Timing variables
 unsigned long lastMqttReconnect = 0;
-unsigned long lastRadioCheck = 0;
 unsigned long lastStatusReport = 0;
 
 const unsigned long MQTT_RECONNECT_INTERVAL = 5000;  // 5 seconds
-const unsigned long RADIO_CHECK_INTERVAL = 100;     // 100ms
 const unsigned long STATUS_REPORT_INTERVAL = 30000; // 30 seconds
 
 // MQTT topics
@@ -36,9 +44,11 @@ String mqttBaseTopic;
 String mqttStatusTopic;
 String mqttCommandTopic;
 String mqttRadioTopic;
+String mqttRawResponseTopic;
 
 void enterNormalMode() {
     debugLog("Entering normal mode");
+    startLoopWatchdog();
     
     // Load configuration from EEPROM
     if (!loadConfig(activeConfig)) {
@@ -50,29 +60,62 @@ void enterNormalMode() {
     
     printConfig(activeConfig);
     
+    initializeMailbox();
+    
     // Initialize components
+    loopStage(STAGE_WIFI);
     if (!initializeWiFi()) {
         debugLog("WiFi initialization failed, entering configuration mode");
+        stopLoopWatchdog();
         enterConfigurationMode();
         return;
     }
     
+    loopStage(STAGE_BOOT);
+    initializeTimeSync();
+    
     if (!initializeRadio()) {
         debugLog("Radio initialization failed, continuing without radio");
     }
     
+    // Topics and routes must exist before the first connect subscribes
+    setupMqttTopics();
+    
+    loopStage(STAGE_MQTT_CONNECT);
     if (!initializeMQTT()) {
         debugLog("MQTT initialization failed, continuing without MQTT");
     }
+    loopStage(STAGE_BOOT);
     
-    setupMqttTopics();
+    if (!initializeNodeOta()) {
+        debugLog("Node firmware push unavailable");
+    }
+    
+    initializeNodeRegistry();
+    initializeNodeGroups();
+    initializeNoiseSurvey();
+    initializeTdmaBeacon();
+    initializeDecoders();
+    initializeUplinkFilter();
+    initializeCapture();
+    initializeUdpBridge();
+    initializeGatewayDedup();
+    initializeLastValueCache();
+    initializeLiveConfig();
+    initializeLiveFeed();
     
     debugLog("Normal mode initialization completed");
     
     // Main operation loop
     while (true) {
         handleNormalModeLoop();
-        delay(10);
+        
+        // Idle up to 10ms, but not while a received frame waits for its ACK
+        loopStage(STAGE_IDLE);
+        unsigned long idleStart = millis();
+        while (!GatewayRadio::frameReady() && millis() - idleStart < 10) {
+            delay(1);
+        }
     }
 }
 
@@ -121,6 +164,9 @@ bool initializeMQTT() {
     
     mqttClient.setServer(activeConfig.mqttServer, activeConfig.mqttPort);
     mqttClient.setCallback(onMqttMessage);
+#if MQTT_TLS
+    initializeMqttTls();
+#endif
     
     return connectMqtt();
 }
@@ -134,6 +180,12 @@ bool connectMqtt() {
     // Modfied to get unique Client Id
     String clientId = String(activeConfig.apName) + String(ESP.getChipId());
     
+#if MQTT_TLS
+    if (!prepareMqttTlsConnect()) {
+        return false;
+    }
+#endif
+    
     bool connected = false;
     if (strlen(activeConfig.mqttUser) > 0) {
         connected = mqttClient.connect(clientId.c_str(), activeConfig.mqttUser, activeConfig.mqttPass);
@@ -145,10 +197,19 @@ bool connectMqtt() {
         mqttConnected = true;
         debugLog("MQTT connected successfully");
         
-        // Subscribe to command topic
-        String commandTopic = mqttCommandTopic + "/+";
+        // Subscribe to all command routes, including multi-level ones
+        String commandTopic = mqttCommandTopic + "/#";
         mqttClient.subscribe(commandTopic.c_str());
         debugLog("Subscribed to: " + commandTopic);
+        subscribeGatewayDedup();
+        
+        // At-least-once: whatever was not acknowledged before the drop goes out again
+        resendMqttQos1InFlight();
+        republishLastValues();
+        publishPendingConfigResponse();
+        
+        // Why the previous run ended, once per boot
+        publishLoopWatchdogPostMortem();
         
         // Publish status
         publishStatus();
@@ -187,6 +248,9 @@ bool initializeRadio() {
         debugLog("Radio encryption enabled");
     }
     
+    // Airtime accounting needs the final modem and encryption settings
+    initializeAirtime();
+    
     radioInitialized = true;
     debugLog("Radio initialized successfully");
     debugLog("Frequency: " + String(RFM69_FREQUENCY) + " MHz");
@@ -195,9 +259,45 @@ bool initializeRadio() {
     debugLog("Power Level: " + String(activeConfig.radioPower));
     debugLog("Pin Configuration - CS: " + String(RFM69_CS_PIN) + ", IRQ: " + String(RFM69_IRQ_PIN) + ", RST: " + String(RFM69_RST_PIN));
     
+#if RFM69_SECOND_RADIO
+    initializeSecondRadio();
+#endif
+    
     return true;
 }
 
+#if RFM69_SECOND_RADIO
+// Same node ID, key and power as the first radio; band, channel and network from config.h
+void initializeSecondRadio() {
+    uint8_t networkId = RFM69_2_NETWORK_ID != 0 ? RFM69_2_NETWORK_ID : activeConfig.networkId;
+    
+    if (!radio2.initialize(RFM69_2_FREQUENCY, activeConfig.nodeId, networkId)) {
+        debugLog("Second radio initialization failed, continuing with one radio");
+        radio.use();
+        return;
+    }
+#if IS_RFM69_2_HW_HCW
+    radio2.setHighPower();
+#endif
+    radio2.setPowerLevel(activeConfig.radioPower);
+#if IS_RFM69_SPY_MODE
+    radio2.spyMode(IS_RFM69_SPY_MODE);
+#endif
+    if (RFM69_2_FREQUENCY_HZ != 0) {
+        radio2.setFrequency(RFM69_2_FREQUENCY_HZ);
+    }
+    if (strlen(activeConfig.encryptionKey) > 0) {
+        radio2.encrypt(activeConfig.encryptionKey);
+    }
+    
+    // Everything but the receive path and radio2 commands talks to the first radio
+    radio.use();
+    
+    debugLog("Second radio initialized: " + String(radio2.getFrequency()) + " Hz, network ID " + String(networkId) +
+             ", CS: " + String(RFM69_2_CS_PIN) + ", IRQ: " + String(RFM69_2_IRQ_PIN));
+}
+#endif
+
 void setupMqttTopics() {
     // Use configured topic prefixes instead of hardcoded ones
     String inPrefix = String(activeConfig.mqttTopicPrefixIn);
@@ -215,16 +315,20 @@ void setupMqttTopics() {
     mqttStatusTopic = mqttBaseTopic + "/status";
     mqttCommandTopic = inPrefix + String(activeConfig.nodeId) + "/command";
     mqttRadioTopic = mqttBaseTopic + "/radio";
+    mqttRawResponseTopic = mqttBaseTopic + "/response/raw";
     
     debugLog("MQTT Topic Configuration:");
     debugLog("  Incoming Prefix: " + inPrefix);
     debugLog("  Outgoing Prefix: " + outPrefix);
     debugLog("  Base Topic: " + mqttBaseTopic);
     debugLog("  Command Topic: " + mqttCommandTopic);
+    
+    buildMqttRoutes();
 }
 
 void handleNormalModeLoop() {
     // Handle WiFi connection
+    loopStage(STAGE_WIFI);
     if (!WiFi.isConnected()) {
         if (wifiConnected) {
             debugLog("WiFi connection lost, attempting reconnect");
@@ -245,6 +349,7 @@ void handleNormalModeLoop() {
     }
     
     // Handle MQTT connection
+    loopStage(STAGE_MQTT_CONNECT);
     if (wifiConnected && !mqttClient.connected()) {
         if (mqttConnected) {
             debugLog("MQTT connection lost");
@@ -258,53 +363,238 @@ void handleNormalModeLoop() {
     }
     
     // Process MQTT messages
+    loopStage(STAGE_MQTT_LOOP);
     if (mqttConnected) {
         mqttClient.loop();
+        handleMqttQos1Loop();
+        handleLastValueLoop();
     }
     
-    // Handle radio communication
-    if (radioInitialized && millis() - lastRadioCheck > RADIO_CHECK_INTERVAL) {
+    // Handle radio communication on every pass, nodes wait for ACKs
+    loopStage(STAGE_RADIO_RX);
+    if (radioInitialized) {
         handleRadioMessages();
-        lastRadioCheck = millis();
     }
+    handleGatewayDedupLoop();
+    
+    // Deferred downlinks and node firmware push share the airtime budget
+    loopStage(STAGE_RADIO_TX);
+    if (radioInitialized) {
+        handleTdmaLoop();
+        handleRadioTxQueue();
+        handleGroupSendLoop();
+        handleNoiseSurveyLoop();
+    }
+    loopStage(STAGE_MAILBOX);
+    handleMailboxLoop();
+    loopStage(STAGE_NODE_OTA);
+    handleNodeOtaLoop();
+    loopStage(STAGE_CAPTURE);
+    handleCaptureLoop();
+    loopStage(STAGE_UDP_BRIDGE);
+    if (wifiConnected) {
+        handleUdpBridgeLoop();
+    }
+    loopStage(STAGE_LIVE_FEED);
+    handleLiveFeedLoop();
+    loopStage(STAGE_LIVE_CONFIG);
+    handleLiveConfigLoop();
     
     // Publish periodic status
+    loopStage(STAGE_STATUS);
     if (mqttConnected && millis() - lastStatusReport > STATUS_REPORT_INTERVAL) {
         publishStatus();
         lastStatusReport = millis();
     }
 }
 
+// Read a frame from one radio and ACK it right away. Returns false when the
+// radio had nothing; the frame is queued on the radio for processRadioFrame().
+static bool receiveRadioFrame(GatewayRadio& receiver) {
+    if (!receiver.ready()) {
+        return false;
+    }
+    
+    // The frame is read into its queue slot, sending the ACK does not touch it
+    RadioFrame* received = receiver.receiveFrame();
+    if (received == nullptr) {
+        return false;
+    }
+    const RadioFrame& frame = *received;
+    loopWatchdogFrame(frame);
+    
+    // ACKs for a running group send are collected there, not forwarded
+    if ((frame.ctl & RFM69_CTL_SENDACK) && frame.radioIndex == 0 && groupSendAck(frame.senderId)) {
+        receiver.receiveDone();
+        return true;
+    }
+    
+    // ACK before any logging, parsing or MQTT work so it reaches the node in
+    // time. The ACK carries a queued downlink, unless the node is in a firmware
+    // push or talks to the second radio, which only sends plain ACKs.
+    if (frame.ackRequested && nodeAckAllowed(frame.senderId)) {
+        bool acked;
+        if (frame.radioIndex != 0 || nodeOtaTarget(frame.senderId)) {
+            acked = radioAckAllowed(0);
+            if (acked) {
+                receiver.sendACK();
+            }
+        } else {
+            acked = sendNodeAck(frame.senderId);
+        }
+        if (acked) {
+            receiver.acksSent++;
+            recordAckLatency(micros() - frame.rxMicros);
+        }
+    }
+    
+    // The node is awake right now, hand over what waits for it
+    if (!frame.ackRequested && frame.radioIndex == 0) {
+        deliverMailbox(frame.senderId);
+    }
+    
+    // Back to receiving while the frame waits for processing
+    receiver.receiveDone();
+    receiver.queueFrame();
+    return true;
+}
+
+static void receiveRadioFrames() {
+    receiveRadioFrame(radio);
+#if RFM69_SECOND_RADIO
+    receiveRadioFrame(radio2);
+    radio.use();
+#endif
+}
+
+// Next frame by strict priority: a routine frame only goes when no radio has
+// an alarm waiting. Within a class the radios take turns.
+static bool nextRadioFrame(RadioFrame& frame) {
+    static uint8_t nextRadio = 0;
+    
+    for (uint8_t lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        for (uint8_t i = 0; i < RADIO_COUNT; i++) {
+            uint8_t index = (nextRadio + i) % RADIO_COUNT;
+            if (GatewayRadio::instance(index)->nextFrame(frame, lane)) {
+                nextRadio = (index + 1) % RADIO_COUNT;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void handleRadioMessages() {
-    if (radio.receiveDone()) {
-        // Get sender information
-        uint8_t senderId = radio.SENDERID;
-        uint8_t targetId = radio.TARGETID;
-        int16_t rssi = radio.RSSI;
-        bool ackRequested = radio.ACKRequested();
-        
-        // Get message data
-        String messageData = "";
-        for (uint8_t i = 0; i < radio.DATALEN; i++) {
-            messageData += (char)radio.DATA[i];
+    receiveRadioFrames();
+    
+    // Radios are read again after every processed frame, so an alarm that
+    // arrives while a routine frame is published goes next
+    RadioFrame frame;
+    for (uint8_t round = 0; round < RADIO_RX_QUEUE_LEN * RADIO_COUNT; round++) {
+#if MQTT_UPLINK_QOS == 1
+        // A full QoS 1 window keeps frames queued until the MQTT loop reads PUBACKs
+        if (mqttConnected && mqttQos1WindowFull()) break;
+#endif
+        // Alarms held while the broker was down go out before anything new
+        if (mqttConnected && nextHeldAlarm(frame)) {
+            processRadioToMqtt(frame);
+            continue;
         }
-        
-        debugLog("Radio message received from node " + String(senderId) + ": " + messageData);
-        debugLog("RSSI: " + String(rssi) + " dBm");
-        
-        // Send ACK if requested
-        if (ackRequested) {
-            radio.sendACK();
-            debugLog("ACK sent to node " + String(senderId));
+        if (!nextRadioFrame(frame)) break;
+        processRadioFrame(frame);
+        receiveRadioFrames();
+    }
+}
+
+void processRadioFrame(const RadioFrame& frame) {
+    // Every frame goes to the capture stream and live feed, sniffed traffic between other nodes ends there
+    captureRadioFrame(frame);
+    liveFeedFrame(frame);
+#if !CAPTURE_FORWARD_SNIFFED
+    if (frame.targetId != activeConfig.nodeId && frame.targetId != RF69_BROADCAST_ADDR) {
+        return;
+    }
+#endif
+    
+    if (nodeBlocked(frame.senderId)) {
+        return;
+    }
+    tdmaFrame(frame);
+    
+    // Firmware push traffic is consumed by the transfer, never forwarded
+    if (frame.radioIndex == 0 && handleNodeOtaFrame(frame.senderId, frame.data, frame.length)) {
+        return;
+    }
+    
+    // The UDP bridge gets the frame unfiltered and ahead of MQTT
+    udpBridgeForward(frame);
+    
+    // Kept for queries even when another gateway forwards it or the broker is down
+    cacheLastValue(frame);
+    
+    // With overlapping gateways only the one with the best signal forwards.
+    // Alarms are not held for the vote, every gateway that hears one forwards it.
+    if (frame.priority != PRIORITY_ALARM && gatewayDedupHold(frame)) {
+        return;
+    }
+    
+    // Process and forward to MQTT
+    processRadioToMqtt(frame);
+}
+
+void radioFrameJson(const RadioFrame& frame, JsonDocument& doc) {
+    doc["senderId"] = frame.senderId;
+    doc["targetId"] = frame.targetId;
+    doc["rssi"] = frame.rssi;
+    if (nodeType(frame.senderId) != 0) {
+        doc["nodeType"] = nodeType(frame.senderId);
+    }
+    if (frame.priority == PRIORITY_ALARM) {
+        doc["priority"] = "alarm";
+    }
+    if (frame.radioIndex != 0) {
+        doc["radio"] = frame.radioIndex + 1;
+        doc["networkId"] = frame.networkId;
+    }
+    
+    // Nodes with a binary layout are decoded, only text that looks like JSON is parsed
+    if (decodeRadioPayload(frame, doc)) {
+        char raw[RF69_MAX_DATA_LEN * 2 + 1];
+        for (uint8_t i = 0; i < frame.length; i++) {
+            snprintf(raw + i * 2, 3, "%02x", frame.data[i]);
+        }
+        raw[frame.length * 2] = '\0';
+        doc["raw"] = raw;
+    } else {
+        String message = "";
+        for (uint8_t i = 0; i < frame.length; i++) {
+            message += (char)frame.data[i];
+        }
+        doc["message"] = message;
+        if (frame.length > 0 && (frame.data[0] == '{' || frame.data[0] == '[')) {
+            DynamicJsonDocument radioDoc(256);
+            if (deserializeJson(radioDoc, message) == DeserializationError::Ok) {
+                doc["data"] = radioDoc;
+            }
         }
-        
-        // Process and forward to MQTT
-        processRadioToMqtt(senderId, targetId, messageData, rssi);
     }
 }
 
-void processRadioToMqtt(uint8_t senderId, uint8_t targetId, const String& message, int16_t rssi) {
+void processRadioToMqtt(const RadioFrame& frame) {
+    // Get message data
+    String message = "";
+    for (uint8_t i = 0; i < frame.length; i++) {
+        message += (char)frame.data[i];
+    }
+    
+    debugLog("Radio message received from node " + String(frame.senderId) + ": " + message);
+    debugLog("RSSI: " + String(frame.rssi) + " dBm");
+    
     if (!mqttConnected) {
+        // Alarms are kept for the broker, everything else is only cached
+        if (frame.priority == PRIORITY_ALARM) {
+            holdAlarmFrame(frame);
+        }
         debugLog("Cannot forward to MQTT: not connected");
         return;
     }
@@ -312,15 +602,17 @@ void processRadioToMqtt(uint8_t senderId, uint8_t targetId, const String& messag
     // Create JSON message for MQTT
     DynamicJsonDocument doc(512);
     doc["timestamp"] = millis();
-    doc["senderId"] = senderId;
-    doc["targetId"] = targetId;
-    doc["rssi"] = rssi;
-    doc["message"] = message;
+    radioFrameJson(frame, doc);
+    
+    // Epoch ms at radio interrupt and at publish, the difference is gateway queueing
+    if (timeSynced()) {
+        doc["rxTime"] = epochMillisAt(frame.rxMicros);
+        doc["publishTime"] = epochMillis();
+    }
     
-    // Try to parse the radio message as JSON for structured data
-    DynamicJsonDocument radioDoc(256);
-    if (deserializeJson(radioDoc, message) == DeserializationError::Ok) {
-        doc["data"] = radioDoc;
+    // Unchanged or too frequent values are dropped before serialization, alarms always pass
+    if (frame.priority != PRIORITY_ALARM && !uplinkFilterPass(frame.senderId, doc["data"])) {
+        return;
     }
     
     String jsonString;
@@ -332,8 +624,16 @@ void processRadioToMqtt(uint8_t senderId, uint8_t targetId, const String& messag
         outPrefix += "/";
     }
     
-    String topic = outPrefix + String(activeConfig.nodeId) + "/radio/received/" + String(senderId);
-    if (mqttClient.publish(topic.c_str(), jsonString.c_str())) {
+    // Each radio has its own namespace: radio/..., radio2/...
+    String topic = outPrefix + String(activeConfig.nodeId) + (frame.radioIndex == 0 ? "/radio" : "/radio2") +
+                   "/received/" + String(frame.senderId);
+#if MQTT_UPLINK_QOS == 1
+    bool published = mqttPublishQos1(topic.c_str(), (const uint8_t*)jsonString.c_str(), jsonString.length());
+#else
+    bool published = mqttClient.publish(topic.c_str(), jsonString.c_str());
+#endif
+    if (published) {
+        recordPriorityLatency(PRIORITY_UPLINK, frame.priority, micros() - frame.rxMicros);
         debugLog("Forwarded to MQTT topic: " + topic);
     } else {
         debugLog("Failed to publish to MQTT");
@@ -341,44 +641,13 @@ void processRadioToMqtt(uint8_t senderId, uint8_t targetId, const String& messag
 }
 
 void onMqttMessage(char* topic, byte* payload, unsigned int length) {
-    String topicStr = String(topic);
-    String message = "";
-    
-    for (unsigned int i = 0; i < length; i++) {
-        message += (char)payload[i];
-    }
-    
-    debugLog("MQTT message received on topic: " + topicStr);
-    debugLog("Message: " + message);
-    
-    // Parse command topic
-    if (topicStr.startsWith(mqttCommandTopic)) {
-        handleMqttCommand(topicStr, message);
+    // Topic and payload are routed in place, without copying into Strings
+    if (!handleGatewayDedupClaim(topic, payload, length) && !dispatchMqttCommand(topic, payload, length)) {
+        debugLog("Unknown command topic: " + String(topic));
     }
 }
 
-void handleMqttCommand(const String& topic, const String& message) {
-    // Extract command from topic: gateway/1/command/{command}
-    int lastSlash = topic.lastIndexOf('/');
-    if (lastSlash == -1) return;
-    
-    String command = topic.substring(lastSlash + 1);
-    
-    debugLog("Processing command: " + command);
-    
-    if (command == "send") {
-        handleRadioSendCommand(message);
-    } else if (command == "status") {
-        publishStatus();
-    } else if (command == "reboot") {
-        debugLog("Reboot command received via MQTT");
-        ESP.restart();
-    } else {
-        debugLog("Unknown command: " + command);
-    }
-}
-
-void handleRadioSendCommand(const String& message) {
+void handleRadioSendCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
     if (!radioInitialized) {
         debugLog("Cannot send radio message: radio not initialized");
         return;
@@ -386,50 +655,133 @@ void handleRadioSendCommand(const String& message) {
     
     // Parse JSON command
     DynamicJsonDocument doc(512);
-    if (deserializeJson(doc, message) != DeserializationError::Ok) {
+    if (deserializeJson(doc, payload, length) != DeserializationError::Ok) {
         debugLog("Invalid JSON in send command");
         return;
     }
     
-    if (!doc.containsKey("nodeId") || !doc.containsKey("message")) {
+    // command/send/{nodeId} carries the target in the topic
+    bool nodeInTopic = params.count > 0;
+    if ((!nodeInTopic && !doc.containsKey("nodeId")) || !doc.containsKey("message")) {
         debugLog("Send command missing required fields (nodeId, message)");
         return;
     }
     
-    uint8_t targetNode = doc["nodeId"];
-    String payload = doc["message"];
+    uint32_t targetId = nodeInTopic ? params.values[0] : doc["nodeId"].as<uint32_t>();
+    if (targetId > 255) {
+        debugLog("Send command node id out of range: " + String(targetId));
+        return;
+    }
+    uint8_t targetNode = targetId;
+    const char* message = doc["message"] | "";
+    size_t messageLength = strlen(message);
     bool requestAck = doc["ack"] | false;
     
-    debugLog("Sending radio message to node " + String(targetNode) + ": " + payload);
+    // "priority":"alarm" or "routine", otherwise the node's registry class
+    uint8_t priority = downlinkPriority(targetNode);
+    if (doc.containsKey("priority")) {
+        priority = strcmp(doc["priority"] | "", "alarm") == 0 ? PRIORITY_ALARM : PRIORITY_ROUTINE;
+    }
     
-    bool success = false;
-    if (requestAck) {
-        success = radio.sendWithRetry(targetNode, payload.c_str(), payload.length(), 3, 100);
-    } else {
-        radio.send(targetNode, payload.c_str(), payload.length());
-        success = true; // No way to verify without ACK
+    // Sleeping nodes get the message with their next transmission
+    if (doc["mailbox"] | false) {
+        uint32_t key = doc["key"] | 0;
+        if (messageLength > RF69_MAX_DATA_LEN || key > 255) {
+            debugLog("Mailbox message too long or key out of range for node " + String(targetNode));
+            return;
+        }
+        queueMailboxCommand(targetNode, (const uint8_t*)message, messageLength, key, doc["ttl"] | MAILBOX_DEFAULT_TTL_S);
+        return;
     }
     
-    // Report result back to MQTT
-    DynamicJsonDocument response(256);
-    response["command"] = "send";
-    response["targetNode"] = targetNode;
-    response["success"] = success;
-    response["timestamp"] = millis();
+    debugLog("Sending radio message to node " + String(targetNode) + ": " + String(message));
     
-    String responseString;
-    serializeJson(response, responseString);
+    // Sent now, or queued until duty-cycle budget and channel allow it
+    RadioTxResult result = radioTransmit(targetNode, message, messageLength, requestAck, RADIO_RESPONSE_SEND, priority);
+    publishRadioSendResult(RADIO_RESPONSE_SEND, targetNode, result, 0);
     
-    String responseTopic = mqttBaseTopic + "/response/send";
-    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+    debugLog("Radio send result: " + String(result == RADIO_TX_SENT ? "success" : result == RADIO_TX_DEFERRED ? "deferred" : "failed"));
+}
+
+// Reports a downlink result; deferred frames report again once they went out
+void publishRadioSendResult(uint8_t responseKind, uint8_t targetNode, RadioTxResult result, unsigned long deferredMs) {
+    if (!mqttConnected) return;
     
-    debugLog("Radio send result: " + String(success ? "success" : "failed"));
+    if (responseKind == RADIO_RESPONSE_SEND) {
+        DynamicJsonDocument response(256);
+        response["command"] = "send";
+        response["targetNode"] = targetNode;
+        response["success"] = result == RADIO_TX_SENT;
+        if (result == RADIO_TX_DEFERRED) {
+            response["deferred"] = true;
+        }
+        if (deferredMs > 0) {
+            response["deferredMs"] = deferredMs;
+        }
+        response["timestamp"] = millis();
+        
+        String responseString;
+        serializeJson(response, responseString);
+        
+        String responseTopic = mqttBaseTopic + "/response/send";
+        mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+    } else if (responseKind == RADIO_RESPONSE_RAW) {
+        char response[96];
+        int responseLength = snprintf(response, sizeof(response), "{\"targetNode\":%u,\"success\":%s,\"deferred\":%s,\"deferredMs\":%lu}",
+                                      targetNode, result == RADIO_TX_SENT ? "true" : "false", result == RADIO_TX_DEFERRED ? "true" : "false", deferredMs);
+        mqttClient.publish(mqttRawResponseTopic.c_str(), (const uint8_t*)response, responseLength);
+    }
 }
 
+// Raw downlink: target (and ACK flag) come from the topic, the payload is sent
+// to the radio as is. No JSON, no String copies, no per-command logging.
+static void sendRawRadioFrame(const MqttRouteParams& params, const byte* payload, unsigned int length, bool requestAck) {
+    uint8_t targetNode = params.values[0];
+    
+    if (!radioInitialized || length > RF69_MAX_DATA_LEN || params.values[0] > 255) {
+        debugLog("Raw send rejected for node " + String(params.values[0]) + ", length " + String(length));
+        return;
+    }
+    
+    // Only ACKed sends have a result worth reporting
+    uint8_t responseKind = requestAck ? RADIO_RESPONSE_RAW : RADIO_RESPONSE_NONE;
+    RadioTxResult result = radioTransmit(targetNode, payload, length, requestAck, responseKind, downlinkPriority(targetNode));
+    publishRadioSendResult(responseKind, targetNode, result, 0);
+}
+
+void handleRadioRawCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    sendRawRadioFrame(params, payload, length, false);
+}
+
+void handleRadioRawAckCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    sendRawRadioFrame(params, payload, length, true);
+}
+
+#if RFM69_SECOND_RADIO
+// Raw downlink on the second radio, sent right away; ACKed sends report on response/raw
+static void sendRadio2Frame(const MqttRouteParams& params, const byte* payload, unsigned int length, bool requestAck) {
+    if (!radio2.ready() || length > RF69_MAX_DATA_LEN || params.values[0] > 255) {
+        debugLog("Radio 2 send rejected for node " + String(params.values[0]) + ", length " + String(length));
+        return;
+    }
+    
+    RadioTxResult result = radioTransmitVia(radio2, params.values[0], payload, length, requestAck);
+    publishRadioSendResult(requestAck ? RADIO_RESPONSE_RAW : RADIO_RESPONSE_NONE, params.values[0], result, 0);
+}
+
+void handleRadio2RawCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    sendRadio2Frame(params, payload, length, false);
+}
+
+void handleRadio2RawAckCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    sendRadio2Frame(params, payload, length, true);
+}
+#endif
+
 void publishStatus() {
     if (!mqttConnected) return;
     
-    DynamicJsonDocument doc(512);
+    DynamicJsonDocument doc(1024);
     doc["timestamp"] = millis();
     doc["uptime"] = millis();
     doc["nodeId"] = activeConfig.nodeId;
@@ -447,10 +799,45 @@ void publishStatus() {
     doc["freeHeap"] = ESP.getFreeHeap();
     doc["cpuFreq"] = ESP.getCpuFreqMHz();
     
-    String statusString;
-    serializeJson(doc, statusString);
+    JsonObject clock = doc.createNestedObject("time");
+    clock["synced"] = timeSynced();
+    if (timeSynced()) {
+        clock["epochMs"] = epochMillis();
+        clock["syncs"] = timeSyncCount();
+        clock["lastSyncS"] = timeSyncAgeS();
+        clock["offsetMs"] = clockOffsetMs();
+        clock["driftPpm"] = clockDriftPpm();
+    }
+    
+    addLoopStallCounts(doc.createNestedObject("stalls"));
     
-    if (mqttClient.publish(mqttStatusTopic.c_str(), statusString.c_str(), true)) {
+    // Streamed, the status can exceed the MQTT client buffer
+    mqttClient.beginPublish(mqttStatusTopic.c_str(), measureJson(doc), true);
+    serializeJson(doc, mqttClient);
+    if (mqttClient.endPublish()) {
         debugLog("Status published to MQTT");
     }
+    
+    publishMqttQos1Stats();
+    publishAirtimeStats();
+    publishMailboxStats();
+    publishRadioStats();
+    publishSurveyStats();
+    publishTdmaStats();
+    publishAckStats();
+    publishPriorityStats();
+    publishNodeRegistryStats();
+    publishGroupStats();
+    publishDecoderStats();
+    publishFilterStats();
+    publishCaptureStats();
+    publishUdpBridgeStats();
+    publishGatewayDedupStats();
+    publishLastValueStats();
+    publishLiveFeedStats();
+    publishLiveConfigStats();
+    publishLoopWatchdogStats();
+#if MQTT_TLS
+    publishMqttTlsStats();
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Claim published on GATEWAY_DEDUP_TOPIC by every gateway for every frame it
+// wants to forward, all multi-byte fields little endian:
+//   0  magic       DEDUP_CLAIM_MAGIC
+//   1  gateway     uint32, chip ID of the claiming gateway
+//   5  fingerprint uint32, FNV-1a of network, sender, target and payload
+//   9  rssi        int8 dBm
+#define DEDUP_CLAIM_MAGIC       0xD1
+#define DEDUP_CLAIM_LEN         10
+
+// A frame held for the arbitration window
+struct DedupPending {
+    bool used;
+    uint32_t fingerprint;
+    unsigned long heldAt;
+    RadioFrame frame;
+};
+
+// A claim seen from another gateway, kept so a frame that arrives here after
+// the other gateway already claimed it is dropped without a window
+struct DedupClaim {
+    uint32_t fingerprint;
+    uint32_t gatewayId;
+    int16_t rssi;
+    unsigned long seenAt;
+};
+
+static DedupPending dedupPending[DEDUP_MAX_PENDING];
+static DedupClaim dedupClaims[DEDUP_MAX_CLAIMS];
+static uint8_t dedupClaimNext = 0;
+static bool dedupEnabled = false;
+static uint32_t dedupGatewayId = 0;
+
+// Statistics
+static uint32_t dedupForwarded = 0;
+static uint32_t dedupSuppressed = 0;
+static uint32_t dedupLocalDuplicates = 0;
+static uint32_t dedupUncontested = 0;
+static uint32_t dedupClaimsSeen = 0;
+static uint32_t dedupHoldOverflows = 0;
+static uint32_t dedupArbitrationAvgUs = 0;
+static uint32_t dedupArbitrationMaxUs = 0;
+
+bool initializeGatewayDedup() {
+    if (strlen(GATEWAY_DEDUP_TOPIC) == 0) {
+        return false;
+    }
+
+    dedupGatewayId = ESP.getChipId();
+    memset(dedupPending, 0, sizeof(dedupPending));
+    memset(dedupClaims, 0, sizeof(dedupClaims));
+    dedupEnabled = true;
+
+    debugLog("Duplicate suppression on " + String(GATEWAY_DEDUP_TOPIC) + ", window " + String(GATEWAY_DEDUP_WINDOW_MS) + " ms");
+    return true;
+}
+
+void subscribeGatewayDedup() {
+    if (dedupEnabled) {
+        mqttClient.subscribe(GATEWAY_DEDUP_TOPIC);
+    }
+}
+
+static uint32_t frameFingerprint(const RadioFrame& frame) {
+    uint32_t hash = 2166136261UL;
+    uint8_t header[3] = { frame.networkId, frame.senderId, frame.targetId };
+    for (uint8_t i = 0; i < sizeof(header); i++) {
+        hash = (hash ^ header[i]) * 16777619UL;
+    }
+    for (uint8_t i = 0; i < frame.length; i++) {
+        hash = (hash ^ frame.data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+// Stronger signal wins, the lower gateway ID breaks ties so all gateways agree
+static bool claimBeats(int16_t rssi, uint32_t gatewayId, int16_t otherRssi, uint32_t otherGatewayId) {
+    return rssi > otherRssi || (rssi == otherRssi && gatewayId < otherGatewayId);
+}
+
+static bool claimExpired(const DedupClaim& claim) {
+    return claim.fingerprint == 0 || millis() - claim.seenAt > GATEWAY_DEDUP_WINDOW_MS * 4;
+}
+
+static void recordArbitration(const DedupPending& pending) {
+    uint32_t latencyUs = (millis() - pending.heldAt) * 1000UL;
+    dedupArbitrationAvgUs = dedupArbitrationAvgUs == 0 ? latencyUs : (dedupArbitrationAvgUs * 7 + latencyUs) / 8;
+    if (latencyUs > dedupArbitrationMaxUs) dedupArbitrationMaxUs = latencyUs;
+}
+
+static void publishClaim(uint32_t fingerprint, int16_t rssi) {
+    uint8_t claim[DEDUP_CLAIM_LEN];
+    claim[0] = DEDUP_CLAIM_MAGIC;
+    for (uint8_t i = 0; i < 4; i++) {
+        claim[1 + i] = dedupGatewayId >> (8 * i);
+        claim[5 + i] = fingerprint >> (8 * i);
+    }
+    claim[9] = (uint8_t)(int8_t)rssi;
+
+    mqttClient.publish(GATEWAY_DEDUP_TOPIC, claim, sizeof(claim));
+}
+
+// Returns true when the frame is taken over: held for arbitration or suppressed.
+// Held frames that win are forwarded by handleGatewayDedupLoop().
+bool gatewayDedupHold(const RadioFrame& frame) {
+    if (!dedupEnabled) {
+        return false;
+    }
+    // Without the side channel there is nobody to arbitrate with
+    if (!mqttConnected) {
+        dedupUncontested++;
+        return false;
+    }
+
+    uint32_t fingerprint = frameFingerprint(frame);
+    if (fingerprint == 0) fingerprint = 1;
+
+    // Another gateway claimed this frame already
+    for (uint8_t i = 0; i < DEDUP_MAX_CLAIMS; i++) {
+        DedupClaim& claim = dedupClaims[i];
+        if (claim.fingerprint == fingerprint && !claimExpired(claim) &&
+            !claimBeats(frame.rssi, dedupGatewayId, claim.rssi, claim.gatewayId)) {
+            dedupSuppressed++;
+            return true;
+        }
+    }
+
+    // A retransmission of a frame this gateway holds already keeps the better copy
+    uint8_t freeSlot = DEDUP_MAX_PENDING;
+    for (uint8_t i = 0; i < DEDUP_MAX_PENDING; i++) {
+        DedupPending& pending = dedupPending[i];
+        if (!pending.used) {
+            if (freeSlot == DEDUP_MAX_PENDING) freeSlot = i;
+            continue;
+        }
+        if (pending.fingerprint == fingerprint) {
+            // The better copy is announced again, other gateways vote against its RSSI
+            if (frame.rssi > pending.frame.rssi) {
+                pending.frame = frame;
+                publishClaim(fingerprint, frame.rssi);
+            }
+            dedupLocalDuplicates++;
+            return true;
+        }
+    }
+
+    if (freeSlot == DEDUP_MAX_PENDING) {
+        // Forwarding a possible duplicate beats losing the frame
+        dedupHoldOverflows++;
+        return false;
+    }
+
+    DedupPending& pending = dedupPending[freeSlot];
+    pending.used = true;
+    pending.fingerprint = fingerprint;
+    pending.heldAt = millis();
+    pending.frame = frame;
+
+    publishClaim(fingerprint, frame.rssi);
+    return true;
+}
+
+// Claims arrive through the MQTT callback, in the main loop
+bool handleGatewayDedupClaim(const char* topic, const byte* payload, unsigned int length) {
+    if (!dedupEnabled || strcmp(topic, GATEWAY_DEDUP_TOPIC) != 0) {
+        return false;
+    }
+    if (length != DEDUP_CLAIM_LEN || payload[0] != DEDUP_CLAIM_MAGIC) {
+        return true;
+    }
+
+    uint32_t gatewayId = 0;
+    uint32_t fingerprint = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        gatewayId |= (uint32_t)payload[1 + i] << (8 * i);
+        fingerprint |= (uint32_t)payload[5 + i] << (8 * i);
+    }
+    int16_t rssi = (int8_t)payload[9];
+
+    // Our own claims come back from the broker
+    if (gatewayId == dedupGatewayId) {
+        return true;
+    }
+    dedupClaimsSeen++;
+
+    for (uint8_t i = 0; i < DEDUP_MAX_PENDING; i++) {
+        DedupPending& pending = dedupPending[i];
+        if (pending.used && pending.fingerprint == fingerprint &&
+            !claimBeats(pending.frame.rssi, dedupGatewayId, rssi, gatewayId)) {
+            recordArbitration(pending);
+            pending.used = false;
+            dedupSuppressed++;
+        }
+    }
+
+    DedupClaim& claim = dedupClaims[dedupClaimNext];
+    dedupClaimNext = (dedupClaimNext + 1) % DEDUP_MAX_CLAIMS;
+    claim.fingerprint = fingerprint;
+    claim.gatewayId = gatewayId;
+    claim.rssi = rssi;
+    claim.seenAt = millis();
+    return true;
+}
+
+void handleGatewayDedupLoop() {
+    if (!dedupEnabled) return;
+
+    for (uint8_t i = 0; i < DEDUP_MAX_PENDING; i++) {
+        DedupPending& pending = dedupPending[i];
+        if (!pending.used || millis() - pending.heldAt < GATEWAY_DEDUP_WINDOW_MS) {
+            continue;
+        }
+
+        // Nobody with a better signal claimed the frame within the window
+        recordArbitration(pending);
+        pending.used = false;
+        dedupForwarded++;
+        processRadioToMqtt(pending.frame);
+    }
+}
+
+void publishGatewayDedupStats() {
+    if (!mqttConnected || !dedupEnabled) return;
+
+    char stats[256];
+    snprintf(stats, sizeof(stats),
+             "{\"forwarded\":%lu,\"suppressed\":%lu,\"localDuplicates\":%lu,\"uncontested\":%lu,\"claimsSeen\":%lu,"
+             "\"holdOverflows\":%lu,\"windowMs\":%u,\"arbitrationAvgUs\":%lu,\"arbitrationMaxUs\":%lu}",
+             (unsigned long)dedupForwarded, (unsigned long)dedupSuppressed, (unsigned long)dedupLocalDuplicates,
+             (unsigned long)dedupUncontested, (unsigned long)dedupClaimsSeen, (unsigned long)dedupHoldOverflows,
+             (unsigned)GATEWAY_DEDUP_WINDOW_MS, (unsigned long)dedupArbitrationAvgUs, (unsigned long)dedupArbitrationMaxUs);
+
+    String statsTopic = mqttBaseTopic + "/stats/dedup";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
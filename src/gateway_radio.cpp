@@ -0,0 +1,317 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <RFM69registers.h>
+#include <SPI.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+GatewayRadio* GatewayRadio::_instances[RADIO_COUNT];
+GatewayRadio* GatewayRadio::_active = nullptr;
+volatile bool GatewayRadio::_irqPending[RADIO_COUNT];
+volatile uint32_t GatewayRadio::_irqMicros[RADIO_COUNT];
+
+GatewayRadio::GatewayRadio(uint8_t slaveSelectPin, uint8_t interruptPin, bool isRFM69HW_HCW, uint8_t index)
+    : GatewayRadioBase(slaveSelectPin, interruptPin, isRFM69HW_HCW),
+      framesReceived(0), framesDropped(0), acksSent(0), queuePeak(0), rssiAvg(0), readAvgUs(0), readMaxUs(0),
+      _index(index), _networkId(0), _ready(false),
+      _parkedMode(RF69_MODE_STANDBY), _parkedPayloadLength(0), _rxHead(), _rxCount(), _rxLast(nullptr) {
+    if (index < RADIO_COUNT) {
+        _instances[index] = this;
+    }
+}
+
+bool GatewayRadio::initialize(uint8_t freqBand, uint16_t ID, uint8_t networkID) {
+    use();
+    if (!GatewayRadioBase::initialize(freqBand, ID, networkID)) {
+        return false;
+    }
+
+    // Replace the library handler attached by initialize()
+    detachInterrupt(_interruptNum);
+    attachInterrupt(_interruptNum, _index == 0 ? GatewayRadio::isrRadio0 : GatewayRadio::isrRadio1, RISING);
+
+    _networkId = networkID;
+    _ready = true;
+    return true;
+}
+
+void GatewayRadio::use() {
+    if (_active == this) return;
+
+    noInterrupts();
+    if (_active != nullptr) {
+        _active->_parkedMode = _mode;
+        _active->_parkedPayloadLength = PAYLOADLEN;
+    }
+    _mode = _parkedMode;
+    PAYLOADLEN = _parkedPayloadLength;
+    _haveData = false;
+    _active = this;
+    interrupts();
+}
+
+void GatewayRadio::changeNetwork(uint8_t networkID) {
+    setNetwork(networkID);
+    _networkId = networkID;
+}
+
+bool GatewayRadio::receiveDone() {
+    use();
+
+    noInterrupts();
+    if (_irqPending[_index]) {
+        _irqPending[_index] = false;
+        _haveData = true;
+    }
+    interrupts();
+
+    return GatewayRadioBase::receiveDone();
+}
+
+void GatewayRadio::selectBurst() {
+    _spi->beginTransaction(SPISettings(RFM69_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+    digitalWrite(_slaveSelectPin, LOW);
+}
+
+void GatewayRadio::unselectBurst() {
+    digitalWrite(_slaveSelectPin, HIGH);
+    _spi->endTransaction();
+}
+
+// The library's interrupt handler with the payload read as one burst. The
+// header is read first, it decides the queue the payload goes to.
+RadioFrame* GatewayRadio::receiveFrame() {
+    use();
+
+    noInterrupts();
+    bool pending = _irqPending[_index];
+    _irqPending[_index] = false;
+    interrupts();
+
+    // Also the "packet sent" interrupt of a transmission lands here
+    if (!pending || _mode != RF69_MODE_RX || !(readReg(REG_IRQFLAGS2) & RF_IRQFLAGS2_PAYLOADREADY)) {
+        GatewayRadioBase::receiveDone();
+        return nullptr;
+    }
+
+    uint32_t readStart = micros();
+    int16_t rssi = readRSSI();
+    setMode(RF69_MODE_STANDBY);
+
+    uint8_t header[4];
+    selectBurst();
+    _spi->transfer(REG_FIFO & 0x7F);
+    _spi->transferBytes(nullptr, header, sizeof(header));
+
+    PAYLOADLEN = min(header[0], (uint8_t)66);
+    TARGETID = header[1] | ((uint16_t)(header[3] & 0x0C) << 6);
+    SENDERID = header[2] | ((uint16_t)(header[3] & 0x03) << 8);
+    if (!(_spyMode || TARGETID == _address || TARGETID == RF69_BROADCAST_ADDR) || PAYLOADLEN < 3) {
+        PAYLOADLEN = 0;
+        unselectBurst();
+        receiveBegin();
+        return nullptr;
+    }
+
+    RSSI = rssi;
+    DATALEN = PAYLOADLEN - 3;
+    ACK_RECEIVED = header[3] & RFM69_CTL_SENDACK;
+    ACK_REQUESTED = header[3] & RFM69_CTL_REQACK;
+    // With ATC this reads the ACK RSSI byte ahead of the payload
+    interruptHook(header[3]);
+
+    uint8_t ctl = (ACK_REQUESTED ? RFM69_CTL_REQACK : 0) | (ACK_RECEIVED ? RFM69_CTL_SENDACK : 0) | (header[3] & RFM69_CTL_PRIORITY);
+    uint8_t lane = framePriority(SENDERID, ctl);
+    RadioFrame& frame = _rxCount[lane] < RADIO_RX_QUEUE_LEN
+        ? _rxQueue[lane][(_rxHead[lane] + _rxCount[lane]) % RADIO_RX_QUEUE_LEN]
+        : _rxSpare;
+
+    frame.length = min(DATALEN, (uint8_t)RF69_MAX_DATA_LEN);
+    _spi->transferBytes(nullptr, frame.data, frame.length);
+    unselectBurst();
+
+    frame.radioIndex = _index;
+    frame.networkId = _networkId;
+    frame.senderId = SENDERID;
+    frame.targetId = TARGETID;
+    frame.rssi = rssi;
+    frame.ackRequested = ACKRequested();
+    frame.ctl = ctl;
+    frame.priority = lane;
+    frame.rxMicros = _irqMicros[_index];
+    _rxLast = &frame;
+
+    uint32_t readUs = micros() - readStart;
+    readMaxUs = max(readMaxUs, readUs);
+    readAvgUs = framesReceived == 0 ? readUs : (readAvgUs * 7 + readUs) / 8;
+    return &frame;
+}
+
+#ifndef RFM69_ENABLE_ATC
+// The library's sendFrame() with header and payload written as one burst
+void GatewayRadio::sendFrame(uint16_t toAddress, const void* buffer, uint8_t size, bool requestACK, bool sendACK) {
+    // No reception while the FIFO is filled
+    setMode(RF69_MODE_STANDBY);
+    while ((readReg(REG_IRQFLAGS1) & RF_IRQFLAGS1_MODEREADY) == 0x00);
+    if (size > RF69_MAX_DATA_LEN) size = RF69_MAX_DATA_LEN;
+
+    uint8_t fifo[RF69_MAX_DATA_LEN + 5];
+    fifo[0] = REG_FIFO | 0x80;
+    fifo[1] = size + 3;
+    fifo[2] = (uint8_t)toAddress;
+    fifo[3] = (uint8_t)_address;
+    fifo[4] = sendACK ? RFM69_CTL_SENDACK : (requestACK ? RFM69_CTL_REQACK : 0);
+    fifo[4] |= ((toAddress & 0x300) >> 6) | ((_address & 0x300) >> 8);
+    memcpy(fifo + 5, buffer, size);
+
+    selectBurst();
+    _spi->writeBytes(fifo, size + 5);
+    unselectBurst();
+
+    // DIO0 goes high when the frame is sent
+    setMode(RF69_MODE_TX);
+    uint32_t txStart = millis();
+    while (digitalRead(_interruptPin) == 0 && millis() - txStart < RF69_TX_LIMIT_MS);
+    setMode(RF69_MODE_STANDBY);
+}
+#endif
+
+bool GatewayRadio::frameReady() {
+    for (uint8_t i = 0; i < RADIO_COUNT; i++) {
+        if (_irqPending[i]) return true;
+    }
+    return false;
+}
+
+void IRAM_ATTR GatewayRadio::isrRadio0() {
+    _irqMicros[0] = micros();
+    _irqPending[0] = true;
+}
+
+void IRAM_ATTR GatewayRadio::isrRadio1() {
+    _irqMicros[RADIO_COUNT - 1] = micros();
+    _irqPending[RADIO_COUNT - 1] = true;
+}
+
+bool GatewayRadio::queueFrame() {
+    if (_rxLast == nullptr) return false;
+
+    RadioFrame& frame = *_rxLast;
+    _rxLast = nullptr;
+    framesReceived++;
+    rssiAvg = framesReceived == 1 ? frame.rssi : (rssiAvg * 7 + frame.rssi) / 8;
+
+    // Routine traffic cannot fill the queue alarms are waiting in
+    if (&frame == &_rxSpare) {
+        framesDropped++;
+        return false;
+    }
+
+    _rxCount[frame.priority]++;
+    if (queuedFrames() > queuePeak) queuePeak = queuedFrames();
+    return true;
+}
+
+bool GatewayRadio::nextFrame(RadioFrame& frame, uint8_t priority) {
+    if (_rxCount[priority] == 0) return false;
+
+    frame = _rxQueue[priority][_rxHead[priority]];
+    _rxHead[priority] = (_rxHead[priority] + 1) % RADIO_RX_QUEUE_LEN;
+    _rxCount[priority]--;
+    return true;
+}
+
+uint8_t GatewayRadio::queuedFrames() const {
+    uint8_t count = 0;
+    for (uint8_t lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        count += _rxCount[lane];
+    }
+    return count;
+}
+
+void publishRadioStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(512);
+    JsonArray radios = doc.createNestedArray("radios");
+    for (uint8_t i = 0; i < RADIO_COUNT; i++) {
+        GatewayRadio* radio = GatewayRadio::instance(i);
+        if (radio == nullptr) continue;
+
+        JsonObject entry = radios.createNestedObject();
+        entry["radio"] = i;
+        entry["ready"] = radio->ready();
+        entry["networkId"] = radio->networkId();
+        entry["frequency"] = radio->ready() ? radio->getFrequency() : 0;
+        entry["received"] = radio->framesReceived;
+        entry["dropped"] = radio->framesDropped;
+        entry["acks"] = radio->acksSent;
+        entry["queued"] = radio->queuedFrames();
+        entry["queuePeak"] = radio->queuePeak;
+        entry["rssiAvg"] = radio->rssiAvg;
+        entry["readAvgUs"] = radio->readAvgUs;
+        entry["readMaxUs"] = radio->readMaxUs;
+    }
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/radio";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
+
+// Radio interrupt to ACK on air, upper bounds in ms; the last bucket is open
+static const uint16_t ackLatencyBucketsMs[ACK_LATENCY_BUCKETS - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+
+static uint32_t ackLatencyCounts[ACK_LATENCY_BUCKETS];
+static uint32_t acksSent = 0;
+static uint32_t acksLate = 0;
+static uint32_t ackLatencyMaxUs = 0;
+static uint32_t ackLatencyAvgUs = 0;
+
+void recordAckLatency(uint32_t latencyUs) {
+    uint8_t bucket = 0;
+    while (bucket < ACK_LATENCY_BUCKETS - 1 && latencyUs >= ackLatencyBucketsMs[bucket] * 1000UL) {
+        bucket++;
+    }
+    ackLatencyCounts[bucket]++;
+
+    // The node has given up on this ACK and will retransmit
+    if (latencyUs > ACK_NODE_TIMEOUT_MS * 1000UL) {
+        acksLate++;
+    }
+
+    acksSent++;
+    ackLatencyMaxUs = max(ackLatencyMaxUs, latencyUs);
+    ackLatencyAvgUs = acksSent == 1 ? latencyUs : (ackLatencyAvgUs * 7 + latencyUs) / 8;
+}
+
+void publishAckStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(512);
+    doc["acks"] = acksSent;
+    doc["late"] = acksLate;
+    doc["nodeTimeoutMs"] = ACK_NODE_TIMEOUT_MS;
+    doc["avgUs"] = ackLatencyAvgUs;
+    doc["maxUs"] = ackLatencyMaxUs;
+
+    JsonArray bounds = doc.createNestedArray("bucketsMs");
+    for (uint8_t i = 0; i < ACK_LATENCY_BUCKETS - 1; i++) {
+        bounds.add(ackLatencyBucketsMs[i]);
+    }
+    JsonArray counts = doc.createNestedArray("counts");
+    for (uint8_t i = 0; i < ACK_LATENCY_BUCKETS; i++) {
+        counts.add(ackLatencyCounts[i]);
+    }
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/ack";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
@@ -0,0 +1,217 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include "payload_decoder.h"
+#include <ESPAsyncWebServer.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+// The configuration portal's server, in normal mode it serves the API
+extern AsyncWebServer webServer;
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define LAST_VALUE_NONE 0xFF
+
+// Latest frame of the most recently heard nodes, so a backend can read a
+// sleeping node's state without waiting for it or going over the radio. The
+// frame is kept as received and decoded when asked for, which bounds an entry
+// to frame size and answers with the node's current decoder layout.
+struct LastValue {
+    RadioFrame frame;
+    unsigned long receivedAt;       // millis()
+    uint64_t rxTime;                // Epoch ms at radio interrupt, 0 = clock was not synced
+    bool statePending;              // Retained state topic not published yet
+};
+
+static LastValue lastValues[LAST_VALUE_CACHE_NODES];
+static uint8_t lastValueCount = 0;
+static uint8_t lastValueSlot[RADIO_COUNT][256];
+static uint8_t statePendingCount = 0;
+
+static uint32_t lastValueHits = 0;
+static uint32_t lastValueMisses = 0;
+static uint32_t lastValueEvictions = 0;
+static uint32_t statePublished = 0;
+
+static const LastValue* findLastValue(uint8_t radioIndex, uint32_t nodeId) {
+    if (radioIndex >= RADIO_COUNT || nodeId > 255 || lastValueSlot[radioIndex][nodeId] == LAST_VALUE_NONE) {
+        lastValueMisses++;
+        return nullptr;
+    }
+    lastValueHits++;
+    return &lastValues[lastValueSlot[radioIndex][nodeId]];
+}
+
+// The retained state carries no age, it would be stale as soon as it is stored
+static void lastValueJson(const LastValue& entry, JsonDocument& doc, bool withAge) {
+    radioFrameJson(entry.frame, doc);
+    if (entry.rxTime != 0) {
+        doc["rxTime"] = entry.rxTime;
+    }
+    if (withAge) {
+        doc["ageMs"] = millis() - entry.receivedAt;
+    }
+}
+
+void cacheLastValue(const RadioFrame& frame) {
+    uint8_t slot = lastValueSlot[frame.radioIndex][frame.senderId];
+    if (slot == LAST_VALUE_NONE) {
+        if (lastValueCount < LAST_VALUE_CACHE_NODES) {
+            slot = lastValueCount++;
+        } else {
+            // Full: the node heard from longest ago makes room
+            slot = 0;
+            for (uint8_t i = 1; i < lastValueCount; i++) {
+                if ((long)(lastValues[i].receivedAt - lastValues[slot].receivedAt) < 0) {
+                    slot = i;
+                }
+            }
+            LastValue& evicted = lastValues[slot];
+            lastValueSlot[evicted.frame.radioIndex][evicted.frame.senderId] = LAST_VALUE_NONE;
+            if (evicted.statePending) {
+                evicted.statePending = false;
+                statePendingCount--;
+            }
+            lastValueEvictions++;
+        }
+        lastValueSlot[frame.radioIndex][frame.senderId] = slot;
+    }
+
+    LastValue& entry = lastValues[slot];
+    entry.frame = frame;
+    entry.receivedAt = millis();
+    entry.rxTime = timeSynced() ? epochMillisAt(frame.rxMicros) : 0;
+#if LAST_VALUE_STATE_RETAIN
+    if (!entry.statePending) {
+        entry.statePending = true;
+        statePendingCount++;
+    }
+#endif
+}
+
+// After a reconnect every state topic goes out again, the broker may have
+// lost retained messages and frames may have arrived while it was away
+void republishLastValues() {
+#if LAST_VALUE_STATE_RETAIN
+    for (uint8_t i = 0; i < lastValueCount; i++) {
+        if (!lastValues[i].statePending) {
+            lastValues[i].statePending = true;
+            statePendingCount++;
+        }
+    }
+#endif
+}
+
+static bool publishLastValueState(const LastValue& entry) {
+    DynamicJsonDocument doc(640);
+    lastValueJson(entry, doc, false);
+
+    String topic = mqttBaseTopic + (entry.frame.radioIndex == 0 ? "/radio" : "/radio2") + "/state/" + String(entry.frame.senderId);
+    if (!mqttClient.beginPublish(topic.c_str(), measureJson(doc), true)) {
+        return false;
+    }
+    serializeJson(doc, mqttClient);
+    return mqttClient.endPublish();
+}
+
+// A few state topics per pass, so a reconnect does not hold up the radio
+void handleLastValueLoop() {
+    if (statePendingCount == 0) return;
+
+    uint8_t published = 0;
+    for (uint8_t i = 0; i < lastValueCount && published < LAST_VALUE_STATE_BURST; i++) {
+        if (!lastValues[i].statePending) continue;
+        if (!publishLastValueState(lastValues[i])) return;
+
+        lastValues[i].statePending = false;
+        statePendingCount--;
+        statePublished++;
+        published++;
+    }
+}
+
+static void publishLastValue(uint8_t radioIndex, uint32_t nodeId) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(640);
+    doc["command"] = "get";
+    const LastValue* entry = findLastValue(radioIndex, nodeId);
+    doc["cached"] = entry != nullptr;
+    if (entry != nullptr) {
+        lastValueJson(*entry, doc, true);
+    } else {
+        doc["senderId"] = nodeId;
+        if (radioIndex != 0) {
+            doc["radio"] = radioIndex + 1;
+        }
+    }
+
+    // Streamed, a decoded frame can exceed the MQTT client buffer
+    String responseTopic = mqttBaseTopic + "/response/get";
+    mqttClient.beginPublish(responseTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
+
+// command/get/{node}: the node's latest frame on response/get, from RAM only
+void handleGetCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    publishLastValue(0, params.values[0]);
+}
+
+#if RFM69_SECOND_RADIO
+// command/radio2/get/{node}: the same for nodes on the second radio
+void handleRadio2GetCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    publishLastValue(1, params.values[0]);
+}
+#endif
+
+// GET /api/last?node={id}[&radio=2] answers like command/get, without a node
+// it lists the cached nodes
+static void handleApiLastValue(AsyncWebServerRequest *request) {
+    String json;
+    if (request->hasParam("node")) {
+        uint8_t radioIndex = request->hasParam("radio") && request->getParam("radio")->value().toInt() == 2 ? 1 : 0;
+        const LastValue* entry = findLastValue(radioIndex, request->getParam("node")->value().toInt());
+        if (entry == nullptr) {
+            request->send(404, "application/json", "{\"cached\":false}");
+            return;
+        }
+
+        DynamicJsonDocument doc(640);
+        doc["cached"] = true;
+        lastValueJson(*entry, doc, true);
+        serializeJson(doc, json);
+    } else {
+        DynamicJsonDocument doc(128 + lastValueCount * 64);
+        JsonArray nodes = doc.createNestedArray("nodes");
+        for (uint8_t i = 0; i < lastValueCount; i++) {
+            JsonObject node = nodes.createNestedObject();
+            node["nodeId"] = lastValues[i].frame.senderId;
+            node["radio"] = lastValues[i].frame.radioIndex + 1;
+            node["ageMs"] = millis() - lastValues[i].receivedAt;
+        }
+        serializeJson(doc, json);
+    }
+    request->send(200, "application/json", json);
+}
+
+void initializeLastValueCache() {
+    memset(lastValueSlot, LAST_VALUE_NONE, sizeof(lastValueSlot));
+    lastValueCount = 0;
+    statePendingCount = 0;
+
+    webServer.on("/api/last", HTTP_GET, handleApiLastValue);
+}
+
+void publishLastValueStats() {
+    if (!mqttConnected) return;
+
+    char stats[192];
+    snprintf(stats, sizeof(stats), "{\"nodes\":%u,\"capacity\":%u,\"hits\":%lu,\"misses\":%lu,\"evictions\":%lu,\"statePublished\":%lu}",
+             lastValueCount, LAST_VALUE_CACHE_NODES, (unsigned long)lastValueHits, (unsigned long)lastValueMisses,
+             (unsigned long)lastValueEvictions, (unsigned long)statePublished);
+
+    String statsTopic = mqttBaseTopic + "/stats/lastvalue";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
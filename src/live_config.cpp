@@ -0,0 +1,466 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <ESP8266WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern AsyncWebServer webServer;
+extern PubSubClient mqttClient;
+extern GatewayRadio radio;
+#if RFM69_SECOND_RADIO
+extern GatewayRadio radio2;
+#endif
+extern GatewayConfig activeConfig;
+extern bool radioInitialized;
+extern bool wifiConnected;
+extern bool mqttConnected;
+extern unsigned long lastMqttReconnect;
+extern String mqttBaseTopic;
+extern String mqttCommandTopic;
+
+// What a configuration change touches, see configChanges()
+#define CONFIG_CHANGE_RADIO_ADDRESS 0x01
+#define CONFIG_CHANGE_RADIO_POWER   0x02
+#define CONFIG_CHANGE_RADIO_KEY     0x04
+#define CONFIG_CHANGE_WIFI          0x08
+#define CONFIG_CHANGE_MQTT          0x10
+#define CONFIG_CHANGE_TOPICS        0x20
+#define CONFIG_CHANGE_STORED        0x40    // Only used in configuration mode, saved for next time
+
+// Changes are applied from the main loop, never from MQTT or web server callbacks
+static GatewayConfig pendingConfig;
+static volatile bool configPending = false;
+
+static char configBody[LIVE_CONFIG_BODY_MAX + 1];
+static size_t configBodyLength = 0;
+
+static uint32_t configApplied = 0;
+
+// A WiFi or broker change is saved once the gateway is connected with it. Until
+// then the previous settings are kept, and restored if no connection comes up.
+static GatewayConfig previousConfig;
+static bool reconnectPending = false;
+static bool rolledBack = false;
+static unsigned long reconnectDeadline = 0;
+static uint8_t responseChanges = 0;
+static unsigned long responseApplyMs = 0;
+
+static uint8_t configChanges(const GatewayConfig& from, const GatewayConfig& to) {
+    uint8_t changes = 0;
+
+    if (from.networkId != to.networkId || from.nodeId != to.nodeId) {
+        changes |= CONFIG_CHANGE_RADIO_ADDRESS;
+    }
+    if (from.radioPower != to.radioPower) {
+        changes |= CONFIG_CHANGE_RADIO_POWER;
+    }
+    if (strcmp(from.encryptionKey, to.encryptionKey) != 0) {
+        changes |= CONFIG_CHANGE_RADIO_KEY;
+    }
+    if (from.dhcp != to.dhcp || from.staticIP != to.staticIP || from.netmask != to.netmask ||
+        from.gateway != to.gateway || from.dns1 != to.dns1 || from.dns2 != to.dns2 ||
+        strcmp(from.wifiSSID, to.wifiSSID) != 0 || strcmp(from.wifiPassword, to.wifiPassword) != 0) {
+        changes |= CONFIG_CHANGE_WIFI;
+    }
+    // The AP name is part of the MQTT client id
+    if (strcmp(from.mqttServer, to.mqttServer) != 0 || from.mqttPort != to.mqttPort ||
+        strcmp(from.mqttUser, to.mqttUser) != 0 || strcmp(from.mqttPass, to.mqttPass) != 0 ||
+        strcmp(from.apName, to.apName) != 0) {
+        changes |= CONFIG_CHANGE_MQTT;
+    }
+    // The node id is part of every topic
+    if (strcmp(from.mqttTopicPrefixIn, to.mqttTopicPrefixIn) != 0 || strcmp(from.mqttTopicPrefixOut, to.mqttTopicPrefixOut) != 0 ||
+        from.nodeId != to.nodeId) {
+        changes |= CONFIG_CHANGE_TOPICS;
+    }
+    if (strcmp(from.apUser, to.apUser) != 0 || strcmp(from.apPassword, to.apPassword) != 0 || from.expertMode != to.expertMode) {
+        changes |= CONFIG_CHANGE_STORED;
+    }
+
+    return changes;
+}
+
+static void addChangeNames(JsonArray names, uint8_t changes) {
+    if (changes & (CONFIG_CHANGE_RADIO_ADDRESS | CONFIG_CHANGE_RADIO_POWER | CONFIG_CHANGE_RADIO_KEY)) names.add("radio");
+    if (changes & CONFIG_CHANGE_WIFI) names.add("wifi");
+    if (changes & CONFIG_CHANGE_MQTT) names.add("mqtt");
+    if (changes & CONFIG_CHANGE_TOPICS) names.add("topics");
+    if (changes & CONFIG_CHANGE_STORED) names.add("stored");
+}
+
+static bool copyConfigString(JsonVariantConst value, char* target, size_t maxLength, const char* name, String& error) {
+    if (value.isNull()) return true;
+
+    const char* text = value | "";
+    if (strlen(text) > maxLength) {
+        error = String(name) + " too long";
+        return false;
+    }
+    strncpy(target, text, maxLength);
+    target[maxLength] = '\0';
+    return true;
+}
+
+static bool copyConfigAddress(JsonVariantConst value, IPAddress& target, const char* name, String& error) {
+    if (value.isNull()) return true;
+
+    if (!target.fromString(value | "")) {
+        error = String("invalid ") + name;
+        return false;
+    }
+    return true;
+}
+
+// Checked as a long, before it is narrowed into its GatewayConfig field
+static bool copyConfigNumber(JsonVariantConst value, long minValue, long maxValue, long& target, const char* name, String& error) {
+    if (value.isNull()) return true;
+
+    if (!value.is<long>() || value.as<long>() < minValue || value.as<long>() > maxValue) {
+        error = String(name) + " must be " + String(minValue) + "-" + String(maxValue);
+        return false;
+    }
+    target = value.as<long>();
+    return true;
+}
+
+// Fields the portal only offers in expert mode
+static const char* const expertFields[] = {
+    "nodeId", "radioPower", "apName", "mqttServer", "mqttPort", "mqttUser", "mqttPass", "mqttTopicPrefixIn", "mqttTopicPrefixOut"
+};
+
+// Fields present in 'json' replace those of 'config'; names are those of GatewayConfig
+static bool configFromJson(JsonVariantConst json, GatewayConfig& config, String& error) {
+    if (!config.expertMode) {
+        for (const char* field : expertFields) {
+            if (!json[field].isNull()) {
+                error = String(field) + " requires expert mode";
+                return false;
+            }
+        }
+    }
+
+    long networkId = config.networkId;
+    long nodeId = config.nodeId;
+    long radioPower = config.radioPower;
+    long mqttPort = config.mqttPort;
+    if (!copyConfigNumber(json["networkId"], 1, 255, networkId, "networkId", error) ||
+        !copyConfigNumber(json["nodeId"], 1, 255, nodeId, "nodeId", error) ||
+        !copyConfigNumber(json["radioPower"], 0, 31, radioPower, "radioPower", error) ||
+        !copyConfigNumber(json["mqttPort"], 1, 65535, mqttPort, "mqttPort", error)) {
+        return false;
+    }
+    config.networkId = networkId;
+    config.nodeId = nodeId;
+    config.radioPower = radioPower;
+    config.mqttPort = mqttPort;
+    if (!json["dhcp"].isNull()) config.dhcp = json["dhcp"];
+
+    if (!copyConfigString(json["encryptionKey"], config.encryptionKey, ENCRYPTION_KEY_LENGTH, "encryptionKey", error) ||
+        !copyConfigString(json["wifiSSID"], config.wifiSSID, MAX_SSID_LENGTH, "wifiSSID", error) ||
+        !copyConfigString(json["wifiPassword"], config.wifiPassword, MAX_PASSWORD_LENGTH, "wifiPassword", error) ||
+        !copyConfigString(json["mqttServer"], config.mqttServer, MAX_STRING_LENGTH, "mqttServer", error) ||
+        !copyConfigString(json["mqttUser"], config.mqttUser, MAX_STRING_LENGTH, "mqttUser", error) ||
+        !copyConfigString(json["mqttPass"], config.mqttPass, MAX_PASSWORD_LENGTH, "mqttPass", error) ||
+        !copyConfigString(json["mqttTopicPrefixIn"], config.mqttTopicPrefixIn, MAX_STRING_LENGTH, "mqttTopicPrefixIn", error) ||
+        !copyConfigString(json["mqttTopicPrefixOut"], config.mqttTopicPrefixOut, MAX_STRING_LENGTH, "mqttTopicPrefixOut", error) ||
+        !copyConfigString(json["apName"], config.apName, MAX_SSID_LENGTH, "apName", error) ||
+        !copyConfigString(json["apUser"], config.apUser, MAX_STRING_LENGTH, "apUser", error) ||
+        !copyConfigString(json["apPassword"], config.apPassword, MAX_PASSWORD_LENGTH, "apPassword", error) ||
+        !copyConfigAddress(json["staticIP"], config.staticIP, "staticIP", error) ||
+        !copyConfigAddress(json["netmask"], config.netmask, "netmask", error) ||
+        !copyConfigAddress(json["gateway"], config.gateway, "gateway", error) ||
+        !copyConfigAddress(json["dns1"], config.dns1, "dns1", error) ||
+        !copyConfigAddress(json["dns2"], config.dns2, "dns2", error)) {
+        return false;
+    }
+
+    if (strlen(config.encryptionKey) != 0 && strlen(config.encryptionKey) != ENCRYPTION_KEY_LENGTH) {
+        error = "encryptionKey must be 16 characters";
+        return false;
+    }
+    if (strlen(config.wifiSSID) == 0 || strlen(config.mqttServer) == 0) {
+        error = "wifiSSID and mqttServer are required";
+        return false;
+    }
+
+    return true;
+}
+
+// Parse a change request and queue it for the main loop. Returns the subsystems it touches.
+static bool queueConfigChange(const char* json, size_t length, uint8_t& changes, String& error) {
+    if (configPending || reconnectPending) {
+        error = "previous change still pending";
+        return false;
+    }
+
+    DynamicJsonDocument doc(1024);
+    DeserializationError parseError = deserializeJson(doc, json, length);
+    if (parseError) {
+        error = String("invalid JSON: ") + parseError.c_str();
+        return false;
+    }
+
+    GatewayConfig config = activeConfig;
+    if (!configFromJson(doc.as<JsonVariantConst>(), config, error)) {
+        return false;
+    }
+
+    changes = configChanges(activeConfig, config);
+    if (changes == 0) {
+        return true;
+    }
+
+    pendingConfig = config;
+    configPending = true;
+    return true;
+}
+
+static void publishConfigResponse(bool ok, uint8_t changes, unsigned long applyMs, bool saved, const String& error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(256);
+    response["command"] = "config";
+    response["success"] = ok;
+    if (ok) {
+        addChangeNames(response.createNestedArray("changed"), changes);
+        response["applyMs"] = applyMs;
+        response["saved"] = saved;
+    } else {
+        response["error"] = error;
+    }
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/config";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+static void applyRadioConfig(GatewayRadio& target, uint8_t changes, bool followNetwork) {
+    if (changes & CONFIG_CHANGE_RADIO_ADDRESS) {
+        if (followNetwork) {
+            target.changeNetwork(activeConfig.networkId);
+        }
+        target.setAddress(activeConfig.nodeId);
+    }
+    if (changes & CONFIG_CHANGE_RADIO_POWER) {
+        target.setPowerLevel(activeConfig.radioPower);
+    }
+    if (changes & CONFIG_CHANGE_RADIO_KEY) {
+        target.encrypt(strlen(activeConfig.encryptionKey) > 0 ? activeConfig.encryptionKey : nullptr);
+    }
+}
+
+// Restart only what the change touches; everything else keeps running
+static void applyPendingConfig(bool rollback) {
+    unsigned long start = millis();
+    uint8_t changes = configChanges(activeConfig, pendingConfig);
+    String oldCommandTopic = mqttCommandTopic;
+
+    // A rollback restores settings that are still in flash, it is not armed again
+    bool network = (changes & (CONFIG_CHANGE_WIFI | CONFIG_CHANGE_MQTT)) != 0;
+    if (network && !rollback) {
+        previousConfig = activeConfig;
+        rolledBack = false;
+        reconnectPending = true;
+        reconnectDeadline = millis() + LIVE_CONFIG_ROLLBACK_MS;
+    }
+
+    activeConfig = pendingConfig;
+    configPending = false;
+
+    if (radioInitialized) {
+        applyRadioConfig(radio, changes, true);
+#if RFM69_SECOND_RADIO
+        if (radio2.ready()) {
+            radio2.use();
+            applyRadioConfig(radio2, changes, RFM69_2_NETWORK_ID == 0);
+            radio.use();
+        }
+#endif
+        if (changes & CONFIG_CHANGE_RADIO_KEY) {
+            // AES padding changes frame airtime
+            initializeAirtime();
+        }
+    }
+
+    if (changes & CONFIG_CHANGE_TOPICS) {
+        setupMqttTopics();
+    }
+
+    if (changes & (CONFIG_CHANGE_WIFI | CONFIG_CHANGE_MQTT)) {
+        mqttClient.disconnect();
+        mqttConnected = false;
+        mqttClient.setServer(activeConfig.mqttServer, activeConfig.mqttPort);
+#if MQTT_TLS
+        initializeMqttTls();
+#endif
+        // Reconnect on the next loop pass, the new topics are subscribed on connect
+        lastMqttReconnect = 0;
+    }
+
+    if (changes & CONFIG_CHANGE_WIFI) {
+        // The loop sees the lost connection and reconnects with the new settings
+        if (activeConfig.dhcp) {
+            WiFi.config(IPAddress(), IPAddress(), IPAddress(), IPAddress(), IPAddress());
+        }
+        WiFi.disconnect();
+        wifiConnected = false;
+    } else if (!(changes & CONFIG_CHANGE_MQTT) && (changes & CONFIG_CHANGE_TOPICS) && mqttClient.connected()) {
+        // Same connection, only the subscription moves
+        mqttClient.unsubscribe((oldCommandTopic + "/#").c_str());
+        mqttClient.subscribe((mqttCommandTopic + "/#").c_str());
+        publishStatus();
+    }
+
+    unsigned long applyMs = millis() - start;
+    configApplied++;
+
+    debugLog("Configuration applied live in " + String(applyMs) + " ms");
+    printConfig(activeConfig);
+
+    // A broker or network change is saved and reported once the new connection is up
+    if (network) {
+        responseChanges = changes;
+        responseApplyMs = applyMs;
+    } else {
+        publishConfigResponse(true, changes, applyMs, saveConfig(activeConfig), "");
+    }
+}
+
+// Called by connectMqtt() once subscribed
+void publishPendingConfigResponse() {
+    if (!mqttConnected) return;
+
+    if (reconnectPending) {
+        reconnectPending = false;
+        publishConfigResponse(true, responseChanges, responseApplyMs, saveConfig(activeConfig), "");
+    } else if (rolledBack) {
+        rolledBack = false;
+        publishConfigResponse(false, 0, 0, false, "no connection with the new settings, previous configuration restored");
+    }
+}
+
+void handleLiveConfigLoop() {
+    if (reconnectPending && (long)(millis() - reconnectDeadline) >= 0) {
+        debugLog("No connection with the new settings, restoring the previous configuration");
+        reconnectPending = false;
+        rolledBack = true;
+        pendingConfig = previousConfig;
+        applyPendingConfig(true);
+    } else if (configPending) {
+        applyPendingConfig(false);
+    }
+}
+
+// command/config: JSON with the GatewayConfig fields to change
+void handleConfigCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    uint8_t changes = 0;
+    String error;
+    if (!queueConfigChange((const char*)payload, length, changes, error)) {
+        debugLog("Config command rejected: " + error);
+        publishConfigResponse(false, 0, 0, false, error);
+    } else if (changes == 0) {
+        publishConfigResponse(true, 0, 0, false, "");
+    }
+}
+
+// The API is on the station LAN, it takes the device's own portal login
+static bool apiConfigAuthenticated(AsyncWebServerRequest *request) {
+    if (request->authenticate(activeConfig.apUser, activeConfig.apPassword)) {
+        return true;
+    }
+    request->requestAuthentication();
+    return false;
+}
+
+static void handleApiConfigGet(AsyncWebServerRequest *request) {
+    if (!apiConfigAuthenticated(request)) return;
+
+    DynamicJsonDocument doc(1024);
+    doc["networkId"] = activeConfig.networkId;
+    doc["nodeId"] = activeConfig.nodeId;
+    doc["radioPower"] = activeConfig.radioPower;
+    doc["dhcp"] = activeConfig.dhcp;
+    doc["staticIP"] = activeConfig.staticIP.toString();
+    doc["netmask"] = activeConfig.netmask.toString();
+    doc["gateway"] = activeConfig.gateway.toString();
+    doc["dns1"] = activeConfig.dns1.toString();
+    doc["dns2"] = activeConfig.dns2.toString();
+    doc["wifiSSID"] = activeConfig.wifiSSID;
+    doc["mqttServer"] = activeConfig.mqttServer;
+    doc["mqttPort"] = activeConfig.mqttPort;
+    doc["mqttUser"] = activeConfig.mqttUser;
+    doc["mqttTopicPrefixIn"] = activeConfig.mqttTopicPrefixIn;
+    doc["mqttTopicPrefixOut"] = activeConfig.mqttTopicPrefixOut;
+    doc["apName"] = activeConfig.apName;
+    doc["expertMode"] = activeConfig.expertMode;
+
+    String jsonString;
+    serializeJson(doc, jsonString);
+    request->send(200, "application/json", jsonString);
+}
+
+static void handleApiConfigBody(AsyncWebServerRequest *request, uint8_t* data, size_t length, size_t index, size_t total) {
+    if (total > LIVE_CONFIG_BODY_MAX || index + length > LIVE_CONFIG_BODY_MAX) {
+        configBodyLength = 0;
+        return;
+    }
+    memcpy(configBody + index, data, length);
+    configBodyLength = index + length;
+}
+
+// POST /api/config with the fields to change and "password" (the expert mode password)
+static void handleApiConfigPost(AsyncWebServerRequest *request) {
+    if (!apiConfigAuthenticated(request)) {
+        configBodyLength = 0;
+        return;
+    }
+
+    String error;
+    uint8_t changes = 0;
+
+    StaticJsonDocument<128> auth;
+    configBody[configBodyLength] = '\0';
+    deserializeJson(auth, configBody, configBodyLength);
+    const char* password = auth["password"] | "";
+
+    if (configBodyLength == 0) {
+        error = "missing or oversized body";
+    } else if (strcmp(password, DEF_CFG_ENABLE_EXPERT_CONF_PASS) != 0) {
+        request->send(403, "application/json", "{\"success\":false,\"error\":\"invalid password\"}");
+        configBodyLength = 0;
+        return;
+    } else {
+        queueConfigChange(configBody, configBodyLength, changes, error);
+    }
+    configBodyLength = 0;
+
+    DynamicJsonDocument response(256);
+    response["success"] = error.length() == 0;
+    if (error.length() > 0) {
+        response["error"] = error;
+    } else {
+        addChangeNames(response.createNestedArray("changed"), changes);
+    }
+
+    String responseString;
+    serializeJson(response, responseString);
+    request->send(error.length() > 0 ? 400 : 202, "application/json", responseString);
+}
+
+void initializeLiveConfig() {
+    webServer.on("/api/config", HTTP_GET, handleApiConfigGet);
+    webServer.on("/api/config", HTTP_POST, handleApiConfigPost, nullptr, handleApiConfigBody);
+}
+
+void publishLiveConfigStats() {
+    if (!mqttConnected) return;
+
+    char stats[64];
+    snprintf(stats, sizeof(stats), "{\"applied\":%lu}", (unsigned long)configApplied);
+
+    String statsTopic = mqttBaseTopic + "/stats/config";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
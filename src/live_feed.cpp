@@ -0,0 +1,231 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <ESP8266WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+// The configuration portal's server, in normal mode it serves the live feed
+extern AsyncWebServer webServer;
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+static AsyncWebSocket liveSocket("/ws");
+
+// Per-client counters; queue depth comes from the client itself
+struct LiveClient {
+    uint32_t id;                    // 0 = unused
+    uint32_t sent;
+    uint32_t dropped;               // Frames not queued because the client was behind
+    uint32_t coalesced;             // Stats updates skipped, the next one replaces them
+};
+
+static LiveClient liveClients[LIVE_FEED_MAX_CLIENTS];
+static unsigned long lastLiveStats = 0;
+static unsigned long lastLiveCleanup = 0;
+
+// Link statistics for the stats message
+static uint32_t liveFrames = 0;
+static uint32_t liveFramesAtStats = 0;
+static int16_t liveLastRssi = 0;
+
+static const char LIVE_PAGE[] PROGMEM = R"**(
+<!DOCTYPE html>
+<html>
+<head>
+    <title>MPS Hub Gateway - Live</title>
+    <meta name="viewport" content="width=device-width, initial-scale=1">
+    <style>
+        body { font-family: monospace; margin: 10px; background: #f0f0f0; }
+        #stats { background: white; padding: 6px; border-radius: 6px; margin-bottom: 8px; }
+        #frames { background: white; padding: 6px; border-radius: 6px; height: 80vh; overflow-y: scroll; white-space: pre; }
+    </style>
+</head>
+<body>
+<div id="stats">connecting...</div>
+<div id="frames"></div>
+<script>
+    var frames = document.getElementById('frames');
+    var ws = new WebSocket('ws://' + location.host + '/ws');
+    ws.onmessage = function(e) {
+        var m = JSON.parse(e.data);
+        if (m.type == 'stats') {
+            document.getElementById('stats').textContent = 'frames ' + m.frames + ' (' + m.perSec + '/s), last RSSI ' + m.lastRssi + ' dBm, heap ' + m.freeHeap;
+            return;
+        }
+        var line = document.createElement('div');
+        line.textContent = new Date().toISOString().substr(11, 12) + ' ' + m.sender + ' > ' + m.target + ' ' + m.rssi + ' dBm ' + m.data;
+        frames.insertBefore(line, frames.firstChild);
+        while (frames.childNodes.length > 200) frames.removeChild(frames.lastChild);
+    };
+    ws.onclose = function() { document.getElementById('stats').textContent = 'disconnected'; };
+</script>
+</body>
+</html>
+)**";
+
+static LiveClient* findLiveClient(uint32_t id) {
+    for (uint8_t i = 0; i < LIVE_FEED_MAX_CLIENTS; i++) {
+        if (liveClients[i].id == id) return &liveClients[i];
+    }
+    return nullptr;
+}
+
+static void onLiveSocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length) {
+    if (type == WS_EVT_CONNECT) {
+        LiveClient* slot = findLiveClient(0);
+        if (slot == nullptr) {
+            client->close();
+            return;
+        }
+        memset(slot, 0, sizeof(LiveClient));
+        slot->id = client->id();
+
+        // A slow browser loses frames instead of its connection
+        client->setCloseClientOnQueueFull(false);
+        debugLog("Live feed client " + String(client->id()) + " connected: " + client->remoteIP().toString());
+    } else if (type == WS_EVT_DISCONNECT) {
+        LiveClient* slot = findLiveClient(client->id());
+        if (slot != nullptr) {
+            slot->id = 0;
+        }
+    }
+}
+
+void initializeLiveFeed() {
+    memset(liveClients, 0, sizeof(liveClients));
+
+    liveSocket.onEvent(onLiveSocketEvent);
+    webServer.addHandler(&liveSocket);
+    webServer.on("/live", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send_P(200, "text/html", LIVE_PAGE);
+    });
+    webServer.begin();
+
+    debugLog("Live feed at http://" + WiFi.localIP().toString() + "/live");
+}
+
+// Queue one encoded message to every client that keeps up. The buffer is shared,
+// so a message is encoded once no matter how many clients there are.
+static void sendToLiveClients(const JsonDocument& doc, bool coalesce) {
+    size_t length = measureJson(doc);
+    AsyncWebSocketSharedBuffer buffer = std::make_shared<std::vector<uint8_t>>(length + 1);
+    serializeJson(doc, (char*)buffer->data(), length + 1);
+    buffer->resize(length);
+
+    for (AsyncWebSocketClient& client : liveSocket.getClients()) {
+        LiveClient* slot = findLiveClient(client.id());
+        if (slot == nullptr || client.status() != WS_CONNECTED) continue;
+
+        if (client.queueLen() >= LIVE_FEED_CLIENT_QUEUE) {
+            if (coalesce) {
+                slot->coalesced++;
+            } else {
+                slot->dropped++;
+            }
+            continue;
+        }
+
+        if (client.text(buffer)) {
+            slot->sent++;
+        } else {
+            slot->dropped++;
+        }
+    }
+}
+
+void liveFeedFrame(const RadioFrame& frame) {
+    liveFrames++;
+    liveLastRssi = frame.rssi;
+
+    if (liveSocket.count() == 0) return;
+
+    char hex[RF69_MAX_DATA_LEN * 2 + 1];
+    for (uint8_t i = 0; i < frame.length; i++) {
+        snprintf(hex + i * 2, 3, "%02x", frame.data[i]);
+    }
+    hex[frame.length * 2] = '\0';
+
+    StaticJsonDocument<384> doc;
+    doc["type"] = "frame";
+    doc["sender"] = frame.senderId;
+    doc["target"] = frame.targetId;
+    doc["rssi"] = frame.rssi;
+    doc["ctl"] = frame.ctl;
+    if (frame.radioIndex != 0) {
+        doc["radio"] = frame.radioIndex + 1;
+    }
+    doc["data"] = (const char*)hex;
+    if (timeSynced()) {
+        doc["rxTime"] = epochMillisAt(frame.rxMicros);
+    }
+
+    sendToLiveClients(doc, false);
+}
+
+void handleLiveFeedLoop() {
+    if (millis() - lastLiveCleanup > 1000) {
+        liveSocket.cleanupClients(LIVE_FEED_MAX_CLIENTS);
+        lastLiveCleanup = millis();
+    }
+
+    if (millis() - lastLiveStats < LIVE_FEED_STATS_MS) return;
+
+    unsigned long elapsed = millis() - lastLiveStats;
+    lastLiveStats = millis();
+    uint32_t frames = liveFrames - liveFramesAtStats;
+    liveFramesAtStats = liveFrames;
+
+    if (liveSocket.count() == 0) return;
+
+    DynamicJsonDocument doc(768);
+    doc["type"] = "stats";
+    doc["frames"] = liveFrames;
+    doc["perSec"] = frames * 1000.0f / elapsed;
+    doc["lastRssi"] = liveLastRssi;
+    doc["wifiRSSI"] = WiFi.RSSI();
+    doc["freeHeap"] = ESP.getFreeHeap();
+
+    JsonArray clients = doc.createNestedArray("clients");
+    for (AsyncWebSocketClient& client : liveSocket.getClients()) {
+        LiveClient* slot = findLiveClient(client.id());
+        if (slot == nullptr) continue;
+
+        JsonObject entry = clients.createNestedObject();
+        entry["id"] = slot->id;
+        entry["queue"] = client.queueLen();
+        entry["sent"] = slot->sent;
+        entry["dropped"] = slot->dropped;
+        entry["coalesced"] = slot->coalesced;
+    }
+
+    sendToLiveClients(doc, true);
+}
+
+void publishLiveFeedStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(768);
+    doc["clients"] = liveSocket.count();
+
+    JsonArray clients = doc.createNestedArray("perClient");
+    for (AsyncWebSocketClient& client : liveSocket.getClients()) {
+        LiveClient* slot = findLiveClient(client.id());
+        if (slot == nullptr) continue;
+
+        JsonObject entry = clients.createNestedObject();
+        entry["id"] = slot->id;
+        entry["ip"] = client.remoteIP().toString();
+        entry["queue"] = client.queueLen();
+        entry["sent"] = slot->sent;
+        entry["dropped"] = slot->dropped;
+        entry["coalesced"] = slot->coalesced;
+    }
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/live";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
@@ -0,0 +1,260 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include "loop_watchdog.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+#include <Ticker.h>
+#include <user_interface.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define POST_MORTEM_MAGIC           0x574C5047  // "GPLW"
+#define LOOP_STAGE_DEPTH            4
+
+static const char* const stageNames[LOOP_STAGE_COUNT] = {
+    "boot", "wifi", "mqttConnect", "mqttLoop", "radioRx", "radioTx", "mailbox", "nodeOta",
+    "capture", "udpBridge", "liveFeed", "config", "status", "idle", "log"
+};
+
+// Kept in RTC user memory, which survives every reset but a power cycle. The first
+// three words are rewritten on each stage change, the rest by the watchdog tick.
+struct PostMortem {
+    uint32_t magic;
+    uint8_t stage;
+    uint8_t lastSender;
+    uint8_t lastLength;
+    int8_t lastRssi;
+    uint32_t stageMs;
+    uint32_t freeHeap;
+    uint32_t maxBlock;
+    uint32_t uptimeS;
+    uint32_t lastFrameAgeMs;        // 0xFFFFFFFF = no frame received
+    uint8_t watchdogReset;          // Restarted by this watchdog, not by the SDK
+    uint8_t reserved[3];
+};
+
+static PostMortem record;
+static PostMortem previousRecord;
+static bool previousValid = false;
+static uint32_t previousReason = REASON_DEFAULT_RST;
+static bool postMortemPublished = false;
+
+// Active stage and the outer stages it interrupted
+static volatile uint8_t currentStage = STAGE_BOOT;
+static volatile unsigned long stageStart = 0;
+static volatile bool stageStallCounted = false;
+static uint8_t outerStage[LOOP_STAGE_DEPTH];
+static unsigned long outerStart[LOOP_STAGE_DEPTH];
+static bool outerStallCounted[LOOP_STAGE_DEPTH];
+static uint8_t stageDepth = 0;
+
+static volatile uint32_t stageStalls[LOOP_STAGE_COUNT];
+static uint32_t stageMaxMs[LOOP_STAGE_COUNT];
+static uint8_t lastStallStage = STAGE_BOOT;
+static uint32_t lastStallMs = 0;
+static unsigned long lastStallAt = 0;
+static unsigned long lastFrameAt = 0;
+static bool frameSeen = false;
+
+static Ticker watchdogTicker;
+static bool watchdogRunning = false;
+
+static void writeRecord(size_t length) {
+    ESP.rtcUserMemoryWrite(LOOP_WATCHDOG_RTC_BLOCK, (uint32_t*)&record, length);
+}
+
+// Runs from the SDK timer, so only while the loop yields: blocking network and
+// radio calls do, a hard lockup ends in the SDK watchdog with the last record.
+static void watchdogTick() {
+    uint32_t elapsed = millis() - stageStart;
+
+    record.stageMs = elapsed;
+    record.freeHeap = ESP.getFreeHeap();
+    record.maxBlock = ESP.getMaxFreeBlockSize();
+    record.uptimeS = millis() / 1000;
+    record.lastFrameAgeMs = frameSeen ? millis() - lastFrameAt : 0xFFFFFFFF;
+
+    if (elapsed > LOOP_STALL_MS && !stageStallCounted) {
+        stageStallCounted = true;
+        stageStalls[currentStage]++;
+    }
+
+    if (LOOP_WATCHDOG_RESET_MS > 0 && elapsed > LOOP_WATCHDOG_RESET_MS) {
+        record.watchdogReset = 1;
+        writeRecord(sizeof(record));
+        // ESP.restart() must not be called from timer context
+        system_restart();
+        return;
+    }
+
+    writeRecord(sizeof(record));
+}
+
+void initializeLoopWatchdog() {
+    previousReason = ESP.getResetInfoPtr()->reason;
+    previousValid = ESP.rtcUserMemoryRead(LOOP_WATCHDOG_RTC_BLOCK, (uint32_t*)&previousRecord, sizeof(previousRecord)) &&
+                    previousRecord.magic == POST_MORTEM_MAGIC && previousRecord.stage < LOOP_STAGE_COUNT;
+
+    // Only resets the firmware did not ask for leave a post-mortem worth reporting
+    if (previousValid && !previousRecord.watchdogReset && previousReason != REASON_WDT_RST &&
+        previousReason != REASON_EXCEPTION_RST && previousReason != REASON_SOFT_WDT_RST) {
+        previousValid = false;
+    }
+
+    if (previousValid) {
+        debugLog("Post-mortem: reset in stage " + String(stageNames[previousRecord.stage]) + " after " +
+                 String(previousRecord.stageMs) + " ms, reason " + ESP.getResetReason());
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.magic = POST_MORTEM_MAGIC;
+    record.stage = STAGE_BOOT;
+    record.lastFrameAgeMs = 0xFFFFFFFF;
+    writeRecord(sizeof(record));
+}
+
+void startLoopWatchdog() {
+    if (watchdogRunning) return;
+
+    stageStart = millis();
+    watchdogTicker.attach_ms(LOOP_WATCHDOG_TICK_MS, watchdogTick);
+    watchdogRunning = true;
+}
+
+// The configuration portal has no loop stages, it would look like a stall
+void stopLoopWatchdog() {
+    if (!watchdogRunning) return;
+
+    watchdogTicker.detach();
+    watchdogRunning = false;
+}
+
+static void closeStage(unsigned long now) {
+    uint32_t elapsed = now - stageStart;
+    uint8_t stage = currentStage;
+
+    if (elapsed > stageMaxMs[stage]) {
+        stageMaxMs[stage] = elapsed;
+    }
+    if (elapsed > LOOP_STALL_MS) {
+        if (!stageStallCounted) {
+            stageStalls[stage]++;
+        }
+        lastStallStage = stage;
+        lastStallMs = elapsed;
+        lastStallAt = now;
+    }
+}
+
+static void openStage(uint8_t stage, unsigned long start, bool stallCounted) {
+    currentStage = stage;
+    stageStart = start;
+    stageStallCounted = stallCounted;
+
+    if (watchdogRunning) {
+        record.stage = stage;
+        record.stageMs = millis() - start;
+        writeRecord(3 * sizeof(uint32_t));
+    }
+}
+
+// Main loop stage change, ends all nested stages
+void loopStage(LoopStage stage) {
+    unsigned long now = millis();
+    closeStage(now);
+    stageDepth = 0;
+    openStage(stage, now, false);
+}
+
+// Stage inside another one, e.g. a blocking radio transmission from an MQTT command
+void enterLoopStage(LoopStage stage) {
+    if (stageDepth >= LOOP_STAGE_DEPTH) return;
+
+    outerStage[stageDepth] = currentStage;
+    outerStart[stageDepth] = stageStart;
+    outerStallCounted[stageDepth] = stageStallCounted;
+    stageDepth++;
+    openStage(stage, millis(), false);
+}
+
+void leaveLoopStage() {
+    if (stageDepth == 0) return;
+
+    closeStage(millis());
+    stageDepth--;
+    // The outer stage keeps its original start, its time includes the nested one
+    openStage(outerStage[stageDepth], outerStart[stageDepth], outerStallCounted[stageDepth]);
+}
+
+void loopWatchdogFrame(const RadioFrame& frame) {
+    record.lastSender = frame.senderId;
+    record.lastLength = frame.length;
+    record.lastRssi = frame.rssi;
+    lastFrameAt = millis();
+    frameSeen = true;
+}
+
+// Published once per boot, retained so it is there for whoever looks later
+void publishLoopWatchdogPostMortem() {
+    if (!mqttConnected || !previousValid || postMortemPublished) return;
+
+    DynamicJsonDocument doc(384);
+    doc["reason"] = ESP.getResetReason();
+    doc["watchdogReset"] = previousRecord.watchdogReset != 0;
+    doc["stage"] = stageNames[previousRecord.stage];
+    doc["stageMs"] = previousRecord.stageMs;
+    doc["freeHeap"] = previousRecord.freeHeap;
+    doc["maxBlock"] = previousRecord.maxBlock;
+    doc["uptimeS"] = previousRecord.uptimeS;
+
+    if (previousRecord.lastFrameAgeMs != 0xFFFFFFFF) {
+        JsonObject frame = doc.createNestedObject("lastFrame");
+        frame["senderId"] = previousRecord.lastSender;
+        frame["length"] = previousRecord.lastLength;
+        frame["rssi"] = previousRecord.lastRssi;
+        frame["ageMs"] = previousRecord.lastFrameAgeMs;
+    }
+
+    String postMortemString;
+    serializeJson(doc, postMortemString);
+
+    String postMortemTopic = mqttBaseTopic + "/postmortem";
+    postMortemPublished = mqttClient.publish(postMortemTopic.c_str(), postMortemString.c_str(), true);
+}
+
+void addLoopStallCounts(JsonObject stalls) {
+    for (uint8_t stage = 0; stage < LOOP_STAGE_COUNT; stage++) {
+        if (stageStalls[stage] > 0) {
+            stalls[stageNames[stage]] = stageStalls[stage];
+        }
+    }
+}
+
+void publishLoopWatchdogStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(1024);
+    doc["stallMs"] = LOOP_STALL_MS;
+
+    JsonObject stages = doc.createNestedObject("stages");
+    for (uint8_t stage = 0; stage < LOOP_STAGE_COUNT; stage++) {
+        JsonObject entry = stages.createNestedObject(stageNames[stage]);
+        entry["maxMs"] = stageMaxMs[stage];
+        entry["stalls"] = stageStalls[stage];
+    }
+
+    if (lastStallMs > 0) {
+        JsonObject lastStall = doc.createNestedObject("lastStall");
+        lastStall["stage"] = stageNames[lastStallStage];
+        lastStall["ms"] = lastStallMs;
+        lastStall["ageS"] = (millis() - lastStallAt) / 1000;
+    }
+
+    // Streamed, one entry per stage can exceed the MQTT client buffer
+    String statsTopic = mqttBaseTopic + "/stats/watchdog";
+    mqttClient.beginPublish(statsTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
@@ -16,6 +16,9 @@ void setup() {
     debugLog("ESP8266 RFM69 Gateway v2 Starting...");
     debugLog("Compiled: " + String(__DATE__) + " " + String(__TIME__));
     
+    // Report what the previous run was doing if it ended in a reset
+    initializeLoopWatchdog();
+    
     // Check configuration GPIO pin
     configModeRequested = checkConfigurationMode();
     
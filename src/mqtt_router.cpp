@@ -0,0 +1,193 @@
+#include "config.h"
+
+extern String mqttCommandTopic;
+
+// Command routes below mqttCommandTopic. Segments are matched literally,
+// '+' matches one numeric segment that is passed to the handler as a parameter.
+// Adding a command is one line here; lookup walks one trie level per topic
+// segment and compares a segment only with the siblings at its level.
+static void routeStatus(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    publishStatus();
+}
+
+static void routeReboot(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    debugLog("Reboot command received via MQTT");
+    ESP.restart();
+}
+
+struct MqttRoute {
+    const char* pattern;
+    MqttRouteHandler handler;
+};
+
+static const MqttRoute mqttRoutes[] = {
+    { "send",           handleRadioSendCommand },
+    { "send/+",         handleRadioSendCommand },
+    { "raw/+",          handleRadioRawCommand },
+    { "raw/+/ack",      handleRadioRawAckCommand },
+#if RFM69_SECOND_RADIO
+    { "radio2/raw/+",   handleRadio2RawCommand },
+    { "radio2/raw/+/ack", handleRadio2RawAckCommand },
+    { "radio2/get/+",   handleRadio2GetCommand },
+#endif
+    { "mbox/+",         handleMailboxCommand },
+    { "mbox/+/+",       handleMailboxCommand },
+    { "decoder/+",      handleDecoderCommand },
+    { "filter/+",       handleFilterCommand },
+    { "node/+",         handleNodeCommand },
+    { "get/+",          handleGetCommand },
+    { "group/+",        handleGroupCommand },
+    { "group/+/send",   handleGroupSendCommand },
+    { "survey",         handleSurveyCommand },
+    { "survey/move",    handleSurveyMoveCommand },
+    { "tdma",           handleTdmaCommand },
+    { "config",         handleConfigCommand },
+    { "status",         routeStatus },
+    { "reboot",         routeReboot },
+    { "fw/begin",       handleNodeOtaBegin },
+    { "fw/data/+",      handleNodeOtaData },
+    { "fw/push",        handleNodeOtaPush },
+    { "fw/abort",       handleNodeOtaAbort },
+    { "fw/status",      handleNodeOtaStatus },
+};
+
+// Trie compiled from mqttRoutes, node 0 is the root (the command topic itself)
+struct MqttRouteNode {
+    const char* segment;        // Points into the route pattern, not terminated
+    uint8_t length;
+    uint8_t firstChild;         // 0 = no child
+    uint8_t nextSibling;        // 0 = last sibling
+    MqttRouteHandler handler;
+};
+
+static MqttRouteNode routeNodes[MQTT_ROUTE_MAX_NODES];
+static uint8_t routeNodeCount = 0;
+
+// Command topic prefix, cached so matching needs no strlen per message
+static const char* routePrefix = nullptr;
+static size_t routePrefixLength = 0;
+
+static uint8_t findRouteChild(uint8_t parent, const char* segment, size_t length) {
+    for (uint8_t child = routeNodes[parent].firstChild; child != 0; child = routeNodes[child].nextSibling) {
+        if (routeNodes[child].length == length && memcmp(routeNodes[child].segment, segment, length) == 0) {
+            return child;
+        }
+    }
+    return 0;
+}
+
+static uint8_t addRouteChild(uint8_t parent, const char* segment, size_t length) {
+    uint8_t child = findRouteChild(parent, segment, length);
+    if (child != 0) {
+        return child;
+    }
+
+    if (routeNodeCount >= MQTT_ROUTE_MAX_NODES) {
+        debugLog("MQTT route table full");
+        return 0;
+    }
+
+    child = routeNodeCount++;
+    routeNodes[child].segment = segment;
+    routeNodes[child].length = length;
+    routeNodes[child].firstChild = 0;
+    routeNodes[child].handler = nullptr;
+
+    // Literal segments are tried before the '+' wildcard, so keep wildcards last
+    uint8_t* link = &routeNodes[parent].firstChild;
+    if (!(length == 1 && segment[0] == '+')) {
+        while (*link != 0 && !(routeNodes[*link].length == 1 && routeNodes[*link].segment[0] == '+')) {
+            link = &routeNodes[*link].nextSibling;
+        }
+    } else {
+        while (*link != 0) {
+            link = &routeNodes[*link].nextSibling;
+        }
+    }
+    routeNodes[child].nextSibling = *link;
+    *link = child;
+
+    return child;
+}
+
+void buildMqttRoutes() {
+    memset(routeNodes, 0, sizeof(routeNodes));
+    routeNodeCount = 1;
+
+    for (size_t i = 0; i < sizeof(mqttRoutes) / sizeof(mqttRoutes[0]); i++) {
+        uint8_t node = 0;
+        const char* segment = mqttRoutes[i].pattern;
+
+        while (true) {
+            const char* slash = strchr(segment, '/');
+            size_t length = slash ? (size_t)(slash - segment) : strlen(segment);
+
+            node = addRouteChild(node, segment, length);
+            if (node == 0 || !slash) break;
+            segment = slash + 1;
+        }
+
+        if (node != 0) {
+            routeNodes[node].handler = mqttRoutes[i].handler;
+        }
+    }
+
+    routePrefix = mqttCommandTopic.c_str();
+    routePrefixLength = mqttCommandTopic.length();
+
+    debugLog("MQTT command routes: " + String(sizeof(mqttRoutes) / sizeof(mqttRoutes[0])) + " (" + String(routeNodeCount) + " trie nodes)");
+}
+
+static bool parseRouteNumber(const char* segment, size_t length, uint32_t& value) {
+    if (length == 0 || length > 9) return false;
+
+    value = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (segment[i] < '0' || segment[i] > '9') return false;
+        value = value * 10 + (segment[i] - '0');
+    }
+    return true;
+}
+
+bool dispatchMqttCommand(const char* topic, const byte* payload, unsigned int length) {
+    if (routePrefix == nullptr || strncmp(topic, routePrefix, routePrefixLength) != 0 || topic[routePrefixLength] != '/') {
+        return false;
+    }
+
+    MqttRouteParams params;
+    params.count = 0;
+
+    uint8_t node = 0;
+    const char* segment = topic + routePrefixLength + 1;
+
+    while (true) {
+        const char* slash = strchr(segment, '/');
+        size_t segmentLength = slash ? (size_t)(slash - segment) : strlen(segment);
+
+        uint8_t child = findRouteChild(node, segment, segmentLength);
+        if (child == 0) {
+            // Fall back to the wildcard, which is always the last sibling
+            uint8_t last = routeNodes[node].firstChild;
+            while (last != 0 && routeNodes[last].nextSibling != 0) {
+                last = routeNodes[last].nextSibling;
+            }
+            if (last == 0 || routeNodes[last].segment[0] != '+' || params.count >= MQTT_ROUTE_MAX_PARAMS ||
+                !parseRouteNumber(segment, segmentLength, params.values[params.count])) {
+                return false;
+            }
+            params.count++;
+            child = last;
+        }
+
+        node = child;
+        if (!slash) break;
+        segment = slash + 1;
+    }
+
+    if (routeNodes[node].handler == nullptr) {
+        return false;
+    }
+
+    routeNodes[node].handler(params, payload, length);
+    return true;
+}
@@ -0,0 +1,85 @@
+#include "config.h"
+
+#if MQTT_TLS
+
+#include "mqtt_transport.h"
+#include <WiFiClientSecureBearSSL.h>
+#include <PubSubClient.h>
+
+extern BearSSL::WiFiClientSecure wifiClient;
+extern MqttTransport mqttTransport;
+extern PubSubClient mqttClient;
+extern GatewayConfig activeConfig;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Kept across connections, so a reconnect resumes the session with an
+// abbreviated handshake instead of a full key exchange
+static BearSSL::Session tlsSession;
+static BearSSL::X509List* tlsTrustAnchors = nullptr;
+static bool tlsMflnNegotiated = false;
+static bool tlsMflnProbed = false;
+
+// Also called after a broker change, the new broker gets a fresh probe and session
+void initializeMqttTls() {
+    tlsSession = BearSSL::Session();
+    tlsMflnProbed = false;
+    wifiClient.setSession(&tlsSession);
+
+    if (strlen(MQTT_TLS_FINGERPRINT) > 0) {
+        wifiClient.setFingerprint(MQTT_TLS_FINGERPRINT);
+        debugLog("MQTT TLS: broker pinned by certificate fingerprint");
+    } else if (strlen(MQTT_TLS_CA_CERT) > 0) {
+        if (tlsTrustAnchors == nullptr) {
+            tlsTrustAnchors = new BearSSL::X509List(MQTT_TLS_CA_CERT);
+        }
+        wifiClient.setTrustAnchors(tlsTrustAnchors);
+        debugLog("MQTT TLS: broker validated against pinned CA");
+    } else {
+        wifiClient.setInsecure();
+        debugLog("MQTT TLS: no fingerprint or CA configured, broker certificate NOT verified");
+    }
+}
+
+// Called before every connect attempt. Returns false while the connection cannot succeed yet.
+bool prepareMqttTlsConnect() {
+    // Buffer sizes must be set before the handshake, and only shrink if the broker agrees
+    if (!tlsMflnProbed) {
+        tlsMflnNegotiated = wifiClient.probeMaxFragmentLength(activeConfig.mqttServer, activeConfig.mqttPort, MQTT_TLS_MFLN);
+        tlsMflnProbed = true;
+        if (tlsMflnNegotiated) {
+            wifiClient.setBufferSizes(MQTT_TLS_MFLN, MQTT_TLS_TX_BUFFER);
+            debugLog("MQTT TLS: max fragment length " + String(MQTT_TLS_MFLN) + " accepted");
+        } else {
+            debugLog("MQTT TLS: broker does not support max fragment length, using full buffers");
+        }
+    }
+
+    // Certificate validity needs the wall clock
+    if (strlen(MQTT_TLS_CA_CERT) > 0 && strlen(MQTT_TLS_FINGERPRINT) == 0) {
+        if (!timeSynced()) {
+            debugLog("MQTT TLS: waiting for SNTP before validating the broker certificate");
+            return false;
+        }
+        wifiClient.setX509Time(epochMillis() / 1000);
+    }
+
+    return true;
+}
+
+void publishMqttTlsStats() {
+    if (!mqttConnected) return;
+
+    char stats[224];
+    snprintf(stats, sizeof(stats),
+             "{\"handshakes\":%lu,\"failures\":%lu,\"lastMs\":%lu,\"avgMs\":%lu,\"heapCost\":%ld,\"mfln\":%u,\"freeHeap\":%lu,\"maxBlock\":%u}",
+             (unsigned long)mqttTransport.connects(), (unsigned long)mqttTransport.connectFailures(),
+             (unsigned long)mqttTransport.lastConnectMs(), (unsigned long)mqttTransport.avgConnectMs(),
+             (long)mqttTransport.connectHeapCost(), tlsMflnNegotiated ? MQTT_TLS_MFLN : 0,
+             (unsigned long)ESP.getFreeHeap(), ESP.getMaxFreeBlockSize());
+
+    String statsTopic = mqttBaseTopic + "/stats/tls";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
+
+#endif // MQTT_TLS
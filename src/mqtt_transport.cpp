@@ -0,0 +1,307 @@
+#include "config.h"
+#include "mqtt_transport.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern MqttTransport mqttTransport;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define MQTT_PACKET_PUBLISH     0x30
+#define MQTT_PACKET_PUBACK      0x40
+#define MQTT_FLAG_QOS1          0x02
+#define MQTT_FLAG_DUP           0x08
+
+enum SniffState {
+    SNIFF_HEADER,
+    SNIFF_LENGTH,
+    SNIFF_BODY
+};
+
+static void onMqttPuback(uint16_t packetId);
+
+MqttTransport::MqttTransport(Client& inner)
+    : _inner(&inner), _connects(0), _connectFailures(0), _lastConnectMs(0), _avgConnectMs(0), _connectHeapCost(0),
+      _state(SNIFF_HEADER), _type(0), _remaining(0), _multiplier(1), _packetId(0), _idBytes(0) {
+}
+
+int MqttTransport::recordConnect(int result, unsigned long start, uint32_t heapBefore) {
+    if (!result) {
+        _connectFailures++;
+        return result;
+    }
+
+    _lastConnectMs = millis() - start;
+    _avgConnectMs = _connects == 0 ? _lastConnectMs : (_avgConnectMs * 7 + _lastConnectMs) / 8;
+    _connectHeapCost = (int32_t)heapBefore - (int32_t)ESP.getFreeHeap();
+    _connects++;
+    return result;
+}
+
+int MqttTransport::connect(IPAddress ip, uint16_t port) {
+    _state = SNIFF_HEADER;
+    unsigned long start = millis();
+    uint32_t heapBefore = ESP.getFreeHeap();
+    return recordConnect(_inner->connect(ip, port), start, heapBefore);
+}
+
+int MqttTransport::connect(const char* host, uint16_t port) {
+    _state = SNIFF_HEADER;
+    unsigned long start = millis();
+    uint32_t heapBefore = ESP.getFreeHeap();
+    return recordConnect(_inner->connect(host, port), start, heapBefore);
+}
+
+size_t MqttTransport::write(uint8_t b) {
+    return _inner->write(b);
+}
+
+size_t MqttTransport::write(const uint8_t* buf, size_t size) {
+    return _inner->write(buf, size);
+}
+
+size_t MqttTransport::writeRaw(const uint8_t* buf, size_t size) {
+    return _inner->write(buf, size);
+}
+
+int MqttTransport::available() {
+    return _inner->available();
+}
+
+int MqttTransport::read() {
+    int b = _inner->read();
+    if (b >= 0) {
+        sniff(b);
+    }
+    return b;
+}
+
+int MqttTransport::read(uint8_t* buf, size_t size) {
+    int count = _inner->read(buf, size);
+    for (int i = 0; i < count; i++) {
+        sniff(buf[i]);
+    }
+    return count;
+}
+
+int MqttTransport::peek() {
+    return _inner->peek();
+}
+
+void MqttTransport::flush() {
+    _inner->flush();
+}
+
+void MqttTransport::stop() {
+    _state = SNIFF_HEADER;
+    _inner->stop();
+}
+
+uint8_t MqttTransport::connected() {
+    return _inner->connected();
+}
+
+MqttTransport::operator bool() {
+    return (bool)*_inner;
+}
+
+void MqttTransport::sniff(uint8_t b) {
+    switch (_state) {
+        case SNIFF_HEADER:
+            _type = b & 0xF0;
+            _remaining = 0;
+            _multiplier = 1;
+            _state = SNIFF_LENGTH;
+            break;
+
+        case SNIFF_LENGTH:
+            _remaining += (b & 0x7F) * _multiplier;
+            _multiplier <<= 7;
+            if (!(b & 0x80)) {
+                _packetId = 0;
+                _idBytes = 0;
+                _state = _remaining > 0 ? SNIFF_BODY : SNIFF_HEADER;
+            }
+            break;
+
+        case SNIFF_BODY:
+            if (_type == MQTT_PACKET_PUBACK && _idBytes < 2) {
+                _packetId = (_packetId << 8) | b;
+                _idBytes++;
+            }
+            if (--_remaining == 0) {
+                if (_type == MQTT_PACKET_PUBACK && _idBytes == 2) {
+                    onMqttPuback(_packetId);
+                }
+                _state = SNIFF_HEADER;
+            }
+            break;
+    }
+}
+
+// QoS 1 in-flight window. Slot i only ever uses packet IDs i+1, i+1+W, i+1+2W, ...
+// so a PUBACK finds its slot without a search. Packets are kept encoded for
+// retransmission with the DUP flag set.
+struct MqttInFlight {
+    bool used;
+    uint16_t packetId;
+    uint16_t length;
+    uint8_t retries;
+    unsigned long sentAt;
+    uint8_t packet[MQTT_QOS1_SLOT_SIZE];
+};
+
+static MqttInFlight inFlight[MQTT_QOS1_WINDOW];
+static uint16_t nextPacketId[MQTT_QOS1_WINDOW];
+static uint8_t inFlightCount = 0;
+
+// Statistics
+static uint32_t qos1Published = 0;
+static uint32_t qos1Acked = 0;
+static uint32_t qos1Retransmitted = 0;
+static uint32_t qos1Dropped = 0;
+static uint32_t qos1Oversized = 0;      // Sent at QoS 0, too large for a slot
+static uint32_t qos1RttMs = 0;          // Smoothed PUBACK round trip
+
+static void onMqttPuback(uint16_t packetId) {
+    if (packetId == 0) return;
+
+    MqttInFlight& slot = inFlight[(packetId - 1) % MQTT_QOS1_WINDOW];
+    if (!slot.used || slot.packetId != packetId) {
+        return;  // Late PUBACK for a retransmitted or dropped packet
+    }
+
+    uint32_t rtt = millis() - slot.sentAt;
+    qos1RttMs = qos1RttMs == 0 ? rtt : (qos1RttMs * 7 + rtt) / 8;
+
+    slot.used = false;
+    inFlightCount--;
+    qos1Acked++;
+}
+
+static int findFreeInFlightSlot() {
+    for (uint8_t i = 0; i < MQTT_QOS1_WINDOW; i++) {
+        if (!inFlight[i].used) return i;
+    }
+    return -1;
+}
+
+bool mqttPublishQos1(const char* topic, const uint8_t* payload, size_t length) {
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + 2 + length;
+
+    // Fixed header is at most 4 bytes for the slot sizes used here. A packet
+    // that cannot be kept for retransmission still goes out, at QoS 0.
+    if (remaining + 4 > MQTT_QOS1_SLOT_SIZE) {
+        qos1Oversized++;
+        return mqttClient.publish(topic, payload, length);
+    }
+
+    // Callers wait for mqttQos1WindowFull() to clear, from the main loop
+    int index = findFreeInFlightSlot();
+    if (index < 0) {
+        qos1Dropped++;
+        return false;
+    }
+
+    MqttInFlight& slot = inFlight[index];
+    uint16_t packetId = nextPacketId[index];
+    if (packetId == 0 || (packetId - 1) % MQTT_QOS1_WINDOW != index) {
+        packetId = index + 1;
+    }
+    nextPacketId[index] = packetId + MQTT_QOS1_WINDOW > 0xFFFF ? index + 1 : packetId + MQTT_QOS1_WINDOW;
+
+    uint8_t* out = slot.packet;
+    *out++ = MQTT_PACKET_PUBLISH | MQTT_FLAG_QOS1;
+    do {
+        uint8_t digit = remaining & 0x7F;
+        remaining >>= 7;
+        *out++ = remaining > 0 ? (digit | 0x80) : digit;
+    } while (remaining > 0);
+    *out++ = topicLength >> 8;
+    *out++ = topicLength & 0xFF;
+    memcpy(out, topic, topicLength);
+    out += topicLength;
+    *out++ = packetId >> 8;
+    *out++ = packetId & 0xFF;
+    memcpy(out, payload, length);
+    out += length;
+
+    slot.used = true;
+    slot.packetId = packetId;
+    slot.length = out - slot.packet;
+    slot.retries = 0;
+    slot.sentAt = millis();
+    inFlightCount++;
+    qos1Published++;
+
+    // Stored first, so a failed write is simply retransmitted later
+    mqttTransport.writeRaw(slot.packet, slot.length);
+    return true;
+}
+
+// PUBACKs are read by the MQTT loop stage, publishing waits for them there
+// rather than running the client, and its command callbacks, from a publish
+bool mqttQos1WindowFull() {
+    return inFlightCount >= MQTT_QOS1_WINDOW;
+}
+
+static void retransmitInFlight(MqttInFlight& slot) {
+    slot.packet[0] |= MQTT_FLAG_DUP;
+    slot.sentAt = millis();
+    slot.retries++;
+    qos1Retransmitted++;
+    mqttTransport.writeRaw(slot.packet, slot.length);
+}
+
+void handleMqttQos1Loop() {
+    if (inFlightCount == 0 || !mqttClient.connected()) return;
+
+    for (uint8_t i = 0; i < MQTT_QOS1_WINDOW; i++) {
+        MqttInFlight& slot = inFlight[i];
+        if (!slot.used || millis() - slot.sentAt < MQTT_QOS1_RETRY_MS) continue;
+
+        if (slot.retries >= MQTT_QOS1_MAX_RETRIES) {
+            debugLog("QoS 1 packet " + String(slot.packetId) + " dropped after " + String(slot.retries) + " retries");
+            slot.used = false;
+            inFlightCount--;
+            qos1Dropped++;
+            continue;
+        }
+
+        retransmitInFlight(slot);
+    }
+}
+
+// Unacknowledged packets from the previous connection go out again with DUP set
+void resendMqttQos1InFlight() {
+    if (inFlightCount == 0) return;
+
+    debugLog("Resending " + String(inFlightCount) + " unacknowledged QoS 1 messages");
+    for (uint8_t i = 0; i < MQTT_QOS1_WINDOW; i++) {
+        if (inFlight[i].used) {
+            retransmitInFlight(inFlight[i]);
+        }
+    }
+}
+
+void publishMqttQos1Stats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(256);
+    doc["window"] = MQTT_QOS1_WINDOW;
+    doc["inFlight"] = inFlightCount;
+    doc["published"] = qos1Published;
+    doc["acked"] = qos1Acked;
+    doc["retransmitted"] = qos1Retransmitted;
+    doc["dropped"] = qos1Dropped;
+    doc["oversized"] = qos1Oversized;
+    doc["rttMs"] = qos1RttMs;
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/mqtt";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
@@ -0,0 +1,395 @@
+#include "config.h"
+#include <RFM69.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define GROUP_FILE_PATH         "/groups.bin"
+#define GROUP_TEMP_PATH         "/groups.tmp"
+#define GROUP_FILE_MAGIC        0x31505247UL    // "GRP1"
+
+// Stored group, slot i is group i + 1. Group 0 is not stored, it is every
+// registered node.
+struct NodeGroup {
+    uint8_t members[32];            // Bit n = node n
+    uint8_t type;                   // Non-zero: registry nodes of this type are members too
+    uint8_t used;
+};
+
+static NodeGroup nodeGroups[NODE_GROUP_MAX];
+static bool groupsMounted = false;
+
+// One group downlink at a time. Members are sent to one after another with a
+// short listening gap, instead of waiting out every node's retries; ACKs are
+// collected as they arrive and missing nodes get the frame again next round.
+struct GroupDelivery {
+    bool active;
+    bool requestAck;
+    uint8_t groupId;
+    uint8_t length;
+    uint8_t data[RF69_MAX_DATA_LEN];
+    uint8_t members[32];
+    uint8_t pending[32];            // Members not ACKed (or not sent) yet
+    uint16_t next;                  // Next node of the current round
+    uint8_t round;
+    unsigned long startedAt;
+    unsigned long lastSent;
+};
+
+static GroupDelivery delivery;
+
+// Statistics
+static uint32_t groupSends = 0;
+static uint32_t groupBroadcasts = 0;
+static uint32_t groupDelivered = 0;
+static uint32_t groupFailed = 0;
+static uint32_t lastGroupDurationMs = 0;
+
+static bool nodeBit(const uint8_t* bits, uint8_t node) {
+    return bits[node >> 3] & (1 << (node & 7));
+}
+
+static void setNodeBit(uint8_t* bits, uint8_t node, bool value) {
+    if (value) {
+        bits[node >> 3] |= 1 << (node & 7);
+    } else {
+        bits[node >> 3] &= ~(1 << (node & 7));
+    }
+}
+
+static bool groupMember(uint8_t groupId, uint8_t node) {
+    if (node == 0 || node == RF69_BROADCAST_ADDR) {
+        return false;
+    }
+    if (groupId == 0) {
+        return nodeRegistered(node);
+    }
+    const NodeGroup& group = nodeGroups[groupId - 1];
+    return group.used && (nodeBit(group.members, node) || (group.type != 0 && nodeType(node) == group.type));
+}
+
+static bool saveNodeGroups() {
+    File file = LittleFS.open(GROUP_TEMP_PATH, "w");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t magic = GROUP_FILE_MAGIC;
+    bool ok = file.write((const uint8_t*)&magic, sizeof(magic)) == sizeof(magic) &&
+              file.write((const uint8_t*)nodeGroups, sizeof(nodeGroups)) == sizeof(nodeGroups);
+    file.close();
+
+    if (!ok) {
+        LittleFS.remove(GROUP_TEMP_PATH);
+        return false;
+    }
+
+    LittleFS.remove(GROUP_FILE_PATH);
+    return LittleFS.rename(GROUP_TEMP_PATH, GROUP_FILE_PATH);
+}
+
+bool initializeNodeGroups() {
+    memset(nodeGroups, 0, sizeof(nodeGroups));
+    memset(&delivery, 0, sizeof(delivery));
+
+    groupsMounted = LittleFS.begin();
+    if (groupsMounted) {
+        File file = LittleFS.open(GROUP_FILE_PATH, "r");
+        if (file) {
+            uint32_t magic = 0;
+            if (file.read((uint8_t*)&magic, sizeof(magic)) != sizeof(magic) || magic != GROUP_FILE_MAGIC ||
+                file.read((uint8_t*)nodeGroups, sizeof(nodeGroups)) != sizeof(nodeGroups)) {
+                debugLog("Node groups invalid, ignored");
+                memset(nodeGroups, 0, sizeof(nodeGroups));
+            }
+            file.close();
+        }
+    } else {
+        debugLog("LittleFS mount failed, node groups are not persisted");
+    }
+    return groupsMounted;
+}
+
+// Set a group from JSON: {"nodes":[...],"type":n}; an empty definition removes it
+static bool setNodeGroup(uint8_t groupId, const byte* payload, unsigned int length, String& error) {
+    NodeGroup& group = nodeGroups[groupId - 1];
+
+    if (length == 0) {
+        memset(&group, 0, sizeof(group));
+    } else {
+        DynamicJsonDocument doc(1024);
+        DeserializationError parseError = deserializeJson(doc, payload, length);
+        if (parseError) {
+            error = String("invalid JSON: ") + parseError.c_str();
+            return false;
+        }
+
+        NodeGroup updated;
+        memset(&updated, 0, sizeof(updated));
+        for (JsonVariant node : doc["nodes"].as<JsonArray>()) {
+            uint32_t nodeId = node.as<uint32_t>();
+            if (nodeId == 0 || nodeId > 255 || nodeId == RF69_BROADCAST_ADDR) {
+                error = "node ids must be 1-255";
+                return false;
+            }
+            setNodeBit(updated.members, nodeId, true);
+        }
+        uint32_t type = doc["type"] | 0;
+        if (type > 255) {
+            error = "type must be 0-255";
+            return false;
+        }
+        updated.type = type;
+        updated.used = 1;
+        group = updated;
+    }
+
+    if (!saveNodeGroups()) {
+        error = "group write failed";
+        return false;
+    }
+    return true;
+}
+
+static void publishGroupResponse(uint8_t groupId, bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    uint8_t members = 0;
+    DynamicJsonDocument response(256 + 255 * JSON_ARRAY_SIZE(1));
+    response["command"] = "group";
+    response["groupId"] = groupId;
+    response["success"] = ok;
+    if (!ok) {
+        response["error"] = error;
+    } else {
+        if (groupId != 0) {
+            response["type"] = nodeGroups[groupId - 1].type;
+        }
+        JsonArray nodes = response.createNestedArray("nodes");
+        for (uint16_t node = 1; node < 256; node++) {
+            if (groupMember(groupId, node)) {
+                nodes.add(node);
+                members++;
+            }
+        }
+        response["members"] = members;
+    }
+
+    // Streamed, a large group's member list exceeds the MQTT client buffer
+    String responseTopic = mqttBaseTopic + "/response/group";
+    mqttClient.beginPublish(responseTopic.c_str(), measureJson(response), false);
+    serializeJson(response, mqttClient);
+    mqttClient.endPublish();
+}
+
+// command/group/{id}: {"nodes":[2,3],"type":3} defines group 1-NODE_GROUP_MAX,
+// "{}" publishes the members, an empty payload removes the group
+void handleGroupCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    uint32_t groupId = params.values[0];
+    String error;
+    bool ok = false;
+
+    if (groupId > NODE_GROUP_MAX) {
+        error = "invalid group id";
+    } else if (length == 2 && payload[0] == '{' && payload[1] == '}') {
+        ok = groupId == 0 || nodeGroups[groupId - 1].used;
+        if (!ok) error = "group not defined";
+    } else if (groupId == 0) {
+        error = "group 0 is every registered node";
+    } else {
+        ok = setNodeGroup(groupId, payload, length, error);
+    }
+
+    if (!ok) {
+        debugLog("Group " + String(groupId) + " command rejected: " + error);
+    }
+    publishGroupResponse(groupId, ok, error);
+}
+
+// Summary of the running group send, or the error that kept it from starting
+static void publishGroupSendResult(uint8_t groupId, const char* error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(256 + 255 * JSON_ARRAY_SIZE(1));
+    response["command"] = "groupSend";
+    response["groupId"] = groupId;
+    response["success"] = error == nullptr;
+    if (error != nullptr) {
+        response["error"] = error;
+    } else {
+        // Delivered are the ACKed members, or without ACK the ones that were sent
+        JsonArray delivered = response.createNestedArray(delivery.requestAck ? "acked" : "sent");
+        JsonArray failed = response.createNestedArray(delivery.requestAck ? "timedOut" : "failed");
+        for (uint16_t node = 1; node < 256; node++) {
+            if (!nodeBit(delivery.members, node)) continue;
+            if (nodeBit(delivery.pending, node)) {
+                failed.add(node);
+            } else {
+                delivered.add(node);
+            }
+        }
+        response["rounds"] = delivery.round + 1;
+        response["durationMs"] = millis() - delivery.startedAt;
+    }
+
+    String responseTopic = mqttBaseTopic + "/response/group";
+    mqttClient.beginPublish(responseTopic.c_str(), measureJson(response), false);
+    serializeJson(response, mqttClient);
+    mqttClient.endPublish();
+}
+
+static void finishGroupSend() {
+    for (uint16_t node = 1; node < 256; node++) {
+        if (!nodeBit(delivery.members, node)) continue;
+        if (nodeBit(delivery.pending, node)) {
+            groupFailed++;
+        } else {
+            groupDelivered++;
+        }
+    }
+    lastGroupDurationMs = millis() - delivery.startedAt;
+
+    debugLog("Group " + String(delivery.groupId) + " send finished after " + String(lastGroupDurationMs) + " ms");
+    publishGroupSendResult(delivery.groupId, nullptr);
+    delivery.active = false;
+}
+
+// An ACK from a member the running group send waits for; consumed when true
+bool groupSendAck(uint8_t nodeId) {
+    if (!delivery.active || !delivery.requestAck || !nodeBit(delivery.pending, nodeId)) {
+        return false;
+    }
+    setNodeBit(delivery.pending, nodeId, false);
+    return true;
+}
+
+void handleGroupSendLoop() {
+    if (!delivery.active) return;
+
+    // Listen for the previous member's ACK before the radio goes back to TX
+    if (millis() - delivery.lastSent < GROUP_SEND_GAP_MS) return;
+
+    while (delivery.next < 256 && !nodeBit(delivery.pending, delivery.next)) {
+        delivery.next++;
+    }
+
+    if (delivery.next >= 256) {
+        bool done = true;
+        for (uint8_t i = 0; i < sizeof(delivery.pending) && done; i++) {
+            done = delivery.pending[i] == 0;
+        }
+        if (done || !delivery.requestAck || delivery.round >= RADIO_TX_RETRIES) {
+            // Late ACKs of the last round still count
+            if (!done && delivery.requestAck && millis() - delivery.lastSent < RADIO_TX_RETRY_WAIT_MS) return;
+            finishGroupSend();
+            return;
+        }
+        delivery.round++;
+        delivery.next = 1;
+        return;
+    }
+
+    if (millis() - delivery.startedAt > GROUP_SEND_TIMEOUT_MS) {
+        finishGroupSend();
+        return;
+    }
+
+    // Over budget or busy channel: the same member is tried again next pass
+    if (!radioTransmitImmediate(delivery.next, delivery.data, delivery.length, delivery.requestAck)) return;
+
+    delivery.lastSent = millis();
+    if (!delivery.requestAck) {
+        setNodeBit(delivery.pending, delivery.next, false);
+    }
+    delivery.next++;
+}
+
+static void publishGroupBroadcastResult(uint8_t groupId, RadioTxResult result) {
+    if (!mqttConnected) return;
+
+    char response[128];
+    int responseLength = snprintf(response, sizeof(response),
+                                  "{\"command\":\"groupSend\",\"groupId\":%u,\"broadcast\":true,\"success\":%s,\"deferred\":%s}",
+                                  groupId, result != RADIO_TX_FAILED ? "true" : "false", result == RADIO_TX_DEFERRED ? "true" : "false");
+
+    String responseTopic = mqttBaseTopic + "/response/group";
+    mqttClient.publish(responseTopic.c_str(), (const uint8_t*)response, responseLength);
+}
+
+// command/group/{id}/send: {"message":"...","ack":true} to every member, one
+// summary on response/group. Without ACK, group 0 or "broadcast":true send a
+// single broadcast frame, which every node on the network receives.
+void handleGroupSendCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    uint32_t groupId = params.values[0];
+    if (groupId > NODE_GROUP_MAX || (groupId != 0 && !nodeGroups[groupId - 1].used)) {
+        debugLog("Group send rejected: group " + String(groupId) + " not defined");
+        return;
+    }
+
+    DynamicJsonDocument doc(512);
+    if (deserializeJson(doc, payload, length) != DeserializationError::Ok || !doc.containsKey("message")) {
+        debugLog("Group send command missing message");
+        return;
+    }
+
+    const char* message = doc["message"] | "";
+    size_t messageLength = strlen(message);
+    bool requestAck = doc["ack"] | false;
+    if (messageLength > RF69_MAX_DATA_LEN) {
+        debugLog("Group send message too long");
+        return;
+    }
+
+    if (delivery.active) {
+        publishGroupSendResult(groupId, "group send in progress");
+        return;
+    }
+
+    if (!requestAck && (groupId == 0 || (doc["broadcast"] | false))) {
+        RadioTxResult result = radioTransmit(RF69_BROADCAST_ADDR, message, messageLength, false, RADIO_RESPONSE_NONE, PRIORITY_ROUTINE);
+        groupBroadcasts++;
+        publishGroupBroadcastResult(groupId, result);
+        return;
+    }
+
+    memset(&delivery, 0, sizeof(delivery));
+    delivery.groupId = groupId;
+    delivery.requestAck = requestAck;
+    delivery.length = messageLength;
+    memcpy(delivery.data, message, messageLength);
+    for (uint16_t node = 1; node < 256; node++) {
+        if (groupMember(groupId, node)) {
+            setNodeBit(delivery.members, node, true);
+        }
+    }
+    memcpy(delivery.pending, delivery.members, sizeof(delivery.pending));
+    delivery.next = 1;
+    delivery.startedAt = millis();
+    delivery.lastSent = millis() - GROUP_SEND_GAP_MS;
+    delivery.active = true;
+    groupSends++;
+
+    debugLog("Group " + String(groupId) + " send started" + String(requestAck ? " with ACK" : ""));
+}
+
+void publishGroupStats() {
+    if (!mqttConnected) return;
+
+    uint8_t groups = 0;
+    for (uint8_t i = 0; i < NODE_GROUP_MAX; i++) {
+        if (nodeGroups[i].used) groups++;
+    }
+
+    char stats[192];
+    snprintf(stats, sizeof(stats),
+             "{\"groups\":%u,\"sends\":%lu,\"broadcasts\":%lu,\"delivered\":%lu,\"failed\":%lu,\"lastDurationMs\":%lu,\"active\":%s}",
+             groups, (unsigned long)groupSends, (unsigned long)groupBroadcasts, (unsigned long)groupDelivered,
+             (unsigned long)groupFailed, (unsigned long)lastGroupDurationMs, delivery.active ? "true" : "false");
+
+    String statsTopic = mqttBaseTopic + "/stats/group";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
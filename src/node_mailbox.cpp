@@ -0,0 +1,291 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern GatewayRadio radio;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define MAILBOX_NONE 0xFF
+
+// Downlinks for sleeping nodes wait here until the node transmits. All nodes
+// share one fixed pool; each node's entries form a FIFO list through 'next'.
+struct MailboxEntry {
+    uint8_t nodeId;
+    uint8_t key;                    // Non-zero key: a newer entry with the same key replaces this one
+    uint8_t length;
+    uint8_t next;
+    unsigned long queuedAt;
+    unsigned long expiresAt;
+    uint8_t data[RF69_MAX_DATA_LEN];
+};
+
+static MailboxEntry mailboxPool[MAILBOX_POOL_SIZE];
+static uint8_t mailboxFree = MAILBOX_NONE;
+static uint8_t mailboxHead[256];
+static uint8_t mailboxCount = 0;
+static unsigned long lastMailboxExpiry = 0;
+
+// Per-node delivery statistics for the nodes that used the mailbox most recently
+struct MailboxStats {
+    uint8_t nodeId;
+    uint32_t delivered;
+    uint32_t expired;
+    uint32_t coalesced;
+    uint32_t lastLatencyMs;
+    uint32_t avgLatencyMs;
+    unsigned long lastUsed;
+};
+
+static MailboxStats mailboxStats[MAILBOX_STATS_NODES];
+
+void initializeMailbox() {
+    memset(mailboxHead, MAILBOX_NONE, sizeof(mailboxHead));
+    for (uint8_t i = 0; i < MAILBOX_POOL_SIZE; i++) {
+        mailboxPool[i].next = i + 1 < MAILBOX_POOL_SIZE ? i + 1 : MAILBOX_NONE;
+    }
+    mailboxFree = 0;
+    mailboxCount = 0;
+    memset(mailboxStats, 0, sizeof(mailboxStats));
+}
+
+static MailboxStats& statsForNode(uint8_t nodeId) {
+    uint8_t oldest = 0;
+    for (uint8_t i = 0; i < MAILBOX_STATS_NODES; i++) {
+        if (mailboxStats[i].nodeId == nodeId) {
+            mailboxStats[i].lastUsed = millis();
+            return mailboxStats[i];
+        }
+        if (mailboxStats[i].lastUsed < mailboxStats[oldest].lastUsed) {
+            oldest = i;
+        }
+    }
+
+    memset(&mailboxStats[oldest], 0, sizeof(MailboxStats));
+    mailboxStats[oldest].nodeId = nodeId;
+    mailboxStats[oldest].lastUsed = millis();
+    return mailboxStats[oldest];
+}
+
+uint8_t mailboxDepth(uint8_t nodeId) {
+    uint8_t depth = 0;
+    for (uint8_t i = mailboxHead[nodeId]; i != MAILBOX_NONE; i = mailboxPool[i].next) {
+        depth++;
+    }
+    return depth;
+}
+
+static void releaseMailboxHead(uint8_t nodeId) {
+    uint8_t index = mailboxHead[nodeId];
+    mailboxHead[nodeId] = mailboxPool[index].next;
+    mailboxPool[index].next = mailboxFree;
+    mailboxFree = index;
+    mailboxCount--;
+}
+
+static void expireMailboxEntries() {
+    for (uint16_t node = 0; node < 256; node++) {
+        // Entries are in queue order but TTLs differ, so check the whole list
+        uint8_t* link = &mailboxHead[node];
+        while (*link != MAILBOX_NONE) {
+            MailboxEntry& entry = mailboxPool[*link];
+            if ((long)(millis() - entry.expiresAt) >= 0) {
+                uint8_t index = *link;
+                *link = entry.next;
+                entry.next = mailboxFree;
+                mailboxFree = index;
+                mailboxCount--;
+                statsForNode(node).expired++;
+            } else {
+                link = &entry.next;
+            }
+        }
+    }
+}
+
+MailboxResult mailboxEnqueue(uint8_t nodeId, const uint8_t* data, uint8_t length, uint8_t key, uint32_t ttlSeconds) {
+    if (length > RF69_MAX_DATA_LEN) {
+        return MAILBOX_REJECTED;
+    }
+
+    unsigned long expiresAt = millis() + ttlSeconds * 1000UL;
+
+    // Coalesce: a superseding command replaces the queued one in place
+    uint8_t depth = 0;
+    uint8_t tail = MAILBOX_NONE;
+    for (uint8_t i = mailboxHead[nodeId]; i != MAILBOX_NONE; i = mailboxPool[i].next) {
+        MailboxEntry& entry = mailboxPool[i];
+        if (key != 0 && entry.key == key) {
+            memcpy(entry.data, data, length);
+            entry.length = length;
+            entry.queuedAt = millis();
+            entry.expiresAt = expiresAt;
+            statsForNode(nodeId).coalesced++;
+            return MAILBOX_COALESCED;
+        }
+        depth++;
+        tail = i;
+    }
+
+    if (depth >= MAILBOX_MAX_PER_NODE) {
+        return MAILBOX_REJECTED;
+    }
+    if (mailboxFree == MAILBOX_NONE) {
+        expireMailboxEntries();
+        if (mailboxFree == MAILBOX_NONE) {
+            return MAILBOX_REJECTED;
+        }
+    }
+
+    uint8_t index = mailboxFree;
+    MailboxEntry& entry = mailboxPool[index];
+    mailboxFree = entry.next;
+
+    entry.nodeId = nodeId;
+    entry.key = key;
+    entry.length = length;
+    entry.next = MAILBOX_NONE;
+    entry.queuedAt = millis();
+    entry.expiresAt = expiresAt;
+    memcpy(entry.data, data, length);
+
+    if (tail == MAILBOX_NONE) {
+        mailboxHead[nodeId] = index;
+    } else {
+        mailboxPool[tail].next = index;
+    }
+    mailboxCount++;
+    statsForNode(nodeId);
+
+    return MAILBOX_QUEUED;
+}
+
+static void publishMailboxDelivery(uint8_t nodeId, uint32_t latencyMs, uint8_t remaining) {
+    if (!mqttConnected) return;
+
+    char response[96];
+    int responseLength = snprintf(response, sizeof(response), "{\"nodeId\":%u,\"delivered\":true,\"latencyMs\":%lu,\"depth\":%u}",
+                                  nodeId, (unsigned long)latencyMs, remaining);
+
+    String responseTopic = mqttBaseTopic + "/response/mailbox";
+    mqttClient.publish(responseTopic.c_str(), (const uint8_t*)response, responseLength);
+}
+
+static void markMailboxDelivered(uint8_t nodeId) {
+    uint32_t latency = millis() - mailboxPool[mailboxHead[nodeId]].queuedAt;
+    releaseMailboxHead(nodeId);
+
+    MailboxStats& stats = statsForNode(nodeId);
+    stats.delivered++;
+    stats.lastLatencyMs = latency;
+    stats.avgLatencyMs = stats.delivered == 1 ? latency : (stats.avgLatencyMs * 7 + latency) / 8;
+
+    publishMailboxDelivery(nodeId, latency, mailboxDepth(nodeId));
+}
+
+// ACK for a received frame, carrying the oldest queued downlink for the node
+// as ACK payload. A node that gets a non-empty ACK should poll again for more.
+// Returns false when the airtime budget did not allow an ACK.
+bool sendNodeAck(uint8_t nodeId) {
+    uint8_t index = mailboxHead[nodeId];
+    if (index != MAILBOX_NONE && (long)(millis() - mailboxPool[index].expiresAt) < 0) {
+        MailboxEntry& entry = mailboxPool[index];
+        if (!radioAckAllowed(entry.length)) {
+            return false;
+        }
+        radio.sendACK(entry.data, entry.length);
+        markMailboxDelivered(nodeId);
+        return true;
+    }
+
+    if (!radioAckAllowed(0)) {
+        return false;
+    }
+    radio.sendACK();
+    return true;
+}
+
+// Nodes that do not ask for ACKs still listen briefly after transmitting
+void deliverMailbox(uint8_t nodeId) {
+    uint8_t index = mailboxHead[nodeId];
+    if (index == MAILBOX_NONE || (long)(millis() - mailboxPool[index].expiresAt) >= 0) {
+        return;
+    }
+
+    MailboxEntry& entry = mailboxPool[index];
+    if (radioTransmitImmediate(nodeId, entry.data, entry.length)) {
+        markMailboxDelivered(nodeId);
+    }
+}
+
+void handleMailboxLoop() {
+    if (mailboxCount > 0 && millis() - lastMailboxExpiry > 1000) {
+        expireMailboxEntries();
+        lastMailboxExpiry = millis();
+    }
+}
+
+static void publishMailboxQueued(uint8_t nodeId, MailboxResult result) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(192);
+    response["command"] = "mailbox";
+    response["nodeId"] = nodeId;
+    response["queued"] = result != MAILBOX_REJECTED;
+    response["coalesced"] = result == MAILBOX_COALESCED;
+    response["depth"] = mailboxDepth(nodeId);
+    response["timestamp"] = millis();
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/mailbox";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+void queueMailboxCommand(uint8_t nodeId, const uint8_t* data, uint8_t length, uint8_t key, uint32_t ttlSeconds) {
+    publishMailboxQueued(nodeId, mailboxEnqueue(nodeId, data, length, key, ttlSeconds));
+}
+
+// command/mbox/{node}[/{key}]: raw bytes for the node's mailbox
+void handleMailboxCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    // Key 0 means no coalescing, a key above 255 must not wrap into one
+    uint32_t key = params.count > 1 ? params.values[1] : 0;
+    if (params.values[0] == 0 || params.values[0] > 255 || key > 255 || length > RF69_MAX_DATA_LEN) {
+        debugLog("Mailbox command rejected for node " + String(params.values[0]));
+        return;
+    }
+
+    queueMailboxCommand(params.values[0], payload, length, key, MAILBOX_DEFAULT_TTL_S);
+}
+
+void publishMailboxStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(1024);
+    doc["queued"] = mailboxCount;
+    doc["poolSize"] = MAILBOX_POOL_SIZE;
+
+    JsonArray nodes = doc.createNestedArray("nodes");
+    for (uint8_t i = 0; i < MAILBOX_STATS_NODES; i++) {
+        MailboxStats& stats = mailboxStats[i];
+        if (stats.nodeId == 0) continue;
+
+        JsonObject node = nodes.createNestedObject();
+        node["nodeId"] = stats.nodeId;
+        node["depth"] = mailboxDepth(stats.nodeId);
+        node["delivered"] = stats.delivered;
+        node["expired"] = stats.expired;
+        node["coalesced"] = stats.coalesced;
+        node["lastLatencyMs"] = stats.lastLatencyMs;
+        node["avgLatencyMs"] = stats.avgLatencyMs;
+    }
+
+    // Streamed, the node list can exceed the MQTT client buffer
+    String statsTopic = mqttBaseTopic + "/stats/mailbox";
+    mqttClient.beginPublish(statsTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
@@ -0,0 +1,645 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+// Objects owned by gateway.cpp
+extern PubSubClient mqttClient;
+extern GatewayRadio radio;
+extern bool radioInitialized;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Radio frame types of the node firmware push protocol (first payload byte).
+// All multi-byte fields are little endian.
+//   OFFER  gw->node  [F1][size u32][crc32 u32][blockSize u8][window u8]
+//   READY  node->gw  [F2][nextBlock u16]              nextBlock = resume point
+//   BLOCK  gw->node  [F3][flags u8][index u16][crc16 u16][data...]
+//   SACK   node->gw  [F4][base u16][bitmap u32]       bit i = block base+i received
+//   COMMIT gw->node  [F5][crc32 u32]
+//   DONE   node->gw  [F6][status u8]                  0 = image verified
+#define FW_FRAME_OFFER   0xF1
+#define FW_FRAME_READY   0xF2
+#define FW_FRAME_BLOCK   0xF3
+#define FW_FRAME_SACK    0xF4
+#define FW_FRAME_COMMIT  0xF5
+#define FW_FRAME_DONE    0xF6
+
+#define FW_BLOCK_FLAG_SACK_REQ  0x01    // Node must answer this block with a SACK
+#define FW_BLOCK_FLAG_LAST      0x02    // Last block of the image
+
+#define FW_BLOCK_HEADER_LEN     6
+
+static const char* NODE_FW_IMAGE_PATH = "/nodefw.bin";
+static const char* NODE_FW_META_PATH = "/nodefw.meta";     // Expected size and CRC32 of the staged image
+
+enum NodeOtaState {
+    NODE_OTA_IDLE,
+    NODE_OTA_OFFER,
+    NODE_OTA_STREAM,
+    NODE_OTA_WAIT_SACK,
+    NODE_OTA_COMMIT
+};
+
+// Staged image
+static bool fsMounted = false;
+static File stageFile;
+static uint32_t stageSize = 0;
+static uint32_t stageCrc = 0;
+static uint32_t stageReceived = 0;
+static bool stageReady = false;
+
+// Transfer state, one target node at a time
+static NodeOtaState otaState = NODE_OTA_IDLE;
+static uint8_t otaTargets[32];                 // Bitmap of pending target node IDs
+static uint8_t otaNode = 0;
+static uint16_t otaTotalBlocks = 0;
+static uint16_t otaWindowBase = 0;             // First block not yet acknowledged by the node
+static uint32_t otaAckedMask = 0;              // Relative to otaWindowBase
+static uint32_t otaSentMask = 0;               // Relative to otaWindowBase, sent in the current round
+static uint16_t otaLastSent = 0;
+static uint8_t otaRetries = 0;
+static unsigned long otaStateSince = 0;
+
+// Transfer statistics
+static unsigned long otaStartTime = 0;
+static unsigned long otaLastProgress = 0;
+static uint32_t otaBlocksSent = 0;
+static uint32_t otaBlocksRetransmitted = 0;
+static uint16_t otaResumeBlock = 0;
+
+uint16_t crc16Ccitt(const uint8_t* data, size_t length, uint16_t crc) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void putLe16(uint8_t* buf, uint16_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = value >> 8;
+}
+
+static void putLe32(uint8_t* buf, uint32_t value) {
+    for (uint8_t i = 0; i < 4; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint16_t getLe16(const uint8_t* buf) {
+    return buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+static uint32_t getLe32(const uint8_t* buf) {
+    return buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+bool initializeNodeOta() {
+    fsMounted = LittleFS.begin();
+    if (!fsMounted) {
+        debugLog("LittleFS mount failed, node firmware push disabled");
+        return false;
+    }
+
+    // The staged image survives reboots, so neither the upload nor a push has to start over
+    File meta = LittleFS.open(NODE_FW_META_PATH, "r");
+    if (meta) {
+        uint8_t buffer[8];
+        if (meta.read(buffer, sizeof(buffer)) == sizeof(buffer)) {
+            stageSize = getLe32(buffer);
+            stageCrc = getLe32(buffer + 4);
+        }
+        meta.close();
+
+        File image = LittleFS.open(NODE_FW_IMAGE_PATH, "r");
+        if (image) {
+            stageReceived = min((uint32_t)image.size(), stageSize);
+            image.close();
+        }
+        stageReady = stageSize > 0 && stageReceived == stageSize;
+    }
+
+    debugLog("Node firmware staging ready, stored image: " + String(stageSize) + " bytes");
+    return true;
+}
+
+bool nodeOtaActive() {
+    return otaState != NODE_OTA_IDLE;
+}
+
+// The node currently being updated, its mailbox waits until the push ends
+bool nodeOtaTarget(uint8_t nodeId) {
+    return otaState != NODE_OTA_IDLE && nodeId == otaNode;
+}
+
+static void publishNodeOtaResponse(const char* action, bool success, const String& detail) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(256);
+    response["command"] = "fw";
+    response["action"] = action;
+    response["success"] = success;
+    response["received"] = stageReceived;
+    response["size"] = stageSize;
+    response["staged"] = stageReady;
+    if (detail.length() > 0) {
+        response["detail"] = detail;
+    }
+    response["timestamp"] = millis();
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/fw";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+static void publishNodeOtaProgress(const char* state) {
+    if (!mqttConnected) return;
+
+    uint32_t ackedBytes = min((uint32_t)otaWindowBase * NODE_FW_BLOCK_SIZE, stageSize);
+    uint32_t resumedBytes = (uint32_t)otaResumeBlock * NODE_FW_BLOCK_SIZE;
+    unsigned long elapsed = millis() - otaStartTime;
+
+    // Rate counts only bytes moved in this session, resumed blocks were sent earlier
+    uint32_t bytesPerSec = 0;
+    if (elapsed > 0 && ackedBytes > resumedBytes) {
+        bytesPerSec = (uint64_t)(ackedBytes - resumedBytes) * 1000 / elapsed;
+    }
+
+    DynamicJsonDocument doc(384);
+    doc["nodeId"] = otaNode;
+    doc["state"] = state;
+    doc["acked"] = ackedBytes;
+    doc["total"] = stageSize;
+    doc["bytesPerSec"] = bytesPerSec;
+    doc["retxRatio"] = otaBlocksSent > 0 ? (float)otaBlocksRetransmitted / otaBlocksSent : 0.0f;
+    doc["etaSec"] = bytesPerSec > 0 ? (stageSize - ackedBytes) / bytesPerSec : 0;
+    doc["blocksSent"] = otaBlocksSent;
+    doc["blocksRetransmitted"] = otaBlocksRetransmitted;
+    doc["timestamp"] = millis();
+
+    String progressString;
+    serializeJson(doc, progressString);
+
+    String progressTopic = mqttBaseTopic + "/fw/progress";
+    mqttClient.publish(progressTopic.c_str(), progressString.c_str());
+    otaLastProgress = millis();
+}
+
+static void setOtaState(NodeOtaState state) {
+    otaState = state;
+    otaStateSince = millis();
+    otaRetries = 0;
+}
+
+static bool startNextOtaTarget() {
+    if (stageFile) {
+        stageFile.close();
+    }
+
+    for (uint16_t node = 1; node < 256; node++) {
+        if (otaTargets[node >> 3] & (1 << (node & 7))) {
+            otaTargets[node >> 3] &= ~(1 << (node & 7));
+
+            stageFile = LittleFS.open(NODE_FW_IMAGE_PATH, "r");
+            if (!stageFile) {
+                debugLog("Cannot open staged node image");
+                break;
+            }
+
+            otaNode = node;
+            otaTotalBlocks = (stageSize + NODE_FW_BLOCK_SIZE - 1) / NODE_FW_BLOCK_SIZE;
+            otaWindowBase = 0;
+            otaAckedMask = 0;
+            otaSentMask = 0;
+            otaBlocksSent = 0;
+            otaBlocksRetransmitted = 0;
+            otaResumeBlock = 0;
+            otaStartTime = millis();
+            otaLastProgress = 0;
+            setOtaState(NODE_OTA_OFFER);
+            otaStateSince = 0;  // Send the first offer immediately
+
+            debugLog("Node firmware push to node " + String(otaNode) + ", " + String(otaTotalBlocks) + " blocks");
+            return true;
+        }
+    }
+
+    memset(otaTargets, 0, sizeof(otaTargets));
+    otaState = NODE_OTA_IDLE;
+    return false;
+}
+
+static void finishOtaTarget(const char* result) {
+    debugLog("Node firmware push to node " + String(otaNode) + ": " + result);
+    publishNodeOtaProgress(result);
+    startNextOtaTarget();
+}
+
+// A frame refused by the duty-cycle budget or a busy channel is not sent and
+// the step is repeated on a later pass, without using up a retry
+enum OtaBlockResult {
+    OTA_BLOCK_SENT,
+    OTA_BLOCK_REFUSED,
+    OTA_BLOCK_READ_FAILED
+};
+
+static bool sendOtaOffer() {
+    uint8_t frame[11];
+    frame[0] = FW_FRAME_OFFER;
+    putLe32(frame + 1, stageSize);
+    putLe32(frame + 5, stageCrc);
+    frame[9] = NODE_FW_BLOCK_SIZE;
+    frame[10] = NODE_FW_WINDOW_BLOCKS;
+    return radioTransmitImmediate(otaNode, frame, sizeof(frame));
+}
+
+static OtaBlockResult sendOtaBlock(uint16_t index, bool requestSack) {
+    uint8_t frame[FW_BLOCK_HEADER_LEN + NODE_FW_BLOCK_SIZE];
+    uint32_t offset = (uint32_t)index * NODE_FW_BLOCK_SIZE;
+    size_t length = min((uint32_t)NODE_FW_BLOCK_SIZE, stageSize - offset);
+
+    if (!stageFile.seek(offset) || stageFile.read(frame + FW_BLOCK_HEADER_LEN, length) != (int)length) {
+        debugLog("Node image read failed at block " + String(index));
+        return OTA_BLOCK_READ_FAILED;
+    }
+
+    frame[0] = FW_FRAME_BLOCK;
+    frame[1] = (requestSack ? FW_BLOCK_FLAG_SACK_REQ : 0) | (index + 1 == otaTotalBlocks ? FW_BLOCK_FLAG_LAST : 0);
+    putLe16(frame + 2, index);
+    putLe16(frame + 4, crc16Ccitt(frame + FW_BLOCK_HEADER_LEN, length));
+    if (!radioTransmitImmediate(otaNode, frame, FW_BLOCK_HEADER_LEN + length)) {
+        return OTA_BLOCK_REFUSED;
+    }
+    otaLastSent = index;
+    return OTA_BLOCK_SENT;
+}
+
+static bool sendOtaCommit() {
+    uint8_t frame[5];
+    frame[0] = FW_FRAME_COMMIT;
+    putLe32(frame + 1, stageCrc);
+    return radioTransmitImmediate(otaNode, frame, sizeof(frame));
+}
+
+// Streams the unacknowledged blocks of the current window, a few per loop pass
+// so the radio receive path and MQTT keep being serviced during the burst
+static void streamOtaWindow() {
+    const uint8_t blocksPerPass = 4;
+    uint16_t windowEnd = min((uint16_t)(otaWindowBase + NODE_FW_WINDOW_BLOCKS), otaTotalBlocks);
+
+    uint8_t sent = 0;
+    for (uint16_t index = otaWindowBase; index < windowEnd && sent < blocksPerPass; index++) {
+        uint32_t bit = 1UL << (index - otaWindowBase);
+        if ((otaAckedMask | otaSentMask) & bit) continue;
+
+        // Ask for a SACK with the last outstanding block of the window
+        bool last = true;
+        for (uint16_t next = index + 1; next < windowEnd; next++) {
+            if (!((otaAckedMask | otaSentMask) & (1UL << (next - otaWindowBase)))) {
+                last = false;
+                break;
+            }
+        }
+
+        OtaBlockResult result = sendOtaBlock(index, last);
+        if (result == OTA_BLOCK_READ_FAILED) {
+            finishOtaTarget("failed");
+            return;
+        }
+        if (result == OTA_BLOCK_REFUSED) {
+            return;
+        }
+        otaSentMask |= bit;
+        otaBlocksSent++;
+        sent++;
+
+        if (last) {
+            setOtaState(NODE_OTA_WAIT_SACK);
+            return;
+        }
+    }
+}
+
+static void handleOtaSack(uint16_t base, uint32_t bitmap) {
+    if (base < otaWindowBase) {
+        // Stale SACK from an earlier window
+        return;
+    }
+
+    // Slide the window to the node's first missing block
+    uint16_t shift = base - otaWindowBase;
+    if (shift >= 32) {
+        otaAckedMask = 0;
+        otaSentMask = 0;
+    } else {
+        otaAckedMask >>= shift;
+        otaSentMask >>= shift;
+    }
+    otaWindowBase = base;
+    otaAckedMask |= bitmap;
+
+    if (otaWindowBase >= otaTotalBlocks) {
+        bool sent = sendOtaCommit();
+        setOtaState(NODE_OTA_COMMIT);
+        if (!sent) {
+            otaStateSince = 0;  // Send it again on the next pass
+        }
+        return;
+    }
+
+    // Blocks sent but not reported are NACKs, resend them in the next round
+    uint32_t missing = otaSentMask & ~otaAckedMask;
+    for (uint8_t i = 0; i < 32; i++) {
+        if (missing & (1UL << i)) otaBlocksRetransmitted++;
+    }
+    otaSentMask = 0;
+    setOtaState(NODE_OTA_STREAM);
+}
+
+bool handleNodeOtaFrame(uint8_t senderId, const uint8_t* data, uint8_t length) {
+    if (otaState == NODE_OTA_IDLE || senderId != otaNode || length == 0) {
+        return false;
+    }
+
+    switch (data[0]) {
+        case FW_FRAME_READY:
+            if (length >= 3 && otaState == NODE_OTA_OFFER) {
+                // Node reports how far an interrupted transfer got
+                otaResumeBlock = min(getLe16(data + 1), otaTotalBlocks);
+                otaWindowBase = otaResumeBlock;
+                otaAckedMask = 0;
+                otaSentMask = 0;
+                otaStartTime = millis();
+                if (otaResumeBlock > 0) {
+                    debugLog("Node " + String(otaNode) + " resumes at block " + String(otaResumeBlock));
+                }
+                setOtaState(NODE_OTA_STREAM);
+            }
+            return true;
+
+        case FW_FRAME_SACK:
+            if (length >= 7 && (otaState == NODE_OTA_STREAM || otaState == NODE_OTA_WAIT_SACK)) {
+                handleOtaSack(getLe16(data + 1), getLe32(data + 3));
+            }
+            return true;
+
+        case FW_FRAME_DONE:
+            if (length >= 2 && otaState == NODE_OTA_COMMIT) {
+                finishOtaTarget(data[1] == 0 ? "complete" : "verify-failed");
+            }
+            return true;
+    }
+
+    return false;
+}
+
+void handleNodeOtaLoop() {
+    if (otaState == NODE_OTA_IDLE) return;
+
+    // Pause while the duty-cycle budget is used up or the channel is busy
+    if (!radioTxPossible(FW_BLOCK_HEADER_LEN + NODE_FW_BLOCK_SIZE)) return;
+
+    unsigned long waited = millis() - otaStateSince;
+
+    switch (otaState) {
+        case NODE_OTA_OFFER:
+            if (otaStateSince == 0 || waited > NODE_FW_OFFER_TIMEOUT_MS) {
+                if (otaRetries >= NODE_FW_OFFER_RETRIES) {
+                    finishOtaTarget("no-response");
+                    return;
+                }
+                if (!sendOtaOffer()) break;
+                otaStateSince = millis();
+                otaRetries++;
+            }
+            break;
+
+        case NODE_OTA_STREAM:
+            streamOtaWindow();
+            break;
+
+        case NODE_OTA_WAIT_SACK:
+            if (waited > NODE_FW_SACK_TIMEOUT_MS) {
+                if (otaRetries >= NODE_FW_SACK_RETRIES) {
+                    // Node keeps its blocks, a later push resumes from its READY
+                    finishOtaTarget("interrupted");
+                    return;
+                }
+                OtaBlockResult result = sendOtaBlock(otaLastSent, true);
+                if (result == OTA_BLOCK_READ_FAILED) {
+                    finishOtaTarget("failed");
+                    return;
+                }
+                if (result == OTA_BLOCK_REFUSED) break;
+                otaBlocksSent++;
+                otaBlocksRetransmitted++;
+                otaStateSince = millis();
+                otaRetries++;
+            }
+            break;
+
+        case NODE_OTA_COMMIT:
+            if (waited > NODE_FW_SACK_TIMEOUT_MS) {
+                if (otaRetries >= NODE_FW_SACK_RETRIES) {
+                    finishOtaTarget("no-commit");
+                    return;
+                }
+                if (!sendOtaCommit()) break;
+                otaStateSince = millis();
+                otaRetries++;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (otaState != NODE_OTA_IDLE && millis() - otaLastProgress > NODE_FW_PROGRESS_INTERVAL_MS) {
+        publishNodeOtaProgress("running");
+    }
+}
+
+void handleNodeOtaBegin(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    if (!fsMounted) {
+        publishNodeOtaResponse("begin", false, "flash staging unavailable");
+        return;
+    }
+
+    DynamicJsonDocument doc(128);
+    if (deserializeJson(doc, payload, length) != DeserializationError::Ok) {
+        publishNodeOtaResponse("begin", false, "invalid JSON");
+        return;
+    }
+
+    uint32_t size = doc["size"] | 0;
+    if (size == 0 || size > NODE_FW_MAX_IMAGE_SIZE || !doc.containsKey("crc32")) {
+        publishNodeOtaResponse("begin", false, "size and crc32 required");
+        return;
+    }
+    if (nodeOtaActive()) {
+        publishNodeOtaResponse("begin", false, "push in progress");
+        return;
+    }
+
+    if (stageFile) {
+        stageFile.close();
+    }
+    stageFile = LittleFS.open(NODE_FW_IMAGE_PATH, "w");
+    if (!stageFile) {
+        publishNodeOtaResponse("begin", false, "cannot create image file");
+        return;
+    }
+
+    stageSize = size;
+    stageCrc = doc["crc32"] | 0;
+    stageReceived = 0;
+    stageReady = false;
+
+    uint8_t buffer[8];
+    putLe32(buffer, stageSize);
+    putLe32(buffer + 4, stageCrc);
+    File meta = LittleFS.open(NODE_FW_META_PATH, "w");
+    if (meta) {
+        meta.write(buffer, sizeof(buffer));
+        meta.close();
+    }
+
+    debugLog("Staging node image: " + String(stageSize) + " bytes");
+    publishNodeOtaResponse("begin", true, "");
+}
+
+// Chunks are written in order; an out of order offset reports the expected one
+// so an interrupted upload can resume where the gateway left off
+void handleNodeOtaData(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    uint32_t offset = params.values[0];
+
+    if (stageReady || stageSize == 0) {
+        publishNodeOtaResponse("data", false, "no upload in progress");
+        return;
+    }
+    if (!stageFile) {
+        // Upload interrupted by a reboot, continue appending to the partial image
+        stageFile = LittleFS.open(NODE_FW_IMAGE_PATH, "a");
+        if (!stageFile) {
+            publishNodeOtaResponse("data", false, "cannot open image file");
+            return;
+        }
+    }
+    if (offset != stageReceived || stageReceived + length > stageSize) {
+        publishNodeOtaResponse("data", false, "expected offset " + String(stageReceived));
+        return;
+    }
+
+    if (stageFile.write(payload, length) != length) {
+        publishNodeOtaResponse("data", false, "flash write failed");
+        return;
+    }
+    stageReceived += length;
+
+    if (stageReceived < stageSize) {
+        return;
+    }
+
+    // Image complete, verify it from flash
+    stageFile.close();
+    File image = LittleFS.open(NODE_FW_IMAGE_PATH, "r");
+    uint32_t crc = 0;
+    uint8_t buffer[64];
+    int readBytes;
+    while ((readBytes = image.read(buffer, sizeof(buffer))) > 0) {
+        crc = crc32Update(crc, buffer, readBytes);
+    }
+    image.close();
+
+    if (crc != stageCrc) {
+        publishNodeOtaResponse("data", false, "image CRC mismatch");
+        stageReceived = 0;
+        LittleFS.remove(NODE_FW_IMAGE_PATH);
+        return;
+    }
+
+    stageReady = true;
+    debugLog("Node image staged, CRC32 0x" + String(stageCrc, HEX));
+    publishNodeOtaResponse("data", true, "image staged");
+}
+
+// Node 0 is the broadcast address
+static bool addOtaTarget(uint8_t* targets, uint32_t nodeId) {
+    if (nodeId == 0 || nodeId > 255) {
+        return false;
+    }
+    targets[nodeId >> 3] |= 1 << (nodeId & 7);
+    return true;
+}
+
+void handleNodeOtaPush(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    if (!radioInitialized) {
+        publishNodeOtaResponse("push", false, "radio not initialized");
+        return;
+    }
+    if (!stageReady) {
+        publishNodeOtaResponse("push", false, "no staged image");
+        return;
+    }
+    if (nodeOtaActive()) {
+        publishNodeOtaResponse("push", false, "push in progress");
+        return;
+    }
+
+    DynamicJsonDocument doc(512);
+    if (deserializeJson(doc, payload, length) != DeserializationError::Ok) {
+        publishNodeOtaResponse("push", false, "invalid JSON");
+        return;
+    }
+
+    // Ids are checked before they are narrowed, 300 must not reach node 44
+    uint8_t targets[sizeof(otaTargets)];
+    memset(targets, 0, sizeof(targets));
+    if (doc.containsKey("nodeId") && !addOtaTarget(targets, doc["nodeId"].as<uint32_t>())) {
+        publishNodeOtaResponse("push", false, "node ids must be 1-255");
+        return;
+    }
+    JsonArray nodes = doc["nodeIds"];
+    for (JsonVariant node : nodes) {
+        if (!addOtaTarget(targets, node.as<uint32_t>())) {
+            publishNodeOtaResponse("push", false, "node ids must be 1-255");
+            return;
+        }
+    }
+    memcpy(otaTargets, targets, sizeof(otaTargets));
+
+    if (!startNextOtaTarget()) {
+        publishNodeOtaResponse("push", false, "no target nodes");
+        return;
+    }
+    publishNodeOtaResponse("push", true, "");
+}
+
+void handleNodeOtaAbort(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    if (nodeOtaActive()) {
+        memset(otaTargets, 0, sizeof(otaTargets));
+        finishOtaTarget("aborted");
+    }
+    publishNodeOtaResponse("abort", true, "");
+}
+
+void handleNodeOtaStatus(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    publishNodeOtaResponse("status", true, nodeOtaActive() ? "push to node " + String(otaNode) : "");
+}
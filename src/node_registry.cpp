@@ -0,0 +1,288 @@
+#include "config.h"
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// One fixed-size record per node id after a small header, so a record is
+// found by offset and rewritten in place
+#define REGISTRY_FILE_PATH      "/nodes.bin"
+#define REGISTRY_FILE_MAGIC     0x31444F4EUL    // "NOD1"
+#define REGISTRY_HEADER_LEN     8               // magic, record size, reserved
+
+// Hot fields of every record, all the per-frame path looks at
+static uint8_t registryFlags[256];
+static uint8_t registryTypes[256];
+static bool registryMounted = false;
+
+// Statistics
+static uint32_t registryBlocked = 0;
+static uint32_t registryWrites = 0;
+
+static uint32_t recordOffset(uint8_t nodeId) {
+    return REGISTRY_HEADER_LEN + (uint32_t)nodeId * sizeof(NodeRecord);
+}
+
+// The file is created once at full size, later writes never change its length
+static bool createRegistryFile() {
+    File file = LittleFS.open(REGISTRY_FILE_PATH, "w");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t header[2] = { REGISTRY_FILE_MAGIC, sizeof(NodeRecord) };
+    bool ok = file.write((const uint8_t*)header, sizeof(header)) == sizeof(header);
+
+    NodeRecord empty;
+    memset(&empty, 0, sizeof(empty));
+    for (uint16_t node = 0; node < 256 && ok; node++) {
+        ok = file.write((const uint8_t*)&empty, sizeof(empty)) == sizeof(empty);
+    }
+    file.close();
+
+    if (!ok) {
+        LittleFS.remove(REGISTRY_FILE_PATH);
+    }
+    return ok;
+}
+
+bool initializeNodeRegistry() {
+    memset(registryFlags, 0, sizeof(registryFlags));
+    memset(registryTypes, 0, sizeof(registryTypes));
+
+    registryMounted = LittleFS.begin();
+    if (!registryMounted) {
+        debugLog("LittleFS mount failed, node registry disabled");
+        return false;
+    }
+
+    File file = LittleFS.open(REGISTRY_FILE_PATH, "r");
+    uint32_t header[2] = { 0, 0 };
+    if (!file || file.read((uint8_t*)header, sizeof(header)) != sizeof(header) ||
+        header[0] != REGISTRY_FILE_MAGIC || header[1] != sizeof(NodeRecord) ||
+        file.size() != recordOffset(0) + 256 * sizeof(NodeRecord)) {
+        if (file) file.close();
+        debugLog("Node registry missing or invalid, creating it");
+        registryMounted = createRegistryFile();
+        return registryMounted;
+    }
+
+    // Records are read once, only the hot fields stay in RAM
+    uint16_t count = 0;
+    NodeRecord record;
+    for (uint16_t node = 0; node < 256; node++) {
+        if (file.read((uint8_t*)&record, sizeof(record)) != sizeof(record)) break;
+        if (record.flags & NODE_FLAG_REGISTERED) {
+            registryFlags[node] = record.flags;
+            registryTypes[node] = record.type;
+            count++;
+        }
+    }
+    file.close();
+
+    debugLog("Node registry loaded: " + String(count) + " nodes");
+    return true;
+}
+
+bool nodeRegistered(uint8_t nodeId) {
+    return registryFlags[nodeId] & NODE_FLAG_REGISTERED;
+}
+
+bool nodeBlocked(uint8_t nodeId) {
+    if (registryFlags[nodeId] & NODE_FLAG_BLOCKED) {
+        registryBlocked++;
+        return true;
+    }
+    return false;
+}
+
+bool nodeAckAllowed(uint8_t nodeId) {
+    return !(registryFlags[nodeId] & (NODE_FLAG_BLOCKED | NODE_FLAG_NO_ACK));
+}
+
+bool nodeAlarm(uint8_t nodeId) {
+    return registryFlags[nodeId] & NODE_FLAG_ALARM;
+}
+
+uint8_t nodeType(uint8_t nodeId) {
+    return registryTypes[nodeId];
+}
+
+// Cold fields come from the file
+bool getNodeRecord(uint8_t nodeId, NodeRecord& record) {
+    memset(&record, 0, sizeof(record));
+    if (!registryMounted || !nodeRegistered(nodeId)) {
+        return false;
+    }
+
+    File file = LittleFS.open(REGISTRY_FILE_PATH, "r");
+    if (!file) {
+        return false;
+    }
+    bool ok = file.seek(recordOffset(nodeId), SeekSet) && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record);
+    file.close();
+    return ok;
+}
+
+static bool writeNodeRecord(uint8_t nodeId, const NodeRecord& record) {
+    if (!registryMounted) {
+        return false;
+    }
+
+    // Only this node's slot is rewritten
+    File file = LittleFS.open(REGISTRY_FILE_PATH, "r+");
+    if (!file) {
+        return false;
+    }
+    bool ok = file.seek(recordOffset(nodeId), SeekSet) && file.write((const uint8_t*)&record, sizeof(record)) == sizeof(record);
+    file.close();
+
+    if (ok) {
+        registryFlags[nodeId] = record.flags;
+        registryTypes[nodeId] = record.type;
+        registryWrites++;
+    }
+    return ok;
+}
+
+bool setNodeRecord(uint8_t nodeId, const char* name, const char* location, uint8_t type, uint8_t flags, String& error) {
+    if (nodeId == 0) {
+        error = "invalid node id";
+        return false;
+    }
+    if (strlen(name) > NODE_NAME_MAX || strlen(location) > NODE_LOCATION_MAX) {
+        error = "name or location too long";
+        return false;
+    }
+
+    NodeRecord record;
+    memset(&record, 0, sizeof(record));
+    record.nodeId = nodeId;
+    record.flags = NODE_FLAG_REGISTERED | (flags & ~NODE_FLAG_REGISTERED);
+    record.type = type;
+    strncpy(record.name, name, NODE_NAME_MAX);
+    strncpy(record.location, location, NODE_LOCATION_MAX);
+    record.updated = timeSynced() ? epochMillis() / 1000 : 0;
+
+    if (!writeNodeRecord(nodeId, record)) {
+        error = "registry write failed";
+        return false;
+    }
+    return true;
+}
+
+bool removeNodeRecord(uint8_t nodeId) {
+    NodeRecord empty;
+    memset(&empty, 0, sizeof(empty));
+    return nodeId != 0 && writeNodeRecord(nodeId, empty);
+}
+
+String nodeRecordJson(uint8_t nodeId) {
+    NodeRecord record;
+    if (!getNodeRecord(nodeId, record)) {
+        return "";
+    }
+
+    DynamicJsonDocument doc(256);
+    doc["nodeId"] = nodeId;
+    doc["name"] = record.name;
+    doc["location"] = record.location;
+    doc["type"] = record.type;
+    doc["blocked"] = (record.flags & NODE_FLAG_BLOCKED) != 0;
+    doc["noAck"] = (record.flags & NODE_FLAG_NO_ACK) != 0;
+    doc["alarm"] = (record.flags & NODE_FLAG_ALARM) != 0;
+    doc["decoderId"] = nodeDecoder(nodeId);
+    if (record.updated != 0) {
+        doc["updated"] = record.updated;
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+static void publishNodeResponse(uint8_t nodeId, bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    String responseString;
+    if (ok && nodeRegistered(nodeId)) {
+        responseString = nodeRecordJson(nodeId);
+    } else {
+        DynamicJsonDocument response(192);
+        response["command"] = "node";
+        response["nodeId"] = nodeId;
+        response["success"] = ok;
+        if (!ok) {
+            response["error"] = error;
+        }
+        serializeJson(response, responseString);
+    }
+
+    String responseTopic = mqttBaseTopic + "/response/node";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+// command/node/{id}: {"name","location","type","blocked","noAck","alarm"} updates the
+// given fields, "{}" publishes the record, an empty payload removes the node
+void handleNodeCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    uint32_t nodeId = params.values[0];
+    String error;
+    bool ok = false;
+
+    if (nodeId == 0 || nodeId > 255) {
+        error = "invalid node id";
+    } else if (length == 0) {
+        ok = removeNodeRecord(nodeId);
+        if (!ok) error = "registry write failed";
+    } else {
+        DynamicJsonDocument doc(384);
+        DeserializationError parseError = deserializeJson(doc, payload, length);
+        if (parseError) {
+            error = String("invalid JSON: ") + parseError.c_str();
+        } else if (doc.as<JsonObjectConst>().size() == 0) {
+            ok = nodeRegistered(nodeId);
+            if (!ok) error = "node not registered";
+        } else {
+            NodeRecord record;
+            getNodeRecord(nodeId, record);
+
+            uint8_t flags = record.flags;
+            if (!doc["blocked"].isNull()) {
+                flags = doc["blocked"] ? (flags | NODE_FLAG_BLOCKED) : (flags & ~NODE_FLAG_BLOCKED);
+            }
+            if (!doc["noAck"].isNull()) {
+                flags = doc["noAck"] ? (flags | NODE_FLAG_NO_ACK) : (flags & ~NODE_FLAG_NO_ACK);
+            }
+            if (!doc["alarm"].isNull()) {
+                flags = doc["alarm"] ? (flags | NODE_FLAG_ALARM) : (flags & ~NODE_FLAG_ALARM);
+            }
+
+            ok = setNodeRecord(nodeId, doc["name"] | record.name, doc["location"] | record.location,
+                               doc["type"] | record.type, flags, error);
+        }
+    }
+
+    if (!ok) {
+        debugLog("Node " + String(nodeId) + " registry command rejected: " + error);
+    }
+    publishNodeResponse(nodeId, ok, error);
+}
+
+void publishNodeRegistryStats() {
+    if (!mqttConnected) return;
+
+    uint16_t nodes = 0;
+    for (uint16_t node = 1; node < 256; node++) {
+        if (registryFlags[node] & NODE_FLAG_REGISTERED) nodes++;
+    }
+
+    char stats[96];
+    snprintf(stats, sizeof(stats), "{\"nodes\":%u,\"blockedFrames\":%lu,\"writes\":%lu}",
+             nodes, (unsigned long)registryBlocked, (unsigned long)registryWrites);
+
+    String statsTopic = mqttBaseTopic + "/stats/nodes";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
@@ -0,0 +1,377 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <RFM69registers.h>
+#include <ArduinoJson.h>
+
+// Objects owned by gateway.cpp
+extern PubSubClient mqttClient;
+extern GatewayRadio radio;
+extern bool radioInitialized;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Channel move announcement, broadcast before the gateway retunes. Little endian.
+//   MOVE   gw->nodes [C5][frequency u32][inMs u16]    retune to frequency in inMs
+#define SURVEY_FRAME_MOVE       0xC5
+
+#define SURVEY_CHANNEL_PATH     "/channel.bin"
+#define SURVEY_CHANNEL_MAGIC    0x314E4843UL    // "CHN1"
+
+// Minimum samples of every channel before one is recommended
+#define SURVEY_MIN_SAMPLES      20
+
+// RSSI histogram, upper bounds in dBm; the last bucket is open
+static const int16_t surveyBucketsDbm[NOISE_SURVEY_BUCKETS - 1] = { -110, -100, -95, -90, -85, -80, -70 };
+
+struct SurveyChannel {
+    uint32_t frequency;
+    uint32_t samples;
+    uint32_t busy;                  // Samples at or above AIRTIME_LBT_RSSI_DBM
+    int32_t floorX16;               // Average RSSI of the idle samples, 1/16 dBm
+    int16_t maxDbm;
+    uint32_t counts[NOISE_SURVEY_BUCKETS];
+};
+
+static SurveyChannel surveyChannels[NOISE_SURVEY_MAX_CHANNELS];
+static uint8_t surveyChannelCount = 0;
+static uint8_t surveyNext = 0;
+static bool surveyEnabled = false;
+static unsigned long surveyIntervalMs = NOISE_SURVEY_INTERVAL_MS;
+static unsigned long lastSurveySample = 0;
+static uint32_t homeFrequency = 0;
+static uint32_t surveySkipped = 0;
+
+// Pending channel move
+static uint32_t moveFrequency = 0;
+static unsigned long moveAt = 0;
+static uint8_t moveAnnouncements = 0;
+static unsigned long lastMoveAnnouncement = 0;
+
+// ISM range of the RFM69_FREQUENCY band. Survey channels and moves stay in it,
+// outside it the airtime accounting knows no duty cycle limit.
+static bool frequencyInBand(uint32_t frequency) {
+#if RFM69_FREQUENCY == RF69_315MHZ
+    return frequency >= 300000000UL && frequency <= 348000000UL;
+#elif RFM69_FREQUENCY == RF69_433MHZ
+    return frequency >= 433050000UL && frequency <= 434790000UL;
+#elif RFM69_FREQUENCY == RF69_915MHZ
+    return frequency >= 902000000UL && frequency <= 928000000UL;
+#else
+    return frequency >= 863000000UL && frequency <= 870000000UL;
+#endif
+}
+
+// Channels spaced NOISE_SURVEY_STEP_HZ apart with the operating one in the
+// middle, those beyond a band edge are left out
+static void defaultSurveyChannels() {
+    memset(surveyChannels, 0, sizeof(surveyChannels));
+    surveyChannelCount = 0;
+    uint8_t channels = min(NOISE_SURVEY_CHANNELS, NOISE_SURVEY_MAX_CHANNELS);
+    for (uint8_t i = 0; i < channels; i++) {
+        uint32_t frequency = homeFrequency + ((int32_t)i - channels / 2) * (int32_t)NOISE_SURVEY_STEP_HZ;
+        if (frequencyInBand(frequency) || frequency == homeFrequency) {
+            surveyChannels[surveyChannelCount++].frequency = frequency;
+        }
+    }
+}
+
+static void resetSurveyStats() {
+    for (uint8_t i = 0; i < surveyChannelCount; i++) {
+        uint32_t frequency = surveyChannels[i].frequency;
+        memset(&surveyChannels[i], 0, sizeof(SurveyChannel));
+        surveyChannels[i].frequency = frequency;
+    }
+    surveyNext = 0;
+    surveySkipped = 0;
+}
+
+static void saveChannel(uint32_t frequency) {
+    File file = LittleFS.open(SURVEY_CHANNEL_PATH, "w");
+    if (!file) {
+        debugLog("Channel could not be saved");
+        return;
+    }
+    uint32_t record[2] = { SURVEY_CHANNEL_MAGIC, frequency };
+    file.write((const uint8_t*)record, sizeof(record));
+    file.close();
+}
+
+static void retune(uint32_t frequency) {
+    radio.setFrequency(frequency);
+    homeFrequency = radio.getFrequency();
+
+    // The sub-band, and with it the duty cycle budget, may have changed
+    initializeAirtime();
+}
+
+// A channel chosen by an earlier move overrides the band default
+void initializeNoiseSurvey() {
+    if (!radioInitialized) return;
+
+    if (LittleFS.begin()) {
+        File file = LittleFS.open(SURVEY_CHANNEL_PATH, "r");
+        uint32_t record[2] = { 0, 0 };
+        if (file) {
+            if (file.read((uint8_t*)record, sizeof(record)) == sizeof(record) && record[0] == SURVEY_CHANNEL_MAGIC &&
+                frequencyInBand(record[1])) {
+                retune(record[1]);
+                debugLog("Operating channel " + String(record[1]) + " Hz from an earlier move");
+            }
+            file.close();
+        }
+    }
+
+    homeFrequency = radio.getFrequency();
+    defaultSurveyChannels();
+    surveyEnabled = NOISE_SURVEY;
+}
+
+static void recordSurveySample(SurveyChannel& channel, int16_t rssi) {
+    uint8_t bucket = 0;
+    while (bucket < NOISE_SURVEY_BUCKETS - 1 && rssi >= surveyBucketsDbm[bucket]) {
+        bucket++;
+    }
+    channel.counts[bucket]++;
+
+    if (channel.samples == 0 || rssi > channel.maxDbm) {
+        channel.maxDbm = rssi;
+    }
+    channel.samples++;
+
+    if (rssi >= AIRTIME_LBT_RSSI_DBM) {
+        channel.busy++;
+    } else {
+        uint32_t idle = channel.samples - channel.busy;
+        channel.floorX16 = idle == 1 ? rssi * 16 : channel.floorX16 + (rssi * 16 - channel.floorX16) / 16;
+    }
+}
+
+// Nothing is being received: no frame waits for receiveFrame() and the
+// modem has not matched a sync word
+static bool radioIdle() {
+    return !GatewayRadio::frameReady() && !(radio.readReg(REG_IRQFLAGS1) & RF_IRQFLAGS1_SYNCADDRESSMATCH);
+}
+
+static void sampleNextChannel() {
+    if (!radioIdle()) {
+        surveySkipped++;
+        return;
+    }
+
+    SurveyChannel& channel = surveyChannels[surveyNext];
+    surveyNext = (surveyNext + 1) % surveyChannelCount;
+
+    if (channel.frequency == homeFrequency) {
+        recordSurveySample(channel, radio.readRSSI());
+        return;
+    }
+
+    // Off the operating channel for NOISE_SURVEY_SETTLE_US plus two retunes,
+    // about a millisecond; a frame that starts meanwhile is missed and
+    // retried by its node
+    radio.setFrequency(channel.frequency);
+    delayMicroseconds(NOISE_SURVEY_SETTLE_US);
+    int16_t rssi = radio.readRSSI();
+    radio.setFrequency(homeFrequency);
+
+    recordSurveySample(channel, rssi);
+}
+
+// Lowest occupancy, then lowest noise floor among the channels within one
+// percentage point of it. 0 until every channel has enough samples.
+static uint32_t recommendedChannel() {
+    int8_t best = -1;
+    uint32_t bestPermille = 0;
+    for (uint8_t i = 0; i < surveyChannelCount; i++) {
+        const SurveyChannel& channel = surveyChannels[i];
+        if (channel.samples < SURVEY_MIN_SAMPLES) {
+            return 0;
+        }
+        uint32_t permille = channel.busy * 1000 / channel.samples;
+        if (best < 0 || permille + 10 < bestPermille ||
+            (permille < bestPermille + 10 && channel.floorX16 < surveyChannels[best].floorX16)) {
+            best = i;
+            bestPermille = permille;
+        }
+    }
+    return best >= 0 ? surveyChannels[best].frequency : 0;
+}
+
+static void publishSurveyResponse(bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(256);
+    response["command"] = "survey";
+    response["success"] = ok;
+    if (!ok) {
+        response["error"] = error;
+    }
+    response["enabled"] = surveyEnabled;
+    response["frequency"] = homeFrequency;
+    if (moveFrequency != 0) {
+        response["moveTo"] = moveFrequency;
+        response["moveInMs"] = (long)(moveAt - millis()) > 0 ? moveAt - millis() : 0;
+    }
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/survey";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+// Announcements go out evenly spread over the move delay, each with the time left
+static void handleChannelMove() {
+    if ((long)(millis() - moveAt) >= 0) {
+        debugLog("Moving to " + String(moveFrequency) + " Hz");
+        retune(moveFrequency);
+        saveChannel(moveFrequency);
+        moveFrequency = 0;
+        resetSurveyStats();
+        publishSurveyResponse(true, "");
+        return;
+    }
+
+    if (moveAnnouncements >= NOISE_SURVEY_ANNOUNCES ||
+        millis() - lastMoveAnnouncement < NOISE_SURVEY_MOVE_DELAY_MS / (NOISE_SURVEY_ANNOUNCES + 1)) {
+        return;
+    }
+
+    uint16_t inMs = moveAt - millis();
+    uint8_t frame[7] = { SURVEY_FRAME_MOVE,
+                         (uint8_t)moveFrequency, (uint8_t)(moveFrequency >> 8), (uint8_t)(moveFrequency >> 16), (uint8_t)(moveFrequency >> 24),
+                         (uint8_t)inMs, (uint8_t)(inMs >> 8) };
+    // Over budget or busy channel: tried again next pass
+    if (radioTransmitImmediate(RF69_BROADCAST_ADDR, frame, sizeof(frame))) {
+        moveAnnouncements++;
+        lastMoveAnnouncement = millis();
+    }
+}
+
+void handleNoiseSurveyLoop() {
+    if (moveFrequency != 0) {
+        handleChannelMove();
+        return;
+    }
+
+    if (!surveyEnabled || surveyChannelCount == 0 || millis() - lastSurveySample < surveyIntervalMs) return;
+    lastSurveySample = millis();
+    sampleNextChannel();
+}
+
+// command/survey: {"enabled":true,"channels":[868100000,...],"intervalMs":250};
+// new channels reset the statistics, "{}" reports the state
+void handleSurveyCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    DynamicJsonDocument doc(768);
+    DeserializationError parseError = deserializeJson(doc, payload, length);
+    if (parseError) {
+        publishSurveyResponse(false, String("invalid JSON: ") + parseError.c_str());
+        return;
+    }
+
+    if (doc.containsKey("channels")) {
+        JsonArray channels = doc["channels"].as<JsonArray>();
+        if (channels.size() == 0 || channels.size() > NOISE_SURVEY_MAX_CHANNELS) {
+            publishSurveyResponse(false, "1-" + String(NOISE_SURVEY_MAX_CHANNELS) + " channels");
+            return;
+        }
+        for (JsonVariant frequency : channels) {
+            if (!frequencyInBand(frequency.as<uint32_t>())) {
+                publishSurveyResponse(false, "channel " + String(frequency.as<uint32_t>()) + " Hz is outside the radio band");
+                return;
+            }
+        }
+        memset(surveyChannels, 0, sizeof(surveyChannels));
+        surveyChannelCount = 0;
+        for (JsonVariant frequency : channels) {
+            surveyChannels[surveyChannelCount++].frequency = frequency.as<uint32_t>();
+        }
+        resetSurveyStats();
+    }
+    if (doc.containsKey("intervalMs")) {
+        surveyIntervalMs = max(doc["intervalMs"].as<unsigned long>(), 10UL);
+    }
+    if (doc.containsKey("enabled")) {
+        surveyEnabled = doc["enabled"];
+    }
+
+    publishSurveyResponse(true, "");
+}
+
+// command/survey/move: {"frequency":868300000,"announce":true}; without a
+// frequency the recommended channel is used. Nodes are told with MOVE
+// broadcasts, unless "announce" is false.
+void handleSurveyMoveCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    DynamicJsonDocument doc(256);
+    if (length > 0 && deserializeJson(doc, payload, length) != DeserializationError::Ok) {
+        publishSurveyResponse(false, "invalid JSON");
+        return;
+    }
+
+    uint32_t frequency = doc["frequency"] | recommendedChannel();
+    if (!radioInitialized || frequency == 0) {
+        publishSurveyResponse(false, "no channel to move to");
+        return;
+    }
+    if (!frequencyInBand(frequency)) {
+        publishSurveyResponse(false, "frequency outside the radio band");
+        return;
+    }
+    if (frequency == homeFrequency) {
+        publishSurveyResponse(true, "");
+        return;
+    }
+
+    bool announce = doc["announce"] | true;
+    moveFrequency = frequency;
+    moveAt = millis() + (announce ? NOISE_SURVEY_MOVE_DELAY_MS : 0);
+    moveAnnouncements = announce ? 0 : NOISE_SURVEY_ANNOUNCES;
+    lastMoveAnnouncement = millis() - NOISE_SURVEY_MOVE_DELAY_MS;
+    publishSurveyResponse(true, "");
+}
+
+void publishSurveyStats() {
+    if (!mqttConnected || surveyChannelCount == 0) return;
+
+    DynamicJsonDocument doc(256 + surveyChannelCount * 320);
+    doc["enabled"] = surveyEnabled;
+    doc["frequency"] = homeFrequency;
+    doc["skipped"] = surveySkipped;
+    doc["busyDbm"] = AIRTIME_LBT_RSSI_DBM;
+    uint32_t recommended = recommendedChannel();
+    if (recommended != 0) {
+        doc["recommended"] = recommended;
+    }
+
+    JsonArray bounds = doc.createNestedArray("bucketsDbm");
+    for (uint8_t i = 0; i < NOISE_SURVEY_BUCKETS - 1; i++) {
+        bounds.add(surveyBucketsDbm[i]);
+    }
+
+    JsonArray channels = doc.createNestedArray("channels");
+    for (uint8_t i = 0; i < surveyChannelCount; i++) {
+        const SurveyChannel& channel = surveyChannels[i];
+        JsonObject entry = channels.createNestedObject();
+        entry["frequency"] = channel.frequency;
+        entry["samples"] = channel.samples;
+        if (channel.samples == 0) continue;
+
+        entry["occupancy"] = (float)channel.busy * 100 / channel.samples;
+        if (channel.samples > channel.busy) {
+            entry["floorDbm"] = channel.floorX16 / 16;
+        }
+        entry["maxDbm"] = channel.maxDbm;
+        JsonArray counts = entry.createNestedArray("counts");
+        for (uint8_t b = 0; b < NOISE_SURVEY_BUCKETS; b++) {
+            counts.add(channel.counts[b]);
+        }
+    }
+
+    // Streamed, the channel list exceeds the MQTT client buffer
+    String statsTopic = mqttBaseTopic + "/stats/survey";
+    mqttClient.beginPublish(statsTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
@@ -0,0 +1,428 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include "payload_decoder.h"
+#include <LittleFS.h>
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define DECODER_FILE_PATH       "/decoders.bin"
+#define DECODER_TEMP_PATH       "/decoders.tmp"
+#define DECODER_FILE_MAGIC      0x31434544UL    // "DEC1"
+
+// Field types, the low nibble of an instruction opcode. Multi-byte types are
+// little endian unless named *be.
+enum DecoderFieldType : uint8_t {
+    DECODER_END = 0,
+    DECODER_U8,
+    DECODER_I8,
+    DECODER_U16,
+    DECODER_I16,
+    DECODER_U24,
+    DECODER_U32,
+    DECODER_I32,
+    DECODER_F32,
+    DECODER_U16BE,
+    DECODER_I16BE,
+    DECODER_U32BE,
+    DECODER_I32BE
+};
+
+struct DecoderTypeInfo {
+    const char* name;
+    uint8_t size;
+};
+
+static const DecoderTypeInfo decoderTypes[] = {
+    { "",      0 },
+    { "u8",    1 },
+    { "i8",    1 },
+    { "u16",   2 },
+    { "i16",   2 },
+    { "u24",   3 },
+    { "u32",   4 },
+    { "i32",   4 },
+    { "f32",   4 },
+    { "u16be", 2 },
+    { "i16be", 2 },
+    { "u32be", 4 },
+    { "i32be", 4 },
+};
+
+#define DECODER_TYPE_COUNT      (sizeof(decoderTypes) / sizeof(decoderTypes[0]))
+#define DECODER_OP_TYPE_MASK    0x0F
+#define DECODER_OP_SCALE        0x40    // Followed by a float scale
+#define DECODER_OP_UNIT         0x80    // Followed by a unit name index
+
+// A layout compiled to bytecode. Each instruction is
+//   opcode, offset, name index, [unit index], [float scale]
+// with names and units NUL-separated in the pool.
+struct DecoderLayout {
+    uint8_t minLength;              // Shortest frame the program can run on without bounds checks
+    uint8_t programLength;          // 0 = unused
+    uint8_t poolLength;
+    uint8_t program[DECODER_PROGRAM_SIZE];
+    char pool[DECODER_POOL_SIZE];
+};
+
+static DecoderLayout decoderLayouts[DECODER_MAX_LAYOUTS];
+static uint8_t decoderForNode[256];     // Layout id + 1 per node, 0 = no layout
+static bool decodersMounted = false;
+
+// Statistics
+static uint32_t framesDecoded = 0;
+static uint32_t framesTooShort = 0;
+
+static bool saveDecoders() {
+    File file = LittleFS.open(DECODER_TEMP_PATH, "w");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t magic = DECODER_FILE_MAGIC;
+    bool ok = file.write((const uint8_t*)&magic, sizeof(magic)) == sizeof(magic) &&
+              file.write(decoderForNode, sizeof(decoderForNode)) == sizeof(decoderForNode) &&
+              file.write((const uint8_t*)decoderLayouts, sizeof(decoderLayouts)) == sizeof(decoderLayouts);
+    file.close();
+
+    if (!ok) {
+        LittleFS.remove(DECODER_TEMP_PATH);
+        return false;
+    }
+
+    // Replace the old table only once the new one is complete
+    LittleFS.remove(DECODER_FILE_PATH);
+    return LittleFS.rename(DECODER_TEMP_PATH, DECODER_FILE_PATH);
+}
+
+bool initializeDecoders() {
+    memset(decoderLayouts, 0, sizeof(decoderLayouts));
+    memset(decoderForNode, 0, sizeof(decoderForNode));
+
+    decodersMounted = LittleFS.begin();
+    if (!decodersMounted) {
+        debugLog("LittleFS mount failed, payload decoders disabled");
+        return false;
+    }
+
+    File file = LittleFS.open(DECODER_FILE_PATH, "r");
+    if (!file) {
+        return true;
+    }
+
+    uint32_t magic = 0;
+    if (file.read((uint8_t*)&magic, sizeof(magic)) != sizeof(magic) || magic != DECODER_FILE_MAGIC ||
+        file.read(decoderForNode, sizeof(decoderForNode)) != sizeof(decoderForNode) ||
+        file.read((uint8_t*)decoderLayouts, sizeof(decoderLayouts)) != sizeof(decoderLayouts)) {
+        debugLog("Payload decoder table invalid, ignored");
+        memset(decoderLayouts, 0, sizeof(decoderLayouts));
+        memset(decoderForNode, 0, sizeof(decoderForNode));
+    }
+    file.close();
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < DECODER_MAX_LAYOUTS; i++) {
+        if (decoderLayouts[i].programLength > 0) count++;
+    }
+    debugLog("Payload decoders loaded: " + String(count));
+    return true;
+}
+
+static uint8_t findDecoderType(const char* name) {
+    for (uint8_t i = 1; i < DECODER_TYPE_COUNT; i++) {
+        if (strcmp(decoderTypes[i].name, name) == 0) return i;
+    }
+    return DECODER_END;
+}
+
+// Names are interned so fields sharing a unit store it once
+static int addPoolString(DecoderLayout& layout, const char* text) {
+    size_t length = strlen(text);
+    for (uint8_t i = 0; i < layout.poolLength; i += strlen(layout.pool + i) + 1) {
+        if (strcmp(layout.pool + i, text) == 0) return i;
+    }
+    if (length == 0 || length > DECODER_NAME_MAX || layout.poolLength + length + 1 > DECODER_POOL_SIZE) {
+        return -1;
+    }
+
+    int index = layout.poolLength;
+    memcpy(layout.pool + index, text, length + 1);
+    layout.poolLength += length + 1;
+    return index;
+}
+
+static bool compileDecoderLayout(JsonArrayConst fields, DecoderLayout& layout, String& error) {
+    memset(&layout, 0, sizeof(layout));
+
+    for (JsonObjectConst field : fields) {
+        const char* name = field["name"] | "";
+        const char* typeName = field["type"] | "";
+        const char* unit = field["unit"] | "";
+        int offset = field["offset"] | -1;
+        float scale = field["scale"] | 1.0f;
+
+        uint8_t type = findDecoderType(typeName);
+        if (type == DECODER_END) {
+            error = "unknown type '" + String(typeName) + "'";
+            return false;
+        }
+        if (offset < 0 || offset + decoderTypes[type].size > RF69_MAX_DATA_LEN) {
+            error = "bad offset for '" + String(name) + "'";
+            return false;
+        }
+
+        int nameIndex = addPoolString(layout, name);
+        int unitIndex = unit[0] ? addPoolString(layout, unit) : 0;
+        if (nameIndex < 0 || unitIndex < 0) {
+            error = "names too long for '" + String(name) + "'";
+            return false;
+        }
+
+        uint8_t opcode = type | (scale != 1.0f ? DECODER_OP_SCALE : 0) | (unit[0] ? DECODER_OP_UNIT : 0);
+        size_t size = 3 + (unit[0] ? 1 : 0) + (scale != 1.0f ? sizeof(float) : 0);
+        if (layout.programLength + size + 1 > DECODER_PROGRAM_SIZE) {
+            error = "too many fields";
+            return false;
+        }
+
+        uint8_t* out = layout.program + layout.programLength;
+        *out++ = opcode;
+        *out++ = offset;
+        *out++ = nameIndex;
+        if (opcode & DECODER_OP_UNIT) {
+            *out++ = unitIndex;
+        }
+        if (opcode & DECODER_OP_SCALE) {
+            memcpy(out, &scale, sizeof(float));
+            out += sizeof(float);
+        }
+        layout.programLength = out - layout.program;
+        if (offset + decoderTypes[type].size > layout.minLength) {
+            layout.minLength = offset + decoderTypes[type].size;
+        }
+    }
+
+    if (layout.programLength == 0) {
+        error = "no fields";
+        return false;
+    }
+
+    layout.program[layout.programLength++] = DECODER_END;
+    return true;
+}
+
+// Replace decoder 'decoderId' (1-based) from a JSON layout; an empty layout removes it
+// The id is checked before it is narrowed, topic and form values can be any number
+bool setDecoderLayout(uint32_t decoderId, const char* json, size_t length, String& error) {
+    if (!decodersMounted) {
+        error = "filesystem unavailable";
+        return false;
+    }
+    if (decoderId == 0 || decoderId > DECODER_MAX_LAYOUTS) {
+        error = "decoder id must be 1-" + String(DECODER_MAX_LAYOUTS);
+        return false;
+    }
+
+    DecoderLayout layout;
+    memset(&layout, 0, sizeof(layout));
+
+    DynamicJsonDocument doc(1536);
+    if (length > 0) {
+        DeserializationError parseError = deserializeJson(doc, json, length);
+        if (parseError) {
+            error = String("invalid JSON: ") + parseError.c_str();
+            return false;
+        }
+        if (!compileDecoderLayout(doc["fields"].as<JsonArrayConst>(), layout, error)) {
+            return false;
+        }
+    }
+
+    decoderLayouts[decoderId - 1] = layout;
+
+    // The node list replaces earlier assignments of this decoder
+    for (uint16_t node = 0; node < 256; node++) {
+        if (decoderForNode[node] == decoderId) decoderForNode[node] = 0;
+    }
+    for (JsonVariantConst node : doc["nodes"].as<JsonArrayConst>()) {
+        uint16_t nodeId = node.as<uint16_t>();
+        if (nodeId > 0 && nodeId < 256 && layout.programLength > 0) {
+            decoderForNode[nodeId] = decoderId;
+        }
+    }
+
+    if (!saveDecoders()) {
+        error = "saving failed";
+        return false;
+    }
+
+    debugLog("Payload decoder " + String(decoderId) + (layout.programLength > 0 ? " compiled to " + String(layout.programLength) + " bytes" : " removed"));
+    return true;
+}
+
+static float readScale(const uint8_t* at) {
+    float scale;
+    memcpy(&scale, at, sizeof(float));
+    return scale;
+}
+
+// Decoder layout as JSON, in the form accepted by setDecoderLayout()
+String decoderLayoutJson(uint8_t decoderId) {
+    if (decoderId == 0 || decoderId > DECODER_MAX_LAYOUTS || decoderLayouts[decoderId - 1].programLength == 0) {
+        return "";
+    }
+
+    const DecoderLayout& layout = decoderLayouts[decoderId - 1];
+    DynamicJsonDocument doc(1536);
+
+    JsonArray nodes = doc.createNestedArray("nodes");
+    for (uint16_t node = 1; node < 256; node++) {
+        if (decoderForNode[node] == decoderId) nodes.add(node);
+    }
+
+    JsonArray fields = doc.createNestedArray("fields");
+    for (const uint8_t* pc = layout.program; *pc != DECODER_END; ) {
+        uint8_t opcode = *pc++;
+        JsonObject field = fields.createNestedObject();
+        field["offset"] = *pc++;
+        field["name"] = (const char*)(layout.pool + *pc++);
+        field["type"] = decoderTypes[opcode & DECODER_OP_TYPE_MASK].name;
+        if (opcode & DECODER_OP_UNIT) {
+            field["unit"] = (const char*)(layout.pool + *pc++);
+        }
+        if (opcode & DECODER_OP_SCALE) {
+            field["scale"] = readScale(pc);
+            pc += sizeof(float);
+        }
+    }
+
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
+
+uint8_t nodeDecoder(uint8_t nodeId) {
+    return decoderForNode[nodeId];
+}
+
+bool decodeRadioPayload(const RadioFrame& frame, JsonDocument& doc) {
+    uint8_t decoderId = decoderForNode[frame.senderId];
+    if (decoderId == 0) {
+        return false;
+    }
+
+    const DecoderLayout& layout = decoderLayouts[decoderId - 1];
+    if (frame.length < layout.minLength) {
+        framesTooShort++;
+        return false;
+    }
+
+    JsonObject data = doc.createNestedObject("data");
+    JsonObject units;
+
+    // minLength covers every field, so the program reads without bounds checks
+    for (const uint8_t* pc = layout.program; *pc != DECODER_END; ) {
+        uint8_t opcode = *pc++;
+        const uint8_t* at = frame.data + *pc++;
+        const char* name = layout.pool + *pc++;
+
+        if (opcode & DECODER_OP_UNIT) {
+            if (units.isNull()) units = doc.createNestedObject("units");
+            units[name] = (const char*)(layout.pool + *pc++);
+        }
+
+        int32_t value = 0;
+        float real = 0;
+        bool isReal = false;
+        switch (opcode & DECODER_OP_TYPE_MASK) {
+            case DECODER_U8:    value = at[0]; break;
+            case DECODER_I8:    value = (int8_t)at[0]; break;
+            case DECODER_U16:   value = at[0] | (at[1] << 8); break;
+            case DECODER_I16:   value = (int16_t)(at[0] | (at[1] << 8)); break;
+            case DECODER_U24:   value = at[0] | (at[1] << 8) | ((uint32_t)at[2] << 16); break;
+            case DECODER_U16BE: value = (at[0] << 8) | at[1]; break;
+            case DECODER_I16BE: value = (int16_t)((at[0] << 8) | at[1]); break;
+            case DECODER_F32:   memcpy(&real, at, sizeof(float)); isReal = true; break;
+            case DECODER_U32:
+            case DECODER_U32BE: {
+                uint32_t u = (opcode & DECODER_OP_TYPE_MASK) == DECODER_U32
+                    ? at[0] | (at[1] << 8) | ((uint32_t)at[2] << 16) | ((uint32_t)at[3] << 24)
+                    : ((uint32_t)at[0] << 24) | ((uint32_t)at[1] << 16) | (at[2] << 8) | at[3];
+                if (opcode & DECODER_OP_SCALE) {
+                    real = u;
+                    isReal = true;
+                } else {
+                    data[name] = u;
+                    continue;
+                }
+                break;
+            }
+            case DECODER_I32:   value = at[0] | (at[1] << 8) | ((uint32_t)at[2] << 16) | ((uint32_t)at[3] << 24); break;
+            case DECODER_I32BE: value = ((uint32_t)at[0] << 24) | ((uint32_t)at[1] << 16) | (at[2] << 8) | at[3]; break;
+        }
+
+        if (opcode & DECODER_OP_SCALE) {
+            data[name] = (isReal ? real : value) * readScale(pc);
+            pc += sizeof(float);
+        } else if (isReal) {
+            data[name] = real;
+        } else {
+            data[name] = value;
+        }
+    }
+
+    framesDecoded++;
+    return true;
+}
+
+static void publishDecoderResponse(uint32_t decoderId, bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(192);
+    response["command"] = "decoder";
+    response["decoderId"] = decoderId;
+    response["success"] = ok;
+    if (ok && decoderId > 0 && decoderId <= DECODER_MAX_LAYOUTS) {
+        response["bytes"] = decoderLayouts[decoderId - 1].programLength;
+    } else if (!ok) {
+        response["error"] = error;
+    }
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/decoder";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+// command/decoder/{id}: JSON layout {"nodes":[..],"fields":[{name,type,offset,scale,unit}]}, empty removes
+void handleDecoderCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    String error;
+    bool ok = setDecoderLayout(params.values[0], (const char*)payload, length, error);
+    if (!ok) {
+        debugLog("Decoder " + String(params.values[0]) + " rejected: " + error);
+    }
+    publishDecoderResponse(params.values[0], ok, error);
+}
+
+void publishDecoderStats() {
+    if (!mqttConnected) return;
+
+    uint8_t layouts = 0;
+    for (uint8_t i = 0; i < DECODER_MAX_LAYOUTS; i++) {
+        if (decoderLayouts[i].programLength > 0) layouts++;
+    }
+    uint16_t nodes = 0;
+    for (uint16_t node = 1; node < 256; node++) {
+        if (decoderForNode[node] != 0) nodes++;
+    }
+
+    char stats[128];
+    snprintf(stats, sizeof(stats), "{\"decoders\":%u,\"nodes\":%u,\"decoded\":%lu,\"tooShort\":%lu}",
+             layouts, nodes, (unsigned long)framesDecoded, (unsigned long)framesTooShort);
+
+    String statsTopic = mqttBaseTopic + "/stats/decoder";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
@@ -0,0 +1,125 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Frames are alarms when the node sets RFM69_CTL_PRIORITY in the header or the
+// registry marks the node as an alarm node. Alarm frames have their own receive
+// and transmit queues, which are always served before routine traffic.
+static const char* const priorityNames[PRIORITY_CLASSES] = { "alarm", "routine" };
+
+// Upper bounds in ms; the last bucket is open. Uplink is radio interrupt to
+// MQTT publish, downlink is the wait for the radio.
+static const uint16_t priorityBucketsMs[PRIORITY_LATENCY_BUCKETS - 1] = { 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+struct PriorityLatency {
+    uint32_t counts[PRIORITY_LATENCY_BUCKETS];
+    uint32_t frames;
+    uint32_t maxUs;
+    uint32_t avgUs;
+};
+
+static PriorityLatency priorityLatency[2][PRIORITY_CLASSES];
+static uint32_t headerAlarms = 0;
+static uint32_t registryAlarms = 0;
+
+// Alarm uplinks that reached the local sinks while the broker was down, oldest
+// first. They are published ahead of everything else after reconnect.
+static RadioFrame heldAlarms[PRIORITY_ALARM_HOLD];
+static uint8_t heldAlarmHead = 0;
+static uint8_t heldAlarmCount = 0;
+static uint32_t heldAlarmTotal = 0;
+static uint32_t droppedAlarms = 0;
+
+uint8_t framePriority(uint8_t senderId, uint8_t ctl) {
+    if (ctl & RFM69_CTL_PRIORITY) {
+        headerAlarms++;
+        return PRIORITY_ALARM;
+    }
+    if (nodeAlarm(senderId)) {
+        registryAlarms++;
+        return PRIORITY_ALARM;
+    }
+    return PRIORITY_ROUTINE;
+}
+
+uint8_t downlinkPriority(uint8_t targetId) {
+    return nodeAlarm(targetId) ? PRIORITY_ALARM : PRIORITY_ROUTINE;
+}
+
+void recordPriorityLatency(uint8_t direction, uint8_t priority, uint32_t latencyUs) {
+    PriorityLatency& stats = priorityLatency[direction][priority];
+
+    uint8_t bucket = 0;
+    while (bucket < PRIORITY_LATENCY_BUCKETS - 1 && latencyUs >= priorityBucketsMs[bucket] * 1000UL) {
+        bucket++;
+    }
+    stats.counts[bucket]++;
+
+    stats.frames++;
+    stats.maxUs = max(stats.maxUs, latencyUs);
+    stats.avgUs = stats.frames == 1 ? latencyUs : (stats.avgUs * 7 + latencyUs) / 8;
+}
+
+void holdAlarmFrame(const RadioFrame& frame) {
+    // A full buffer gives up its oldest alarm
+    if (heldAlarmCount == PRIORITY_ALARM_HOLD) {
+        heldAlarmHead = (heldAlarmHead + 1) % PRIORITY_ALARM_HOLD;
+        heldAlarmCount--;
+        droppedAlarms++;
+    }
+    heldAlarms[(heldAlarmHead + heldAlarmCount) % PRIORITY_ALARM_HOLD] = frame;
+    heldAlarmCount++;
+    heldAlarmTotal++;
+}
+
+bool nextHeldAlarm(RadioFrame& frame) {
+    if (heldAlarmCount == 0) return false;
+
+    frame = heldAlarms[heldAlarmHead];
+    heldAlarmHead = (heldAlarmHead + 1) % PRIORITY_ALARM_HOLD;
+    heldAlarmCount--;
+    return true;
+}
+
+static void addPriorityLatency(JsonObject target, uint8_t direction) {
+    for (uint8_t lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        PriorityLatency& stats = priorityLatency[direction][lane];
+
+        JsonObject entry = target.createNestedObject(priorityNames[lane]);
+        entry["frames"] = stats.frames;
+        entry["avgUs"] = stats.avgUs;
+        entry["maxUs"] = stats.maxUs;
+        JsonArray counts = entry.createNestedArray("counts");
+        for (uint8_t i = 0; i < PRIORITY_LATENCY_BUCKETS; i++) {
+            counts.add(stats.counts[i]);
+        }
+    }
+}
+
+void publishPriorityStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(1024);
+    doc["headerAlarms"] = headerAlarms;
+    doc["registryAlarms"] = registryAlarms;
+    doc["heldAlarms"] = heldAlarmTotal;
+    doc["droppedAlarms"] = droppedAlarms;
+
+    JsonArray bounds = doc.createNestedArray("bucketsMs");
+    for (uint8_t i = 0; i < PRIORITY_LATENCY_BUCKETS - 1; i++) {
+        bounds.add(priorityBucketsMs[i]);
+    }
+    addPriorityLatency(doc.createNestedObject("uplink"), PRIORITY_UPLINK);
+    addPriorityLatency(doc.createNestedObject("downlink"), PRIORITY_DOWNLINK);
+
+    // Streamed, both histograms together can exceed the MQTT client buffer
+    String statsTopic = mqttBaseTopic + "/stats/priority";
+    mqttClient.beginPublish(statsTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
@@ -0,0 +1,376 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <PubSubClient.h>
+#include <RFM69registers.h>
+#include <ArduinoJson.h>
+
+extern PubSubClient mqttClient;
+extern GatewayRadio radio;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define RFM69_FXOSC             32000000UL
+#define RFM69_FRAME_HEADER_LEN  3           // target, sender, control byte
+#define RFM69_CRC_LEN           2
+#define RF_OPMODE_MODE_MASK     0x1C
+#define RF_OPMODE_RX            0x10
+#define RF_SYNC_ON              0x80
+
+// Duty-cycle limits per sub-band (ETSI EN 300 220, 863-870 MHz), in 0.1 % units
+struct AirtimeSubBand {
+    const char* name;
+    uint32_t fromHz;
+    uint32_t toHz;
+    uint16_t dutyPermille;
+};
+
+static const AirtimeSubBand subBands[] = {
+    { "h1.4", 863000000, 868000000, 1 },
+    { "g",    868000000, 868600000, 10 },
+    { "g1",   868700000, 869200000, 1 },
+    { "g2",   869400000, 869650000, 100 },
+    { "g3",   869700000, 870000000, 10 },
+};
+
+#define SUB_BAND_COUNT (sizeof(subBands) / sizeof(subBands[0]))
+
+// Rolling one hour window per sub-band, kept as coarse buckets of airtime
+static uint32_t bandUsageUs[SUB_BAND_COUNT][AIRTIME_WINDOW_BUCKETS];
+static uint32_t bucketEpoch = 0;
+static const unsigned long AIRTIME_BUCKET_MS = 3600000UL / AIRTIME_WINDOW_BUCKETS;
+
+// Active modem parameters, read from the radio once it is configured
+static int8_t activeBand = -1;          // -1 = frequency without duty-cycle limit
+static uint32_t bitrate = 55555;
+static uint16_t preambleBytes = 3;
+static uint8_t syncBytes = 2;
+static bool aesEnabled = false;
+
+// Deferred transmissions, one queue per priority class, oldest first
+struct RadioTxEntry {
+    uint8_t targetId;
+    uint8_t length;
+    uint8_t responseKind;
+    bool requestAck;
+    uint8_t lbtAttempts;
+    unsigned long queuedAt;
+    unsigned long notBefore;
+    uint8_t data[RF69_MAX_DATA_LEN];
+};
+
+static RadioTxEntry txQueue[PRIORITY_CLASSES][RADIO_TX_QUEUE_LEN];
+static uint8_t txQueueHead[PRIORITY_CLASSES];
+static uint8_t txQueueCount[PRIORITY_CLASSES];
+
+// Statistics
+static uint32_t framesSent = 0;
+static uint32_t deferredBudget = 0;
+static uint32_t deferredBusy = 0;
+static uint32_t acksSuppressed = 0;
+static uint32_t queueOverflows = 0;
+
+void initializeAirtime() {
+    bitrate = RFM69_FXOSC / (((uint16_t)radio.readReg(REG_BITRATEMSB) << 8) | radio.readReg(REG_BITRATELSB));
+    preambleBytes = ((uint16_t)radio.readReg(REG_PREAMBLEMSB) << 8) | radio.readReg(REG_PREAMBLELSB);
+    uint8_t syncConfig = radio.readReg(REG_SYNCCONFIG);
+    syncBytes = (syncConfig & RF_SYNC_ON) ? ((syncConfig >> 3) & 0x07) + 1 : 0;
+    aesEnabled = radio.readReg(REG_PACKETCONFIG2) & 0x01;
+
+    uint32_t frequency = radio.getFrequency();
+    activeBand = -1;
+    for (uint8_t i = 0; i < SUB_BAND_COUNT; i++) {
+        if (frequency >= subBands[i].fromHz && frequency < subBands[i].toHz) {
+            activeBand = i;
+            break;
+        }
+    }
+
+    debugLog("Airtime: " + String(bitrate) + " bps, sub-band " + String(activeBand >= 0 ? subBands[activeBand].name : "unlimited") +
+             ", 40 byte frame " + String(radioFrameAirtimeUs(40)) + " us");
+}
+
+uint32_t radioFrameAirtimeUs(uint8_t payloadLength) {
+    // AES works on 16 byte blocks over everything after the length byte
+    uint16_t messageBytes = RFM69_FRAME_HEADER_LEN + payloadLength;
+    if (aesEnabled) {
+        messageBytes = (messageBytes + 15) & ~15;
+    }
+    uint32_t frameBytes = preambleBytes + syncBytes + 1 + messageBytes + RFM69_CRC_LEN;
+    return (uint64_t)frameBytes * 8 * 1000000UL / bitrate;
+}
+
+static uint32_t bandBudgetUs(uint8_t band) {
+    return 3600000000UL / 1000 * subBands[band].dutyPermille;
+}
+
+static void advanceBuckets() {
+    uint32_t epoch = millis() / AIRTIME_BUCKET_MS;
+    uint32_t elapsed = epoch - bucketEpoch;
+    if (elapsed == 0) return;
+
+    // Clear the buckets that rolled out of the window since the last call
+    for (uint32_t i = 1; i <= elapsed && i <= AIRTIME_WINDOW_BUCKETS; i++) {
+        uint8_t bucket = (bucketEpoch + i) % AIRTIME_WINDOW_BUCKETS;
+        for (uint8_t band = 0; band < SUB_BAND_COUNT; band++) {
+            bandUsageUs[band][bucket] = 0;
+        }
+    }
+    bucketEpoch = epoch;
+}
+
+static uint32_t bandUsedUs(uint8_t band) {
+    uint32_t used = 0;
+    for (uint8_t i = 0; i < AIRTIME_WINDOW_BUCKETS; i++) {
+        used += bandUsageUs[band][i];
+    }
+    return used;
+}
+
+bool airtimeAvailable(uint8_t payloadLength) {
+    if (activeBand < 0) return true;
+
+    advanceBuckets();
+    return bandUsedUs(activeBand) + radioFrameAirtimeUs(payloadLength) <= bandBudgetUs(activeBand);
+}
+
+void accountAirtime(uint8_t payloadLength) {
+    framesSent++;
+    if (activeBand < 0) return;
+
+    advanceBuckets();
+    bandUsageUs[activeBand][bucketEpoch % AIRTIME_WINDOW_BUCKETS] += radioFrameAirtimeUs(payloadLength);
+}
+
+// Listen before talk. The RSSI register is only meaningful while receiving;
+// in any other mode the library's own CSMA check in send() covers the channel.
+static bool channelClear() {
+    if ((radio.readReg(REG_OPMODE) & RF_OPMODE_MODE_MASK) != RF_OPMODE_RX) {
+        return true;
+    }
+    return radio.readRSSI() < AIRTIME_LBT_RSSI_DBM;
+}
+
+bool radioTxPossible(uint8_t length) {
+    return airtimeAvailable(length) && channelClear();
+}
+
+bool radioAckAllowed(uint8_t length) {
+    // A late ACK is useless to the node, so over budget it is not sent at all
+    if (!airtimeAvailable(length)) {
+        acksSuppressed++;
+        return false;
+    }
+    accountAirtime(length);
+    return true;
+}
+
+bool radioTransmitImmediate(uint8_t targetId, const void* data, uint8_t length, bool requestAck) {
+    if (!airtimeAvailable(length)) {
+        deferredBudget++;
+        return false;
+    }
+    if (!channelClear()) {
+        deferredBusy++;
+        return false;
+    }
+    radio.send(targetId, data, length, requestAck);
+    accountAirtime(length);
+    return true;
+}
+
+// Same retry scheme as RFM69::sendWithRetry(), but every attempt is checked
+// against and charged to the budget
+static bool transmitWithAck(GatewayRadio& via, uint8_t targetId, const void* data, uint8_t length) {
+    bool acked = false;
+    enterLoopStage(STAGE_RADIO_TX);
+
+    for (uint8_t attempt = 0; attempt <= RADIO_TX_RETRIES && !acked; attempt++) {
+        if (!airtimeAvailable(length)) {
+            deferredBudget++;
+            break;
+        }
+
+        via.send(targetId, data, length, true);
+        accountAirtime(length);
+
+        unsigned long sentAt = millis();
+        while (millis() - sentAt < RADIO_TX_RETRY_WAIT_MS) {
+            if (via.ACKReceived(targetId)) {
+                acked = true;
+                break;
+            }
+            yield();
+        }
+    }
+
+    leaveLoopStage();
+    return acked;
+}
+
+static unsigned long lbtBackoff(uint8_t attempts) {
+    // Randomized binary exponential backoff. The first window is already twice
+    // the base, so senders that found the channel busy together spread out.
+    unsigned long window = (unsigned long)AIRTIME_LBT_BACKOFF_MS << (min(attempts, (uint8_t)4) + 1);
+    return random(AIRTIME_LBT_BACKOFF_MS, window + 1);
+}
+
+static bool queueRadioTx(uint8_t targetId, const void* data, uint8_t length, bool requestAck, uint8_t responseKind,
+                         uint8_t priority, unsigned long delayMs) {
+    if (txQueueCount[priority] >= RADIO_TX_QUEUE_LEN) {
+        queueOverflows++;
+        return false;
+    }
+
+    RadioTxEntry& entry = txQueue[priority][(txQueueHead[priority] + txQueueCount[priority]) % RADIO_TX_QUEUE_LEN];
+    entry.targetId = targetId;
+    entry.length = length;
+    entry.responseKind = responseKind;
+    entry.requestAck = requestAck;
+    entry.lbtAttempts = 0;
+    entry.queuedAt = millis();
+    entry.notBefore = millis() + delayMs;
+    memcpy(entry.data, data, length);
+    txQueueCount[priority]++;
+    return true;
+}
+
+RadioTxResult radioTransmit(uint8_t targetId, const void* data, uint8_t length, bool requestAck, uint8_t responseKind, uint8_t priority) {
+    if (length > RF69_MAX_DATA_LEN || priority >= PRIORITY_CLASSES) {
+        return RADIO_TX_FAILED;
+    }
+
+    // Keep order within a class: nothing overtakes frames of the same or a higher class
+    uint8_t waiting = 0;
+    for (uint8_t lane = 0; lane <= priority; lane++) {
+        waiting += txQueueCount[lane];
+    }
+
+    bool sendNow = false;
+    if (waiting == 0) {
+        if (!airtimeAvailable(length)) {
+            deferredBudget++;
+        } else if (!channelClear()) {
+            deferredBusy++;
+        } else {
+            sendNow = true;
+        }
+    }
+    if (!sendNow) {
+        return queueRadioTx(targetId, data, length, requestAck, responseKind, priority, lbtBackoff(0)) ? RADIO_TX_DEFERRED : RADIO_TX_FAILED;
+    }
+
+    bool sent = true;
+    if (requestAck) {
+        sent = transmitWithAck(radio, targetId, data, length);
+    } else {
+        radio.send(targetId, data, length);
+        accountAirtime(length);
+    }
+    if (sent) {
+        recordPriorityLatency(PRIORITY_DOWNLINK, priority, 0);
+    }
+    return sent ? RADIO_TX_SENT : RADIO_TX_FAILED;
+}
+
+// Immediate transmission on another radio, without queueing. Charged to the
+// shared budget, which is conservative when the radio is on another sub-band.
+RadioTxResult radioTransmitVia(GatewayRadio& via, uint8_t targetId, const void* data, uint8_t length, bool requestAck) {
+    if (length > RF69_MAX_DATA_LEN || !via.ready()) {
+        return RADIO_TX_FAILED;
+    }
+    if (!airtimeAvailable(length)) {
+        deferredBudget++;
+        return RADIO_TX_FAILED;
+    }
+
+    bool sent = true;
+    via.use();
+    if (requestAck) {
+        sent = transmitWithAck(via, targetId, data, length);
+    } else {
+        via.send(targetId, data, length);
+        accountAirtime(length);
+    }
+    // Everything else in the gateway talks to the first radio
+    radio.use();
+
+    return sent ? RADIO_TX_SENT : RADIO_TX_FAILED;
+}
+
+void handleRadioTxQueue() {
+    // Strict priority: a lower class only gets the radio while no higher one is ready
+    uint8_t lane = 0;
+    while (lane < PRIORITY_CLASSES &&
+           (txQueueCount[lane] == 0 || (long)(millis() - txQueue[lane][txQueueHead[lane]].notBefore) < 0)) {
+        lane++;
+    }
+    if (lane == PRIORITY_CLASSES) return;
+
+    RadioTxEntry& entry = txQueue[lane][txQueueHead[lane]];
+    unsigned long waitedMs = millis() - entry.queuedAt;
+
+    bool sent = false;
+    bool success = false;
+
+    if (!airtimeAvailable(entry.length)) {
+        // Budget frees up as buckets roll out of the window
+        deferredBudget++;
+        entry.notBefore = millis() + AIRTIME_BUCKET_MS / 10;
+    } else if (!channelClear()) {
+        deferredBusy++;
+        if (++entry.lbtAttempts >= AIRTIME_LBT_MAX_ATTEMPTS) {
+            sent = true;  // Give up, channel never cleared
+        } else {
+            entry.notBefore = millis() + lbtBackoff(entry.lbtAttempts);
+        }
+    } else if (entry.requestAck) {
+        success = transmitWithAck(radio, entry.targetId, entry.data, entry.length);
+        sent = true;
+    } else {
+        radio.send(entry.targetId, entry.data, entry.length);
+        accountAirtime(entry.length);
+        success = true;
+        sent = true;
+    }
+
+    if (sent) {
+        if (success) {
+            recordPriorityLatency(PRIORITY_DOWNLINK, lane, waitedMs * 1000UL);
+        }
+        publishRadioSendResult(entry.responseKind, entry.targetId, success ? RADIO_TX_SENT : RADIO_TX_FAILED, millis() - entry.queuedAt);
+        txQueueHead[lane] = (txQueueHead[lane] + 1) % RADIO_TX_QUEUE_LEN;
+        txQueueCount[lane]--;
+    }
+}
+
+void publishAirtimeStats() {
+    if (!mqttConnected) return;
+
+    advanceBuckets();
+
+    DynamicJsonDocument doc(512);
+    doc["bitrate"] = bitrate;
+    doc["subBand"] = activeBand >= 0 ? subBands[activeBand].name : "unlimited";
+    doc["framesSent"] = framesSent;
+    doc["deferredBudget"] = deferredBudget;
+    doc["deferredBusy"] = deferredBusy;
+    doc["acksSuppressed"] = acksSuppressed;
+    doc["queueDepth"] = txQueueCount[PRIORITY_ALARM] + txQueueCount[PRIORITY_ROUTINE];
+    doc["alarmQueueDepth"] = txQueueCount[PRIORITY_ALARM];
+    doc["queueOverflows"] = queueOverflows;
+
+    // Usage of every sub-band with airtime in the window, in percent of its budget
+    JsonObject bands = doc.createNestedObject("usage");
+    for (uint8_t band = 0; band < SUB_BAND_COUNT; band++) {
+        uint32_t used = bandUsedUs(band);
+        if (used > 0 || band == activeBand) {
+            bands[subBands[band].name] = (float)used * 100 / bandBudgetUs(band);
+        }
+    }
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/airtime";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
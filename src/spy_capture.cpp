@@ -0,0 +1,154 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+extern GatewayConfig activeConfig;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// pcap file format, one record per radio frame. Records carry a small radio
+// header before the frame payload under a user link type, see README.
+#define PCAP_MAGIC_USEC         0xA1B2C3D4UL
+#define PCAP_VERSION_MAJOR      2
+#define PCAP_VERSION_MINOR      4
+#define PCAP_LINKTYPE_USER0     147
+#define CAPTURE_RADIO_HDR_LEN   6           // version, rssi, network, sender, target, ctl
+#define CAPTURE_RADIO_HDR_VER   1
+
+struct PcapGlobalHeader {
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t thisZone;
+    uint32_t sigFigs;
+    uint32_t snapLen;
+    uint32_t linkType;
+};
+
+struct PcapRecordHeader {
+    uint32_t tsSec;
+    uint32_t tsUsec;
+    uint32_t inclLen;
+    uint32_t origLen;
+};
+
+static WiFiServer captureServer(CAPTURE_TCP_PORT);
+static WiFiClient captureClient;
+
+// Byte ring of complete records, a record is either stored whole or counted as dropped
+static uint8_t captureRing[CAPTURE_RING_SIZE];
+static size_t ringHead = 0;             // Next byte to write
+static size_t ringTail = 0;             // Next byte to send
+static size_t ringUsed = 0;
+
+// Statistics
+static uint32_t captureFrames = 0;
+static uint32_t captureDropped = 0;
+static uint32_t captureBytesSent = 0;
+static uint32_t captureClients = 0;
+static size_t ringPeak = 0;
+
+void initializeCapture() {
+    captureServer.begin();
+    captureServer.setNoDelay(true);
+    debugLog("Packet capture listening on TCP port " + String(CAPTURE_TCP_PORT));
+}
+
+static void ringWrite(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    size_t first = min(length, CAPTURE_RING_SIZE - ringHead);
+    memcpy(captureRing + ringHead, bytes, first);
+    memcpy(captureRing, bytes + first, length - first);
+    ringHead = (ringHead + length) % CAPTURE_RING_SIZE;
+    ringUsed += length;
+}
+
+void captureRadioFrame(const RadioFrame& frame) {
+    if (!captureClient.connected()) return;
+
+    size_t recordLength = sizeof(PcapRecordHeader) + CAPTURE_RADIO_HDR_LEN + frame.length;
+    if (ringUsed + recordLength > CAPTURE_RING_SIZE) {
+        captureDropped++;
+        return;
+    }
+
+    // Wall clock once synced, otherwise time since boot
+    uint64_t timestampUs = timeSynced() ? epochMicrosAt(frame.rxMicros) : micros64() - (uint32_t)(micros() - frame.rxMicros);
+
+    PcapRecordHeader record;
+    record.tsSec = timestampUs / 1000000ULL;
+    record.tsUsec = timestampUs % 1000000ULL;
+    record.inclLen = CAPTURE_RADIO_HDR_LEN + frame.length;
+    record.origLen = record.inclLen;
+
+    uint8_t radioHeader[CAPTURE_RADIO_HDR_LEN] = {
+        CAPTURE_RADIO_HDR_VER,
+        (uint8_t)(int8_t)frame.rssi,
+        frame.networkId,
+        frame.senderId,
+        frame.targetId,
+        frame.ctl
+    };
+
+    ringWrite(&record, sizeof(record));
+    ringWrite(radioHeader, sizeof(radioHeader));
+    ringWrite(frame.data, frame.length);
+
+    captureFrames++;
+    if (ringUsed > ringPeak) ringPeak = ringUsed;
+}
+
+static void acceptCaptureClient() {
+    WiFiClient client = captureServer.accept();
+    if (!client) return;
+
+    if (captureClient.connected()) {
+        // One reader at a time, a new one replaces the old
+        captureClient.stop();
+    }
+    captureClient = client;
+    captureClient.setNoDelay(true);
+    captureClients++;
+
+    ringHead = ringTail = ringUsed = 0;
+
+    PcapGlobalHeader header = {
+        PCAP_MAGIC_USEC, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0,
+        CAPTURE_RADIO_HDR_LEN + RF69_MAX_DATA_LEN, PCAP_LINKTYPE_USER0
+    };
+    ringWrite(&header, sizeof(header));
+
+    debugLog("Packet capture client connected: " + captureClient.remoteIP().toString());
+}
+
+void handleCaptureLoop() {
+    if (captureServer.hasClient()) {
+        acceptCaptureClient();
+    }
+    if (ringUsed == 0 || !captureClient.connected()) return;
+
+    // Send what the socket takes without blocking, at most up to the ring end
+    size_t room = captureClient.availableForWrite();
+    size_t length = min(min(ringUsed, CAPTURE_RING_SIZE - ringTail), room);
+    if (length == 0) return;
+
+    size_t written = captureClient.write(captureRing + ringTail, length);
+    ringTail = (ringTail + written) % CAPTURE_RING_SIZE;
+    ringUsed -= written;
+    captureBytesSent += written;
+}
+
+void publishCaptureStats() {
+    if (!mqttConnected) return;
+
+    char stats[192];
+    snprintf(stats, sizeof(stats),
+             "{\"connected\":%s,\"clients\":%lu,\"frames\":%lu,\"dropped\":%lu,\"bytesSent\":%lu,\"ringSize\":%u,\"ringPeak\":%u}",
+             captureClient.connected() ? "true" : "false", (unsigned long)captureClients, (unsigned long)captureFrames,
+             (unsigned long)captureDropped, (unsigned long)captureBytesSent, (unsigned)CAPTURE_RING_SIZE, (unsigned)ringPeak);
+
+    String statsTopic = mqttBaseTopic + "/stats/capture";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
@@ -0,0 +1,281 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+
+// Objects owned by gateway.cpp
+extern PubSubClient mqttClient;
+extern bool radioInitialized;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Beacon, broadcast at the start of every cycle. All multi-byte fields are little endian.
+//   BEACON gw->nodes [B1][epoch s u32][ms u16][cycleMs u16][slotMs u16][guardMs u16]
+//                    [slots u8][version u8][first u8][node u8, slot u8]...
+// Slot s starts guardMs + s * slotMs after the beacon. Each beacon carries the
+// next TDMA_BEACON_PAIRS assignments, so a node knows its slot after at most
+// slots / TDMA_BEACON_PAIRS beacons; a new version means the slots changed.
+#define TDMA_FRAME_BEACON       0xB1
+#define TDMA_BEACON_HEADER_LEN  16
+#define TDMA_NO_SLOT            0xFF
+
+static bool tdmaEnabled = false;
+static uint16_t tdmaSlotMs = TDMA_SLOT_MS;
+static uint16_t tdmaGuardMs = TDMA_GUARD_MS;
+static uint16_t tdmaMinCycleMs = TDMA_MIN_CYCLE_MS;
+
+// Registered nodes in ID order get slots 0, 1, ...
+static uint8_t slotOfNode[256];
+static uint8_t nodeOfSlot[255];
+static uint8_t slotCount = 0;
+static uint8_t assignmentVersion = 0;
+static uint8_t assignmentCursor = 0;
+static bool layoutChanged = false;              // Slot or cycle settings changed by command/tdma
+
+// Current cycle, started by the beacon actually sent
+static uint16_t cycleMs = 0;
+static unsigned long nextBeaconAt = 0;
+static uint32_t cycleStartMicros = 0;
+static bool cycleRunning = false;
+static uint8_t slotsUsed[32];                   // Bit s = a frame arrived in slot s this cycle
+static uint8_t nodesHeard[32];                  // Bit n = node n transmitted this cycle
+
+// Statistics
+static uint32_t tdmaBeacons = 0;
+static uint32_t tdmaBeaconsLate = 0;
+static uint32_t tdmaOnTime = 0;
+static uint32_t tdmaLate = 0;
+static uint32_t tdmaOffSlot = 0;
+static uint32_t tdmaMissed = 0;
+static uint32_t tdmaCollisions = 0;
+static uint32_t tdmaAssignedSlots = 0;
+static uint32_t tdmaUsedSlots = 0;
+
+static void putLe16(uint8_t* buf, uint16_t value) {
+    buf[0] = value & 0xFF;
+    buf[1] = value >> 8;
+}
+
+static void putLe32(uint8_t* buf, uint32_t value) {
+    for (uint8_t i = 0; i < 4; i++) {
+        buf[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static bool testBit(const uint8_t* bits, uint8_t index) {
+    return bits[index >> 3] & (1 << (index & 7));
+}
+
+static void setBit(uint8_t* bits, uint8_t index) {
+    bits[index >> 3] |= 1 << (index & 7);
+}
+
+static void assignSlots() {
+    uint8_t previous[256];
+    memcpy(previous, slotOfNode, sizeof(previous));
+
+    memset(slotOfNode, TDMA_NO_SLOT, sizeof(slotOfNode));
+    slotCount = 0;
+    for (uint16_t node = 1; node < 256; node++) {
+        if (node != RF69_BROADCAST_ADDR && nodeRegistered(node)) {
+            slotOfNode[node] = slotCount;
+            nodeOfSlot[slotCount++] = node;
+        }
+    }
+
+    if (memcmp(previous, slotOfNode, sizeof(previous)) != 0) {
+        assignmentVersion++;
+        assignmentCursor = 0;
+    }
+    cycleMs = max((uint32_t)tdmaMinCycleMs, (uint32_t)tdmaGuardMs + (uint32_t)slotCount * tdmaSlotMs);
+}
+
+void initializeTdmaBeacon() {
+    memset(slotOfNode, TDMA_NO_SLOT, sizeof(slotOfNode));
+    tdmaEnabled = TDMA_BEACON;
+    nextBeaconAt = millis();
+}
+
+// Slots of the cycle that ends: assigned slots nobody used are missed
+static void closeCycle() {
+    if (!cycleRunning) return;
+
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+        tdmaAssignedSlots++;
+        if (testBit(nodesHeard, nodeOfSlot[slot])) {
+            tdmaUsedSlots++;
+        } else {
+            tdmaMissed++;
+        }
+    }
+    cycleRunning = false;
+}
+
+static bool sendBeacon() {
+    uint8_t frame[TDMA_BEACON_HEADER_LEN + TDMA_BEACON_PAIRS * 2];
+
+    uint64_t now = timeSynced() ? epochMillis() : millis();
+    frame[0] = TDMA_FRAME_BEACON;
+    putLe32(frame + 1, now / 1000);
+    putLe16(frame + 5, now % 1000);
+    putLe16(frame + 7, cycleMs);
+    putLe16(frame + 9, tdmaSlotMs);
+    putLe16(frame + 11, tdmaGuardMs);
+    frame[13] = slotCount;
+    frame[14] = assignmentVersion;
+    frame[15] = assignmentCursor;
+
+    uint8_t length = TDMA_BEACON_HEADER_LEN;
+    uint8_t slot = assignmentCursor;
+    for (uint8_t i = 0; i < TDMA_BEACON_PAIRS && slot < slotCount; i++, slot++) {
+        frame[length++] = nodeOfSlot[slot];
+        frame[length++] = slot;
+    }
+
+    // Over budget or busy channel: tried again next pass, the cycle starts late
+    if (!radioTransmitImmediate(RF69_BROADCAST_ADDR, frame, length)) {
+        return false;
+    }
+    assignmentCursor = slot < slotCount ? slot : 0;
+    return true;
+}
+
+void handleTdmaLoop() {
+    if (!tdmaEnabled || (long)(millis() - nextBeaconAt) < 0) return;
+
+    // The ending cycle is scored against the slots it was announced with,
+    // registry and command changes take effect with the new one
+    closeCycle();
+    if (assignmentCursor == 0 || layoutChanged) {
+        assignSlots();
+        layoutChanged = false;
+    }
+    if (!sendBeacon()) return;
+
+    if (millis() - nextBeaconAt > TDMA_BEACON_LATE_MS) {
+        tdmaBeaconsLate++;
+        nextBeaconAt = millis();
+    }
+    cycleStartMicros = micros();
+    nextBeaconAt += cycleMs;
+    cycleRunning = true;
+    memset(slotsUsed, 0, sizeof(slotsUsed));
+    memset(nodesHeard, 0, sizeof(nodesHeard));
+    tdmaBeacons++;
+}
+
+// Where a frame from the primary radio landed in the cycle. A second frame in
+// a slot, or a node's second frame in a cycle (a retry), counts as a likely
+// collision.
+void tdmaFrame(const RadioFrame& frame) {
+    if (!tdmaEnabled || !cycleRunning || frame.radioIndex != 0) return;
+
+    uint8_t ownSlot = slotOfNode[frame.senderId];
+    if (ownSlot == TDMA_NO_SLOT) return;
+
+    long offsetMs = (long)(frame.rxMicros - cycleStartMicros) / 1000 - tdmaGuardMs;
+    long slot = offsetMs >= 0 ? offsetMs / tdmaSlotMs : -1;
+
+    if (testBit(nodesHeard, frame.senderId)) {
+        tdmaCollisions++;
+    }
+    setBit(nodesHeard, frame.senderId);
+
+    if (slot == ownSlot) {
+        tdmaOnTime++;
+    } else if (slot == ownSlot + 1) {
+        tdmaLate++;
+    } else {
+        tdmaOffSlot++;
+    }
+
+    if (slot >= 0 && slot < slotCount) {
+        if (testBit(slotsUsed, slot)) {
+            tdmaCollisions++;
+        }
+        setBit(slotsUsed, slot);
+    }
+}
+
+static void publishTdmaResponse(bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(256);
+    response["command"] = "tdma";
+    response["success"] = ok;
+    if (!ok) {
+        response["error"] = error;
+    }
+    response["enabled"] = tdmaEnabled;
+    response["slotMs"] = tdmaSlotMs;
+    response["guardMs"] = tdmaGuardMs;
+    response["minCycleMs"] = tdmaMinCycleMs;
+    response["slots"] = slotCount;
+    response["cycleMs"] = cycleMs;
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/tdma";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+// command/tdma: {"enabled":true,"slotMs":100,"guardMs":200,"minCycleMs":10000},
+// "{}" reports the state. Changes take effect with the next beacon.
+void handleTdmaCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    DynamicJsonDocument doc(256);
+    DeserializationError parseError = deserializeJson(doc, payload, length);
+    if (parseError) {
+        publishTdmaResponse(false, String("invalid JSON: ") + parseError.c_str());
+        return;
+    }
+
+    // Every node id can hold a slot, the cycle of 255 slots must fit the beacon's u16
+    uint32_t slotMs = doc["slotMs"] | (uint32_t)tdmaSlotMs;
+    uint32_t guardMs = doc["guardMs"] | (uint32_t)tdmaGuardMs;
+    uint32_t minCycleMs = doc["minCycleMs"] | (uint32_t)tdmaMinCycleMs;
+    if (slotMs < 10 || slotMs > 250 || guardMs + 255 * slotMs > 65535 || minCycleMs > 65535) {
+        publishTdmaResponse(false, "slotMs must be 10-250, guardMs + 255 slots and minCycleMs at most 65535 ms");
+        return;
+    }
+
+    tdmaSlotMs = slotMs;
+    tdmaGuardMs = guardMs;
+    tdmaMinCycleMs = minCycleMs;
+    if (doc.containsKey("enabled")) {
+        bool enabled = doc["enabled"];
+        if (enabled && !tdmaEnabled) {
+            nextBeaconAt = millis();
+        } else if (!enabled) {
+            closeCycle();
+        }
+        tdmaEnabled = enabled;
+    }
+    layoutChanged = true;
+
+    publishTdmaResponse(true, "");
+}
+
+void publishTdmaStats() {
+    if (!mqttConnected || (!tdmaEnabled && tdmaBeacons == 0)) return;
+
+    DynamicJsonDocument doc(384);
+    doc["enabled"] = tdmaEnabled;
+    doc["cycleMs"] = cycleMs;
+    doc["slots"] = slotCount;
+    doc["beacons"] = tdmaBeacons;
+    doc["beaconsLate"] = tdmaBeaconsLate;
+    // Share of assigned slots their node transmitted in, in percent
+    doc["utilisation"] = tdmaAssignedSlots > 0 ? (float)tdmaUsedSlots * 100 / tdmaAssignedSlots : 0;
+    doc["onTime"] = tdmaOnTime;
+    doc["late"] = tdmaLate;
+    doc["offSlot"] = tdmaOffSlot;
+    doc["missed"] = tdmaMissed;
+    doc["collisions"] = tdmaCollisions;
+
+    String statsString;
+    serializeJson(doc, statsString);
+
+    String statsTopic = mqttBaseTopic + "/stats/tdma";
+    mqttClient.publish(statsTopic.c_str(), statsString.c_str());
+}
@@ -0,0 +1,80 @@
+#include "config.h"
+#include <coredecls.h>
+#include <sys/time.h>
+
+// Wall clock from SNTP. Each sync is compared with where the local clock
+// had run since the previous one, which gives the offset corrected by the
+// sync and the drift of the local oscillator.
+static bool synced = false;
+static uint32_t syncCount = 0;
+static uint64_t syncMicros = 0;         // micros64() at the last sync
+static int64_t syncEpochUs = 0;         // Epoch time at the last sync
+static int64_t lastOffsetUs = 0;
+static float driftPpm = 0;
+
+static void onTimeSet() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    uint64_t nowMicros = micros64();
+    int64_t epochUs = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+
+    if (synced) {
+        uint64_t elapsedUs = nowMicros - syncMicros;
+        lastOffsetUs = epochUs - (syncEpochUs + (int64_t)elapsedUs);
+        if (elapsedUs > 0) {
+            driftPpm = (float)lastOffsetUs * 1e6f / (float)elapsedUs;
+        }
+    }
+
+    syncMicros = nowMicros;
+    syncEpochUs = epochUs;
+    syncCount++;
+    synced = true;
+}
+
+// Overrides the core's weak default of one hour
+extern "C" uint32_t sntp_update_delay_MS_rfc_not_less_than_15000() {
+    return NTP_SYNC_INTERVAL_S * 1000UL;
+}
+
+void initializeTimeSync() {
+    settimeofday_cb(onTimeSet);
+    configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2);
+    debugLog("SNTP time sync started: " + String(NTP_SERVER_1) + ", " + String(NTP_SERVER_2));
+}
+
+bool timeSynced() {
+    return synced;
+}
+
+uint64_t epochMillis() {
+    if (!synced) return 0;
+    return (syncEpochUs + (int64_t)(micros64() - syncMicros)) / 1000;
+}
+
+// Epoch time of an earlier micros() reading, such as a radio interrupt
+uint64_t epochMicrosAt(uint32_t microsValue) {
+    if (!synced) return 0;
+    uint32_t ageUs = (uint32_t)micros() - microsValue;
+    return syncEpochUs + (int64_t)(micros64() - syncMicros) - ageUs;
+}
+
+uint64_t epochMillisAt(uint32_t microsValue) {
+    return epochMicrosAt(microsValue) / 1000;
+}
+
+uint32_t timeSyncCount() {
+    return syncCount;
+}
+
+uint32_t timeSyncAgeS() {
+    return synced ? (micros64() - syncMicros) / 1000000ULL : 0;
+}
+
+int32_t clockOffsetMs() {
+    return lastOffsetUs / 1000;
+}
+
+float clockDriftPpm() {
+    return driftPpm;
+}
@@ -0,0 +1,165 @@
+#include "config.h"
+#include "gateway_radio.h"
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+extern bool radioInitialized;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+// Datagram layout, all multi-byte fields little endian:
+//   0  magic     UDP_BRIDGE_MAGIC
+//   1  type      UDP_TYPE_*
+//   2  seq       uint16, gateway uplink counter or echoed downlink sequence
+//   4  sender    node id
+//   5  target    node id
+//   6  rssi      int8 dBm (uplink)
+//   7  flags     UDP_FLAG_* (uplink/downlink) or RadioTxResult (result)
+//   8  dwellUs   uint32, radio interrupt to datagram send (uplink)
+//  12  payload   up to RF69_MAX_DATA_LEN bytes
+#define UDP_BRIDGE_MAGIC        0xB7
+#define UDP_BRIDGE_HEADER_LEN   12
+
+#define UDP_TYPE_UPLINK         0x01
+#define UDP_TYPE_DOWNLINK       0x02
+#define UDP_TYPE_RESULT         0x03
+#define UDP_TYPE_PING           0x04
+#define UDP_TYPE_PONG           0x05
+
+#define UDP_FLAG_ACK_REQUESTED  0x01    // Uplink asked for an ACK, or downlink should be sent with ACK
+#define UDP_FLAG_ACK_FRAME      0x02    // Uplink is an ACK frame
+#define UDP_FLAG_RADIO2         0x04    // Uplink was received by the second radio
+#define UDP_FLAG_ALARM          0x08    // Uplink is an alarm, or downlink goes in the alarm lane
+
+static WiFiUDP bridgeUdp;
+static IPAddress bridgeHost;
+static bool bridgeEnabled = false;
+static uint16_t uplinkSeq = 0;
+
+// Statistics
+static uint32_t udpUplinks = 0;
+static uint32_t udpSendErrors = 0;
+static uint32_t udpDownlinks = 0;
+static uint32_t udpRejected = 0;
+static uint32_t udpPings = 0;
+
+bool initializeUdpBridge() {
+    if (strlen(UDP_BRIDGE_HOST) == 0) {
+        return false;
+    }
+
+    if (!WiFi.hostByName(UDP_BRIDGE_HOST, bridgeHost)) {
+        debugLog("UDP bridge host " + String(UDP_BRIDGE_HOST) + " not resolved, bridge disabled");
+        return false;
+    }
+
+    bridgeUdp.begin(UDP_BRIDGE_LOCAL_PORT);
+    bridgeEnabled = true;
+    debugLog("UDP bridge to " + bridgeHost.toString() + ":" + String(UDP_BRIDGE_PORT) + ", listening on " + String(UDP_BRIDGE_LOCAL_PORT));
+    return true;
+}
+
+static void putHeader(uint8_t* out, uint8_t type, uint16_t seq, uint8_t sender, uint8_t target, int8_t rssi, uint8_t flags, uint32_t dwellUs) {
+    out[0] = UDP_BRIDGE_MAGIC;
+    out[1] = type;
+    out[2] = seq & 0xFF;
+    out[3] = seq >> 8;
+    out[4] = sender;
+    out[5] = target;
+    out[6] = (uint8_t)rssi;
+    out[7] = flags;
+    out[8] = dwellUs & 0xFF;
+    out[9] = (dwellUs >> 8) & 0xFF;
+    out[10] = (dwellUs >> 16) & 0xFF;
+    out[11] = dwellUs >> 24;
+}
+
+static void sendDatagram(IPAddress host, uint16_t port, const uint8_t* data, size_t length) {
+    if (!bridgeUdp.beginPacket(host, port) || bridgeUdp.write(data, length) != length || !bridgeUdp.endPacket()) {
+        udpSendErrors++;
+    }
+}
+
+void udpBridgeForward(const RadioFrame& frame) {
+    if (!bridgeEnabled) return;
+
+    uint8_t datagram[UDP_BRIDGE_HEADER_LEN + RF69_MAX_DATA_LEN];
+    uint8_t flags = (frame.ctl & RFM69_CTL_REQACK ? UDP_FLAG_ACK_REQUESTED : 0) | (frame.ctl & RFM69_CTL_SENDACK ? UDP_FLAG_ACK_FRAME : 0) |
+                    (frame.radioIndex != 0 ? UDP_FLAG_RADIO2 : 0) | (frame.priority == PRIORITY_ALARM ? UDP_FLAG_ALARM : 0);
+    putHeader(datagram, UDP_TYPE_UPLINK, uplinkSeq++, frame.senderId, frame.targetId, frame.rssi, flags, micros() - frame.rxMicros);
+    memcpy(datagram + UDP_BRIDGE_HEADER_LEN, frame.data, frame.length);
+
+    sendDatagram(bridgeHost, UDP_BRIDGE_PORT, datagram, UDP_BRIDGE_HEADER_LEN + frame.length);
+    udpUplinks++;
+}
+
+static void handleDatagram(const uint8_t* data, size_t length, IPAddress from, uint16_t fromPort) {
+    uint8_t type = data[1];
+    uint16_t seq = data[2] | (data[3] << 8);
+
+    // Pings are answered at once with the request header, for round trip measurement
+    if (type == UDP_TYPE_PING) {
+        uint8_t reply[UDP_BRIDGE_HEADER_LEN];
+        memcpy(reply, data, UDP_BRIDGE_HEADER_LEN);
+        reply[1] = UDP_TYPE_PONG;
+        sendDatagram(from, fromPort, reply, sizeof(reply));
+        udpPings++;
+        return;
+    }
+
+    uint8_t target = data[5];
+    uint8_t payloadLength = length - UDP_BRIDGE_HEADER_LEN;
+    if (type != UDP_TYPE_DOWNLINK || target == 0 || payloadLength > RF69_MAX_DATA_LEN || !radioInitialized) {
+        udpRejected++;
+        return;
+    }
+
+    bool requestAck = data[7] & UDP_FLAG_ACK_REQUESTED;
+    uint8_t priority = data[7] & UDP_FLAG_ALARM ? PRIORITY_ALARM : downlinkPriority(target);
+    RadioTxResult result = radioTransmit(target, data + UDP_BRIDGE_HEADER_LEN, payloadLength, requestAck, RADIO_RESPONSE_NONE, priority);
+    udpDownlinks++;
+
+    if (requestAck) {
+        uint8_t reply[UDP_BRIDGE_HEADER_LEN];
+        putHeader(reply, UDP_TYPE_RESULT, seq, 0, target, 0, result, 0);
+        sendDatagram(from, fromPort, reply, sizeof(reply));
+    }
+}
+
+void handleUdpBridgeLoop() {
+    if (!bridgeEnabled) return;
+
+    uint8_t datagram[UDP_BRIDGE_HEADER_LEN + RF69_MAX_DATA_LEN];
+    for (uint8_t i = 0; i < UDP_BRIDGE_MAX_PER_LOOP; i++) {
+        int length = bridgeUdp.parsePacket();
+        if (length <= 0) return;
+
+        // The next parsePacket() discards whatever of a rejected datagram is left unread
+        IPAddress from = bridgeUdp.remoteIP();
+        if (length < UDP_BRIDGE_HEADER_LEN || length > (int)sizeof(datagram) || from != bridgeHost) {
+            udpRejected++;
+            continue;
+        }
+
+        bridgeUdp.read(datagram, length);
+        if (datagram[0] != UDP_BRIDGE_MAGIC) {
+            udpRejected++;
+            continue;
+        }
+        handleDatagram(datagram, length, from, bridgeUdp.remotePort());
+    }
+}
+
+void publishUdpBridgeStats() {
+    if (!mqttConnected || !bridgeEnabled) return;
+
+    char stats[160];
+    snprintf(stats, sizeof(stats), "{\"seq\":%u,\"uplinks\":%lu,\"sendErrors\":%lu,\"downlinks\":%lu,\"rejected\":%lu,\"pings\":%lu}",
+             uplinkSeq, (unsigned long)udpUplinks, (unsigned long)udpSendErrors, (unsigned long)udpDownlinks,
+             (unsigned long)udpRejected, (unsigned long)udpPings);
+
+    String statsTopic = mqttBaseTopic + "/stats/udp";
+    mqttClient.publish(statsTopic.c_str(), stats);
+}
@@ -0,0 +1,333 @@
+#include "config.h"
+#include "uplink_filter.h"
+#include <LittleFS.h>
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+extern bool mqttConnected;
+extern String mqttBaseTopic;
+
+#define FILTER_FILE_PATH        "/filters.bin"
+#define FILTER_TEMP_PATH        "/filters.tmp"
+#define FILTER_FILE_MAGIC       0x31544C46UL    // "FLT1"
+#define FILTER_NONE             0xFF
+
+// Stored rule for one node. Zero disables the respective check.
+struct FilterField {
+    char name[FILTER_FIELD_NAME_MAX + 1];
+    float deadband;                 // Publish only when the field moved at least this far
+};
+
+struct FilterRule {
+    uint8_t nodeId;                 // 0 = unused
+    uint8_t burst;                  // Token bucket depth
+    uint16_t minIntervalS;          // Minimum time between publishes
+    uint16_t heartbeatS;            // Publish at least this often, regardless of other checks
+    uint16_t maxPerMinute;          // Token bucket refill rate
+    uint8_t fieldCount;
+    FilterField fields[FILTER_MAX_FIELDS];
+};
+
+// Runtime state, not persisted
+struct FilterState {
+    bool published;
+    unsigned long lastPublish;
+    unsigned long lastRefill;
+    float tokens;
+    float lastValues[FILTER_MAX_FIELDS];
+    uint32_t forwarded;
+    uint32_t heartbeats;
+    uint32_t suppressedInterval;
+    uint32_t suppressedDeadband;
+    uint32_t suppressedRate;
+};
+
+static FilterRule filterRules[FILTER_MAX_NODES];
+static FilterState filterStates[FILTER_MAX_NODES];
+static uint8_t filterSlotForNode[256];
+static bool filtersMounted = false;
+
+// Uplinks of nodes without a rule
+static uint32_t unfilteredForwarded = 0;
+
+static void indexFilterRules() {
+    memset(filterSlotForNode, FILTER_NONE, sizeof(filterSlotForNode));
+    for (uint8_t i = 0; i < FILTER_MAX_NODES; i++) {
+        if (filterRules[i].nodeId != 0) {
+            filterSlotForNode[filterRules[i].nodeId] = i;
+        }
+    }
+}
+
+static bool saveFilterRules() {
+    File file = LittleFS.open(FILTER_TEMP_PATH, "w");
+    if (!file) {
+        return false;
+    }
+
+    uint32_t magic = FILTER_FILE_MAGIC;
+    bool ok = file.write((const uint8_t*)&magic, sizeof(magic)) == sizeof(magic) &&
+              file.write((const uint8_t*)filterRules, sizeof(filterRules)) == sizeof(filterRules);
+    file.close();
+
+    if (!ok) {
+        LittleFS.remove(FILTER_TEMP_PATH);
+        return false;
+    }
+
+    LittleFS.remove(FILTER_FILE_PATH);
+    return LittleFS.rename(FILTER_TEMP_PATH, FILTER_FILE_PATH);
+}
+
+bool initializeUplinkFilter() {
+    memset(filterRules, 0, sizeof(filterRules));
+    memset(filterStates, 0, sizeof(filterStates));
+
+    filtersMounted = LittleFS.begin();
+    if (filtersMounted) {
+        File file = LittleFS.open(FILTER_FILE_PATH, "r");
+        if (file) {
+            uint32_t magic = 0;
+            if (file.read((uint8_t*)&magic, sizeof(magic)) != sizeof(magic) || magic != FILTER_FILE_MAGIC ||
+                file.read((uint8_t*)filterRules, sizeof(filterRules)) != sizeof(filterRules)) {
+                debugLog("Uplink filter rules invalid, ignored");
+                memset(filterRules, 0, sizeof(filterRules));
+            }
+            file.close();
+        }
+    } else {
+        debugLog("LittleFS mount failed, uplink filter rules are not persisted");
+    }
+
+    indexFilterRules();
+    return filtersMounted;
+}
+
+static void resetFilterState(uint8_t slot) {
+    memset(&filterStates[slot], 0, sizeof(FilterState));
+    filterStates[slot].tokens = filterRules[slot].burst;
+    filterStates[slot].lastRefill = millis();
+}
+
+// Optional whole number of a rule, range-checked before it is narrowed to its field
+static bool readRuleNumber(JsonVariantConst value, uint32_t fallback, uint32_t max, uint32_t& target,
+                           const char* name, String& error) {
+    if (value.isNull()) {
+        target = fallback;
+        return true;
+    }
+    if (!value.is<uint32_t>() || value.as<uint32_t>() > max) {
+        error = String(name) + " must be 0-" + String(max);
+        return false;
+    }
+    target = value.as<uint32_t>();
+    return true;
+}
+
+// Set the rule of a node from JSON; an empty rule removes it
+bool setUplinkFilterRule(uint8_t nodeId, const char* json, size_t length, String& error) {
+    if (nodeId == 0) {
+        error = "node id must be 1-255";
+        return false;
+    }
+
+    uint8_t slot = filterSlotForNode[nodeId];
+
+    if (length == 0) {
+        if (slot != FILTER_NONE) {
+            memset(&filterRules[slot], 0, sizeof(FilterRule));
+        }
+    } else {
+        DynamicJsonDocument doc(512);
+        DeserializationError parseError = deserializeJson(doc, json, length);
+        if (parseError) {
+            error = String("invalid JSON: ") + parseError.c_str();
+            return false;
+        }
+
+        FilterRule rule;
+        memset(&rule, 0, sizeof(rule));
+        rule.nodeId = nodeId;
+        uint32_t minIntervalS, heartbeatS, maxPerMinute, burst;
+        if (!readRuleNumber(doc["minIntervalS"], 0, UINT16_MAX, minIntervalS, "minIntervalS", error) ||
+            !readRuleNumber(doc["heartbeatS"], 0, UINT16_MAX, heartbeatS, "heartbeatS", error) ||
+            !readRuleNumber(doc["maxPerMinute"], 0, UINT16_MAX, maxPerMinute, "maxPerMinute", error) ||
+            !readRuleNumber(doc["burst"], 1, UINT8_MAX, burst, "burst", error)) {
+            return false;
+        }
+        // An empty bucket would never fill up and drop every frame
+        if (maxPerMinute > 0 && burst == 0) {
+            error = "burst must be at least 1 with maxPerMinute";
+            return false;
+        }
+        rule.minIntervalS = minIntervalS;
+        rule.heartbeatS = heartbeatS;
+        rule.maxPerMinute = maxPerMinute;
+        rule.burst = burst;
+
+        for (JsonPairConst field : doc["deadband"].as<JsonObjectConst>()) {
+            if (rule.fieldCount >= FILTER_MAX_FIELDS) {
+                error = "at most " + String(FILTER_MAX_FIELDS) + " deadband fields";
+                return false;
+            }
+            if (strlen(field.key().c_str()) > FILTER_FIELD_NAME_MAX) {
+                error = "field name too long";
+                return false;
+            }
+            FilterField& target = rule.fields[rule.fieldCount++];
+            strncpy(target.name, field.key().c_str(), FILTER_FIELD_NAME_MAX);
+            target.deadband = field.value().as<float>();
+        }
+
+        if (slot == FILTER_NONE) {
+            for (uint8_t i = 0; i < FILTER_MAX_NODES && slot == FILTER_NONE; i++) {
+                if (filterRules[i].nodeId == 0) slot = i;
+            }
+            if (slot == FILTER_NONE) {
+                error = "rule table full";
+                return false;
+            }
+        }
+
+        filterRules[slot] = rule;
+        resetFilterState(slot);
+    }
+
+    indexFilterRules();
+
+    if (filtersMounted && !saveFilterRules()) {
+        error = "saving failed";
+        return false;
+    }
+    return true;
+}
+
+static bool deadbandExceeded(const FilterRule& rule, const FilterState& state, JsonVariantConst data) {
+    if (rule.fieldCount == 0 || !state.published) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < rule.fieldCount; i++) {
+        JsonVariantConst value = data[rule.fields[i].name];
+        // A missing or non-numeric field cannot be compared, so it always counts as a change
+        if (!value.is<float>()) {
+            return true;
+        }
+        if (fabsf(value.as<float>() - state.lastValues[i]) >= rule.fields[i].deadband) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool uplinkFilterPass(uint8_t nodeId, JsonVariantConst data) {
+    uint8_t slot = filterSlotForNode[nodeId];
+    if (slot == FILTER_NONE) {
+        unfilteredForwarded++;
+        return true;
+    }
+
+    const FilterRule& rule = filterRules[slot];
+    FilterState& state = filterStates[slot];
+    unsigned long now = millis();
+    unsigned long sincePublish = now - state.lastPublish;
+
+    if (rule.maxPerMinute > 0) {
+        state.tokens += (now - state.lastRefill) * rule.maxPerMinute / 60000.0f;
+        if (state.tokens > rule.burst) {
+            state.tokens = rule.burst;
+        }
+        state.lastRefill = now;
+    }
+
+    bool heartbeat = rule.heartbeatS > 0 && state.published && sincePublish >= rule.heartbeatS * 1000UL;
+    if (!heartbeat) {
+        if (state.published && sincePublish < rule.minIntervalS * 1000UL) {
+            state.suppressedInterval++;
+            return false;
+        }
+        if (!deadbandExceeded(rule, state, data)) {
+            state.suppressedDeadband++;
+            return false;
+        }
+        if (rule.maxPerMinute > 0 && state.tokens < 1.0f) {
+            state.suppressedRate++;
+            return false;
+        }
+    } else {
+        state.heartbeats++;
+    }
+
+    if (rule.maxPerMinute > 0 && state.tokens >= 1.0f) {
+        state.tokens -= 1.0f;
+    }
+    for (uint8_t i = 0; i < rule.fieldCount; i++) {
+        state.lastValues[i] = data[rule.fields[i].name] | state.lastValues[i];
+    }
+    state.published = true;
+    state.lastPublish = now;
+    state.forwarded++;
+    return true;
+}
+
+static void publishFilterResponse(uint8_t nodeId, bool ok, const String& error) {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument response(192);
+    response["command"] = "filter";
+    response["nodeId"] = nodeId;
+    response["success"] = ok;
+    if (!ok) {
+        response["error"] = error;
+    }
+
+    String responseString;
+    serializeJson(response, responseString);
+
+    String responseTopic = mqttBaseTopic + "/response/filter";
+    mqttClient.publish(responseTopic.c_str(), responseString.c_str());
+}
+
+// command/filter/{node}: {"minIntervalS":10,"heartbeatS":600,"maxPerMinute":6,"burst":2,"deadband":{"temp":0.2}}, empty removes
+void handleFilterCommand(const MqttRouteParams& params, const byte* payload, unsigned int length) {
+    String error;
+    bool ok = params.values[0] <= 255 && setUplinkFilterRule(params.values[0], (const char*)payload, length, error);
+    if (!ok) {
+        debugLog("Filter rule for node " + String(params.values[0]) + " rejected: " + error);
+    }
+    publishFilterResponse(params.values[0], ok, error);
+}
+
+void publishFilterStats() {
+    if (!mqttConnected) return;
+
+    DynamicJsonDocument doc(2048);
+    doc["unfiltered"] = unfilteredForwarded;
+
+    uint32_t forwarded = 0;
+    uint32_t suppressed = 0;
+    JsonArray nodes = doc.createNestedArray("nodes");
+    for (uint8_t i = 0; i < FILTER_MAX_NODES; i++) {
+        if (filterRules[i].nodeId == 0) continue;
+
+        FilterState& state = filterStates[i];
+        JsonObject node = nodes.createNestedObject();
+        node["nodeId"] = filterRules[i].nodeId;
+        node["forwarded"] = state.forwarded;
+        node["heartbeats"] = state.heartbeats;
+        node["interval"] = state.suppressedInterval;
+        node["deadband"] = state.suppressedDeadband;
+        node["rate"] = state.suppressedRate;
+
+        forwarded += state.forwarded;
+        suppressed += state.suppressedInterval + state.suppressedDeadband + state.suppressedRate;
+    }
+    doc["forwarded"] = forwarded;
+    doc["suppressed"] = suppressed;
+
+    // Streamed, the node list can exceed the MQTT client buffer
+    String statsTopic = mqttBaseTopic + "/stats/filter";
+    mqttClient.beginPublish(statsTopic.c_str(), measureJson(doc), false);
+    serializeJson(doc, mqttClient);
+    mqttClient.endPublish();
+}
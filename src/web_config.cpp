@@ -104,10 +104,12 @@ window.addEventListener('resize', function() {
             <li><a href="/radio">Radio Config</a></li>
             <li><a href="/network">Network Config</a></li>
             <li><a href="/ap">Access Point</a></li>
+            <li><a href="/nodes">Nodes</a></li>
             <li><a href="/system">System</a></li>
 )**";
 const char* HTML_HEADER_EXPERT = R"**(
             <li><a href="/mqtt">MQTT Config</a></li>
+            <li><a href="/decoders">Payload Decoders</a></li>
         </ul>
     </div>
 )**";
@@ -173,6 +175,11 @@ void setupWebServer() {
     webServer.on("/ap", HTTP_GET, handleApPage);
     webServer.on("/ap", HTTP_POST, handleApSave);
     
+    webServer.on("/decoders", HTTP_GET, handleDecoderPage);
+    webServer.on("/decoders", HTTP_POST, handleDecoderSave);
+    webServer.on("/nodes", HTTP_GET, handleNodesPage);
+    webServer.on("/nodes", HTTP_POST, handleNodesSave);
+    
     webServer.on("/system", HTTP_GET, handleSystemPage);
     webServer.on("/system", HTTP_POST, handleSystemAction);
     
@@ -488,6 +495,183 @@ void handleMqttSave(AsyncWebServerRequest *request) {
     request->send(200, "text/html", html);
 }
 
+void handleDecoderPage(AsyncWebServerRequest *request) {
+    if (!currentConfig.expertMode) {
+        request->send(403, "text/html", "Expert mode required");
+        return;
+    }
+    
+    String html = getHtmlHeader();
+    html += "<div class='expert-only'>";
+    html += "<h2>Payload Decoders (Expert Mode)</h2>";
+    html += "<p>Binary layouts for nodes that send packed structs. Types: u8 i8 u16 i16 u24 u32 i32 f32 u16be i16be u32be i32be (little endian unless *be).</p>";
+    
+    for (uint8_t id = 1; id <= DECODER_MAX_LAYOUTS; id++) {
+        String layout = decoderLayoutJson(id);
+        if (layout.length() > 0) {
+            layout.replace("&", "&amp;");
+            layout.replace("<", "&lt;");
+            html += "<p><strong>Decoder " + String(id) + ":</strong></p><pre>" + layout + "</pre>";
+        }
+    }
+    
+    html += R"(
+        <form method="POST" action="/decoders">
+            <div class="form-group">
+                <label>Decoder ID (1-)" + String(DECODER_MAX_LAYOUTS) + R"():</label>
+                <input type="number" name="decoderId" min="1" max=")" + String(DECODER_MAX_LAYOUTS) + R"(" value="1" required>
+            </div>
+            <div class="form-group">
+                <label>Layout JSON (empty removes the decoder):</label>
+                <textarea name="layout" rows="8" style="width:100%" placeholder='{"nodes":[2,3],"fields":[{"name":"temp","type":"i16","offset":0,"scale":0.01,"unit":"C"}]}'></textarea>
+            </div>
+            <button type="submit" class="btn">Save Decoder</button>
+        </form>
+    </div>
+    )";
+    html += HTML_FOOTER;
+    
+    request->send(200, "text/html", html);
+}
+
+void handleDecoderSave(AsyncWebServerRequest *request) {
+    if (!currentConfig.expertMode) {
+        request->send(403, "text/html", "Expert mode required");
+        return;
+    }
+    
+    String message = "";
+    long decoderId = 0;
+    String layout = "";
+    
+    if (request->hasParam("decoderId", true)) {
+        decoderId = request->getParam("decoderId", true)->value().toInt();
+    }
+    if (request->hasParam("layout", true)) {
+        layout = request->getParam("layout", true)->value();
+        layout.trim();
+    }
+    
+    String error;
+    if (decoderId < 0) {
+        message = "Error: decoder id must be 1-" + String(DECODER_MAX_LAYOUTS);
+    } else if (setDecoderLayout(decoderId, layout.c_str(), layout.length(), error)) {
+        message = "Decoder " + String(decoderId) + (layout.length() > 0 ? " saved successfully!" : " removed");
+    } else {
+        message = "Error: " + error;
+    }
+    
+    String html = getHtmlHeader();
+    html += "<h2>Payload Decoders</h2>";
+    html += "<div class='" + String(message.startsWith("Error") ? "error" : "success") + "'>" + message + "</div>";
+    html += "<button class='btn' onclick='location.href=\"/decoders\"'>Back to Payload Decoders</button>";
+    html += "<button class='btn' onclick='location.href=\"/\"'>Home</button>";
+    html += HTML_FOOTER;
+    request->send(200, "text/html", html);
+}
+
+static String htmlEscape(const char* text) {
+    String escaped = text;
+    escaped.replace("&", "&amp;");
+    escaped.replace("<", "&lt;");
+    escaped.replace("\"", "&quot;");
+    return escaped;
+}
+
+void handleNodesPage(AsyncWebServerRequest *request) {
+    String html = getHtmlHeader();
+    html += "<h2>Nodes</h2>";
+    html += "<p>Names and policies of the nodes on this gateway. Blocked nodes are neither ACKed nor forwarded.</p>";
+    
+    html += "<table><tr><th>ID</th><th>Name</th><th>Location</th><th>Type</th><th>Policy</th></tr>";
+    NodeRecord record;
+    for (uint16_t node = 1; node < 256; node++) {
+        if (!getNodeRecord(node, record)) continue;
+        
+        String policy = (record.flags & NODE_FLAG_BLOCKED) ? "blocked" : (record.flags & NODE_FLAG_NO_ACK) ? "no ACK" : "";
+        if (record.flags & NODE_FLAG_ALARM) {
+            policy += policy.length() > 0 ? ", alarm" : "alarm";
+        }
+        html += "<tr><td>" + String(node) + "</td><td>" + htmlEscape(record.name) + "</td><td>" + htmlEscape(record.location) +
+                "</td><td>" + String(record.type) + "</td><td>" + policy + "</td></tr>";
+    }
+    html += "</table>";
+    
+    html += R"(
+        <form method="POST" action="/nodes">
+            <div class="form-group">
+                <label>Node ID (1-255):</label>
+                <input type="number" name="nodeId" min="1" max="255" required>
+            </div>
+            <div class="form-group">
+                <label>Name:</label>
+                <input type="text" name="name" maxlength=")" + String(NODE_NAME_MAX) + R"(">
+            </div>
+            <div class="form-group">
+                <label>Location:</label>
+                <input type="text" name="location" maxlength=")" + String(NODE_LOCATION_MAX) + R"(">
+            </div>
+            <div class="form-group">
+                <label>Type (0-255):</label>
+                <input type="number" name="type" min="0" max="255" value="0">
+            </div>
+            <div class="form-group">
+                <label><input type="checkbox" name="blocked" value="1"> Blocked</label>
+                <label><input type="checkbox" name="noAck" value="1"> No ACK</label>
+                <label><input type="checkbox" name="alarm" value="1"> Alarm</label>
+                <label><input type="checkbox" name="remove" value="1"> Remove node</label>
+            </div>
+            <button type="submit" class="btn">Save Node</button>
+        </form>
+    )";
+    html += HTML_FOOTER;
+    
+    request->send(200, "text/html", html);
+}
+
+void handleNodesSave(AsyncWebServerRequest *request) {
+    String message = "";
+    long nodeId = 0;
+    
+    if (request->hasParam("nodeId", true)) {
+        nodeId = request->getParam("nodeId", true)->value().toInt();
+    }
+    
+    String error;
+    if (nodeId < 1 || nodeId > 255) {
+        message = "Error: node id must be 1-255";
+    } else if (request->hasParam("remove", true)) {
+        if (removeNodeRecord(nodeId)) {
+            message = "Node " + String(nodeId) + " removed";
+        } else {
+            message = "Error: node could not be removed";
+        }
+    } else {
+        String name = request->hasParam("name", true) ? request->getParam("name", true)->value() : "";
+        String location = request->hasParam("location", true) ? request->getParam("location", true)->value() : "";
+        long type = request->hasParam("type", true) ? request->getParam("type", true)->value().toInt() : 0;
+        uint8_t flags = (request->hasParam("blocked", true) ? NODE_FLAG_BLOCKED : 0) |
+                        (request->hasParam("noAck", true) ? NODE_FLAG_NO_ACK : 0) |
+                        (request->hasParam("alarm", true) ? NODE_FLAG_ALARM : 0);
+        
+        if (type < 0 || type > 255) {
+            message = "Error: node type must be 0-255";
+        } else if (setNodeRecord(nodeId, name.c_str(), location.c_str(), type, flags, error)) {
+            message = "Node " + String(nodeId) + " saved successfully!";
+        } else {
+            message = "Error: " + error;
+        }
+    }
+    
+    String html = getHtmlHeader();
+    html += "<h2>Nodes</h2>";
+    html += "<div class='" + String(message.startsWith("Error") ? "error" : "success") + "'>" + message + "</div>";
+    html += "<button class='btn' onclick='location.href=\"/nodes\"'>Back to Nodes</button>";
+    html += "<button class='btn' onclick='location.href=\"/\"'>Home</button>";
+    html += HTML_FOOTER;
+    request->send(200, "text/html", html);
+}
+
 void handleApPage(AsyncWebServerRequest *request) {
     String html = getHtmlHeader();
     html += R"(
@@ -675,6 +859,9 @@ void enterConfigurationMode() {
         currentConfig = defaultConfig;
     }
     
+    initializeDecoders();
+    initializeNodeRegistry();
+    
     startCaptivePortal();
     
     // Configuration mode main loop
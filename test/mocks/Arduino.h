@@ -0,0 +1,260 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// Host stand-in for the ESP8266 Arduino core, with what the gateway modules
+// under test use. Time only moves when a test advances it, so timeouts and
+// rate limits are deterministic.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define PROGMEM
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define F(text) text
+#define FPSTR(text) text
+
+#define LOW             0
+#define HIGH            1
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define RISING          1
+#define FALLING         2
+#define CHANGE          3
+#define MSBFIRST        1
+#define DEC             10
+#define HEX             16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class String {
+public:
+    String() {}
+    String(const char* text) : _text(text ? text : "") {}
+    String(const std::string& text) : _text(text) {}
+    explicit String(char c) : _text(1, c) {}
+    String(int value, int base = DEC) : _text(format(base == HEX ? "%x" : "%d", value)) {}
+    String(unsigned int value, int base = DEC) : _text(format(base == HEX ? "%x" : "%u", value)) {}
+    String(long value, int base = DEC) : _text(format(base == HEX ? "%lx" : "%ld", value)) {}
+    String(unsigned long value, int base = DEC) : _text(format(base == HEX ? "%lx" : "%lu", value)) {}
+    String(long long value) : _text(std::to_string(value)) {}
+    String(unsigned long long value) : _text(std::to_string(value)) {}
+    String(unsigned char value, int base = DEC) : String((unsigned int)value, base) {}
+    String(short value) : String((int)value) {}
+    String(unsigned short value) : String((unsigned int)value) {}
+    String(float value, unsigned int decimals = 2) : _text(format("%.*f", decimals, (double)value)) {}
+    String(double value, unsigned int decimals = 2) : _text(format("%.*f", decimals, value)) {}
+
+    const char* c_str() const { return _text.c_str(); }
+    unsigned int length() const { return _text.size(); }
+    bool isEmpty() const { return _text.empty(); }
+    bool reserve(unsigned int size) { _text.reserve(size); return true; }
+
+    char charAt(unsigned int index) const { return index < _text.size() ? _text[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    bool equals(const String& other) const { return _text == other._text; }
+    bool operator==(const String& other) const { return _text == other._text; }
+    bool operator==(const char* other) const { return _text == (other ? other : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char* other) const { return !(*this == other); }
+
+    bool startsWith(const String& prefix) const { return _text.compare(0, prefix._text.size(), prefix._text) == 0; }
+    bool endsWith(const String& suffix) const {
+        return _text.size() >= suffix._text.size() &&
+               _text.compare(_text.size() - suffix._text.size(), suffix._text.size(), suffix._text) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const { return position(_text.find(c, from)); }
+    int indexOf(const String& text, unsigned int from = 0) const { return position(_text.find(text._text, from)); }
+    int lastIndexOf(char c) const { return position(_text.rfind(c)); }
+    String substring(unsigned int from) const { return from < _text.size() ? String(_text.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < _text.size() && from < to ? String(_text.substr(from, to - from)) : String();
+    }
+    long toInt() const { return strtol(_text.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(_text.c_str(), nullptr); }
+
+    void trim() {
+        size_t start = _text.find_first_not_of(" \t\r\n");
+        size_t end = _text.find_last_not_of(" \t\r\n");
+        _text = start == std::string::npos ? "" : _text.substr(start, end - start + 1);
+    }
+    void toLowerCase() { for (char& c : _text) c = tolower(c); }
+    void toUpperCase() { for (char& c : _text) c = toupper(c); }
+    void remove(unsigned int index, unsigned int count = 1) { if (index < _text.size()) _text.erase(index, count); }
+    void replace(const String& from, const String& to) {
+        if (from._text.empty()) return;
+        for (size_t at = _text.find(from._text); at != std::string::npos; at = _text.find(from._text, at + to._text.size())) {
+            _text.replace(at, from._text.size(), to._text);
+        }
+    }
+
+    bool concat(const String& other) { _text += other._text; return true; }
+    bool concat(const char* text) { _text += text ? text : ""; return true; }
+    bool concat(const char* text, unsigned int length) { _text.append(text, length); return true; }
+    bool concat(char c) { _text += c; return true; }
+    String& operator+=(const String& other) { concat(other); return *this; }
+    String& operator+=(const char* text) { concat(text); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+    String& operator+=(int value) { return *this += String(value); }
+    String& operator+=(unsigned int value) { return *this += String(value); }
+    String& operator+=(long value) { return *this += String(value); }
+    String& operator+=(unsigned long value) { return *this += String(value); }
+
+    friend String operator+(const String& a, const String& b) { return String(a._text + b._text); }
+    friend String operator+(const String& a, const char* b) { return String(a._text + (b ? b : "")); }
+    friend String operator+(const char* a, const String& b) { return String(std::string(a ? a : "") + b._text); }
+    friend String operator+(const String& a, char b) { return String(a._text + b); }
+
+private:
+    template <typename... Args>
+    static std::string format(const char* pattern, Args... args) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), pattern, args...);
+        return buffer;
+    }
+    static int position(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+
+    std::string _text;
+};
+
+// ArduinoJson's String adapters name it
+class StringSumHelper : public String {
+public:
+    using String::String;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (written < size && write(buffer[written])) written++;
+        return written;
+    }
+    size_t write(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    size_t print(const String& text) { return write((const uint8_t*)text.c_str(), text.length()); }
+    size_t print(const char* text) { return write(text); }
+    size_t println(const String& text) { return print(text) + write("\r\n"); }
+    size_t println(const char* text) { return print(text) + write("\r\n"); }
+    size_t println() { return write("\r\n"); }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// Serial output is dropped
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    operator bool() const { return true; }
+};
+
+inline HardwareSerial Serial;
+
+namespace mock {
+
+inline unsigned long millisNow = 0;
+inline unsigned long microsNow = 0;
+inline uint32_t randomState = 1;
+inline uint8_t pinLevel[64];
+inline uint32_t freeHeap = 40000;
+inline bool restarted = false;
+inline void (*interruptHandlers[64])(void);
+
+inline void advanceMicros(unsigned long us) {
+    microsNow += us;
+    millisNow = microsNow / 1000;
+}
+
+inline void advanceMillis(unsigned long ms) {
+    advanceMicros(ms * 1000);
+}
+
+// Back to power-on state between tests
+inline void reset() {
+    millisNow = 0;
+    microsNow = 0;
+    randomState = 1;
+    memset(pinLevel, 0, sizeof(pinLevel));
+    memset(interruptHandlers, 0, sizeof(interruptHandlers));
+    freeHeap = 40000;
+    restarted = false;
+}
+
+// A rising edge on an interrupt pin runs its attached handler, as DIO0 does
+inline void setPin(uint8_t pin, uint8_t level) {
+    bool rising = pinLevel[pin % 64] == 0 && level != 0;
+    pinLevel[pin % 64] = level;
+    if (rising && interruptHandlers[pin % 64] != nullptr) {
+        interruptHandlers[pin % 64]();
+    }
+}
+
+}  // namespace mock
+
+inline unsigned long millis() { return mock::millisNow; }
+inline unsigned long micros() { return mock::microsNow; }
+inline void delay(unsigned long ms) { mock::advanceMillis(ms); }
+inline void delayMicroseconds(unsigned int us) { mock::advanceMicros(us); }
+// Busy-wait loops call yield(), so time moves on there as it would on the device
+inline void yield() { mock::advanceMicros(100); }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t pin) { return mock::pinLevel[pin % 64]; }
+inline void digitalWrite(uint8_t pin, uint8_t level) { mock::pinLevel[pin % 64] = level; }
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int interrupt, void (*handler)(void), int) { mock::interruptHandlers[interrupt % 64] = handler; }
+inline void detachInterrupt(int interrupt) { mock::interruptHandlers[interrupt % 64] = nullptr; }
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Deterministic, so backoff windows can be checked
+inline long random(long howBig) {
+    if (howBig <= 0) return 0;
+    mock::randomState = mock::randomState * 1103515245u + 12345u;
+    return (mock::randomState >> 8) % howBig;
+}
+inline long random(long howSmall, long howBig) {
+    return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall);
+}
+inline void randomSeed(unsigned long seed) { mock::randomState = seed; }
+
+template <typename T> T min(T a, T b) { return a < b ? a : b; }
+template <typename T> T max(T a, T b) { return a > b ? a : b; }
+template <typename T, typename L, typename H> T constrain(T value, L low, H high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return mock::freeHeap; }
+    uint16_t getMaxFreeBlockSize() { return mock::freeHeap; }
+    uint8_t getHeapFragmentation() { return 0; }
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    void restart() { mock::restarted = true; }
+    void reset() { mock::restarted = true; }
+    void wdtFeed() {}
+    uint32_t random() { return ::random(0x7FFFFFFF); }
+};
+
+inline EspClass ESP;
+
+#endif // MOCK_ARDUINO_H
@@ -0,0 +1,39 @@
+#ifndef MOCK_ESP8266WIFI_H
+#define MOCK_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <map>
+#include <string>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+namespace mock {
+
+// Names the resolver knows; dotted addresses resolve without an entry
+inline std::map<std::string, IPAddress> dnsHosts;
+inline bool wifiConnected = true;
+inline IPAddress wifiLocalIP(192, 168, 1, 2);
+
+}  // namespace mock
+
+class ESP8266WiFiClass {
+public:
+    int hostByName(const char* host, IPAddress& result) {
+        if (!mock::wifiConnected) return 0;
+        if (result.fromString(host)) return 1;
+        auto found = mock::dnsHosts.find(host);
+        if (found == mock::dnsHosts.end()) return 0;
+        result = found->second;
+        return 1;
+    }
+    uint8_t status() { return mock::wifiConnected ? WL_CONNECTED : WL_DISCONNECTED; }
+    bool isConnected() { return mock::wifiConnected; }
+    IPAddress localIP() { return mock::wifiConnected ? mock::wifiLocalIP : IPAddress(); }
+    int32_t RSSI() { return mock::wifiConnected ? -60 : 31; }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif // MOCK_ESP8266WIFI_H
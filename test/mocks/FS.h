@@ -0,0 +1,106 @@
+#ifndef MOCK_FS_H
+#define MOCK_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In-memory file system with the calls the gateway makes. Files are byte
+// vectors keyed by path; a file opened for writing is visible at once.
+namespace mock {
+
+inline std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+inline bool fsMountable = true;
+inline size_t fsFreeBytes = 1 << 20;   // Writes beyond this come up short
+
+}  // namespace mock
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+    File() {}
+    File(std::shared_ptr<std::vector<uint8_t>> data, bool writable) : _data(data), _writable(writable) {}
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!_data || !_writable) return 0;
+        size_t room = mock::fsFreeBytes;
+        if (size > room) size = room;
+        mock::fsFreeBytes -= size;
+        if (_position + size > _data->size()) _data->resize(_position + size);
+        memcpy(_data->data() + _position, buffer, size);
+        _position += size;
+        return size;
+    }
+    using Print::write;
+
+    int available() override { return _data ? (int)(_data->size() - _position) : 0; }
+    int read() override { return available() > 0 ? (*_data)[_position++] : -1; }
+    int read(uint8_t* buffer, size_t size) {
+        size_t count = 0;
+        while (count < size && available() > 0) buffer[count++] = (*_data)[_position++];
+        return count;
+    }
+    int peek() override { return available() > 0 ? (*_data)[_position] : -1; }
+
+    bool seek(uint32_t position, SeekMode mode = SeekSet) {
+        if (!_data) return false;
+        size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? _position : _data->size());
+        if (base + position > _data->size()) return false;
+        _position = base + position;
+        return true;
+    }
+    size_t position() const { return _position; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    void close() { _data.reset(); }
+    operator bool() const { return (bool)_data; }
+
+private:
+    std::shared_ptr<std::vector<uint8_t>> _data;
+    bool _writable = false;
+    size_t _position = 0;
+};
+
+class FS {
+public:
+    bool begin() { return mock::fsMountable; }
+    void end() {}
+    bool format() { mock::files.clear(); return true; }
+
+    File open(const char* path, const char* mode) {
+        auto entry = mock::files.find(path);
+        if (mode[0] == 'r') {
+            return entry == mock::files.end() ? File() : File(entry->second, mode[1] == '+');
+        }
+
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        if (mode[0] == 'a' && entry != mock::files.end()) *data = *entry->second;
+        mock::files[path] = data;
+        File file(data, true);
+        file.seek(0, SeekEnd);
+        return file;
+    }
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+
+    bool exists(const char* path) { return mock::files.count(path) > 0; }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) { return mock::files.erase(path) > 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to) {
+        auto entry = mock::files.find(from);
+        if (entry == mock::files.end()) return false;
+        mock::files[to] = entry->second;
+        mock::files.erase(from);
+        return true;
+    }
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+};
+
+#endif // MOCK_FS_H
@@ -0,0 +1,37 @@
+#ifndef MOCK_IPADDRESS_H
+#define MOCK_IPADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress {
+public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : _address(address) {}
+
+    bool fromString(const char* text) {
+        unsigned int a, b, c, d;
+        if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String& text) { return fromString(text.c_str()); }
+
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(_address & 0xFF), (unsigned)((_address >> 8) & 0xFF),
+                 (unsigned)((_address >> 16) & 0xFF), (unsigned)(_address >> 24));
+        return String(text);
+    }
+    bool isSet() const { return _address != 0; }
+    operator uint32_t() const { return _address; }
+    bool operator==(const IPAddress& other) const { return _address == other._address; }
+    bool operator!=(const IPAddress& other) const { return _address != other._address; }
+
+private:
+    uint32_t _address;
+};
+
+#endif // MOCK_IPADDRESS_H
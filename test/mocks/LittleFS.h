@@ -0,0 +1,8 @@
+#ifndef MOCK_LITTLEFS_H
+#define MOCK_LITTLEFS_H
+
+#include <FS.h>
+
+inline FS LittleFS;
+
+#endif // MOCK_LITTLEFS_H
@@ -0,0 +1,148 @@
+#ifndef MOCK_MQTT_BROKER_H
+#define MOCK_MQTT_BROKER_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Broker stand-in on the other end of a Client: decodes the MQTT packets
+// written to it and lets a test queue what the broker sends back. Connect
+// time and the heap a connection holds are set by the test, as a TLS
+// handshake would cost them.
+class MqttBroker : public Client {
+public:
+    struct Packet {
+        uint8_t type;               // Upper nibble of the fixed header
+        uint8_t flags;              // Lower nibble: DUP, QoS, retain
+        std::string topic;          // PUBLISH only
+        uint16_t packetId;          // PUBLISH with QoS > 0 only
+        std::string payload;
+        std::vector<uint8_t> raw;
+    };
+
+    bool acceptConnections = true;
+    bool autoAck = false;           // PUBACK every QoS 1 PUBLISH
+    uint32_t connectMs = 0;
+    uint32_t connectionHeap = 0;
+    uint32_t connectAttempts = 0;
+    std::string lastHost;
+    std::vector<Packet> packets;
+
+    int connect(IPAddress, uint16_t port) override { return open("", port); }
+    int connect(const char* host, uint16_t port) override { return open(host, port); }
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!_connected) return 0;
+        _outbound.insert(_outbound.end(), buffer, buffer + size);
+        decode();
+        return size;
+    }
+
+    int available() override { return _inbound.size(); }
+    int read() override {
+        if (_inbound.empty()) return -1;
+        uint8_t b = _inbound.front();
+        _inbound.pop_front();
+        return b;
+    }
+    int read(uint8_t* buffer, size_t size) override {
+        size_t count = 0;
+        while (count < size && !_inbound.empty()) {
+            buffer[count++] = _inbound.front();
+            _inbound.pop_front();
+        }
+        return count;
+    }
+    int peek() override { return _inbound.empty() ? -1 : _inbound.front(); }
+    void flush() override {}
+    void stop() override {
+        if (_connected) mock::freeHeap += connectionHeap;
+        _connected = false;
+        _inbound.clear();
+        _outbound.clear();
+    }
+    uint8_t connected() override { return _connected; }
+    operator bool() override { return _connected; }
+
+    // Broker to client
+    void send(const std::vector<uint8_t>& bytes) { _inbound.insert(_inbound.end(), bytes.begin(), bytes.end()); }
+    void puback(uint16_t packetId) { send({ 0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)packetId }); }
+    void publish(const std::string& topic, const std::string& payload) {
+        std::vector<uint8_t> body = { (uint8_t)(topic.size() >> 8), (uint8_t)topic.size() };
+        body.insert(body.end(), topic.begin(), topic.end());
+        body.insert(body.end(), payload.begin(), payload.end());
+        std::vector<uint8_t> packet = { 0x30 };
+        size_t remaining = body.size();
+        do {
+            uint8_t digit = remaining & 0x7F;
+            remaining >>= 7;
+            packet.push_back(remaining > 0 ? (digit | 0x80) : digit);
+        } while (remaining > 0);
+        packet.insert(packet.end(), body.begin(), body.end());
+        send(packet);
+    }
+
+    std::vector<Packet> publishes() const {
+        std::vector<Packet> result;
+        for (const Packet& packet : packets) {
+            if (packet.type == 0x30) result.push_back(packet);
+        }
+        return result;
+    }
+
+private:
+    int open(const char* host, uint16_t) {
+        connectAttempts++;
+        lastHost = host;
+        mock::advanceMillis(connectMs);
+        if (!acceptConnections) return 0;
+        mock::freeHeap -= connectionHeap;
+        _connected = true;
+        return 1;
+    }
+
+    // Split the outbound stream into packets once they are complete
+    void decode() {
+        while (_outbound.size() >= 2) {
+            size_t remaining = 0;
+            size_t at = 1;
+            uint32_t multiplier = 1;
+            bool more = true;
+            while (more) {
+                if (at >= _outbound.size()) return;
+                remaining += (_outbound[at] & 0x7F) * multiplier;
+                multiplier <<= 7;
+                more = _outbound[at++] & 0x80;
+            }
+            if (_outbound.size() < at + remaining) return;
+
+            Packet packet = {};
+            packet.type = _outbound[0] & 0xF0;
+            packet.flags = _outbound[0] & 0x0F;
+            packet.raw.assign(_outbound.begin(), _outbound.begin() + at + remaining);
+            if (packet.type == 0x30) {
+                size_t topicLength = (_outbound[at] << 8) | _outbound[at + 1];
+                size_t body = at + 2;
+                packet.topic.assign((const char*)&_outbound[body], topicLength);
+                body += topicLength;
+                if (packet.flags & 0x06) {
+                    packet.packetId = (_outbound[body] << 8) | _outbound[body + 1];
+                    body += 2;
+                }
+                packet.payload.assign((const char*)&_outbound[body], at + remaining - body);
+                if (autoAck && (packet.flags & 0x06) == 0x02) puback(packet.packetId);
+            }
+            packets.push_back(packet);
+            _outbound.erase(_outbound.begin(), _outbound.begin() + at + remaining);
+        }
+    }
+
+    bool _connected = false;
+    std::vector<uint8_t> _outbound;
+    std::deque<uint8_t> _inbound;
+};
+
+#endif // MOCK_MQTT_BROKER_H
@@ -0,0 +1,92 @@
+#ifndef MOCK_PUBSUBCLIENT_H
+#define MOCK_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <string>
+#include <vector>
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+// Records what the gateway publishes instead of talking to a broker
+class PubSubClient : public Print {
+public:
+    struct Message {
+        std::string topic;
+        std::string payload;
+        bool retained;
+    };
+
+    PubSubClient() : _client(nullptr), _connected(true) {}
+    explicit PubSubClient(Client& client) : _client(&client), _connected(true) {}
+
+    PubSubClient& setClient(Client& client) { _client = &client; return *this; }
+    PubSubClient& setServer(const char*, uint16_t) { return *this; }
+    PubSubClient& setServer(IPAddress, uint16_t) { return *this; }
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) { return *this; }
+    PubSubClient& setKeepAlive(uint16_t) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t) { return *this; }
+    bool setBufferSize(uint16_t) { return true; }
+
+    bool connect(const char*) { return _connected = true; }
+    bool connect(const char*, const char*, const char*) { return _connected = true; }
+    bool connect(const char*, const char*, const char*, const char*, uint8_t, bool, const char*, bool = true) {
+        return _connected = true;
+    }
+    void disconnect() { _connected = false; }
+    bool connected() { return _connected; }
+    int state() { return _connected ? 0 : -1; }
+    bool loop() { return _connected; }
+    bool subscribe(const char*, uint8_t = 0) { return _connected; }
+    bool unsubscribe(const char*) { return _connected; }
+
+    bool publish(const char* topic, const char* payload) { return publish(topic, payload, false); }
+    bool publish(const char* topic, const char* payload, bool retained) {
+        return record(topic, std::string(payload ? payload : ""), retained);
+    }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length) { return publish(topic, payload, length, false); }
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+        return record(topic, std::string((const char*)payload, length), retained);
+    }
+
+    bool beginPublish(const char* topic, unsigned int, bool retained) {
+        _streamTopic = topic;
+        _streamPayload.clear();
+        _streamRetained = retained;
+        return _connected;
+    }
+    size_t write(uint8_t b) override { _streamPayload += (char)b; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { _streamPayload.append((const char*)buffer, size); return size; }
+    int endPublish() { return record(_streamTopic.c_str(), _streamPayload, _streamRetained); }
+
+    // Test side
+    void setConnected(bool connected) { _connected = connected; }
+    const std::vector<Message>& published() const { return _published; }
+    const Message* lastPublished(const char* topic) const {
+        for (size_t i = _published.size(); i > 0; i--) {
+            if (_published[i - 1].topic == topic) return &_published[i - 1];
+        }
+        return nullptr;
+    }
+    void clearPublished() { _published.clear(); }
+
+private:
+    bool record(const char* topic, const std::string& payload, bool retained) {
+        if (!_connected) return false;
+        _published.push_back({ topic, payload, retained });
+        return true;
+    }
+
+    Client* _client;
+    bool _connected;
+    std::vector<Message> _published;
+    std::string _streamTopic;
+    std::string _streamPayload;
+    bool _streamRetained = false;
+};
+
+#endif // MOCK_PUBSUBCLIENT_H
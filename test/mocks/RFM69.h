@@ -0,0 +1,309 @@
+#ifndef MOCK_RFM69_H
+#define MOCK_RFM69_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <RFM69registers.h>
+
+// Host build of the LowPowerLab RFM69 1.5 driver, register access over the
+// mock SPI bus (see RFM69Chip.h). Members the gateway uses keep their names
+// and behavior; the frame reader is the library's, byte by byte at its SPI
+// clock. CSMA waits are not simulated.
+#define RF69_MAX_DATA_LEN       61
+#define RF69_315MHZ             31
+#define RF69_433MHZ             43
+#define RF69_868MHZ             86
+#define RF69_915MHZ             91
+#define RF69_BROADCAST_ADDR     0
+#define RF69_CSMA_LIMIT_MS      1000
+#define RF69_TX_LIMIT_MS        1000
+#define RF69_FSTEP              61.03515625
+#define CSMA_LIMIT              -90
+
+#define RF69_MODE_SLEEP         0
+#define RF69_MODE_STANDBY       1
+#define RF69_MODE_SYNTH         2
+#define RF69_MODE_RX            3
+#define RF69_MODE_TX            4
+
+#define RFM69_CTL_SENDACK       0x80
+#define RFM69_CTL_REQACK        0x40
+
+#define RF69_SPI_CS             15
+#define RF69_IRQ_PIN            4
+#define RFM69_LIBRARY_SPI_CLOCK 8000000
+
+class RFM69 {
+public:
+    static inline uint8_t DATA[RF69_MAX_DATA_LEN + 1];
+    static inline uint8_t DATALEN;
+    static inline uint16_t SENDERID;
+    static inline uint16_t TARGETID;
+    static inline uint8_t PAYLOADLEN;
+    static inline uint8_t ACK_REQUESTED;
+    static inline uint8_t ACK_RECEIVED;
+    static inline int16_t RSSI;
+    static inline volatile uint8_t _mode = RF69_MODE_STANDBY;
+
+    RFM69(uint8_t slaveSelectPin = RF69_SPI_CS, uint8_t interruptPin = RF69_IRQ_PIN, bool isRFM69HW_HCW = false, SPIClass* spi = nullptr)
+        : _slaveSelectPin(slaveSelectPin), _interruptPin(interruptPin), _interruptNum(0), _address(0), _spyMode(false),
+          _powerLevel(31), _isRFM69HW(isRFM69HW_HCW), _spi(spi ? spi : &SPI),
+          _settings(RFM69_LIBRARY_SPI_CLOCK, MSBFIRST, SPI_MODE0) {}
+    virtual ~RFM69() {}
+
+    bool initialize(uint8_t freqBand, uint16_t ID, uint8_t networkID = 1) {
+        static const uint32_t frf[] = { 0x4EC000, 0x6C4000, 0xD90000, 0xE4C000 };
+        uint32_t band = frf[freqBand == RF69_315MHZ ? 0 : freqBand == RF69_433MHZ ? 1 : freqBand == RF69_868MHZ ? 2 : 3];
+
+        digitalWrite(_slaveSelectPin, HIGH);
+        pinMode(_slaveSelectPin, OUTPUT);
+        _spi->begin();
+        writeReg(REG_OPMODE, RF_OPMODE_STANDBY);
+        writeReg(REG_DATAMODUL, 0x00);
+        writeReg(REG_BITRATEMSB, 0x02);
+        writeReg(REG_BITRATELSB, 0x40);
+        writeReg(REG_FRFMSB, band >> 16);
+        writeReg(REG_FRFMID, band >> 8);
+        writeReg(REG_FRFLSB, band);
+        writeReg(REG_SYNCCONFIG, 0x88);
+        writeReg(REG_SYNCVALUE1, 0x2D);
+        writeReg(REG_SYNCVALUE2, networkID);
+        writeReg(REG_PACKETCONFIG1, 0x90);
+        writeReg(REG_PAYLOADLENGTH, 66);
+        writeReg(REG_PACKETCONFIG2, 0x02);
+        encrypt(nullptr);
+
+        _mode = RF69_MODE_SLEEP;
+        setMode(RF69_MODE_STANDBY);
+        _interruptNum = digitalPinToInterrupt(_interruptPin);
+        attachInterrupt(_interruptNum, RFM69::isr0, RISING);
+        _address = ID;
+        return true;
+    }
+
+    void setAddress(uint16_t address) { _address = address; writeReg(REG_NODEADRS, address); }
+    void setNetwork(uint8_t networkID) { writeReg(REG_SYNCVALUE2, networkID); }
+
+    bool canSend() {
+        if (_mode == RF69_MODE_RX && PAYLOADLEN == 0 && readRSSI() < CSMA_LIMIT) {
+            setMode(RF69_MODE_STANDBY);
+            return true;
+        }
+        return false;
+    }
+
+    virtual void send(uint16_t toAddress, const void* buffer, uint8_t bufferSize, bool requestACK = false) {
+        writeReg(REG_PACKETCONFIG2, (readReg(REG_PACKETCONFIG2) & 0xFB) | RF_PACKET2_RXRESTART);
+        canSend();
+        sendFrame(toAddress, buffer, bufferSize, requestACK, false);
+    }
+
+    virtual bool sendWithRetry(uint16_t toAddress, const void* buffer, uint8_t bufferSize, uint8_t retries = 2, uint8_t retryWaitTime = 40) {
+        for (uint8_t i = 0; i <= retries; i++) {
+            send(toAddress, buffer, bufferSize, true);
+            uint32_t sentTime = millis();
+            while (millis() - sentTime < retryWaitTime) {
+                if (ACKReceived(toAddress)) return true;
+                yield();
+            }
+        }
+        return false;
+    }
+
+    virtual bool receiveDone() {
+        if (_haveData) {
+            _haveData = false;
+            interruptHandler();
+        }
+        if (_mode == RF69_MODE_RX && PAYLOADLEN > 0) {
+            setMode(RF69_MODE_STANDBY);
+            return true;
+        } else if (_mode == RF69_MODE_RX) {
+            return false;
+        }
+        receiveBegin();
+        return false;
+    }
+
+    bool ACKReceived(uint16_t fromNodeID) {
+        if (receiveDone()) {
+            return (SENDERID == fromNodeID || fromNodeID == RF69_BROADCAST_ADDR) && ACK_RECEIVED;
+        }
+        return false;
+    }
+
+    bool ACKRequested() { return ACK_REQUESTED && (TARGETID == _address); }
+
+    virtual void sendACK(const void* buffer = "", uint8_t bufferSize = 0) {
+        ACK_REQUESTED = 0;
+        uint16_t sender = SENDERID;
+        int16_t rssi = RSSI;
+        writeReg(REG_PACKETCONFIG2, (readReg(REG_PACKETCONFIG2) & 0xFB) | RF_PACKET2_RXRESTART);
+        canSend();
+        SENDERID = sender;
+        sendFrame(sender, buffer, bufferSize, false, true);
+        RSSI = rssi;
+    }
+
+    uint32_t getFrequency() {
+        return RF69_FSTEP * (((uint32_t)readReg(REG_FRFMSB) << 16) + ((uint16_t)readReg(REG_FRFMID) << 8) + readReg(REG_FRFLSB));
+    }
+    void setFrequency(uint32_t freqHz) {
+        freqHz /= RF69_FSTEP;
+        writeReg(REG_FRFMSB, freqHz >> 16);
+        writeReg(REG_FRFMID, freqHz >> 8);
+        writeReg(REG_FRFLSB, freqHz);
+    }
+
+    void encrypt(const char* key) {
+        setMode(RF69_MODE_STANDBY);
+        if (key != nullptr) {
+            select();
+            _spi->transfer(REG_AESKEY1 | 0x80);
+            for (uint8_t i = 0; i < 16; i++) _spi->transfer(key[i]);
+            unselect();
+        }
+        writeReg(REG_PACKETCONFIG2, (readReg(REG_PACKETCONFIG2) & 0xFE) | (key ? RF_PACKET2_AES_ON : 0));
+    }
+
+    int16_t readRSSI(bool forceTrigger = false) {
+        int16_t rssi = -readReg(REG_RSSIVALUE);
+        return rssi >> 1;
+    }
+
+    void spyMode(bool onOff = true) { _spyMode = onOff; }
+    virtual void setHighPower(bool onOff = true) { _isRFM69HW = onOff; }
+    virtual void setPowerLevel(uint8_t level) { _powerLevel = level > 31 ? 31 : level; }
+    void sleep() { setMode(RF69_MODE_SLEEP); }
+    uint8_t readTemperature(uint8_t calFactor = 0) { return 25 + calFactor; }
+    void rcCalibration() {}
+    void readAllRegs() {}
+
+    uint8_t readReg(uint8_t address) {
+        select();
+        _spi->transfer(address & 0x7F);
+        uint8_t value = _spi->transfer(0);
+        unselect();
+        return value;
+    }
+
+    void writeReg(uint8_t address, uint8_t value) {
+        select();
+        _spi->transfer(address | 0x80);
+        _spi->transfer(value);
+        unselect();
+    }
+
+    void setMode(uint8_t newMode) {
+        static const uint8_t opmode[] = { RF_OPMODE_SLEEP, RF_OPMODE_STANDBY, RF_OPMODE_SYNTHESIZER, RF_OPMODE_RECEIVER, RF_OPMODE_TRANSMITTER };
+        if (newMode == _mode || newMode > RF69_MODE_TX) return;
+        writeReg(REG_OPMODE, (readReg(REG_OPMODE) & 0xE3) | opmode[newMode]);
+        _mode = newMode;
+    }
+
+protected:
+    static void isr0() { _haveData = true; }
+
+    // The library's frame reader: header, then the payload byte by byte into DATA
+    void interruptHandler() {
+        if (_mode == RF69_MODE_RX && (readReg(REG_IRQFLAGS2) & RF_IRQFLAGS2_PAYLOADREADY)) {
+            setMode(RF69_MODE_STANDBY);
+            select();
+            _spi->transfer(REG_FIFO & 0x7F);
+            PAYLOADLEN = _spi->transfer(0);
+            PAYLOADLEN = PAYLOADLEN > 66 ? 66 : PAYLOADLEN;
+            TARGETID = _spi->transfer(0);
+            SENDERID = _spi->transfer(0);
+            uint8_t CTLbyte = _spi->transfer(0);
+            TARGETID |= (uint16_t(CTLbyte) & 0x0C) << 6;
+            SENDERID |= (uint16_t(CTLbyte) & 0x03) << 8;
+
+            if (!(_spyMode || TARGETID == _address || TARGETID == RF69_BROADCAST_ADDR) || PAYLOADLEN < 3) {
+                PAYLOADLEN = 0;
+                unselect();
+                receiveBegin();
+                return;
+            }
+
+            DATALEN = PAYLOADLEN - 3;
+            ACK_RECEIVED = CTLbyte & RFM69_CTL_SENDACK;
+            ACK_REQUESTED = CTLbyte & RFM69_CTL_REQACK;
+            interruptHook(CTLbyte);
+
+            for (uint8_t i = 0; i < DATALEN; i++) {
+                DATA[i] = _spi->transfer(0);
+            }
+            DATA[DATALEN] = 0;
+            unselect();
+            setMode(RF69_MODE_RX);
+        }
+        RSSI = readRSSI();
+    }
+
+    virtual void interruptHook(uint8_t CTLbyte) {}
+
+    virtual void sendFrame(uint16_t toAddress, const void* buffer, uint8_t size, bool requestACK = false, bool sendACK = false) {
+        setMode(RF69_MODE_STANDBY);
+        while ((readReg(REG_IRQFLAGS1) & RF_IRQFLAGS1_MODEREADY) == 0x00);
+        if (size > RF69_MAX_DATA_LEN) size = RF69_MAX_DATA_LEN;
+
+        uint8_t CTLbyte = sendACK ? RFM69_CTL_SENDACK : (requestACK ? RFM69_CTL_REQACK : 0);
+        if (toAddress > 0xFF) CTLbyte |= (toAddress & 0x300) >> 6;
+        if (_address > 0xFF) CTLbyte |= (_address & 0x300) >> 8;
+
+        select();
+        _spi->transfer(REG_FIFO | 0x80);
+        _spi->transfer(size + 3);
+        _spi->transfer((uint8_t)toAddress);
+        _spi->transfer((uint8_t)_address);
+        _spi->transfer(CTLbyte);
+        for (uint8_t i = 0; i < size; i++) {
+            _spi->transfer(((const uint8_t*)buffer)[i]);
+        }
+        unselect();
+
+        setMode(RF69_MODE_TX);
+        uint32_t txStart = millis();
+        while (digitalRead(_interruptPin) == 0 && millis() - txStart < RF69_TX_LIMIT_MS) yield();
+        setMode(RF69_MODE_STANDBY);
+    }
+
+    void receiveBegin() {
+        DATALEN = 0;
+        SENDERID = 0;
+        TARGETID = 0;
+        PAYLOADLEN = 0;
+        ACK_REQUESTED = 0;
+        ACK_RECEIVED = 0;
+        RSSI = 0;
+        if (readReg(REG_IRQFLAGS2) & RF_IRQFLAGS2_PAYLOADREADY) {
+            writeReg(REG_PACKETCONFIG2, (readReg(REG_PACKETCONFIG2) & 0xFB) | RF_PACKET2_RXRESTART);
+        }
+        writeReg(REG_DIOMAPPING1, RF_DIOMAPPING1_DIO0_01);
+        setMode(RF69_MODE_RX);
+    }
+
+    void select() {
+        _spi->beginTransaction(_settings);
+        digitalWrite(_slaveSelectPin, LOW);
+    }
+
+    void unselect() {
+        digitalWrite(_slaveSelectPin, HIGH);
+        _spi->endTransaction();
+    }
+
+    static inline volatile bool _haveData = false;
+
+    uint8_t _slaveSelectPin;
+    uint8_t _interruptPin;
+    uint8_t _interruptNum;
+    uint16_t _address;
+    bool _spyMode;
+    uint8_t _powerLevel;
+    bool _isRFM69HW;
+    SPIClass* _spi;
+    SPISettings _settings;
+};
+
+#endif // MOCK_RFM69_H
@@ -0,0 +1,173 @@
+#ifndef MOCK_RFM69CHIP_H
+#define MOCK_RFM69CHIP_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <RFM69registers.h>
+
+// RFM69 module on the mock SPI bus: register file, receive and transmit FIFO,
+// and DIO0 on the interrupt pin (PayloadReady while receiving, PacketSent
+// once a frame is handed over in TX mode, as the driver maps it). Frames
+// are on the air instantly.
+class RFM69Chip : public SPIDevice {
+public:
+    RFM69Chip(uint8_t csPin, uint8_t irqPin) : _irqPin(irqPin) {
+        reset();
+        SPI.attach(this, csPin);
+    }
+
+    // Power-on register values that matter to the gateway
+    void reset() {
+        memset(_registers, 0, sizeof(_registers));
+        _registers[REG_OPMODE] = RF_OPMODE_STANDBY;
+        _registers[REG_BITRATEMSB] = 0x1A;
+        _registers[REG_BITRATELSB] = 0x0B;
+        _registers[REG_PREAMBLELSB] = 0x03;
+        _registers[REG_SYNCCONFIG] = 0x98;
+        _registers[REG_PACKETCONFIG2] = 0x02;
+        _registers[REG_IRQFLAGS1] = RF_IRQFLAGS1_MODEREADY;
+        _rxLength = 0;
+        _rxRead = 0;
+        _txLength = 0;
+        framesSent = 0;
+        framesMissed = 0;
+        lastFrameLength = 0;
+        _packetSent = false;
+        _replyPending = false;
+        mock::pinLevel[_irqPin % 64] = LOW;
+    }
+
+    // A frame arrives over the air. Only a receiving chip with an empty FIFO
+    // takes it, otherwise it is missed.
+    bool receive(uint8_t targetId, uint8_t senderId, uint8_t ctl, const uint8_t* payload, uint8_t length) {
+        if (mode() != RF_OPMODE_RECEIVER || _rxRead < _rxLength || length > sizeof(_rxFifo) - 4) {
+            framesMissed++;
+            return false;
+        }
+        _rxFifo[0] = length + 3;
+        _rxFifo[1] = targetId;
+        _rxFifo[2] = senderId;
+        _rxFifo[3] = ctl;
+        memcpy(_rxFifo + 4, payload, length);
+        _rxLength = length + 4;
+        _rxRead = 0;
+        updateDio0();
+        return true;
+    }
+
+    // A frame the other side sends back, such as an ACK. It arrives the next
+    // time the chip starts receiving.
+    void replyOnReceive(uint8_t targetId, uint8_t senderId, uint8_t ctl, const uint8_t* payload = nullptr, uint8_t length = 0) {
+        _reply[0] = targetId;
+        _reply[1] = senderId;
+        _reply[2] = ctl;
+        if (length > 0) memcpy(_reply + 3, payload, length);
+        _replyLength = length;
+        _replyPending = true;
+    }
+
+    void setRssi(int dBm) { _registers[REG_RSSIVALUE] = -2 * dBm; }
+    uint8_t reg(uint8_t address) const { return _registers[address & 0x7F]; }
+    void setReg(uint8_t address, uint8_t value) { _registers[address & 0x7F] = value; }
+    uint8_t mode() const { return _registers[REG_OPMODE] & 0x1C; }
+    bool payloadWaiting() const { return _rxRead < _rxLength; }
+
+    // Last frame sent: length, target, sender, control, payload
+    uint8_t lastFrame[70];
+    uint8_t lastFrameLength;
+    uint32_t framesSent;
+    uint32_t framesMissed;
+
+    void select() override { _addressed = false; }
+
+    uint8_t transfer(uint8_t out) override {
+        if (!_addressed) {
+            _address = out & 0x7F;
+            _writing = out & 0x80;
+            _addressed = true;
+            return 0;
+        }
+
+        uint8_t address = _address;
+        if (address != REG_FIFO) {
+            _address = (_address + 1) & 0x7F;
+        }
+        if (_writing) {
+            write(address, out);
+            return 0;
+        }
+        return read(address);
+    }
+
+private:
+    uint8_t read(uint8_t address) {
+        switch (address) {
+            case REG_FIFO: {
+                uint8_t value = _rxRead < _rxLength ? _rxFifo[_rxRead++] : 0;
+                updateDio0();
+                return value;
+            }
+            case REG_IRQFLAGS2:
+                return (_registers[REG_IRQFLAGS2] & ~(RF_IRQFLAGS2_PAYLOADREADY | RF_IRQFLAGS2_FIFONOTEMPTY)) |
+                       (payloadWaiting() ? RF_IRQFLAGS2_PAYLOADREADY | RF_IRQFLAGS2_FIFONOTEMPTY : 0);
+            default:
+                return _registers[address];
+        }
+    }
+
+    void write(uint8_t address, uint8_t value) {
+        switch (address) {
+            case REG_FIFO:
+                if (_txLength < sizeof(_txFifo)) _txFifo[_txLength++] = value;
+                break;
+            case REG_PACKETCONFIG2:
+                // RX restart drops a waiting frame, the bit itself does not stick
+                if (value & RF_PACKET2_RXRESTART) {
+                    _rxLength = 0;
+                    _rxRead = 0;
+                }
+                _registers[address] = value & ~RF_PACKET2_RXRESTART;
+                break;
+            case REG_OPMODE:
+                _registers[address] = value;
+                if (mode() == RF_OPMODE_TRANSMITTER && _txLength > 0) {
+                    memcpy(lastFrame, _txFifo, _txLength);
+                    lastFrameLength = _txLength;
+                    _txLength = 0;
+                    framesSent++;
+                    _packetSent = true;
+                } else if (mode() != RF_OPMODE_TRANSMITTER) {
+                    _packetSent = false;
+                }
+                if (mode() == RF_OPMODE_RECEIVER && _replyPending) {
+                    _replyPending = false;
+                    receive(_reply[0], _reply[1], _reply[2], _reply + 3, _replyLength);
+                }
+                break;
+            default:
+                _registers[address] = value;
+        }
+        updateDio0();
+    }
+
+    void updateDio0() {
+        mock::setPin(_irqPin, _packetSent || payloadWaiting() ? HIGH : LOW);
+    }
+
+    uint8_t _irqPin;
+    uint8_t _registers[0x80];
+    uint8_t _rxFifo[66];
+    uint8_t _rxLength;
+    uint8_t _rxRead;
+    uint8_t _txFifo[66];
+    uint8_t _txLength;
+    bool _packetSent = false;
+    bool _replyPending = false;
+    uint8_t _reply[64];
+    uint8_t _replyLength = 0;
+    bool _addressed = false;
+    bool _writing = false;
+    uint8_t _address = 0;
+};
+
+#endif // MOCK_RFM69CHIP_H
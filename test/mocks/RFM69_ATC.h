@@ -0,0 +1,20 @@
+#ifndef MOCK_RFM69_ATC_H
+#define MOCK_RFM69_ATC_H
+
+#include <RFM69.h>
+
+// Automatic transmission control is not simulated, the radio sends at its set power
+class RFM69_ATC : public RFM69 {
+public:
+    RFM69_ATC(uint8_t slaveSelectPin = RF69_SPI_CS, uint8_t interruptPin = RF69_IRQ_PIN, bool isRFM69HW_HCW = false, SPIClass* spi = nullptr)
+        : RFM69(slaveSelectPin, interruptPin, isRFM69HW_HCW, spi) {}
+
+    void enableAutoPower(int16_t targetRSSI = -90) { _targetRSSI = targetRSSI; }
+    int16_t getAckRSSI() { return 0; }
+    uint8_t getPowerLevel() { return _powerLevel; }
+
+protected:
+    int16_t _targetRSSI = 0;
+};
+
+#endif // MOCK_RFM69_ATC_H
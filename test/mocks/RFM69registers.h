@@ -0,0 +1,49 @@
+#ifndef MOCK_RFM69REGISTERS_H
+#define MOCK_RFM69REGISTERS_H
+
+// RFM69 register map, the subset the gateway and the mock driver use.
+// Values as in the LowPowerLab library.
+#define REG_FIFO            0x00
+#define REG_OPMODE          0x01
+#define REG_DATAMODUL       0x02
+#define REG_BITRATEMSB      0x03
+#define REG_BITRATELSB      0x04
+#define REG_FDEVMSB         0x05
+#define REG_FDEVLSB         0x06
+#define REG_FRFMSB          0x07
+#define REG_FRFMID          0x08
+#define REG_FRFLSB          0x09
+#define REG_PALEVEL         0x11
+#define REG_RSSIVALUE       0x24
+#define REG_DIOMAPPING1     0x25
+#define REG_IRQFLAGS1       0x27
+#define REG_IRQFLAGS2       0x28
+#define REG_PREAMBLEMSB     0x2C
+#define REG_PREAMBLELSB     0x2D
+#define REG_SYNCCONFIG      0x2E
+#define REG_SYNCVALUE1      0x2F
+#define REG_SYNCVALUE2      0x30
+#define REG_PACKETCONFIG1   0x37
+#define REG_PAYLOADLENGTH   0x38
+#define REG_NODEADRS        0x39
+#define REG_PACKETCONFIG2   0x3D
+#define REG_AESKEY1         0x3E
+
+#define RF_OPMODE_SLEEP             0x00
+#define RF_OPMODE_STANDBY           0x04
+#define RF_OPMODE_SYNTHESIZER       0x08
+#define RF_OPMODE_TRANSMITTER       0x0C
+#define RF_OPMODE_RECEIVER          0x10
+
+#define RF_IRQFLAGS1_MODEREADY          0x80
+#define RF_IRQFLAGS1_SYNCADDRESSMATCH   0x01
+#define RF_IRQFLAGS2_FIFONOTEMPTY       0x40
+#define RF_IRQFLAGS2_PACKETSENT         0x08
+#define RF_IRQFLAGS2_PAYLOADREADY       0x04
+
+#define RF_SYNC_ON                  0x80
+#define RF_PACKET2_RXRESTART        0x04
+#define RF_PACKET2_AES_ON           0x01
+#define RF_DIOMAPPING1_DIO0_01      0x40
+
+#endif // MOCK_RFM69REGISTERS_H
@@ -0,0 +1,122 @@
+#ifndef MOCK_SPI_H
+#define MOCK_SPI_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+
+class SPISettings {
+public:
+    SPISettings() : clock(4000000) {}
+    SPISettings(uint32_t clockHz, uint8_t, uint8_t) : clock(clockHz) {}
+
+    uint32_t clock;
+};
+
+// A chip on the mock bus. select() is called on the first byte after its CS
+// pin went LOW, transfer() for every byte while it stays selected.
+class SPIDevice {
+public:
+    virtual ~SPIDevice() {}
+    virtual void select() = 0;
+    virtual uint8_t transfer(uint8_t out) = 0;
+};
+
+// SPI bus that routes bytes to the attached device whose CS pin is LOW, and
+// counts what the driver asks of it. busNs is the time the bytes take on the
+// wire at the clock of their transaction, micros() moves on by it; calls is
+// the number of driver calls into the bus, each of which costs fixed
+// overhead on the device.
+class SPIClass {
+public:
+    struct Stats {
+        uint32_t transactions;
+        uint32_t calls;
+        uint32_t bytes;
+        uint64_t busNs;
+    };
+
+    void begin() {}
+    void end() {}
+
+    void attach(SPIDevice* device, uint8_t csPin) {
+        if (_deviceCount < MAX_DEVICES) {
+            _devices[_deviceCount] = device;
+            _csPins[_deviceCount] = csPin;
+            _deviceCount++;
+            mock::pinLevel[csPin % 64] = HIGH;
+        }
+    }
+    void detachAll() { _deviceCount = 0; }
+
+    void beginTransaction(SPISettings settings) {
+        _clock = settings.clock;
+        _selected = nullptr;
+        stats.transactions++;
+    }
+    void endTransaction() { _selected = nullptr; }
+
+    uint8_t transfer(uint8_t out) {
+        stats.calls++;
+        return shift(out);
+    }
+    void transfer(void* buffer, size_t size) {
+        stats.calls++;
+        uint8_t* bytes = (uint8_t*)buffer;
+        for (size_t i = 0; i < size; i++) {
+            bytes[i] = shift(bytes[i]);
+        }
+    }
+    void transferBytes(const uint8_t* out, uint8_t* in, uint32_t size) {
+        stats.calls++;
+        for (uint32_t i = 0; i < size; i++) {
+            uint8_t b = shift(out ? out[i] : 0xFF);
+            if (in) in[i] = b;
+        }
+    }
+    void writeBytes(const uint8_t* data, uint32_t size) {
+        stats.calls++;
+        for (uint32_t i = 0; i < size; i++) {
+            shift(data[i]);
+        }
+    }
+
+    void resetStats() { memset(&stats, 0, sizeof(stats)); }
+
+    Stats stats = {};
+
+private:
+    static const uint8_t MAX_DEVICES = 4;
+
+    uint8_t shift(uint8_t out) {
+        uint32_t ns = 8000000000ULL / _clock;
+        stats.bytes++;
+        stats.busNs += ns;
+        _pendingNs += ns;
+        if (_pendingNs >= 1000) {
+            mock::advanceMicros(_pendingNs / 1000);
+            _pendingNs %= 1000;
+        }
+        if (_selected == nullptr) {
+            for (uint8_t i = 0; i < _deviceCount; i++) {
+                if (mock::pinLevel[_csPins[i] % 64] == LOW) {
+                    _selected = _devices[i];
+                    _selected->select();
+                    break;
+                }
+            }
+        }
+        return _selected != nullptr ? _selected->transfer(out) : 0xFF;
+    }
+
+    SPIDevice* _devices[MAX_DEVICES] = {};
+    uint8_t _csPins[MAX_DEVICES] = {};
+    uint8_t _deviceCount = 0;
+    SPIDevice* _selected = nullptr;
+    uint32_t _clock = 4000000;
+    uint32_t _pendingNs = 0;
+};
+
+inline SPIClass SPI;
+
+#endif // MOCK_SPI_H
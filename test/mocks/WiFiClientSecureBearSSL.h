@@ -0,0 +1,123 @@
+#ifndef MOCK_WIFICLIENTSECUREBEARSSL_H
+#define MOCK_WIFICLIENTSECUREBEARSSL_H
+
+#include <Arduino.h>
+#include <MqttBroker.h>
+#include <string>
+
+namespace BearSSL {
+
+// Resumption state of one broker, filled in by a full handshake
+class Session {
+public:
+    bool valid() const { return !_host.empty(); }
+    const std::string& host() const { return _host; }
+    void store(const std::string& host) { _host = host; }
+
+private:
+    std::string _host;
+};
+
+class X509List {
+public:
+    explicit X509List(const char* pem) : pem(pem) { created++; }
+
+    std::string pem;
+    static inline uint32_t created = 0;
+};
+
+// TLS broker stand-in: a full handshake or a session resumption is charged
+// its time, certificates are checked the way the client is set up to check
+// them, and the connection holds the I/O buffers on the heap as BearSSL does.
+class WiFiClientSecure : public MqttBroker {
+public:
+    // Broker side
+    bool brokerMfln = true;             // Broker honours the max fragment length extension
+    std::string brokerFingerprint = "AB:CD:EF";
+    std::string brokerCaPem;            // CA that signed the broker certificate
+    time_t certNotBefore = 1700000000;
+    time_t certNotAfter = 1900000000;
+    uint32_t fullHandshakeMs = 1800;
+    uint32_t resumedHandshakeMs = 250;
+    uint32_t probeMs = 300;
+    uint32_t engineHeap = 6000;         // SSL engine state besides the buffers
+
+    // Client side, as the gateway configured it
+    uint32_t rxBufferSize = 16384 + 325;
+    uint32_t txBufferSize = 597;
+    Session* session = nullptr;
+    const X509List* trustAnchors = nullptr;
+    std::string fingerprint;
+    bool insecure = false;
+    time_t x509Time = 0;
+
+    uint32_t mflnProbes = 0;
+    uint32_t fullHandshakes = 0;
+    uint32_t resumedHandshakes = 0;
+
+    bool probeMaxFragmentLength(const char* host, uint16_t port, uint16_t length) {
+        mflnProbes++;
+        mock::advanceMillis(probeMs);
+        return brokerMfln && (length == 512 || length == 1024 || length == 2048 || length == 4096);
+    }
+    bool setBufferSizes(int recv, int xmit) {
+        rxBufferSize = recv + 325;
+        txBufferSize = xmit + 85;
+        return true;
+    }
+    void setSession(Session* value) { session = value; }
+    void setTrustAnchors(const X509List* value) {
+        trustAnchors = value;
+        fingerprint.clear();
+        insecure = false;
+    }
+    bool setFingerprint(const char* value) {
+        fingerprint = value;
+        trustAnchors = nullptr;
+        insecure = false;
+        return true;
+    }
+    void setInsecure() {
+        insecure = true;
+        trustAnchors = nullptr;
+        fingerprint.clear();
+    }
+    void setX509Time(time_t now) { x509Time = now; }
+
+    int connect(IPAddress ip, uint16_t port) override { return connect(ip.toString().c_str(), port); }
+    int connect(const char* host, uint16_t port) override {
+        bool resume = session != nullptr && session->host() == host;
+        connectMs = resume ? resumedHandshakeMs : fullHandshakeMs;
+        connectionHeap = rxBufferSize + txBufferSize + engineHeap;
+
+        bool accepted = acceptConnections && verified(resume) && (brokerMfln || rxBufferSize >= 16384);
+        bool saved = acceptConnections;
+        acceptConnections = accepted;
+        int result = MqttBroker::connect(host, port);
+        acceptConnections = saved;
+        if (!result) return 0;
+
+        if (resume) {
+            resumedHandshakes++;
+        } else {
+            fullHandshakes++;
+            if (session != nullptr) session->store(host);
+        }
+        return 1;
+    }
+
+private:
+    // A resumed session skips the certificate, as the broker does not send it
+    bool verified(bool resume) const {
+        if (resume || insecure) return true;
+        if (!fingerprint.empty()) return fingerprint == brokerFingerprint;
+        if (trustAnchors != nullptr) {
+            return trustAnchors->pem == brokerCaPem && x509Time >= certNotBefore && x509Time <= certNotAfter;
+        }
+        return false;
+    }
+};
+
+}  // namespace BearSSL
+
+#endif // MOCK_WIFICLIENTSECUREBEARSSL_H
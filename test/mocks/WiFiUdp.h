@@ -0,0 +1,101 @@
+#ifndef MOCK_WIFIUDP_H
+#define MOCK_WIFIUDP_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <deque>
+#include <vector>
+
+// WiFiUDP with the local network folded in: datagrams sent are kept for the
+// test, stamped with when they reach the receiver, and datagrams the test
+// queues are handed to parsePacket() in order.
+class WiFiUDP {
+public:
+    struct Datagram {
+        IPAddress host;
+        uint16_t port;
+        std::vector<uint8_t> data;
+        unsigned long sentMicros;       // micros() at endPacket()
+        unsigned long arrivalMicros;    // sentMicros plus the one-way latency
+    };
+
+    std::vector<Datagram> sent;
+    uint32_t latencyUs = 0;             // One-way network latency to the receiver
+    bool failSends = false;             // beginPacket() fails, as with no route
+    uint16_t localPort = 0;
+
+    uint8_t begin(uint16_t port) {
+        localPort = port;
+        return 1;
+    }
+    void stop() { localPort = 0; }
+
+    int beginPacket(IPAddress host, uint16_t port) {
+        if (failSends) return 0;
+        _out = Datagram{ host, port, {}, 0, 0 };
+        _building = true;
+        return 1;
+    }
+    size_t write(const uint8_t* data, size_t length) {
+        if (!_building) return 0;
+        _out.data.insert(_out.data.end(), data, data + length);
+        return length;
+    }
+    size_t write(uint8_t value) { return write(&value, 1); }
+    int endPacket() {
+        if (!_building) return 0;
+        _building = false;
+        _out.sentMicros = micros();
+        _out.arrivalMicros = _out.sentMicros + latencyUs;
+        sent.push_back(_out);
+        return 1;
+    }
+
+    // Next datagram from the network; whatever of the previous one was not
+    // read is dropped, as on the device
+    int parsePacket() {
+        if (_incoming.empty()) {
+            _current = Datagram{};
+            _readPos = 0;
+            return 0;
+        }
+        _current = _incoming.front();
+        _incoming.pop_front();
+        _readPos = 0;
+        return _current.data.size();
+    }
+    int available() { return _current.data.size() - _readPos; }
+    int read(uint8_t* buffer, size_t length) {
+        size_t count = std::min(length, _current.data.size() - _readPos);
+        memcpy(buffer, _current.data.data() + _readPos, count);
+        _readPos += count;
+        return count;
+    }
+    int read() { return _readPos < _current.data.size() ? _current.data[_readPos++] : -1; }
+    IPAddress remoteIP() { return _current.host; }
+    uint16_t remotePort() { return _current.port; }
+
+    // Test side
+    void receive(IPAddress from, uint16_t fromPort, const std::vector<uint8_t>& data) {
+        _incoming.push_back(Datagram{ from, fromPort, data, micros(), micros() });
+    }
+    size_t pending() const { return _incoming.size(); }
+    void clear() {
+        sent.clear();
+        _incoming.clear();
+        _current = Datagram{};
+        _readPos = 0;
+        _building = false;
+        latencyUs = 0;
+        failSends = false;
+    }
+
+private:
+    Datagram _out;
+    Datagram _current;
+    std::deque<Datagram> _incoming;
+    size_t _readPos = 0;
+    bool _building = false;
+};
+
+#endif // MOCK_WIFIUDP_H
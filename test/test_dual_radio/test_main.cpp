@@ -0,0 +1,180 @@
+// Two GatewayRadio modules on one SPI bus, as built with RFM69_SECOND_RADIO:
+// frames are read from the radio that received them, and the library state
+// both share is handed over without losing either radio's mode.
+
+#define RFM69_SECOND_RADIO 1
+
+#include <unity.h>
+#include <RFM69Chip.h>
+
+#include "../../src/gateway_radio.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+uint8_t framePriority(uint8_t senderId, uint8_t ctl) {
+    return (ctl & RFM69_CTL_PRIORITY) ? PRIORITY_ALARM : PRIORITY_ROUTINE;
+}
+
+static const uint8_t GATEWAY_ID = 1;
+
+static RFM69Chip chip1(15, 4);
+static RFM69Chip chip2(16, 5);
+static GatewayRadio radio1(15, 4, false, 0);
+static GatewayRadio radio2(16, 5, false, 1);
+
+static const uint8_t PAYLOAD_1[] = { 0x11, 0x12, 0x13 };
+static const uint8_t PAYLOAD_2[] = { 0x21, 0x22, 0x23, 0x24 };
+
+void setUp(void) {
+    mock::reset();
+    chip1.reset();
+    chip2.reset();
+    digitalWrite(15, HIGH);
+    digitalWrite(16, HIGH);
+    TEST_ASSERT_TRUE(radio1.initialize(RF69_868MHZ, GATEWAY_ID, 100));
+    TEST_ASSERT_TRUE(radio2.initialize(RF69_868MHZ, GATEWAY_ID, 200));
+    radio2.setFrequency(869525000);
+
+    RadioFrame frame;
+    for (uint8_t lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        while (radio1.nextFrame(frame, lane));
+        while (radio2.nextFrame(frame, lane));
+    }
+    mqttClient.clearPublished();
+
+    // Both listening
+    radio1.receiveDone();
+    radio2.receiveDone();
+    radio1.use();
+}
+
+void tearDown(void) {}
+
+void test_radios_configured_separately(void) {
+    TEST_ASSERT_EQUAL_PTR(&radio1, GatewayRadio::instance(0));
+    TEST_ASSERT_EQUAL_PTR(&radio2, GatewayRadio::instance(1));
+    TEST_ASSERT_EQUAL_UINT8(100, chip1.reg(REG_SYNCVALUE2));
+    TEST_ASSERT_EQUAL_UINT8(200, chip2.reg(REG_SYNCVALUE2));
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip1.mode());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip2.mode());
+
+    radio2.use();
+    TEST_ASSERT_UINT32_WITHIN(100, 869525000, radio2.getFrequency());
+    radio1.use();
+    TEST_ASSERT_EQUAL_UINT32(868000000, radio1.getFrequency());
+}
+
+void test_frame_read_from_radio_that_received_it(void) {
+    mock::advanceMicros(500);
+    TEST_ASSERT_TRUE(chip2.receive(GATEWAY_ID, 7, 0, PAYLOAD_2, sizeof(PAYLOAD_2)));
+    TEST_ASSERT_TRUE(GatewayRadio::frameReady());
+    TEST_ASSERT_EQUAL_UINT32(micros(), radio2.irqMicros());
+
+    TEST_ASSERT_NULL(radio1.receiveFrame());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip1.mode());
+
+    RadioFrame* frame = radio2.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL_UINT8(1, frame->radioIndex);
+    TEST_ASSERT_EQUAL_UINT8(200, frame->networkId);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(PAYLOAD_2), frame->length);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD_2, frame->data, sizeof(PAYLOAD_2));
+    TEST_ASSERT_FALSE(GatewayRadio::frameReady());
+}
+
+void test_simultaneous_frames_kept_apart(void) {
+    TEST_ASSERT_TRUE(chip1.receive(GATEWAY_ID, 7, 0, PAYLOAD_1, sizeof(PAYLOAD_1)));
+    TEST_ASSERT_TRUE(chip2.receive(GATEWAY_ID, 8, 0, PAYLOAD_2, sizeof(PAYLOAD_2)));
+
+    RadioFrame* frame = radio2.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL_UINT8(8, frame->senderId);
+    TEST_ASSERT_TRUE(radio2.queueFrame());
+
+    // Radio 1 kept its frame and its receive mode while radio 2 was read
+    TEST_ASSERT_TRUE(chip1.payloadWaiting());
+    frame = radio1.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL_UINT8(7, frame->senderId);
+    TEST_ASSERT_EQUAL_UINT8(0, frame->radioIndex);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD_1, frame->data, sizeof(PAYLOAD_1));
+    TEST_ASSERT_TRUE(radio1.queueFrame());
+
+    TEST_ASSERT_EQUAL_UINT8(1, radio1.queuedFrames());
+    TEST_ASSERT_EQUAL_UINT8(1, radio2.queuedFrames());
+    TEST_ASSERT_EQUAL_UINT32(0, chip1.framesMissed + chip2.framesMissed);
+}
+
+void test_use_parks_shared_library_state(void) {
+    TEST_ASSERT_TRUE(chip1.receive(GATEWAY_ID, 7, 0, PAYLOAD_1, sizeof(PAYLOAD_1)));
+    TEST_ASSERT_NOT_NULL(radio1.receiveFrame());
+    TEST_ASSERT_EQUAL_UINT8(RF69_MODE_STANDBY, RFM69::_mode);
+
+    radio2.use();
+    TEST_ASSERT_EQUAL_UINT8(RF69_MODE_RX, RFM69::_mode);
+    radio1.use();
+    TEST_ASSERT_EQUAL_UINT8(RF69_MODE_STANDBY, RFM69::_mode);
+
+    // Back to receiving on radio 1 without touching radio 2
+    radio1.receiveDone();
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip1.mode());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip2.mode());
+}
+
+void test_send_goes_out_on_chosen_radio(void) {
+    radio2.use();
+    radio2.send(9, PAYLOAD_2, sizeof(PAYLOAD_2));
+    TEST_ASSERT_EQUAL_UINT32(0, chip1.framesSent);
+    TEST_ASSERT_EQUAL_UINT32(1, chip2.framesSent);
+    TEST_ASSERT_EQUAL_UINT8(9, chip2.lastFrame[1]);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD_2, chip2.lastFrame + 4, sizeof(PAYLOAD_2));
+
+    // Radio 1 still receives meanwhile
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip1.mode());
+    TEST_ASSERT_TRUE(chip1.receive(GATEWAY_ID, 7, 0, PAYLOAD_1, sizeof(PAYLOAD_1)));
+    TEST_ASSERT_NOT_NULL(radio1.receiveFrame());
+}
+
+void test_ack_from_second_radio(void) {
+    TEST_ASSERT_TRUE(chip2.receive(GATEWAY_ID, 7, RFM69_CTL_REQACK, PAYLOAD_2, sizeof(PAYLOAD_2)));
+    RadioFrame* frame = radio2.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_TRUE(frame->ackRequested);
+
+    radio2.sendACK();
+    TEST_ASSERT_EQUAL_UINT32(0, chip1.framesSent);
+    TEST_ASSERT_EQUAL_UINT32(1, chip2.framesSent);
+    TEST_ASSERT_EQUAL_UINT8(7, chip2.lastFrame[1]);
+    TEST_ASSERT_EQUAL_HEX8(RFM69_CTL_SENDACK, chip2.lastFrame[3]);
+}
+
+void test_stats_list_both_radios(void) {
+    TEST_ASSERT_TRUE(chip2.receive(GATEWAY_ID, 7, 0, PAYLOAD_2, sizeof(PAYLOAD_2)));
+    TEST_ASSERT_NOT_NULL(radio2.receiveFrame());
+    TEST_ASSERT_TRUE(radio2.queueFrame());
+
+    publishRadioStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/radio");
+    TEST_ASSERT_NOT_NULL(message);
+    StaticJsonDocument<512> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(2, doc["radios"].size());
+    TEST_ASSERT_EQUAL_UINT32(100, doc["radios"][0]["networkId"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(200, doc["radios"][1]["networkId"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["radios"][1]["queued"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(0, doc["radios"][0]["queued"].as<uint32_t>());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_radios_configured_separately);
+    RUN_TEST(test_frame_read_from_radio_that_received_it);
+    RUN_TEST(test_simultaneous_frames_kept_apart);
+    RUN_TEST(test_use_parks_shared_library_state);
+    RUN_TEST(test_send_goes_out_on_chosen_radio);
+    RUN_TEST(test_ack_from_second_radio);
+    RUN_TEST(test_stats_list_both_radios);
+    return UNITY_END();
+}
@@ -0,0 +1,285 @@
+// GatewayRadio against the mock RFM69 module: burst FIFO reads into the
+// receive queues, burst FIFO writes, and the read path compared with the
+// library's byte-wise one.
+
+#include <chrono>
+#include <unity.h>
+#include <RFM69Chip.h>
+
+#include "../../src/gateway_radio.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+uint8_t framePriority(uint8_t senderId, uint8_t ctl) {
+    return (ctl & RFM69_CTL_PRIORITY) ? PRIORITY_ALARM : PRIORITY_ROUTINE;
+}
+
+static const uint8_t GATEWAY_ID = 1;
+static const uint8_t NETWORK_ID = 100;
+static const uint8_t RADIO_CS = 15;
+static const uint8_t RADIO_IRQ = 4;
+static const uint8_t LIBRARY_CS = 16;
+static const uint8_t LIBRARY_IRQ = 5;
+
+static RFM69Chip chip(RADIO_CS, RADIO_IRQ);
+static GatewayRadio radio(RADIO_CS, RADIO_IRQ, false);
+
+// Same module type driven by the unmodified library, for the read benchmark
+static RFM69Chip libraryChip(LIBRARY_CS, LIBRARY_IRQ);
+static RFM69 libraryRadio(LIBRARY_CS, LIBRARY_IRQ, false);
+
+static uint8_t payload[RF69_MAX_DATA_LEN];
+
+// Put the radio in RX and deliver a frame to it
+static void deliver(uint8_t target, uint8_t sender, uint8_t ctl, uint8_t length) {
+    radio.receiveDone();
+    TEST_ASSERT_TRUE(chip.receive(target, sender, ctl, payload, length));
+}
+
+void setUp(void) {
+    mock::reset();
+    chip.reset();
+    libraryChip.reset();
+    digitalWrite(LIBRARY_CS, HIGH);
+    for (uint8_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = 0xA0 + i;
+    }
+    chip.setRssi(-60);
+    TEST_ASSERT_TRUE(radio.initialize(RF69_868MHZ, GATEWAY_ID, NETWORK_ID));
+
+    // Empty the receive queues
+    RadioFrame frame;
+    for (uint8_t lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        while (radio.nextFrame(frame, lane));
+    }
+    radio.framesReceived = 0;
+    radio.framesDropped = 0;
+    mqttClient.clearPublished();
+    SPI.resetStats();
+}
+
+void tearDown(void) {}
+
+void test_initialize_sets_band_and_network(void) {
+    TEST_ASSERT_TRUE(radio.ready());
+    TEST_ASSERT_EQUAL_UINT8(NETWORK_ID, radio.networkId());
+    TEST_ASSERT_EQUAL_UINT8(NETWORK_ID, chip.reg(REG_SYNCVALUE2));
+    TEST_ASSERT_EQUAL_UINT32(868000000, radio.getFrequency());
+}
+
+void test_receive_frame_reads_header_and_payload(void) {
+    deliver(GATEWAY_ID, 7, RFM69_CTL_REQACK, 12);
+    TEST_ASSERT_TRUE(GatewayRadio::frameReady());
+
+    RadioFrame* frame = radio.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL_UINT8(7, frame->senderId);
+    TEST_ASSERT_EQUAL_UINT8(GATEWAY_ID, frame->targetId);
+    TEST_ASSERT_EQUAL_UINT8(NETWORK_ID, frame->networkId);
+    TEST_ASSERT_EQUAL_UINT8(12, frame->length);
+    TEST_ASSERT_EQUAL_MEMORY(payload, frame->data, 12);
+    TEST_ASSERT_EQUAL_INT16(-60, frame->rssi);
+    TEST_ASSERT_TRUE(frame->ackRequested);
+    TEST_ASSERT_EQUAL_UINT8(PRIORITY_ROUTINE, frame->priority);
+
+    // FIFO drained, radio left in standby for the ACK
+    TEST_ASSERT_FALSE(chip.payloadWaiting());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_STANDBY, chip.mode());
+    TEST_ASSERT_FALSE(GatewayRadio::frameReady());
+}
+
+void test_frames_queue_by_priority(void) {
+    deliver(GATEWAY_ID, 7, 0, 4);
+    TEST_ASSERT_NOT_NULL(radio.receiveFrame());
+    TEST_ASSERT_TRUE(radio.queueFrame());
+
+    payload[0] = 0x55;
+    deliver(GATEWAY_ID, 8, RFM69_CTL_PRIORITY, 4);
+    RadioFrame* alarm = radio.receiveFrame();
+    TEST_ASSERT_NOT_NULL(alarm);
+    TEST_ASSERT_EQUAL_UINT8(PRIORITY_ALARM, alarm->priority);
+    TEST_ASSERT_EQUAL_HEX8(RFM69_CTL_PRIORITY, alarm->ctl & RFM69_CTL_PRIORITY);
+    TEST_ASSERT_TRUE(radio.queueFrame());
+    TEST_ASSERT_EQUAL_UINT8(2, radio.queuedFrames());
+
+    RadioFrame frame;
+    TEST_ASSERT_TRUE(radio.nextFrame(frame, PRIORITY_ALARM));
+    TEST_ASSERT_EQUAL_UINT8(8, frame.senderId);
+    TEST_ASSERT_EQUAL_HEX8(0x55, frame.data[0]);
+    TEST_ASSERT_FALSE(radio.nextFrame(frame, PRIORITY_ALARM));
+    TEST_ASSERT_TRUE(radio.nextFrame(frame, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT8(7, frame.senderId);
+}
+
+void test_full_routine_queue_drops_but_alarms_get_through(void) {
+    for (uint8_t i = 0; i < RADIO_RX_QUEUE_LEN; i++) {
+        deliver(GATEWAY_ID, 10 + i, 0, 4);
+        TEST_ASSERT_NOT_NULL(radio.receiveFrame());
+        TEST_ASSERT_TRUE(radio.queueFrame());
+    }
+
+    deliver(GATEWAY_ID, 20, 0, 4);
+    TEST_ASSERT_NOT_NULL(radio.receiveFrame());
+    TEST_ASSERT_FALSE(radio.queueFrame());
+    TEST_ASSERT_EQUAL_UINT32(1, radio.framesDropped);
+
+    deliver(GATEWAY_ID, 21, RFM69_CTL_PRIORITY, 4);
+    TEST_ASSERT_NOT_NULL(radio.receiveFrame());
+    TEST_ASSERT_TRUE(radio.queueFrame());
+
+    // The dropped frame did not overwrite a queued one
+    RadioFrame frame;
+    for (uint8_t i = 0; i < RADIO_RX_QUEUE_LEN; i++) {
+        TEST_ASSERT_TRUE(radio.nextFrame(frame, PRIORITY_ROUTINE));
+        TEST_ASSERT_EQUAL_UINT8(10 + i, frame.senderId);
+    }
+    TEST_ASSERT_TRUE(radio.nextFrame(frame, PRIORITY_ALARM));
+    TEST_ASSERT_EQUAL_UINT8(21, frame.senderId);
+}
+
+void test_frame_for_other_node_is_discarded(void) {
+    deliver(GATEWAY_ID + 1, 7, 0, 8);
+    TEST_ASSERT_NULL(radio.receiveFrame());
+    TEST_ASSERT_FALSE(radio.queueFrame());
+
+    // Dropped from the FIFO, radio listening again
+    TEST_ASSERT_FALSE(chip.payloadWaiting());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip.mode());
+}
+
+void test_broadcast_frame_is_received(void) {
+    deliver(RF69_BROADCAST_ADDR, 7, 0, 3);
+    RadioFrame* frame = radio.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_EQUAL_UINT8(RF69_BROADCAST_ADDR, frame->targetId);
+    TEST_ASSERT_FALSE(frame->ackRequested);
+}
+
+void test_receive_frame_without_interrupt_returns_nothing(void) {
+    radio.receiveDone();
+    TEST_ASSERT_NULL(radio.receiveFrame());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip.mode());
+}
+
+void test_send_frame_writes_fifo_in_one_burst(void) {
+    const char text[] = "hello";
+    radio.send(9, text, 5, true);
+
+    TEST_ASSERT_EQUAL_UINT32(1, chip.framesSent);
+    TEST_ASSERT_EQUAL_UINT8(9, chip.lastFrameLength);
+    const uint8_t expected[] = { 8, 9, GATEWAY_ID, RFM69_CTL_REQACK, 'h', 'e', 'l', 'l', 'o' };
+    TEST_ASSERT_EQUAL_MEMORY(expected, chip.lastFrame, sizeof(expected));
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_STANDBY, chip.mode());
+
+    // The packet sent interrupt is not taken for a frame
+    TEST_ASSERT_TRUE(GatewayRadio::frameReady());
+    TEST_ASSERT_NULL(radio.receiveFrame());
+    TEST_ASSERT_EQUAL_HEX8(RF_OPMODE_RECEIVER, chip.mode());
+}
+
+void test_ack_goes_back_to_sender(void) {
+    deliver(GATEWAY_ID, 7, RFM69_CTL_REQACK, 4);
+    RadioFrame* frame = radio.receiveFrame();
+    TEST_ASSERT_NOT_NULL(frame);
+    TEST_ASSERT_TRUE(radio.ACKRequested());
+
+    radio.sendACK();
+    const uint8_t expected[] = { 3, 7, GATEWAY_ID, RFM69_CTL_SENDACK };
+    TEST_ASSERT_EQUAL_UINT8(sizeof(expected), chip.lastFrameLength);
+    TEST_ASSERT_EQUAL_MEMORY(expected, chip.lastFrame, sizeof(expected));
+}
+
+void test_radio_stats_published(void) {
+    deliver(GATEWAY_ID, 7, 0, 4);
+    TEST_ASSERT_NOT_NULL(radio.receiveFrame());
+    TEST_ASSERT_TRUE(radio.queueFrame());
+
+    publishRadioStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/radio");
+    TEST_ASSERT_NOT_NULL(message);
+
+    StaticJsonDocument<512> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(1, doc["radios"][0]["received"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_INT(-60, doc["radios"][0]["rssiAvg"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(868000000, doc["radios"][0]["frequency"].as<uint32_t>());
+}
+
+// Read of a full-size frame, library handler versus receiveFrame(). Both
+// include the mode switches and the RSSI read around the FIFO access. On the
+// device each SPI call costs a fixed overhead on top of its bus time, so the
+// call count is what the burst read cuts; host time is for reference only.
+void test_benchmark_fifo_read(void) {
+    const uint8_t length = RF69_MAX_DATA_LEN;
+    const uint16_t frames = 500;
+
+    libraryChip.setRssi(-60);
+    digitalWrite(RADIO_CS, HIGH);
+    TEST_ASSERT_TRUE(libraryRadio.initialize(RF69_868MHZ, GATEWAY_ID, NETWORK_ID));
+
+    SPIClass::Stats library = {};
+    std::chrono::nanoseconds libraryHost(0);
+    for (uint16_t i = 0; i < frames; i++) {
+        libraryRadio.receiveDone();
+        TEST_ASSERT_TRUE(libraryChip.receive(GATEWAY_ID, 7, 0, payload, length));
+        SPI.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        TEST_ASSERT_TRUE(libraryRadio.receiveDone());
+        libraryHost += std::chrono::steady_clock::now() - start;
+        library.calls += SPI.stats.calls;
+        library.bytes += SPI.stats.bytes;
+        library.busNs += SPI.stats.busNs;
+    }
+    TEST_ASSERT_EQUAL_UINT8(length, RFM69::DATALEN);
+    TEST_ASSERT_EQUAL_MEMORY(payload, RFM69::DATA, length);
+
+    TEST_ASSERT_TRUE(radio.initialize(RF69_868MHZ, GATEWAY_ID, NETWORK_ID));
+    SPIClass::Stats burst = {};
+    std::chrono::nanoseconds burstHost(0);
+    for (uint16_t i = 0; i < frames; i++) {
+        deliver(GATEWAY_ID, 7, 0, length);
+        SPI.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        RadioFrame* frame = radio.receiveFrame();
+        burstHost += std::chrono::steady_clock::now() - start;
+        TEST_ASSERT_NOT_NULL(frame);
+        TEST_ASSERT_EQUAL_UINT8(length, frame->length);
+        TEST_ASSERT_EQUAL_MEMORY(payload, frame->data, length);
+        burst.calls += SPI.stats.calls;
+        burst.bytes += SPI.stats.bytes;
+        burst.busNs += SPI.stats.busNs;
+    }
+
+    char report[160];
+    snprintf(report, sizeof(report), "library: %u SPI calls, %u bytes, %.1f us on the bus, %lld ns host per frame",
+             library.calls / frames, library.bytes / frames, library.busNs / 1000.0 / frames,
+             (long long)libraryHost.count() / frames);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report), "burst:   %u SPI calls, %u bytes, %.1f us on the bus, %lld ns host per frame",
+             burst.calls / frames, burst.bytes / frames, burst.busNs / 1000.0 / frames,
+             (long long)burstHost.count() / frames);
+    TEST_MESSAGE(report);
+
+    TEST_ASSERT_LESS_THAN(library.calls / 4, burst.calls);
+    TEST_ASSERT_LESS_THAN(library.busNs, burst.busNs);
+    TEST_ASSERT_LESS_OR_EQUAL(radio.readMaxUs, radio.readAvgUs);
+    TEST_ASSERT_GREATER_THAN(0, radio.readAvgUs);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_initialize_sets_band_and_network);
+    RUN_TEST(test_receive_frame_reads_header_and_payload);
+    RUN_TEST(test_frames_queue_by_priority);
+    RUN_TEST(test_full_routine_queue_drops_but_alarms_get_through);
+    RUN_TEST(test_frame_for_other_node_is_discarded);
+    RUN_TEST(test_broadcast_frame_is_received);
+    RUN_TEST(test_receive_frame_without_interrupt_returns_nothing);
+    RUN_TEST(test_send_frame_writes_fifo_in_one_burst);
+    RUN_TEST(test_ack_goes_back_to_sender);
+    RUN_TEST(test_radio_stats_published);
+    RUN_TEST(test_benchmark_fifo_read);
+    return UNITY_END();
+}
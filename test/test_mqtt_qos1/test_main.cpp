@@ -0,0 +1,275 @@
+// QoS 1 in-flight window of mqtt_transport.cpp against a broker stand-in:
+// packet ID to slot mapping, PUBACKs sniffed from the inbound stream,
+// retransmission with DUP and the connect statistics.
+
+#include <unity.h>
+#include <MqttBroker.h>
+
+#include "../../src/mqtt_transport.cpp"
+
+MqttBroker broker;
+MqttTransport mqttTransport(broker);
+PubSubClient mqttClient(mqttTransport);
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+void debugLog(const String& message) {}
+
+static const char TOPIC[] = "rfm69gw/out/7";
+
+static bool publish(const char* payload) {
+    return mqttPublishQos1(TOPIC, (const uint8_t*)payload, strlen(payload));
+}
+
+// Let PubSubClient read what the broker sent, as its loop() does
+static void readInbound() {
+    while (mqttTransport.available()) {
+        mqttTransport.read();
+    }
+}
+
+static uint16_t packetIdOf(size_t index) {
+    return broker.publishes()[index].packetId;
+}
+
+void setUp(void) {
+    mock::reset();
+    memset(inFlight, 0, sizeof(inFlight));
+    memset(nextPacketId, 0, sizeof(nextPacketId));
+    inFlightCount = 0;
+    qos1Published = qos1Acked = qos1Retransmitted = qos1Dropped = qos1Oversized = qos1RttMs = 0;
+
+    broker.stop();
+    broker.packets.clear();
+    broker.acceptConnections = true;
+    broker.autoAck = false;
+    broker.connectMs = 0;
+    broker.connectionHeap = 0;
+    TEST_ASSERT_EQUAL_INT(1, mqttTransport.connect("broker.local", 1883));
+    mqttClient.setConnected(true);
+    mqttClient.clearPublished();
+}
+
+void tearDown(void) {}
+
+void test_publish_encodes_qos1_packet(void) {
+    TEST_ASSERT_TRUE(publish("{\"t\":21}"));
+
+    std::vector<MqttBroker::Packet> sent = broker.publishes();
+    TEST_ASSERT_EQUAL_UINT32(1, sent.size());
+    TEST_ASSERT_EQUAL_HEX8(0x02, sent[0].flags);
+    TEST_ASSERT_EQUAL_STRING(TOPIC, sent[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"t\":21}", sent[0].payload.c_str());
+    TEST_ASSERT_EQUAL_UINT16(1, sent[0].packetId);
+    TEST_ASSERT_EQUAL_UINT8(1, inFlightCount);
+}
+
+void test_packet_ids_follow_their_slot(void) {
+    for (uint8_t i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(publish("x"));
+    }
+    TEST_ASSERT_EQUAL_UINT16(1, packetIdOf(0));
+    TEST_ASSERT_EQUAL_UINT16(2, packetIdOf(1));
+    TEST_ASSERT_EQUAL_UINT16(3, packetIdOf(2));
+
+    // Slot 1 is freed and reused with its next ID, one window further
+    broker.puback(2);
+    readInbound();
+    TEST_ASSERT_EQUAL_UINT8(2, inFlightCount);
+    TEST_ASSERT_TRUE(publish("y"));
+    TEST_ASSERT_EQUAL_UINT16(2 + MQTT_QOS1_WINDOW, packetIdOf(3));
+    TEST_ASSERT_EQUAL_UINT16(2 + MQTT_QOS1_WINDOW, inFlight[1].packetId);
+}
+
+void test_packet_id_wraps_within_slot(void) {
+    // Last ID of slot 0 below 0xFFFF
+    const uint16_t lastId = 1 + (0xFFFF - 1) / MQTT_QOS1_WINDOW * MQTT_QOS1_WINDOW;
+    nextPacketId[0] = lastId;
+    TEST_ASSERT_TRUE(publish("x"));
+    TEST_ASSERT_EQUAL_UINT16(lastId, packetIdOf(0));
+    TEST_ASSERT_EQUAL_UINT16(1, nextPacketId[0]);
+
+    broker.puback(packetIdOf(0));
+    readInbound();
+    TEST_ASSERT_TRUE(publish("x"));
+    TEST_ASSERT_EQUAL_UINT16(1, packetIdOf(1));
+}
+
+void test_puback_frees_slot_and_records_rtt(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    mock::advanceMillis(120);
+    broker.puback(1);
+    readInbound();
+
+    TEST_ASSERT_EQUAL_UINT8(0, inFlightCount);
+    TEST_ASSERT_FALSE(inFlight[0].used);
+    TEST_ASSERT_EQUAL_UINT32(1, qos1Acked);
+    TEST_ASSERT_EQUAL_UINT32(120, qos1RttMs);
+}
+
+void test_stale_puback_is_ignored(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    broker.puback(1 + MQTT_QOS1_WINDOW);
+    broker.puback(0);
+    readInbound();
+
+    TEST_ASSERT_EQUAL_UINT8(1, inFlightCount);
+    TEST_ASSERT_EQUAL_UINT32(0, qos1Acked);
+}
+
+void test_puback_found_between_other_packets(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    TEST_ASSERT_TRUE(publish("y"));
+
+    // A command with a two byte remaining length, then the PUBACK, read in bulk
+    broker.publish("rfm69gw/in/7", std::string(200, 'c'));
+    broker.puback(2);
+    uint8_t buffer[64];
+    while (mqttTransport.read(buffer, sizeof(buffer)) > 0);
+
+    TEST_ASSERT_EQUAL_UINT8(1, inFlightCount);
+    TEST_ASSERT_TRUE(inFlight[0].used);
+    TEST_ASSERT_FALSE(inFlight[1].used);
+}
+
+void test_full_window_refuses_publish(void) {
+    for (uint8_t i = 0; i < MQTT_QOS1_WINDOW; i++) {
+        TEST_ASSERT_FALSE(mqttQos1WindowFull());
+        TEST_ASSERT_TRUE(publish("x"));
+    }
+    TEST_ASSERT_TRUE(mqttQos1WindowFull());
+    TEST_ASSERT_FALSE(publish("x"));
+    TEST_ASSERT_EQUAL_UINT32(1, qos1Dropped);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_QOS1_WINDOW, broker.publishes().size());
+
+    broker.puback(MQTT_QOS1_WINDOW);
+    readInbound();
+    TEST_ASSERT_FALSE(mqttQos1WindowFull());
+}
+
+void test_unacked_packet_retransmitted_with_dup(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    mock::advanceMillis(MQTT_QOS1_RETRY_MS - 1);
+    handleMqttQos1Loop();
+    TEST_ASSERT_EQUAL_UINT32(1, broker.publishes().size());
+
+    mock::advanceMillis(1);
+    handleMqttQos1Loop();
+    std::vector<MqttBroker::Packet> sent = broker.publishes();
+    TEST_ASSERT_EQUAL_UINT32(2, sent.size());
+    TEST_ASSERT_EQUAL_HEX8(0x0A, sent[1].flags);
+    TEST_ASSERT_EQUAL_UINT16(1, sent[1].packetId);
+    TEST_ASSERT_EQUAL_STRING("x", sent[1].payload.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, qos1Retransmitted);
+
+    // The PUBACK for the duplicate clears it
+    broker.puback(1);
+    readInbound();
+    TEST_ASSERT_EQUAL_UINT8(0, inFlightCount);
+}
+
+void test_packet_dropped_after_max_retries(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    for (uint8_t i = 0; i < MQTT_QOS1_MAX_RETRIES; i++) {
+        mock::advanceMillis(MQTT_QOS1_RETRY_MS);
+        handleMqttQos1Loop();
+    }
+    TEST_ASSERT_EQUAL_UINT32(1 + MQTT_QOS1_MAX_RETRIES, broker.publishes().size());
+    TEST_ASSERT_EQUAL_UINT8(1, inFlightCount);
+
+    mock::advanceMillis(MQTT_QOS1_RETRY_MS);
+    handleMqttQos1Loop();
+    TEST_ASSERT_EQUAL_UINT8(0, inFlightCount);
+    TEST_ASSERT_EQUAL_UINT32(1, qos1Dropped);
+}
+
+void test_no_retransmission_while_disconnected(void) {
+    TEST_ASSERT_TRUE(publish("x"));
+    mqttClient.setConnected(false);
+    mock::advanceMillis(MQTT_QOS1_RETRY_MS * 2);
+    handleMqttQos1Loop();
+    TEST_ASSERT_EQUAL_UINT32(1, broker.publishes().size());
+}
+
+void test_in_flight_resent_after_reconnect(void) {
+    TEST_ASSERT_TRUE(publish("a"));
+    TEST_ASSERT_TRUE(publish("b"));
+    broker.puback(1);
+    readInbound();
+
+    mqttTransport.stop();
+    TEST_ASSERT_EQUAL_INT(1, mqttTransport.connect("broker.local", 1883));
+    resendMqttQos1InFlight();
+
+    std::vector<MqttBroker::Packet> sent = broker.publishes();
+    TEST_ASSERT_EQUAL_UINT32(3, sent.size());
+    TEST_ASSERT_EQUAL_UINT16(2, sent[2].packetId);
+    TEST_ASSERT_EQUAL_HEX8(0x0A, sent[2].flags);
+    TEST_ASSERT_EQUAL_STRING("b", sent[2].payload.c_str());
+}
+
+void test_oversized_message_goes_at_qos0(void) {
+    std::string payload(MQTT_QOS1_SLOT_SIZE, 'p');
+    TEST_ASSERT_TRUE(publish(payload.c_str()));
+
+    TEST_ASSERT_EQUAL_UINT32(0, broker.publishes().size());
+    TEST_ASSERT_EQUAL_UINT8(0, inFlightCount);
+    TEST_ASSERT_EQUAL_UINT32(1, qos1Oversized);
+    const PubSubClient::Message* message = mqttClient.lastPublished(TOPIC);
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_QOS1_SLOT_SIZE, message->payload.size());
+}
+
+void test_connect_statistics(void) {
+    mqttTransport.stop();
+    broker.connectMs = 850;
+    broker.connectionHeap = 22000;
+    uint32_t connects = mqttTransport.connects();
+    TEST_ASSERT_EQUAL_INT(1, mqttTransport.connect("broker.local", 8883));
+    TEST_ASSERT_EQUAL_UINT32(connects + 1, mqttTransport.connects());
+    TEST_ASSERT_EQUAL_UINT32(850, mqttTransport.lastConnectMs());
+    TEST_ASSERT_EQUAL_INT32(22000, mqttTransport.connectHeapCost());
+
+    mqttTransport.stop();
+    broker.acceptConnections = false;
+    uint32_t failures = mqttTransport.connectFailures();
+    TEST_ASSERT_EQUAL_INT(0, mqttTransport.connect("broker.local", 8883));
+    TEST_ASSERT_EQUAL_UINT32(failures + 1, mqttTransport.connectFailures());
+}
+
+void test_stats_published(void) {
+    broker.autoAck = true;
+    TEST_ASSERT_TRUE(publish("x"));
+    readInbound();
+    TEST_ASSERT_TRUE(publish("y"));
+
+    publishMqttQos1Stats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/mqtt");
+    TEST_ASSERT_NOT_NULL(message);
+
+    StaticJsonDocument<256> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(MQTT_QOS1_WINDOW, doc["window"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(2, doc["published"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["acked"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["inFlight"].as<uint32_t>());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_publish_encodes_qos1_packet);
+    RUN_TEST(test_packet_ids_follow_their_slot);
+    RUN_TEST(test_packet_id_wraps_within_slot);
+    RUN_TEST(test_puback_frees_slot_and_records_rtt);
+    RUN_TEST(test_stale_puback_is_ignored);
+    RUN_TEST(test_puback_found_between_other_packets);
+    RUN_TEST(test_full_window_refuses_publish);
+    RUN_TEST(test_unacked_packet_retransmitted_with_dup);
+    RUN_TEST(test_packet_dropped_after_max_retries);
+    RUN_TEST(test_no_retransmission_while_disconnected);
+    RUN_TEST(test_in_flight_resent_after_reconnect);
+    RUN_TEST(test_oversized_message_goes_at_qos0);
+    RUN_TEST(test_connect_statistics);
+    RUN_TEST(test_stats_published);
+    return UNITY_END();
+}
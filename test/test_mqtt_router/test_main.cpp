@@ -0,0 +1,169 @@
+// MQTT command route trie of mqtt_router.cpp: literal segments, numeric '+'
+// parameters and the topics that must not match.
+
+#include <unity.h>
+
+#include "../../src/mqtt_router.cpp"
+
+String mqttCommandTopic = "rfm69gw/cmd";
+
+static MqttRouteHandler called;
+static MqttRouteParams calledParams;
+static String calledPayload;
+static bool statusPublished;
+
+#define ROUTE_STUB(name) \
+    void name(const MqttRouteParams& params, const byte* payload, unsigned int length) { \
+        called = name; \
+        calledParams = params; \
+        calledPayload = String(std::string((const char*)payload, length)); \
+    }
+
+ROUTE_STUB(handleRadioSendCommand)
+ROUTE_STUB(handleRadioRawCommand)
+ROUTE_STUB(handleRadioRawAckCommand)
+ROUTE_STUB(handleRadio2RawCommand)
+ROUTE_STUB(handleRadio2RawAckCommand)
+ROUTE_STUB(handleRadio2GetCommand)
+ROUTE_STUB(handleMailboxCommand)
+ROUTE_STUB(handleDecoderCommand)
+ROUTE_STUB(handleFilterCommand)
+ROUTE_STUB(handleNodeCommand)
+ROUTE_STUB(handleGetCommand)
+ROUTE_STUB(handleGroupCommand)
+ROUTE_STUB(handleGroupSendCommand)
+ROUTE_STUB(handleSurveyCommand)
+ROUTE_STUB(handleSurveyMoveCommand)
+ROUTE_STUB(handleTdmaCommand)
+ROUTE_STUB(handleConfigCommand)
+ROUTE_STUB(handleNodeOtaBegin)
+ROUTE_STUB(handleNodeOtaData)
+ROUTE_STUB(handleNodeOtaPush)
+ROUTE_STUB(handleNodeOtaAbort)
+ROUTE_STUB(handleNodeOtaStatus)
+
+void publishStatus() { statusPublished = true; }
+void debugLog(const String& message) {}
+
+static bool dispatch(const char* topic, const char* payload = "") {
+    called = nullptr;
+    calledParams.count = 0;
+    return dispatchMqttCommand(topic, (const byte*)payload, strlen(payload));
+}
+
+void setUp(void) {
+    mock::reset();
+    statusPublished = false;
+    buildMqttRoutes();
+}
+
+void tearDown(void) {}
+
+void test_routes_fit_trie(void) {
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_ROUTE_MAX_NODES, routeNodeCount);
+    TEST_ASSERT_GREATER_THAN(1, routeNodeCount);
+}
+
+// Every pattern reaches its own handler, with '+' given as a number
+void test_every_route_dispatches_to_its_handler(void) {
+    for (size_t i = 0; i < sizeof(mqttRoutes) / sizeof(mqttRoutes[0]); i++) {
+        String topic = mqttCommandTopic + "/" + mqttRoutes[i].pattern;
+        topic.replace("+", "42");
+        TEST_ASSERT_TRUE_MESSAGE(dispatch(topic.c_str()), topic.c_str());
+        if (mqttRoutes[i].handler != routeStatus && mqttRoutes[i].handler != routeReboot) {
+            TEST_ASSERT_TRUE_MESSAGE(called == mqttRoutes[i].handler, topic.c_str());
+        }
+    }
+}
+
+void test_literal_route_without_params(void) {
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/send", "{\"node\":5}"));
+    TEST_ASSERT_TRUE(called == handleRadioSendCommand);
+    TEST_ASSERT_EQUAL_UINT8(0, calledParams.count);
+    TEST_ASSERT_EQUAL_STRING("{\"node\":5}", calledPayload.c_str());
+}
+
+void test_wildcard_passes_number(void) {
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/send/12"));
+    TEST_ASSERT_TRUE(called == handleRadioSendCommand);
+    TEST_ASSERT_EQUAL_UINT8(1, calledParams.count);
+    TEST_ASSERT_EQUAL_UINT32(12, calledParams.values[0]);
+
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/raw/5/ack"));
+    TEST_ASSERT_TRUE(called == handleRadioRawAckCommand);
+    TEST_ASSERT_EQUAL_UINT32(5, calledParams.values[0]);
+}
+
+void test_two_wildcards_in_topic_order(void) {
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/mbox/3/7"));
+    TEST_ASSERT_TRUE(called == handleMailboxCommand);
+    TEST_ASSERT_EQUAL_UINT8(2, calledParams.count);
+    TEST_ASSERT_EQUAL_UINT32(3, calledParams.values[0]);
+    TEST_ASSERT_EQUAL_UINT32(7, calledParams.values[1]);
+}
+
+void test_literal_preferred_over_wildcard(void) {
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/survey/move"));
+    TEST_ASSERT_TRUE(called == handleSurveyMoveCommand);
+
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/group/4/send"));
+    TEST_ASSERT_TRUE(called == handleGroupSendCommand);
+    TEST_ASSERT_EQUAL_UINT32(4, calledParams.values[0]);
+}
+
+void test_non_numeric_parameter_rejected(void) {
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/raw/abc"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/raw/"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/raw/-1"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/fw/data/1234567890"));
+    TEST_ASSERT_TRUE(called == nullptr);
+}
+
+void test_partial_and_unknown_topics_rejected(void) {
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/raw"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/fw"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/nope"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/send/1/2"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/statusx"));
+    TEST_ASSERT_TRUE(called == nullptr);
+}
+
+void test_other_prefix_rejected(void) {
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmdx/send"));
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd"));
+    TEST_ASSERT_FALSE(dispatch("other/cmd/send"));
+    TEST_ASSERT_TRUE(called == nullptr);
+}
+
+void test_builtin_routes(void) {
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/status"));
+    TEST_ASSERT_TRUE(statusPublished);
+    TEST_ASSERT_FALSE(mock::restarted);
+
+    TEST_ASSERT_TRUE(dispatch("rfm69gw/cmd/reboot"));
+    TEST_ASSERT_TRUE(mock::restarted);
+}
+
+void test_rebuild_follows_command_topic(void) {
+    mqttCommandTopic = "site2/cmd";
+    buildMqttRoutes();
+    TEST_ASSERT_FALSE(dispatch("rfm69gw/cmd/send"));
+    TEST_ASSERT_TRUE(dispatch("site2/cmd/send"));
+    mqttCommandTopic = "rfm69gw/cmd";
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_routes_fit_trie);
+    RUN_TEST(test_every_route_dispatches_to_its_handler);
+    RUN_TEST(test_literal_route_without_params);
+    RUN_TEST(test_wildcard_passes_number);
+    RUN_TEST(test_two_wildcards_in_topic_order);
+    RUN_TEST(test_literal_preferred_over_wildcard);
+    RUN_TEST(test_non_numeric_parameter_rejected);
+    RUN_TEST(test_partial_and_unknown_topics_rejected);
+    RUN_TEST(test_other_prefix_rejected);
+    RUN_TEST(test_builtin_routes);
+    RUN_TEST(test_rebuild_follows_command_topic);
+    return UNITY_END();
+}
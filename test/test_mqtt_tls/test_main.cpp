@@ -0,0 +1,196 @@
+// MQTT over TLS of mqtt_tls.cpp against a TLS broker stand-in, built with a
+// pinned CA: max fragment length probe, SNTP before certificate validation,
+// session resumption on reconnect and the handshake statistics.
+
+#define MQTT_TLS 1
+#define MQTT_TLS_CA_CERT "-----BEGIN CERTIFICATE-----\nMIIBgateway-test-ca\n-----END CERTIFICATE-----\n"
+
+#include <unity.h>
+
+#include "../../src/mqtt_transport.cpp"
+#include "../../src/mqtt_tls.cpp"
+
+BearSSL::WiFiClientSecure wifiClient;
+MqttTransport mqttTransport(wifiClient);
+PubSubClient mqttClient(mqttTransport);
+GatewayConfig activeConfig;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+void debugLog(const String& message) {}
+
+static bool clockSynced;
+static uint64_t clockEpochMs;
+
+bool timeSynced() { return clockSynced; }
+uint64_t epochMillis() { return clockEpochMs; }
+
+// What connectMqtt() does before PubSubClient sends CONNECT
+static bool connectBroker() {
+    if (!prepareMqttTlsConnect()) return false;
+    return mqttTransport.connect(activeConfig.mqttServer, activeConfig.mqttPort);
+}
+
+void setUp(void) {
+    mock::reset();
+    wifiClient.stop();
+    wifiClient = BearSSL::WiFiClientSecure();
+    wifiClient.brokerCaPem = MQTT_TLS_CA_CERT;
+    mqttTransport = MqttTransport(wifiClient);
+    mqttClient.clearPublished();
+    mqttConnected = true;
+
+    activeConfig = GatewayConfig();
+    strcpy(activeConfig.mqttServer, "broker.local");
+    activeConfig.mqttPort = 8883;
+    clockSynced = true;
+    clockEpochMs = 1800000000000ULL;
+
+    tlsMflnNegotiated = false;
+    initializeMqttTls();
+}
+
+void tearDown(void) {}
+
+void test_broker_validated_against_ca(void) {
+    TEST_ASSERT_NOT_NULL(wifiClient.trustAnchors);
+    TEST_ASSERT_EQUAL_STRING(MQTT_TLS_CA_CERT, wifiClient.trustAnchors->pem.c_str());
+    TEST_ASSERT_FALSE(wifiClient.insecure);
+    TEST_ASSERT_TRUE(wifiClient.fingerprint.empty());
+    TEST_ASSERT_EQUAL_PTR(&tlsSession, wifiClient.session);
+
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1800000000, wifiClient.x509Time);
+    TEST_ASSERT_EQUAL_UINT32(1, wifiClient.fullHandshakes);
+}
+
+void test_wrong_ca_fails_handshake(void) {
+    wifiClient.brokerCaPem = "-----BEGIN CERTIFICATE-----\nother\n-----END CERTIFICATE-----\n";
+    TEST_ASSERT_FALSE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1, mqttTransport.connectFailures());
+    TEST_ASSERT_EQUAL_UINT32(0, mqttTransport.connects());
+}
+
+void test_waits_for_sntp_before_validating(void) {
+    clockSynced = false;
+    TEST_ASSERT_FALSE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(0, wifiClient.connectAttempts);
+    TEST_ASSERT_EQUAL_UINT32(0, mqttTransport.connectFailures());
+
+    // A clock before the certificate's validity would not have passed
+    clockSynced = true;
+    clockEpochMs = (uint64_t)(wifiClient.certNotBefore - 60) * 1000;
+    TEST_ASSERT_FALSE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1, mqttTransport.connectFailures());
+
+    clockEpochMs = 1800000000000ULL;
+    TEST_ASSERT_TRUE(connectBroker());
+}
+
+void test_mfln_probed_once_and_buffers_shrunk(void) {
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1, wifiClient.mflnProbes);
+    TEST_ASSERT_TRUE(tlsMflnNegotiated);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_TLS_MFLN + 325, wifiClient.rxBufferSize);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_TLS_TX_BUFFER + 85, wifiClient.txBufferSize);
+
+    mqttTransport.stop();
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1, wifiClient.mflnProbes);
+}
+
+// Without the extension the buffers stay at full size, which a broker
+// sending 16 kB records needs; shrinking them would break the handshake
+void test_broker_without_mfln_keeps_full_buffers(void) {
+    wifiClient.brokerMfln = false;
+    uint32_t rxBefore = wifiClient.rxBufferSize;
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_FALSE(tlsMflnNegotiated);
+    TEST_ASSERT_EQUAL_UINT32(rxBefore, wifiClient.rxBufferSize);
+}
+
+void test_mfln_lowers_connection_heap(void) {
+    TEST_ASSERT_TRUE(connectBroker());
+    int32_t smallBuffers = mqttTransport.connectHeapCost();
+    mqttTransport.stop();
+
+    wifiClient = BearSSL::WiFiClientSecure();
+    wifiClient.brokerCaPem = MQTT_TLS_CA_CERT;
+    wifiClient.brokerMfln = false;
+    initializeMqttTls();
+    TEST_ASSERT_TRUE(connectBroker());
+    int32_t fullBuffers = mqttTransport.connectHeapCost();
+
+    TEST_ASSERT_EQUAL_INT32(MQTT_TLS_MFLN + 325 + MQTT_TLS_TX_BUFFER + 85 + 6000, smallBuffers);
+    TEST_ASSERT_GREATER_THAN(smallBuffers + 15000, fullBuffers);
+}
+
+void test_reconnect_resumes_session(void) {
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1800, mqttTransport.lastConnectMs());
+    TEST_ASSERT_TRUE(tlsSession.valid());
+
+    mqttTransport.stop();
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(1, wifiClient.fullHandshakes);
+    TEST_ASSERT_EQUAL_UINT32(1, wifiClient.resumedHandshakes);
+    TEST_ASSERT_EQUAL_UINT32(250, mqttTransport.lastConnectMs());
+    TEST_ASSERT_EQUAL_UINT32((1800 * 7 + 250) / 8, mqttTransport.avgConnectMs());
+}
+
+void test_broker_change_starts_fresh(void) {
+    TEST_ASSERT_TRUE(connectBroker());
+    mqttTransport.stop();
+    const BearSSL::X509List* anchors = wifiClient.trustAnchors;
+    uint32_t listsCreated = BearSSL::X509List::created;
+
+    strcpy(activeConfig.mqttServer, "broker2.local");
+    initializeMqttTls();
+    TEST_ASSERT_FALSE(tlsSession.valid());
+    TEST_ASSERT_EQUAL_PTR(anchors, wifiClient.trustAnchors);
+    TEST_ASSERT_EQUAL_UINT32(listsCreated, BearSSL::X509List::created);
+
+    TEST_ASSERT_TRUE(connectBroker());
+    TEST_ASSERT_EQUAL_UINT32(2, wifiClient.mflnProbes);
+    TEST_ASSERT_EQUAL_UINT32(2, wifiClient.fullHandshakes);
+    TEST_ASSERT_EQUAL_STRING("broker2.local", wifiClient.lastHost.c_str());
+}
+
+void test_stats_published(void) {
+    wifiClient.acceptConnections = false;
+    TEST_ASSERT_FALSE(connectBroker());
+    wifiClient.acceptConnections = true;
+    TEST_ASSERT_TRUE(connectBroker());
+
+    publishMqttTlsStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/tls");
+    TEST_ASSERT_NOT_NULL(message);
+    StaticJsonDocument<256> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(1, doc["handshakes"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["failures"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1800, doc["lastMs"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1800, doc["avgMs"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_INT32(mqttTransport.connectHeapCost(), doc["heapCost"].as<int32_t>());
+    TEST_ASSERT_EQUAL_UINT32(MQTT_TLS_MFLN, doc["mfln"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(mock::freeHeap, doc["freeHeap"].as<uint32_t>());
+
+    mqttClient.clearPublished();
+    mqttConnected = false;
+    publishMqttTlsStats();
+    TEST_ASSERT_EQUAL_UINT32(0, mqttClient.published().size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_broker_validated_against_ca);
+    RUN_TEST(test_wrong_ca_fails_handshake);
+    RUN_TEST(test_waits_for_sntp_before_validating);
+    RUN_TEST(test_mfln_probed_once_and_buffers_shrunk);
+    RUN_TEST(test_broker_without_mfln_keeps_full_buffers);
+    RUN_TEST(test_mfln_lowers_connection_heap);
+    RUN_TEST(test_reconnect_resumes_session);
+    RUN_TEST(test_broker_change_starts_fresh);
+    RUN_TEST(test_stats_published);
+    return UNITY_END();
+}
@@ -0,0 +1,314 @@
+// Payload decoder of payload_decoder.cpp: layout compilation to bytecode,
+// decoding of every field type, the saved table and the command response.
+
+#include <unity.h>
+
+#include "../../src/payload_decoder.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+void debugLog(const String& message) {}
+
+static const char SENSOR_LAYOUT[] =
+    "{\"nodes\":[5,6],\"fields\":["
+    "{\"name\":\"temp\",\"type\":\"i16\",\"offset\":0,\"scale\":0.1,\"unit\":\"C\"},"
+    "{\"name\":\"hum\",\"type\":\"u8\",\"offset\":2,\"unit\":\"%\"},"
+    "{\"name\":\"count\",\"type\":\"u32be\",\"offset\":3},"
+    "{\"name\":\"volt\",\"type\":\"u16\",\"offset\":7,\"scale\":0.001,\"unit\":\"V\"}]}";
+
+static bool setLayout(uint32_t decoderId, const char* json, String& error) {
+    return setDecoderLayout(decoderId, json, strlen(json), error);
+}
+
+static RadioFrame frameFrom(uint8_t senderId, std::initializer_list<uint8_t> bytes) {
+    RadioFrame frame = {};
+    frame.senderId = senderId;
+    frame.length = bytes.size();
+    memcpy(frame.data, bytes.begin(), bytes.size());
+    return frame;
+}
+
+void setUp(void) {
+    mock::reset();
+    mock::files.clear();
+    mock::fsMountable = true;
+    mock::fsFreeBytes = 1 << 20;
+    TEST_ASSERT_TRUE(initializeDecoders());
+    framesDecoded = 0;
+    framesTooShort = 0;
+    mqttClient.clearPublished();
+}
+
+void tearDown(void) {}
+
+void test_layout_compiles_to_bytecode(void) {
+    String error;
+    TEST_ASSERT_TRUE_MESSAGE(setLayout(1, SENSOR_LAYOUT, error), error.c_str());
+
+    const DecoderLayout& layout = decoderLayouts[0];
+    // temp 3+1+4, hum 3+1, count 3, volt 3+1+4, END
+    TEST_ASSERT_EQUAL_UINT8(24, layout.programLength);
+    TEST_ASSERT_EQUAL_UINT8(9, layout.minLength);
+    TEST_ASSERT_EQUAL_HEX8(DECODER_I16 | DECODER_OP_SCALE | DECODER_OP_UNIT, layout.program[0]);
+    TEST_ASSERT_EQUAL_HEX8(DECODER_END, layout.program[layout.programLength - 1]);
+    TEST_ASSERT_EQUAL_UINT8(1, nodeDecoder(5));
+    TEST_ASSERT_EQUAL_UINT8(1, nodeDecoder(6));
+    TEST_ASSERT_EQUAL_UINT8(0, nodeDecoder(7));
+}
+
+void test_pool_interns_repeated_names(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, "{\"fields\":["
+        "{\"name\":\"t1\",\"type\":\"i16\",\"offset\":0,\"unit\":\"C\"},"
+        "{\"name\":\"t2\",\"type\":\"i16\",\"offset\":2,\"unit\":\"C\"}]}", error));
+    // "t1", "C", "t2"
+    TEST_ASSERT_EQUAL_UINT8(3 + 2 + 3, decoderLayouts[0].poolLength);
+}
+
+void test_decode_sensor_frame(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+
+    // temp -215, hum 55, count 0x01020304 big endian, volt 3300
+    RadioFrame frame = frameFrom(5, { 0x29, 0xFF, 55, 0x01, 0x02, 0x03, 0x04, 0xE4, 0x0C });
+    DynamicJsonDocument doc(512);
+    TEST_ASSERT_TRUE(decodeRadioPayload(frame, doc));
+
+    TEST_ASSERT_FLOAT_WITHIN(0.001, -21.5, doc["data"]["temp"].as<float>());
+    TEST_ASSERT_EQUAL_INT(55, doc["data"]["hum"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(0x01020304, doc["data"]["count"].as<uint32_t>());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 3.3, doc["data"]["volt"].as<float>());
+    TEST_ASSERT_EQUAL_STRING("C", doc["units"]["temp"].as<const char*>());
+    TEST_ASSERT_EQUAL_STRING("V", doc["units"]["volt"].as<const char*>());
+    TEST_ASSERT_TRUE(doc["units"]["count"].isNull());
+    TEST_ASSERT_EQUAL_UINT32(1, framesDecoded);
+}
+
+void test_decode_every_type(void) {
+    String error;
+    TEST_ASSERT_TRUE_MESSAGE(setLayout(2, "{\"nodes\":[9],\"fields\":["
+        "{\"name\":\"i8\",\"type\":\"i8\",\"offset\":0},"
+        "{\"name\":\"u24\",\"type\":\"u24\",\"offset\":1},"
+        "{\"name\":\"i32\",\"type\":\"i32\",\"offset\":4},"
+        "{\"name\":\"f32\",\"type\":\"f32\",\"offset\":8},"
+        "{\"name\":\"i16be\",\"type\":\"i16be\",\"offset\":12},"
+        "{\"name\":\"u16be\",\"type\":\"u16be\",\"offset\":14},"
+        "{\"name\":\"i32be\",\"type\":\"i32be\",\"offset\":16},"
+        "{\"name\":\"u32\",\"type\":\"u32\",\"offset\":20},"
+        "{\"name\":\"u32s\",\"type\":\"u32\",\"offset\":20,\"scale\":0.5}]}", error), error.c_str());
+
+    float real = 1.25f;
+    uint8_t f32[4];
+    memcpy(f32, &real, sizeof(f32));
+    RadioFrame frame = frameFrom(9, {
+        0xFF,                           // i8 -1
+        0x01, 0x02, 0x03,               // u24 0x030201
+        0xFE, 0xFF, 0xFF, 0xFF,         // i32 -2
+        f32[0], f32[1], f32[2], f32[3], // f32 1.25
+        0xFF, 0x38,                     // i16be -200
+        0xAB, 0xCD,                     // u16be 0xABCD
+        0xFF, 0xFF, 0xFF, 0x9C,         // i32be -100
+        0x00, 0x00, 0x00, 0xF0          // u32 0xF0000000
+    });
+    DynamicJsonDocument doc(512);
+    TEST_ASSERT_TRUE(decodeRadioPayload(frame, doc));
+
+    JsonObject data = doc["data"];
+    TEST_ASSERT_EQUAL_INT(-1, data["i8"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(0x030201, data["u24"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_INT(-2, data["i32"].as<int>());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 1.25, data["f32"].as<float>());
+    TEST_ASSERT_EQUAL_INT(-200, data["i16be"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(0xABCD, data["u16be"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_INT(-100, data["i32be"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(0xF0000000UL, data["u32"].as<uint32_t>());
+    TEST_ASSERT_FLOAT_WITHIN(1, 0x78000000UL, data["u32s"].as<float>());
+    TEST_ASSERT_TRUE(doc["units"].isNull());
+}
+
+void test_short_frame_and_unassigned_node_not_decoded(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+
+    DynamicJsonDocument doc(512);
+    RadioFrame shortFrame = frameFrom(5, { 0x29, 0xFF, 55, 0x01, 0x02, 0x03, 0x04, 0xE4 });
+    TEST_ASSERT_FALSE(decodeRadioPayload(shortFrame, doc));
+    TEST_ASSERT_EQUAL_UINT32(1, framesTooShort);
+
+    RadioFrame otherNode = frameFrom(7, { 0x29, 0xFF, 55, 0x01, 0x02, 0x03, 0x04, 0xE4, 0x0C });
+    TEST_ASSERT_FALSE(decodeRadioPayload(otherNode, doc));
+    TEST_ASSERT_TRUE(doc["data"].isNull());
+}
+
+void test_invalid_layouts_rejected(void) {
+    String error;
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[{\"name\":\"a\",\"type\":\"u12\",\"offset\":0}]}", error));
+    TEST_ASSERT_EQUAL_STRING("unknown type 'u12'", error.c_str());
+
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[{\"name\":\"a\",\"type\":\"u16\",\"offset\":60}]}", error));
+    TEST_ASSERT_EQUAL_STRING("bad offset for 'a'", error.c_str());
+
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[{\"name\":\"a\",\"type\":\"u16\"}]}", error));
+    TEST_ASSERT_EQUAL_STRING("bad offset for 'a'", error.c_str());
+
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[{\"name\":\"sixteen_chars_xx\",\"type\":\"u8\",\"offset\":0}]}", error));
+    TEST_ASSERT_EQUAL_STRING("names too long for 'sixteen_chars_xx'", error.c_str());
+
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[]}", error));
+    TEST_ASSERT_EQUAL_STRING("no fields", error.c_str());
+
+    TEST_ASSERT_FALSE(setLayout(1, "{\"fields\":[", error));
+    TEST_ASSERT_TRUE(error.startsWith("invalid JSON: "));
+
+    TEST_ASSERT_EQUAL_UINT8(0, decoderLayouts[0].programLength);
+}
+
+void test_program_size_limit(void) {
+    // Three bytes per u8 field, one for END
+    String fields = "{\"fields\":[";
+    for (uint8_t i = 0; i <= (DECODER_PROGRAM_SIZE - 1) / 3; i++) {
+        if (i > 0) fields += ",";
+        fields += "{\"name\":\"a\",\"type\":\"u8\",\"offset\":" + String(i % RF69_MAX_DATA_LEN) + "}";
+    }
+    fields += "]}";
+
+    String error;
+    TEST_ASSERT_FALSE(setLayout(1, fields.c_str(), error));
+    TEST_ASSERT_EQUAL_STRING("too many fields", error.c_str());
+}
+
+void test_decoder_id_range(void) {
+    String error;
+    TEST_ASSERT_FALSE(setLayout(0, SENSOR_LAYOUT, error));
+    TEST_ASSERT_EQUAL_STRING("decoder id must be 1-8", error.c_str());
+    TEST_ASSERT_FALSE(setLayout(DECODER_MAX_LAYOUTS + 1, SENSOR_LAYOUT, error));
+    // Would be decoder 1 if narrowed to a byte first
+    TEST_ASSERT_FALSE(setLayout(257, SENSOR_LAYOUT, error));
+    TEST_ASSERT_EQUAL_UINT8(0, decoderLayouts[0].programLength);
+    TEST_ASSERT_TRUE(setLayout(DECODER_MAX_LAYOUTS, SENSOR_LAYOUT, error));
+}
+
+void test_node_list_replaces_assignment(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+    TEST_ASSERT_TRUE(setLayout(1, "{\"nodes\":[6,300],\"fields\":[{\"name\":\"a\",\"type\":\"u8\",\"offset\":0}]}", error));
+    TEST_ASSERT_EQUAL_UINT8(0, nodeDecoder(5));
+    TEST_ASSERT_EQUAL_UINT8(1, nodeDecoder(6));
+
+    // Empty layout removes the decoder and its nodes
+    TEST_ASSERT_TRUE(setDecoderLayout(1, "", 0, error));
+    TEST_ASSERT_EQUAL_UINT8(0, decoderLayouts[0].programLength);
+    TEST_ASSERT_EQUAL_UINT8(0, nodeDecoder(6));
+    TEST_ASSERT_EQUAL_STRING("", decoderLayoutJson(1).c_str());
+}
+
+void test_layout_json_round_trip(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+    String json = decoderLayoutJson(1);
+
+    TEST_ASSERT_TRUE_MESSAGE(setLayout(2, json.c_str(), error), error.c_str());
+    TEST_ASSERT_EQUAL_UINT8(decoderLayouts[0].programLength, decoderLayouts[1].programLength);
+    TEST_ASSERT_EQUAL_MEMORY(decoderLayouts[0].program, decoderLayouts[1].program, decoderLayouts[0].programLength);
+    TEST_ASSERT_EQUAL_MEMORY(decoderLayouts[0].pool, decoderLayouts[1].pool, decoderLayouts[0].poolLength);
+    // The nodes moved with the copy
+    TEST_ASSERT_EQUAL_UINT8(2, nodeDecoder(5));
+}
+
+void test_table_survives_restart(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(3, SENSOR_LAYOUT, error));
+    TEST_ASSERT_FALSE(LittleFS.exists(DECODER_TEMP_PATH));
+
+    TEST_ASSERT_TRUE(initializeDecoders());
+    TEST_ASSERT_EQUAL_UINT8(3, nodeDecoder(5));
+    TEST_ASSERT_EQUAL_UINT8(24, decoderLayouts[2].programLength);
+}
+
+void test_corrupt_table_ignored(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+    (*mock::files[DECODER_FILE_PATH])[0] ^= 0xFF;
+
+    TEST_ASSERT_TRUE(initializeDecoders());
+    TEST_ASSERT_EQUAL_UINT8(0, nodeDecoder(5));
+    TEST_ASSERT_EQUAL_UINT8(0, decoderLayouts[0].programLength);
+}
+
+void test_failed_save_keeps_previous_table(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+    size_t saved = mock::files[DECODER_FILE_PATH]->size();
+
+    mock::fsFreeBytes = 100;
+    TEST_ASSERT_FALSE(setLayout(2, SENSOR_LAYOUT, error));
+    TEST_ASSERT_EQUAL_STRING("saving failed", error.c_str());
+    TEST_ASSERT_FALSE(LittleFS.exists(DECODER_TEMP_PATH));
+    TEST_ASSERT_EQUAL_UINT32(saved, mock::files[DECODER_FILE_PATH]->size());
+}
+
+void test_unmounted_filesystem(void) {
+    mock::fsMountable = false;
+    TEST_ASSERT_FALSE(initializeDecoders());
+
+    String error;
+    TEST_ASSERT_FALSE(setLayout(1, SENSOR_LAYOUT, error));
+    TEST_ASSERT_EQUAL_STRING("filesystem unavailable", error.c_str());
+}
+
+void test_command_response(void) {
+    MqttRouteParams params = {};
+    params.count = 1;
+    params.values[0] = 1;
+    handleDecoderCommand(params, (const byte*)SENSOR_LAYOUT, strlen(SENSOR_LAYOUT));
+
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/response/decoder");
+    TEST_ASSERT_NOT_NULL(message);
+    StaticJsonDocument<192> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_TRUE(doc["success"].as<bool>());
+    TEST_ASSERT_EQUAL_INT(24, doc["bytes"].as<int>());
+
+    params.values[0] = 99;
+    handleDecoderCommand(params, (const byte*)SENSOR_LAYOUT, strlen(SENSOR_LAYOUT));
+    message = mqttClient.lastPublished("rfm69gw/response/decoder");
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_FALSE(doc["success"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING("decoder id must be 1-8", doc["error"].as<const char*>());
+}
+
+void test_stats_published(void) {
+    String error;
+    TEST_ASSERT_TRUE(setLayout(1, SENSOR_LAYOUT, error));
+    DynamicJsonDocument doc(512);
+    RadioFrame frame = frameFrom(5, { 0x29, 0xFF, 55, 0x01, 0x02, 0x03, 0x04, 0xE4, 0x0C });
+    TEST_ASSERT_TRUE(decodeRadioPayload(frame, doc));
+
+    publishDecoderStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/decoder");
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_STRING("{\"decoders\":1,\"nodes\":2,\"decoded\":1,\"tooShort\":0}", message->payload.c_str());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_layout_compiles_to_bytecode);
+    RUN_TEST(test_pool_interns_repeated_names);
+    RUN_TEST(test_decode_sensor_frame);
+    RUN_TEST(test_decode_every_type);
+    RUN_TEST(test_short_frame_and_unassigned_node_not_decoded);
+    RUN_TEST(test_invalid_layouts_rejected);
+    RUN_TEST(test_program_size_limit);
+    RUN_TEST(test_decoder_id_range);
+    RUN_TEST(test_node_list_replaces_assignment);
+    RUN_TEST(test_layout_json_round_trip);
+    RUN_TEST(test_table_survives_restart);
+    RUN_TEST(test_corrupt_table_ignored);
+    RUN_TEST(test_failed_save_keeps_previous_table);
+    RUN_TEST(test_unmounted_filesystem);
+    RUN_TEST(test_command_response);
+    RUN_TEST(test_stats_published);
+    return UNITY_END();
+}
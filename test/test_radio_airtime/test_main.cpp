@@ -0,0 +1,285 @@
+// Airtime accounting and TX scheduling of radio_airtime.cpp on a mock radio:
+// frame airtime, the per sub-band duty-cycle budget, listen before talk and
+// its backoff, and the priority queues.
+
+#include <unity.h>
+#include <RFM69Chip.h>
+
+#include "../../src/gateway_radio.cpp"
+#include "../../src/radio_airtime.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+static RFM69Chip chip(15, 4);
+GatewayRadio radio(15, 4, false);
+
+struct SendResult {
+    uint8_t responseKind;
+    uint8_t targetNode;
+    RadioTxResult result;
+};
+static std::vector<SendResult> sendResults;
+
+uint8_t framePriority(uint8_t senderId, uint8_t ctl) { return PRIORITY_ROUTINE; }
+void recordPriorityLatency(uint8_t direction, uint8_t priority, uint32_t latencyUs) {}
+void enterLoopStage(LoopStage stage) {}
+void leaveLoopStage() {}
+void debugLog(const String& message) {}
+void publishRadioSendResult(uint8_t responseKind, uint8_t targetNode, RadioTxResult result, unsigned long deferredMs) {
+    sendResults.push_back({ responseKind, targetNode, result });
+}
+
+static const uint8_t PAYLOAD[RF69_MAX_DATA_LEN] = { 1, 2, 3 };
+
+// 61 byte frame at 55555 bps: 3 preamble, 2 sync, length, 64 message, 2 CRC bytes
+static const uint32_t FULL_FRAME_US = 72UL * 8 * 1000000 / 55555;
+
+static void listen(int rssi) {
+    chip.setRssi(rssi);
+    radio.receiveDone();
+}
+
+static void useUpBudget() {
+    while (airtimeAvailable(RF69_MAX_DATA_LEN)) {
+        accountAirtime(RF69_MAX_DATA_LEN);
+    }
+}
+
+void setUp(void) {
+    mock::reset();
+    chip.reset();
+    TEST_ASSERT_TRUE(radio.initialize(RF69_868MHZ, 1, 100));
+
+    memset(bandUsageUs, 0, sizeof(bandUsageUs));
+    bucketEpoch = 0;
+    memset(txQueueHead, 0, sizeof(txQueueHead));
+    memset(txQueueCount, 0, sizeof(txQueueCount));
+    framesSent = deferredBudget = deferredBusy = acksSuppressed = queueOverflows = 0;
+    initializeAirtime();
+
+    sendResults.clear();
+    mqttClient.clearPublished();
+    listen(-100);
+}
+
+void tearDown(void) {}
+
+void test_modem_settings_read_from_radio(void) {
+    TEST_ASSERT_EQUAL_UINT32(55555, bitrate);
+    TEST_ASSERT_EQUAL_UINT16(3, preambleBytes);
+    TEST_ASSERT_EQUAL_UINT8(2, syncBytes);
+    TEST_ASSERT_FALSE(aesEnabled);
+    TEST_ASSERT_EQUAL_STRING("g", subBands[activeBand].name);
+}
+
+void test_frame_airtime(void) {
+    // 3 + 2 + 1 + (3 + 40) + 2 bytes
+    TEST_ASSERT_EQUAL_UINT32(51UL * 8 * 1000000 / 55555, radioFrameAirtimeUs(40));
+    TEST_ASSERT_EQUAL_UINT32(FULL_FRAME_US, radioFrameAirtimeUs(RF69_MAX_DATA_LEN));
+    // Header only, as an ACK
+    TEST_ASSERT_EQUAL_UINT32(11UL * 8 * 1000000 / 55555, radioFrameAirtimeUs(0));
+}
+
+void test_aes_pads_message_to_blocks(void) {
+    radio.encrypt("0123456789abcdef");
+    initializeAirtime();
+    TEST_ASSERT_TRUE(aesEnabled);
+    // 43 message bytes padded to 48
+    TEST_ASSERT_EQUAL_UINT32(56UL * 8 * 1000000 / 55555, radioFrameAirtimeUs(40));
+    // 16 message bytes stay one block
+    TEST_ASSERT_EQUAL_UINT32(24UL * 8 * 1000000 / 55555, radioFrameAirtimeUs(13));
+}
+
+void test_sub_band_from_frequency(void) {
+    radio.setFrequency(869525000);
+    initializeAirtime();
+    TEST_ASSERT_EQUAL_STRING("g2", subBands[activeBand].name);
+
+    radio.setFrequency(915000000);
+    initializeAirtime();
+    TEST_ASSERT_EQUAL_INT8(-1, activeBand);
+    for (uint32_t i = 0; i < 36000000UL / FULL_FRAME_US + 1; i++) {
+        accountAirtime(RF69_MAX_DATA_LEN);
+    }
+    TEST_ASSERT_TRUE(airtimeAvailable(RF69_MAX_DATA_LEN));
+}
+
+// 1 % of an hour on band g is 36 s of airtime
+void test_budget_of_band_g(void) {
+    uint32_t frames = 0;
+    while (airtimeAvailable(RF69_MAX_DATA_LEN)) {
+        accountAirtime(RF69_MAX_DATA_LEN);
+        frames++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(36000000UL / FULL_FRAME_US, frames);
+    TEST_ASSERT_EQUAL_UINT32(frames, framesSent);
+}
+
+void test_budget_frees_as_window_rolls(void) {
+    useUpBudget();
+
+    // Usage of the first bucket leaves the window after one hour
+    mock::advanceMillis(3600000UL - 1);
+    TEST_ASSERT_FALSE(airtimeAvailable(RF69_MAX_DATA_LEN));
+    mock::advanceMillis(1);
+    TEST_ASSERT_TRUE(airtimeAvailable(RF69_MAX_DATA_LEN));
+}
+
+void test_over_budget_frame_deferred(void) {
+    useUpBudget();
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 10, false, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1, deferredBudget);
+    TEST_ASSERT_EQUAL_UINT32(0, chip.framesSent);
+
+    TEST_ASSERT_FALSE(radioTransmitImmediate(7, PAYLOAD, 10));
+    TEST_ASSERT_EQUAL_UINT32(2, deferredBudget);
+}
+
+void test_ack_suppressed_over_budget(void) {
+    TEST_ASSERT_TRUE(radioAckAllowed(0));
+    useUpBudget();
+    TEST_ASSERT_FALSE(radioAckAllowed(0));
+    TEST_ASSERT_EQUAL_UINT32(1, acksSuppressed);
+}
+
+void test_clear_channel_sends_at_once(void) {
+    TEST_ASSERT_EQUAL(RADIO_TX_SENT, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1, chip.framesSent);
+    TEST_ASSERT_EQUAL_UINT8(7, chip.lastFrame[1]);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD, chip.lastFrame + 4, 3);
+    TEST_ASSERT_EQUAL_UINT32(radioFrameAirtimeUs(3), bandUsedUs(activeBand));
+}
+
+void test_busy_channel_defers_with_backoff(void) {
+    listen(-70);
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1, deferredBusy);
+    TEST_ASSERT_EQUAL_UINT32(0, chip.framesSent);
+
+    // First window is twice the base
+    unsigned long notBefore = txQueue[PRIORITY_ROUTINE][0].notBefore;
+    TEST_ASSERT_GREATER_OR_EQUAL(millis() + AIRTIME_LBT_BACKOFF_MS, notBefore);
+    TEST_ASSERT_LESS_OR_EQUAL(millis() + 2 * AIRTIME_LBT_BACKOFF_MS, notBefore);
+
+    listen(-100);
+    mock::advanceMillis(notBefore - millis() - 1);
+    handleRadioTxQueue();
+    TEST_ASSERT_EQUAL_UINT32(0, chip.framesSent);
+
+    mock::advanceMillis(1);
+    handleRadioTxQueue();
+    TEST_ASSERT_EQUAL_UINT32(1, chip.framesSent);
+    TEST_ASSERT_EQUAL_UINT32(1, sendResults.size());
+    TEST_ASSERT_EQUAL(RADIO_TX_SENT, sendResults[0].result);
+}
+
+void test_backoff_windows(void) {
+    for (uint8_t attempts = 0; attempts < 8; attempts++) {
+        unsigned long window = (unsigned long)AIRTIME_LBT_BACKOFF_MS << (min(attempts, (uint8_t)4) + 1);
+        unsigned long longest = 0;
+        for (uint16_t i = 0; i < 200; i++) {
+            unsigned long backoff = lbtBackoff(attempts);
+            TEST_ASSERT_GREATER_OR_EQUAL(AIRTIME_LBT_BACKOFF_MS, backoff);
+            TEST_ASSERT_LESS_OR_EQUAL(window, backoff);
+            longest = max(longest, backoff);
+        }
+        // Spread over the window, not stuck at its start
+        TEST_ASSERT_GREATER_THAN(window / 2, longest);
+    }
+}
+
+void test_busy_channel_gives_up(void) {
+    listen(-70);
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+
+    for (uint8_t i = 0; i < AIRTIME_LBT_MAX_ATTEMPTS && sendResults.empty(); i++) {
+        mock::advanceMillis(1000);
+        handleRadioTxQueue();
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, sendResults.size());
+    TEST_ASSERT_EQUAL(RADIO_TX_FAILED, sendResults[0].result);
+    TEST_ASSERT_EQUAL_UINT32(1 + AIRTIME_LBT_MAX_ATTEMPTS, deferredBusy);
+    TEST_ASSERT_EQUAL_UINT32(0, chip.framesSent);
+}
+
+void test_alarm_queue_served_first(void) {
+    listen(-70);
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(8, PAYLOAD, 3, false, 2, PRIORITY_ALARM));
+
+    listen(-100);
+    mock::advanceMillis(1000);
+    handleRadioTxQueue();
+    TEST_ASSERT_EQUAL_UINT8(8, chip.lastFrame[1]);
+    handleRadioTxQueue();
+    TEST_ASSERT_EQUAL_UINT8(7, chip.lastFrame[1]);
+
+    // A routine frame waits behind queued frames of its class
+    listen(-70);
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    listen(-100);
+    TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(9, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    // but an alarm does not
+    TEST_ASSERT_EQUAL(RADIO_TX_SENT, radioTransmit(10, PAYLOAD, 3, false, 2, PRIORITY_ALARM));
+}
+
+void test_queue_overflow(void) {
+    listen(-70);
+    for (uint8_t i = 0; i < RADIO_TX_QUEUE_LEN; i++) {
+        TEST_ASSERT_EQUAL(RADIO_TX_DEFERRED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    }
+    TEST_ASSERT_EQUAL(RADIO_TX_FAILED, radioTransmit(7, PAYLOAD, 3, false, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1, queueOverflows);
+    TEST_ASSERT_EQUAL(RADIO_TX_FAILED, radioTransmit(7, PAYLOAD, RF69_MAX_DATA_LEN + 1, false, 1, PRIORITY_ALARM));
+}
+
+void test_every_retry_charged(void) {
+    TEST_ASSERT_EQUAL(RADIO_TX_FAILED, radioTransmit(7, PAYLOAD, 3, true, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1 + RADIO_TX_RETRIES, chip.framesSent);
+    TEST_ASSERT_EQUAL_UINT32((1 + RADIO_TX_RETRIES) * radioFrameAirtimeUs(3), bandUsedUs(activeBand));
+    TEST_ASSERT_EQUAL_HEX8(RFM69_CTL_REQACK, chip.lastFrame[3]);
+}
+
+void test_acked_transmission(void) {
+    chip.replyOnReceive(1, 7, RFM69_CTL_SENDACK);
+    TEST_ASSERT_EQUAL(RADIO_TX_SENT, radioTransmit(7, PAYLOAD, 3, true, 1, PRIORITY_ROUTINE));
+    TEST_ASSERT_EQUAL_UINT32(1, chip.framesSent);
+}
+
+void test_stats_published(void) {
+    TEST_ASSERT_EQUAL(RADIO_TX_SENT, radioTransmit(7, PAYLOAD, RF69_MAX_DATA_LEN, false, 1, PRIORITY_ROUTINE));
+    publishAirtimeStats();
+
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/airtime");
+    TEST_ASSERT_NOT_NULL(message);
+    StaticJsonDocument<512> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(55555, doc["bitrate"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_STRING("g", doc["subBand"].as<const char*>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["framesSent"].as<uint32_t>());
+    TEST_ASSERT_FLOAT_WITHIN(0.001, FULL_FRAME_US * 100.0 / 36000000, doc["usage"]["g"].as<float>());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_modem_settings_read_from_radio);
+    RUN_TEST(test_frame_airtime);
+    RUN_TEST(test_aes_pads_message_to_blocks);
+    RUN_TEST(test_sub_band_from_frequency);
+    RUN_TEST(test_budget_of_band_g);
+    RUN_TEST(test_budget_frees_as_window_rolls);
+    RUN_TEST(test_over_budget_frame_deferred);
+    RUN_TEST(test_ack_suppressed_over_budget);
+    RUN_TEST(test_clear_channel_sends_at_once);
+    RUN_TEST(test_busy_channel_defers_with_backoff);
+    RUN_TEST(test_backoff_windows);
+    RUN_TEST(test_busy_channel_gives_up);
+    RUN_TEST(test_alarm_queue_served_first);
+    RUN_TEST(test_queue_overflow);
+    RUN_TEST(test_every_retry_charged);
+    RUN_TEST(test_acked_transmission);
+    RUN_TEST(test_stats_published);
+    return UNITY_END();
+}
@@ -0,0 +1,317 @@
+// UDP binary bridge of udp_bridge.cpp against a local receiver: uplink
+// datagram layout, the radio-to-receiver latency it reports, pings, downlinks
+// and what the gateway refuses to take from the network.
+
+#define UDP_BRIDGE_HOST "192.168.1.50"
+
+#include <unity.h>
+
+#include "../../src/udp_bridge.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+bool radioInitialized = true;
+
+void debugLog(const String& message) {}
+
+static RadioTxResult transmitResult;
+static uint8_t transmitCount;
+static uint8_t transmitTarget;
+static uint8_t transmitPayload[RF69_MAX_DATA_LEN];
+static uint8_t transmitLength;
+static bool transmitAck;
+static uint8_t transmitPriority;
+
+RadioTxResult radioTransmit(uint8_t targetId, const void* data, uint8_t length, bool requestAck, uint8_t responseKind, uint8_t priority) {
+    transmitCount++;
+    transmitTarget = targetId;
+    memcpy(transmitPayload, data, length);
+    transmitLength = length;
+    transmitAck = requestAck;
+    transmitPriority = priority;
+    return transmitResult;
+}
+
+// Node 9 is on the alarm lane for downlinks
+uint8_t downlinkPriority(uint8_t targetId) {
+    return targetId == 9 ? PRIORITY_ALARM : PRIORITY_ROUTINE;
+}
+
+static const IPAddress RECEIVER(192, 168, 1, 50);
+static const uint16_t RECEIVER_PORT = 40000;
+static const uint8_t PAYLOAD[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+static RadioFrame makeFrame(uint8_t sender, uint8_t ctl = 0) {
+    RadioFrame frame = {};
+    frame.networkId = 100;
+    frame.senderId = sender;
+    frame.targetId = 1;
+    frame.rssi = -72;
+    frame.ctl = ctl;
+    frame.priority = PRIORITY_ROUTINE;
+    frame.length = sizeof(PAYLOAD);
+    frame.rxMicros = micros();
+    memcpy(frame.data, PAYLOAD, sizeof(PAYLOAD));
+    return frame;
+}
+
+static std::vector<uint8_t> header(uint8_t type, uint16_t seq, uint8_t target, uint8_t flags) {
+    return { UDP_BRIDGE_MAGIC, type, (uint8_t)(seq & 0xFF), (uint8_t)(seq >> 8), 0, target, 0, flags, 0, 0, 0, 0 };
+}
+
+static std::vector<uint8_t> downlink(uint16_t seq, uint8_t target, uint8_t flags, const uint8_t* payload, size_t length) {
+    std::vector<uint8_t> datagram = header(UDP_TYPE_DOWNLINK, seq, target, flags);
+    datagram.insert(datagram.end(), payload, payload + length);
+    return datagram;
+}
+
+static uint32_t dwellOf(const WiFiUDP::Datagram& datagram) {
+    const uint8_t* d = datagram.data.data();
+    return d[8] | (d[9] << 8) | (d[10] << 16) | ((uint32_t)d[11] << 24);
+}
+
+void setUp(void) {
+    mock::reset();
+    mock::dnsHosts.clear();
+    mock::wifiConnected = true;
+    mqttClient.clearPublished();
+    bridgeUdp.clear();
+    bridgeEnabled = false;
+    bridgeHost = IPAddress();
+    uplinkSeq = 0;
+    udpUplinks = udpSendErrors = udpDownlinks = udpRejected = udpPings = 0;
+    radioInitialized = true;
+    transmitResult = RADIO_TX_SENT;
+    transmitCount = 0;
+    TEST_ASSERT_TRUE(initializeUdpBridge());
+}
+
+void tearDown(void) {}
+
+void test_bridge_listens_on_local_port(void) {
+    TEST_ASSERT_TRUE(bridgeEnabled);
+    TEST_ASSERT_TRUE(bridgeHost == RECEIVER);
+    TEST_ASSERT_EQUAL_UINT16(UDP_BRIDGE_LOCAL_PORT, bridgeUdp.localPort);
+}
+
+void test_unresolved_host_disables_bridge(void) {
+    bridgeEnabled = false;
+    mock::wifiConnected = false;
+    TEST_ASSERT_FALSE(initializeUdpBridge());
+
+    RadioFrame frame = makeFrame(7);
+    udpBridgeForward(frame);
+    handleUdpBridgeLoop();
+    publishUdpBridgeStats();
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.sent.size());
+    TEST_ASSERT_EQUAL_UINT32(0, mqttClient.published().size());
+}
+
+void test_uplink_layout(void) {
+    RadioFrame frame = makeFrame(7, RFM69_CTL_REQACK);
+    frame.radioIndex = 1;
+    frame.priority = PRIORITY_ALARM;
+    udpBridgeForward(frame);
+
+    TEST_ASSERT_EQUAL_UINT32(1, bridgeUdp.sent.size());
+    const WiFiUDP::Datagram& datagram = bridgeUdp.sent[0];
+    TEST_ASSERT_TRUE(datagram.host == RECEIVER);
+    TEST_ASSERT_EQUAL_UINT16(UDP_BRIDGE_PORT, datagram.port);
+    TEST_ASSERT_EQUAL_UINT32(UDP_BRIDGE_HEADER_LEN + sizeof(PAYLOAD), datagram.data.size());
+
+    const uint8_t* d = datagram.data.data();
+    TEST_ASSERT_EQUAL_HEX8(UDP_BRIDGE_MAGIC, d[0]);
+    TEST_ASSERT_EQUAL_HEX8(UDP_TYPE_UPLINK, d[1]);
+    TEST_ASSERT_EQUAL_UINT16(0, d[2] | (d[3] << 8));
+    TEST_ASSERT_EQUAL_UINT8(7, d[4]);
+    TEST_ASSERT_EQUAL_UINT8(1, d[5]);
+    TEST_ASSERT_EQUAL_INT8(-72, (int8_t)d[6]);
+    TEST_ASSERT_EQUAL_HEX8(UDP_FLAG_ACK_REQUESTED | UDP_FLAG_RADIO2 | UDP_FLAG_ALARM, d[7]);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD, d + UDP_BRIDGE_HEADER_LEN, sizeof(PAYLOAD));
+}
+
+void test_uplink_sequence_wraps(void) {
+    uplinkSeq = 0xFFFF;
+    RadioFrame frame = makeFrame(7, RFM69_CTL_SENDACK);
+    udpBridgeForward(frame);
+    udpBridgeForward(frame);
+
+    TEST_ASSERT_EQUAL_UINT32(2, bridgeUdp.sent.size());
+    TEST_ASSERT_EQUAL_HEX8(0xFF, bridgeUdp.sent[0].data[2]);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, bridgeUdp.sent[0].data[3]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, bridgeUdp.sent[1].data[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, bridgeUdp.sent[1].data[3]);
+    TEST_ASSERT_EQUAL_HEX8(UDP_FLAG_ACK_FRAME, bridgeUdp.sent[1].data[7]);
+}
+
+// The receiver learns how long the frame spent in the gateway from the
+// header and adds its own network leg, so the two latencies can be compared
+void test_latency_from_radio_to_receiver(void) {
+    bridgeUdp.latencyUs = 1800;
+    mock::advanceMicros(10000);
+    RadioFrame frame = makeFrame(7);
+    mock::advanceMicros(650);
+    udpBridgeForward(frame);
+
+    mock::advanceMicros(100);
+    RadioFrame second = makeFrame(8);
+    mock::advanceMicros(4200);
+    udpBridgeForward(second);
+
+    const WiFiUDP::Datagram& first = bridgeUdp.sent[0];
+    const WiFiUDP::Datagram& late = bridgeUdp.sent[1];
+    TEST_ASSERT_EQUAL_UINT32(650, dwellOf(first));
+    TEST_ASSERT_EQUAL_UINT32(4200, dwellOf(late));
+
+    // End to end is gateway dwell plus network, measured at the receiver
+    TEST_ASSERT_EQUAL_UINT32(650 + 1800, first.arrivalMicros - frame.rxMicros);
+    TEST_ASSERT_EQUAL_UINT32(4200 + 1800, late.arrivalMicros - second.rxMicros);
+    TEST_ASSERT_EQUAL_UINT32(first.arrivalMicros - dwellOf(first) - bridgeUdp.latencyUs, frame.rxMicros);
+}
+
+void test_ping_answered_with_pong(void) {
+    bridgeUdp.latencyUs = 900;
+    std::vector<uint8_t> ping = header(UDP_TYPE_PING, 0x1234, 0, 0);
+    ping[8] = 0xAA;
+    unsigned long pingSent = micros();
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, ping);
+    mock::advanceMicros(900);
+    handleUdpBridgeLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, bridgeUdp.sent.size());
+    const WiFiUDP::Datagram& pong = bridgeUdp.sent[0];
+    TEST_ASSERT_TRUE(pong.host == RECEIVER);
+    TEST_ASSERT_EQUAL_UINT16(RECEIVER_PORT, pong.port);
+    TEST_ASSERT_EQUAL_UINT32(UDP_BRIDGE_HEADER_LEN, pong.data.size());
+    TEST_ASSERT_EQUAL_HEX8(UDP_TYPE_PONG, pong.data[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x34, pong.data[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x12, pong.data[3]);
+    TEST_ASSERT_EQUAL_HEX8(0xAA, pong.data[8]);
+    TEST_ASSERT_EQUAL_UINT32(1800, pong.arrivalMicros - pingSent);
+    TEST_ASSERT_EQUAL_UINT32(0, transmitCount);
+}
+
+void test_downlink_transmitted(void) {
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(5, 9, 0, PAYLOAD, sizeof(PAYLOAD)));
+    handleUdpBridgeLoop();
+
+    TEST_ASSERT_EQUAL_UINT8(1, transmitCount);
+    TEST_ASSERT_EQUAL_UINT8(9, transmitTarget);
+    TEST_ASSERT_EQUAL_UINT8(sizeof(PAYLOAD), transmitLength);
+    TEST_ASSERT_EQUAL_MEMORY(PAYLOAD, transmitPayload, sizeof(PAYLOAD));
+    TEST_ASSERT_FALSE(transmitAck);
+    TEST_ASSERT_EQUAL_UINT8(PRIORITY_ALARM, transmitPriority);
+    // No result without an ACK request
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.sent.size());
+}
+
+void test_downlink_with_ack_reports_result(void) {
+    transmitResult = RADIO_TX_FAILED;
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(0x0102, 3, UDP_FLAG_ACK_REQUESTED | UDP_FLAG_ALARM, PAYLOAD, 1));
+    handleUdpBridgeLoop();
+
+    TEST_ASSERT_EQUAL_UINT8(1, transmitCount);
+    TEST_ASSERT_TRUE(transmitAck);
+    TEST_ASSERT_EQUAL_UINT8(PRIORITY_ALARM, transmitPriority);
+
+    TEST_ASSERT_EQUAL_UINT32(1, bridgeUdp.sent.size());
+    const WiFiUDP::Datagram& result = bridgeUdp.sent[0];
+    TEST_ASSERT_EQUAL_UINT16(RECEIVER_PORT, result.port);
+    TEST_ASSERT_EQUAL_HEX8(UDP_TYPE_RESULT, result.data[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x02, result.data[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, result.data[3]);
+    TEST_ASSERT_EQUAL_UINT8(3, result.data[5]);
+    TEST_ASSERT_EQUAL_UINT8(RADIO_TX_FAILED, result.data[7]);
+}
+
+void test_rejected_datagrams(void) {
+    uint8_t longPayload[RF69_MAX_DATA_LEN + 1] = {};
+    std::vector<uint8_t> badMagic = downlink(1, 5, 0, PAYLOAD, 1);
+    badMagic[0] = 0x00;
+
+    bridgeUdp.receive(IPAddress(192, 168, 1, 51), RECEIVER_PORT, downlink(1, 5, 0, PAYLOAD, 1));
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, std::vector<uint8_t>(UDP_BRIDGE_HEADER_LEN - 1, UDP_BRIDGE_MAGIC));
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, badMagic);
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(1, 0, 0, PAYLOAD, 1));
+    handleUdpBridgeLoop();
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(1, 5, 0, longPayload, sizeof(longPayload)));
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, header(UDP_TYPE_RESULT, 1, 5, 0));
+    handleUdpBridgeLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(6, udpRejected);
+    TEST_ASSERT_EQUAL_UINT8(0, transmitCount);
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.sent.size());
+}
+
+void test_downlink_rejected_without_radio(void) {
+    radioInitialized = false;
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(1, 5, UDP_FLAG_ACK_REQUESTED, PAYLOAD, 1));
+    handleUdpBridgeLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, udpRejected);
+    TEST_ASSERT_EQUAL_UINT8(0, transmitCount);
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.sent.size());
+}
+
+void test_loop_handles_bounded_batch(void) {
+    for (uint8_t i = 0; i < UDP_BRIDGE_MAX_PER_LOOP + 2; i++) {
+        bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(i, 5, 0, PAYLOAD, 1));
+    }
+    handleUdpBridgeLoop();
+    TEST_ASSERT_EQUAL_UINT8(UDP_BRIDGE_MAX_PER_LOOP, transmitCount);
+    TEST_ASSERT_EQUAL_UINT32(2, bridgeUdp.pending());
+
+    handleUdpBridgeLoop();
+    TEST_ASSERT_EQUAL_UINT8(UDP_BRIDGE_MAX_PER_LOOP + 2, transmitCount);
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.pending());
+}
+
+void test_send_errors_counted(void) {
+    bridgeUdp.failSends = true;
+    RadioFrame frame = makeFrame(7);
+    udpBridgeForward(frame);
+    TEST_ASSERT_EQUAL_UINT32(1, udpUplinks);
+    TEST_ASSERT_EQUAL_UINT32(1, udpSendErrors);
+    TEST_ASSERT_EQUAL_UINT32(0, bridgeUdp.sent.size());
+}
+
+void test_stats_published(void) {
+    RadioFrame frame = makeFrame(7);
+    udpBridgeForward(frame);
+    udpBridgeForward(frame);
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, header(UDP_TYPE_PING, 1, 0, 0));
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(2, 5, 0, PAYLOAD, 1));
+    bridgeUdp.receive(RECEIVER, RECEIVER_PORT, downlink(3, 0, 0, PAYLOAD, 1));
+    handleUdpBridgeLoop();
+
+    publishUdpBridgeStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/udp");
+    TEST_ASSERT_NOT_NULL(message);
+    TEST_ASSERT_EQUAL_STRING("{\"seq\":2,\"uplinks\":2,\"sendErrors\":0,\"downlinks\":1,\"rejected\":1,\"pings\":1}",
+                             message->payload.c_str());
+
+    mqttClient.clearPublished();
+    mqttConnected = false;
+    publishUdpBridgeStats();
+    mqttConnected = true;
+    TEST_ASSERT_EQUAL_UINT32(0, mqttClient.published().size());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_bridge_listens_on_local_port);
+    RUN_TEST(test_unresolved_host_disables_bridge);
+    RUN_TEST(test_uplink_layout);
+    RUN_TEST(test_uplink_sequence_wraps);
+    RUN_TEST(test_latency_from_radio_to_receiver);
+    RUN_TEST(test_ping_answered_with_pong);
+    RUN_TEST(test_downlink_transmitted);
+    RUN_TEST(test_downlink_with_ack_reports_result);
+    RUN_TEST(test_rejected_datagrams);
+    RUN_TEST(test_downlink_rejected_without_radio);
+    RUN_TEST(test_loop_handles_bounded_batch);
+    RUN_TEST(test_send_errors_counted);
+    RUN_TEST(test_stats_published);
+    return UNITY_END();
+}
@@ -0,0 +1,270 @@
+// Uplink filter of uplink_filter.cpp: rule validation, minimum interval,
+// deadband, heartbeat and token bucket, and the saved rule table.
+
+#include <unity.h>
+
+#include "../../src/uplink_filter.cpp"
+
+PubSubClient mqttClient;
+bool mqttConnected = true;
+String mqttBaseTopic = "rfm69gw";
+
+void debugLog(const String& message) {}
+
+static bool setRule(uint8_t nodeId, const char* json, String& error) {
+    return setUplinkFilterRule(nodeId, json, strlen(json), error);
+}
+
+static bool setRule(uint8_t nodeId, const char* json) {
+    String error;
+    bool ok = setRule(nodeId, json, error);
+    TEST_ASSERT_TRUE_MESSAGE(ok, error.c_str());
+    return ok;
+}
+
+// Offer an uplink with one temperature field
+static bool pass(uint8_t nodeId, float temp) {
+    StaticJsonDocument<64> doc;
+    doc["temp"] = temp;
+    return uplinkFilterPass(nodeId, doc.as<JsonVariantConst>());
+}
+
+static FilterState& stateOf(uint8_t nodeId) {
+    return filterStates[filterSlotForNode[nodeId]];
+}
+
+void setUp(void) {
+    mock::reset();
+    mock::files.clear();
+    mock::fsMountable = true;
+    mock::fsFreeBytes = 1 << 20;
+    TEST_ASSERT_TRUE(initializeUplinkFilter());
+    unfilteredForwarded = 0;
+    mqttClient.clearPublished();
+    // Node state starts with time running, not at zero
+    mock::advanceMillis(100000);
+}
+
+void tearDown(void) {}
+
+void test_node_without_rule_passes(void) {
+    TEST_ASSERT_TRUE(pass(9, 20.0f));
+    TEST_ASSERT_TRUE(pass(9, 20.0f));
+    TEST_ASSERT_EQUAL_UINT32(2, unfilteredForwarded);
+}
+
+void test_min_interval(void) {
+    setRule(5, "{\"minIntervalS\":10}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    mock::advanceMillis(9999);
+    TEST_ASSERT_FALSE(pass(5, 25.0f));
+    mock::advanceMillis(1);
+    TEST_ASSERT_TRUE(pass(5, 25.0f));
+    TEST_ASSERT_EQUAL_UINT32(1, stateOf(5).suppressedInterval);
+    TEST_ASSERT_EQUAL_UINT32(2, stateOf(5).forwarded);
+}
+
+void test_deadband(void) {
+    setRule(5, "{\"deadband\":{\"temp\":0.5}}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    TEST_ASSERT_FALSE(pass(5, 20.25f));
+    TEST_ASSERT_FALSE(pass(5, 19.75f));
+    // Compared with the last published value, not the last offered one
+    TEST_ASSERT_TRUE(pass(5, 20.5f));
+    TEST_ASSERT_FALSE(pass(5, 20.75f));
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    TEST_ASSERT_EQUAL_UINT32(3, stateOf(5).suppressedDeadband);
+}
+
+void test_missing_deadband_field_counts_as_change(void) {
+    setRule(5, "{\"deadband\":{\"temp\":0.5}}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+
+    StaticJsonDocument<64> doc;
+    doc["hum"] = 40;
+    TEST_ASSERT_TRUE(uplinkFilterPass(5, doc.as<JsonVariantConst>()));
+    // The stored value is kept when the field is missing
+    TEST_ASSERT_FALSE(pass(5, 20.25f));
+}
+
+void test_heartbeat_overrides_suppression(void) {
+    setRule(5, "{\"minIntervalS\":10,\"heartbeatS\":60,\"deadband\":{\"temp\":1}}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    mock::advanceMillis(30000);
+    TEST_ASSERT_FALSE(pass(5, 20.0f));
+    mock::advanceMillis(30000);
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    TEST_ASSERT_EQUAL_UINT32(1, stateOf(5).heartbeats);
+
+    // The heartbeat restarts the interval
+    mock::advanceMillis(5000);
+    TEST_ASSERT_FALSE(pass(5, 30.0f));
+}
+
+void test_token_bucket(void) {
+    setRule(5, "{\"maxPerMinute\":6,\"burst\":2}");
+    TEST_ASSERT_TRUE(pass(5, 1.0f));
+    TEST_ASSERT_TRUE(pass(5, 2.0f));
+    TEST_ASSERT_FALSE(pass(5, 3.0f));
+    TEST_ASSERT_EQUAL_UINT32(1, stateOf(5).suppressedRate);
+
+    // One token per 10 s
+    mock::advanceMillis(9000);
+    TEST_ASSERT_FALSE(pass(5, 4.0f));
+    mock::advanceMillis(1000);
+    TEST_ASSERT_TRUE(pass(5, 5.0f));
+    TEST_ASSERT_FALSE(pass(5, 6.0f));
+
+    // Refill stops at the burst size
+    mock::advanceMillis(600000);
+    TEST_ASSERT_TRUE(pass(5, 7.0f));
+    TEST_ASSERT_TRUE(pass(5, 8.0f));
+    TEST_ASSERT_FALSE(pass(5, 9.0f));
+}
+
+void test_rule_numbers_range_checked(void) {
+    String error;
+    TEST_ASSERT_FALSE(setRule(5, "{\"minIntervalS\":65536}", error));
+    TEST_ASSERT_EQUAL_STRING("minIntervalS must be 0-65535", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"heartbeatS\":-1}", error));
+    TEST_ASSERT_EQUAL_STRING("heartbeatS must be 0-65535", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"maxPerMinute\":1.5}", error));
+    TEST_ASSERT_EQUAL_STRING("maxPerMinute must be 0-65535", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"burst\":256}", error));
+    TEST_ASSERT_EQUAL_STRING("burst must be 0-255", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"maxPerMinute\":6,\"burst\":0}", error));
+    TEST_ASSERT_EQUAL_STRING("burst must be at least 1 with maxPerMinute", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"minIntervalS\":", error));
+    TEST_ASSERT_TRUE(error.startsWith("invalid JSON: "));
+    TEST_ASSERT_FALSE(setRule(0, "{}", error));
+    TEST_ASSERT_EQUAL_STRING("node id must be 1-255", error.c_str());
+
+    // Nothing was stored
+    TEST_ASSERT_EQUAL_HEX8(FILTER_NONE, filterSlotForNode[5]);
+
+    // Largest values are accepted as given
+    setRule(5, "{\"minIntervalS\":65535,\"maxPerMinute\":65535,\"burst\":255}");
+    TEST_ASSERT_EQUAL_UINT16(65535, filterRules[filterSlotForNode[5]].minIntervalS);
+    TEST_ASSERT_EQUAL_UINT8(255, filterRules[filterSlotForNode[5]].burst);
+}
+
+void test_deadband_field_limits(void) {
+    String error;
+    TEST_ASSERT_FALSE(setRule(5, "{\"deadband\":{\"a\":1,\"b\":1,\"c\":1,\"d\":1,\"e\":1}}", error));
+    TEST_ASSERT_EQUAL_STRING("at most 4 deadband fields", error.c_str());
+    TEST_ASSERT_FALSE(setRule(5, "{\"deadband\":{\"sixteen_chars_xx\":1}}", error));
+    TEST_ASSERT_EQUAL_STRING("field name too long", error.c_str());
+}
+
+void test_rule_replaced_and_removed(void) {
+    setRule(5, "{\"minIntervalS\":10}");
+    uint8_t slot = filterSlotForNode[5];
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+
+    // Replacing keeps the slot and resets the state
+    setRule(5, "{\"minIntervalS\":20}");
+    TEST_ASSERT_EQUAL_UINT8(slot, filterSlotForNode[5]);
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+
+    String error;
+    TEST_ASSERT_TRUE(setUplinkFilterRule(5, "", 0, error));
+    TEST_ASSERT_EQUAL_HEX8(FILTER_NONE, filterSlotForNode[5]);
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+}
+
+void test_rule_table_full(void) {
+    for (uint8_t node = 1; node <= FILTER_MAX_NODES; node++) {
+        setRule(node, "{\"minIntervalS\":1}");
+    }
+    String error;
+    TEST_ASSERT_FALSE(setRule(FILTER_MAX_NODES + 1, "{\"minIntervalS\":1}", error));
+    TEST_ASSERT_EQUAL_STRING("rule table full", error.c_str());
+
+    // A freed slot is reused
+    TEST_ASSERT_TRUE(setUplinkFilterRule(3, "", 0, error));
+    setRule(FILTER_MAX_NODES + 1, "{\"minIntervalS\":1}");
+}
+
+void test_rules_survive_restart(void) {
+    setRule(5, "{\"minIntervalS\":10,\"deadband\":{\"temp\":0.5}}");
+    TEST_ASSERT_TRUE(LittleFS.exists(FILTER_FILE_PATH));
+    TEST_ASSERT_FALSE(LittleFS.exists(FILTER_TEMP_PATH));
+
+    TEST_ASSERT_TRUE(initializeUplinkFilter());
+    TEST_ASSERT_NOT_EQUAL(FILTER_NONE, filterSlotForNode[5]);
+    const FilterRule& rule = filterRules[filterSlotForNode[5]];
+    TEST_ASSERT_EQUAL_UINT16(10, rule.minIntervalS);
+    TEST_ASSERT_EQUAL_STRING("temp", rule.fields[0].name);
+
+    (*mock::files[FILTER_FILE_PATH])[0] ^= 0xFF;
+    TEST_ASSERT_TRUE(initializeUplinkFilter());
+    TEST_ASSERT_EQUAL_HEX8(FILTER_NONE, filterSlotForNode[5]);
+}
+
+void test_rules_kept_in_memory_without_filesystem(void) {
+    mock::fsMountable = false;
+    TEST_ASSERT_FALSE(initializeUplinkFilter());
+    setRule(5, "{\"minIntervalS\":10}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    TEST_ASSERT_FALSE(pass(5, 20.0f));
+    TEST_ASSERT_TRUE(mock::files.empty());
+}
+
+void test_command_response(void) {
+    MqttRouteParams params = {};
+    params.count = 1;
+    params.values[0] = 5;
+    const char rule[] = "{\"burst\":300}";
+    handleFilterCommand(params, (const byte*)rule, strlen(rule));
+
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/response/filter");
+    TEST_ASSERT_NOT_NULL(message);
+    StaticJsonDocument<192> doc;
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_FALSE(doc["success"].as<bool>());
+    TEST_ASSERT_EQUAL_STRING("burst must be 0-255", doc["error"].as<const char*>());
+
+    params.values[0] = 256;
+    handleFilterCommand(params, (const byte*)"{}", 2);
+    message = mqttClient.lastPublished("rfm69gw/response/filter");
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_FALSE(doc["success"].as<bool>());
+    TEST_ASSERT_EQUAL_HEX8(FILTER_NONE, filterSlotForNode[0]);
+}
+
+void test_stats_streamed(void) {
+    setRule(5, "{\"minIntervalS\":10}");
+    TEST_ASSERT_TRUE(pass(5, 20.0f));
+    TEST_ASSERT_FALSE(pass(5, 20.0f));
+    TEST_ASSERT_TRUE(pass(9, 20.0f));
+
+    publishFilterStats();
+    const PubSubClient::Message* message = mqttClient.lastPublished("rfm69gw/stats/filter");
+    TEST_ASSERT_NOT_NULL(message);
+    DynamicJsonDocument doc(1024);
+    TEST_ASSERT_FALSE(deserializeJson(doc, message->payload.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(1, doc["unfiltered"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["forwarded"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["suppressed"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(5, doc["nodes"][0]["nodeId"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(1, doc["nodes"][0]["interval"].as<uint32_t>());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_node_without_rule_passes);
+    RUN_TEST(test_min_interval);
+    RUN_TEST(test_deadband);
+    RUN_TEST(test_missing_deadband_field_counts_as_change);
+    RUN_TEST(test_heartbeat_overrides_suppression);
+    RUN_TEST(test_token_bucket);
+    RUN_TEST(test_rule_numbers_range_checked);
+    RUN_TEST(test_deadband_field_limits);
+    RUN_TEST(test_rule_replaced_and_removed);
+    RUN_TEST(test_rule_table_full);
+    RUN_TEST(test_rules_survive_restart);
+    RUN_TEST(test_rules_kept_in_memory_without_filesystem);
+    RUN_TEST(test_command_response);
+    RUN_TEST(test_stats_streamed);
+    return UNITY_END();
+}